@@ -83,6 +83,15 @@ void flash_erase_sector(uint32_t sector_addr,
                         FlashOperationCompleteCb on_complete,
                         void *context);
 
+/**
+ * Wait for an erase started by flash_erase_subsector or flash_erase_sector to
+ * complete, polling it from the calling task rather than from the timer task.
+ * The erase's callback has been called by the time this returns, unless this
+ * is called from within that erase's own poll. Returns right away if no erase
+ * is in progress.
+ */
+void flash_erase_wait_for_completion(void);
+
 /**
  * Erase the subsector containing the specified address.
  */
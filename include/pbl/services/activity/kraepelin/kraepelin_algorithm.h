@@ -154,3 +154,8 @@ void kalg_get_sleep_stats(KAlgState *state, KAlgOngoingSleepStats *stats);
 //! @param kalg_state the state structure passed into kalg_init
 //! @param enable true to start tracking, false to stop tracking
 void kalg_enable_activity_tracking(KAlgState *kalg_state, bool enable);
+
+#if UNITTEST
+//! Run the real-valued FFT the step analysis uses on d in place
+void kalg_fft_2radix_real(int16_t *d, int16_t width, int16_t width_log_2);
+#endif
@@ -18,6 +18,15 @@ typedef enum {
   BlobDBSyncSessionTypeRecord,
 } BlobDBSyncSessionType;
 
+//! Upper bound for CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW, sizes the in-flight table
+#define BLOB_DB_SYNC_MAX_WINDOW 8
+
+//! A dirty item that has been sent to the phone and is waiting for its ack
+typedef struct {
+  BlobDBDirtyItem *item;
+  BlobDBToken token;
+} BlobDBSyncWriteback;
+
 typedef struct {
   ListNode node;
   //! Unique, never reused. Deferred timer callbacks carry this instead of a
@@ -28,7 +37,14 @@ typedef struct {
   BlobDBDirtyItem *dirty_list;
   RegularTimerInfo timeout_timer;
   RegularTimerInfo abandon_timer;
-  BlobDBToken current_token;
+  //! Writebacks sent but not yet acked, oldest first. Acks may arrive in any order.
+  BlobDBSyncWriteback in_flight[BLOB_DB_SYNC_MAX_WINDOW];
+  uint8_t num_in_flight;
+  //! Next item of dirty_list that has not been sent yet
+  BlobDBDirtyItem *next_item;
+  //! Scratch buffer records are read into before being sent, reused across items
+  void *item_buf;
+  int item_buf_size;
   BlobDBSyncSessionType session_type;
 } BlobDBSyncSession;
 
@@ -51,8 +67,12 @@ BlobDBSyncSession *blob_db_sync_get_session_for_id(BlobDBId db_id);
 //! return NULL if no sync is in progress
 BlobDBSyncSession *blob_db_sync_get_session_for_token(BlobDBToken token);
 
-//! Mark current item as synced and sync the next one
-void blob_db_sync_next(BlobDBSyncSession *session);
+//! Get the in-flight item that was sent with the given token
+//! returns NULL if the session has no writeback outstanding for that token
+BlobDBDirtyItem *blob_db_sync_get_item_for_token(BlobDBSyncSession *session, BlobDBToken token);
+
+//! Mark the item sent with the given token as synced and keep the window full
+void blob_db_sync_next(BlobDBSyncSession *session, BlobDBToken token);
 
 //! Cancel the sync in progress. Pending items will be synced next time.
 void blob_db_sync_cancel(BlobDBSyncSession *session);
@@ -0,0 +1,40 @@
+/* SPDX-FileCopyrightText: 2026 Core Devices LLC */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#pragma once
+
+#include "applib/graphics/gtypes.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! @file compositor_scaling.h
+//!
+//! Row kernels used by the compositor to scale legacy app framebuffers (8-bit ARGB2222) up to the
+//! display. The source column and bilinear weight of every destination column are looked up in a
+//! table that is only rebuilt when the horizontal scale factor changes.
+
+//! Scales one row of the app framebuffer into a row of the display framebuffer.
+//!
+//! Destination columns whose source pixel falls outside src_row are left untouched.
+//!
+//! @param dst_line Data of the destination row, indexed by display x
+//! @param x_begin First display column to write
+//! @param x_end Display column after the last one to write
+//! @param coord_origin Display column that maps to app column 0
+//! @param src_row The app framebuffer row to sample
+//! @param src_row_next The app framebuffer row below src_row to blend with when bilinear, or NULL
+//!     if src_row is the last row
+//! @param fy Bilinear weight of src_row_next, 0-15
+//! @param bilinear true for bilinear filtering, false for nearest-neighbor
+//! @param app_width Width of the app framebuffer
+//! @param scale_x App columns per display column, 16.16 fixed point
+void compositor_scale_row(uint8_t *dst_line, int16_t x_begin, int16_t x_end,
+                          int16_t coord_origin, const GBitmapDataRowInfo *src_row,
+                          const GBitmapDataRowInfo *src_row_next, uint8_t fy, bool bilinear,
+                          int16_t app_width, uint32_t scale_x);
+
+//! Blends a 2x2 neighbourhood of ARGB2222 pixels, weighting the right column by fx and the bottom
+//! row by fy (both 0-15, in 16ths). The result is always opaque.
+uint8_t compositor_scale_blend_bilinear(uint8_t p00, uint8_t p10, uint8_t p01, uint8_t p11,
+                                        uint8_t fx, uint8_t fy);
@@ -82,6 +82,12 @@ struct HRMManagerState {
 
   HRMFeature enabled_features;     // feature union the sensor was last enabled with
 
+  // Summary of the subscriber list, refreshed whenever a subscription is added, removed or
+  // changed so that hrm_manager_new_data_cb() doesn't have to work it out for every sample
+  HRMFeature subscribed_features;  // feature union of all subscribers
+  time_t next_expiration_utc;      // earliest expiring event or expiration due, 0 if none
+  bool has_short_interval_subscriber; // a subscriber's interval keeps the sensor on for good
+
   bool enabled_run_level;          // True if the current run_level (LowPower, Stationary,
                                    // Normal, etc.) allows the sensor to be turned on
   bool enabled_charging_state;     // Ture if we aren't plugged in / charging
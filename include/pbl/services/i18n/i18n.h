@@ -4,14 +4,13 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stddef.h>
-#include "pbl/util/list.h"
 
 #define ISO_LOCALE_LENGTH 6
 #define LOCALE_NAME_LENGTH 30
 
 typedef struct {
-  ListNode node;              //!< Linked list node
   const void *owner;          //!< pointer to owner object
   uint32_t original_hash;     //!< hashed original string
   char *original_string;      //!< original string. Stored following translated_string below
@@ -113,6 +113,7 @@ typedef struct {
   MoHeader hdr;
   char *mo_lang;
   uint32_t *mo_htable;  /* H: hash table */
+  uint8_t *mo_olengths;  /* lengths of the originals, capped at UINT8_MAX, or NULL */
 } Mo;
 
 typedef struct {
@@ -45,3 +45,39 @@ void persist_service_client_close(const Uuid *uuid);
 
 //! Deletes the app's persist file.
 status_t persist_service_delete_file(const Uuid *uuid);
+
+//! Transactions
+//!
+//! A client task can batch several writes by opening a transaction on its
+//! store. Writes and deletes made through the accessors below are then held in
+//! RAM, with later writes to a key replacing earlier ones, and reads through
+//! the accessors see them as if they had already been written. Committing
+//! writes the whole batch with settings_file_set_batch(), so either all of it
+//! lands or, on an error or a reboot part way through, none of it does.
+//! Accesses from other tasks are not affected by the transaction until it is
+//! committed.
+//!
+//! All of these take a store returned by persist_service_lock_and_get_store().
+
+//! Open a transaction for the current task, discarding one it left open.
+status_t persist_service_begin_transaction(SettingsFile *store);
+
+//! Write out the current task's transaction and close it. The transaction is
+//! closed even if the commit fails.
+//! @return E_INVALID_OPERATION if no transaction is open, E_OUT_OF_STORAGE if
+//!   the writes would not all fit, or another error if the batch could not be
+//!   written. None of the writes are made if this fails.
+status_t persist_service_commit_transaction(SettingsFile *store);
+
+bool persist_service_exists(SettingsFile *store, uint32_t key);
+
+//! @return the length of the value, 0 if there is none
+int persist_service_get_len(SettingsFile *store, uint32_t key);
+
+status_t persist_service_get(SettingsFile *store, uint32_t key, void *val_out, size_t val_len);
+
+//! @return E_OUT_OF_RESOURCES if a transaction is open and already buffers as
+//!   much as it is allowed to
+status_t persist_service_set(SettingsFile *store, uint32_t key, const void *val, size_t val_len);
+
+status_t persist_service_delete(SettingsFile *store, uint32_t key);
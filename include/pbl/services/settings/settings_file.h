@@ -94,6 +94,23 @@ status_t settings_file_get(SettingsFile *file, const void *key, size_t key_len,
 status_t settings_file_set(SettingsFile *file, const void *key, size_t key_len,
                            const void *val, size_t val_len);
 
+typedef struct {
+  const void *key;
+  size_t key_len;
+  const void *val;
+  size_t val_len; //!< 0 deletes the key
+} SettingsFileBatchWrite;
+
+//! Sets (or deletes) several records at once. Either all of them end up in the
+//! file or, if we reboot or run into an error part way through, none of them
+//! do. Each key may only appear once in writes.
+//! @note Unless there is only one write, this rewrites the entire file with
+//! the batch appended and swaps it in, so it's as slow as a compaction.
+//! @return E_OUT_OF_STORAGE without writing anything if the file would end up
+//! over its max_used_space
+status_t settings_file_set_batch(SettingsFile *file, const SettingsFileBatchWrite *writes,
+                                 size_t num_writes);
+
 //! Set a record with a specific timestamp instead of the current time.
 //! This is useful when rewriting files and preserving original timestamps.
 //! @param file the settings_file in which to set the value
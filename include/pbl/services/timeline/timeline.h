@@ -23,11 +23,24 @@ typedef struct {
   bool show_all_day_events;
   time_t midnight; // midnight at iter_init
   time_t current_day; // midnight of the current pin
+  bool uses_pin_cache; // counted as a user of the pin cache until deinit
 } TimelineIterState;
 
 //! initialize the timeline (builds the list of TimelineNodes)
 status_t timeline_init(TimelineNode **timeline);
 
+//! Forget about the lists and iterators of the app, called when the app is cleaned up as its heap
+//! goes too
+void timeline_process_cleanup(void);
+
+//! Set up the cache of deserialized pins that timeline iterators prefetch into
+void timeline_pin_cache_init(void);
+
+//! Drop the cached copy of a pin that was changed or removed from the pin db. The shell calls
+//! this for every BlobDB event on the pin db.
+//! @param id the pin to drop, or NULL to drop every cached pin
+void timeline_pin_cache_invalidate(const Uuid *id);
+
 //! Add a timeline pin we've created to the timeline.
 //! Call \ref timeline_item_destroy after this in order to free up the memory used by the item.
 //! @return true on success, false otherwise
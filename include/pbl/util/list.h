@@ -97,6 +97,15 @@ ListNode* list_get_at(ListNode *node, int32_t index);
 //! @note This function will not sort existing nodes in the list.
 ListNode* list_sorted_add(ListNode *head, ListNode *new_node, Comparator comparator, bool ascending);
 
+//! Sorts a list in place with a stable merge sort, in O(n log n) and without allocating.
+//! The resulting order is the same as adding each node, from head to tail, to an empty list with
+//! \ref list_sorted_add.
+//! @param[in] head The head of the list to sort.
+//! @param[in] comparator The comparison function to use
+//! @param[in] ascending True to order the list ascending from head to tail.
+//! @returns The (new) head of the list.
+ListNode* list_sort(ListNode *head, Comparator comparator, bool ascending);
+
 //! @param[in] head The head of the list to search.
 //! @param[in] node The node to search for.
 //! @returns True if the list contains node
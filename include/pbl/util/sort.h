@@ -9,9 +9,30 @@
 //! Standard sort comparator function
 typedef int (*SortComparator)(const void *, const void *);
 
-//! Bubble sorts an array
+//! None of the sorts below allocate. Their recursion depth grows with log2(num_elem) and they
+//! fall back to insertion sort for short runs.
+
+//! Sorts an array in O(n log n) worst case (introsort). Elements that compare equal may be
+//! reordered.
+//! @param[in] array The array that should be sorted
+//! @param[in] num_elem Number of elements in the array
+//! @param[in] elem_size Size of each element in the array
+//! @param[in] comp SortComparator comparator function
+void sort_intro(void *array, size_t num_elem, size_t elem_size, SortComparator comp);
+
+//! Sorts an array in O(n log^2 n) worst case, keeping elements that compare equal in their
+//! original order (insertion sort for short runs, then in-place merges).
 //! @param[in] array The array that should be sorted
 //! @param[in] num_elem Number of elements in the array
 //! @param[in] elem_size Size of each element in the array
 //! @param[in] comp SortComparator comparator function
-void sort_bubble(void *array, size_t num_elem, size_t elem_size, SortComparator comp);
+void sort_stable(void *array, size_t num_elem, size_t elem_size, SortComparator comp);
+
+//! Same as sort_stable() for records ordered by a signed 16-bit key, ascending, without going
+//! through a comparator. The key can be a raw fixed-point field such as Fixed_S16_3.
+//! @param[in] array The array that should be sorted
+//! @param[in] num_elem Number of elements in the array
+//! @param[in] elem_size Size of each element in the array
+//! @param[in] key_offset Offset of the int16_t key within each element, e.g. offsetof()
+void sort_stable_by_int16_key(void *array, size_t num_elem, size_t elem_size,
+                              size_t key_offset);
@@ -209,6 +209,66 @@ ListNode* list_sorted_add(ListNode *node, ListNode *new_node, Comparator compara
   }
 }
 
+ListNode* list_sort(ListNode *head, Comparator comparator, bool ascending) {
+  if (head == NULL) {
+    return NULL;
+  }
+  // Bottom-up merge sort: merge adjacent runs of run_length nodes until a single run is left.
+  for (uint32_t run_length = 1; ; run_length *= 2) {
+    ListNode *left = head;
+    ListNode *tail = NULL;
+    uint32_t num_merges = 0;
+    head = NULL;
+    while (left) {
+      ++num_merges;
+      ListNode *right = left;
+      uint32_t left_size = 0;
+      while (right && left_size < run_length) {
+        right = right->next;
+        ++left_size;
+      }
+      uint32_t right_size = run_length;
+      while (left_size > 0 || (right_size > 0 && right)) {
+        ListNode *node;
+        bool take_right;
+        if (left_size == 0) {
+          take_right = true;
+        } else if (right_size == 0 || right == NULL) {
+          take_right = false;
+        } else {
+          int order = comparator(left, right);
+          if (!ascending) {
+            order = -order;
+          }
+          // Same rule as list_sorted_add: only move ahead of a node that orders strictly after.
+          take_right = (order < 0);
+        }
+        if (take_right) {
+          node = right;
+          right = right->next;
+          --right_size;
+        } else {
+          node = left;
+          left = left->next;
+          --left_size;
+        }
+        if (tail) {
+          tail->next = node;
+        } else {
+          head = node;
+        }
+        node->prev = tail;
+        tail = node;
+      }
+      left = right;
+    }
+    tail->next = NULL;
+    if (num_merges <= 1) {
+      return head;
+    }
+  }
+}
+
 bool list_contains(const ListNode *node, const ListNode *node_to_search) {
   if (node == NULL || node_to_search == NULL) {
     return false;
@@ -3,29 +3,402 @@
 
 #include <pbl/util/sort.h>
 
+#include <pbl/util/attributes.h>
+
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+
+// Runs at most this long are insertion sorted; below this the quadratic sort does less work
+#define SORT_INSERTION_THRESHOLD (12)
+
+// Elements up to this size are moved through a temporary instead of by repeated swaps
+#define SORT_TMP_SIZE (16)
+
+// Stack space for merging a short run into a long one without rotations
+#define SORT_MERGE_BUFFER_SIZE (128)
+
+// Either a comparator or the offset of an int16_t key, so the typed entry points share the
+// algorithms below without paying for an indirect call per comparison.
+typedef struct {
+  size_t elem_size;
+  SortComparator comp;
+  size_t key_offset;
+} SortContext;
+
+static inline int16_t prv_key(const SortContext *ctx, const uint8_t *elem) {
+  int16_t key;
+  memcpy(&key, elem + ctx->key_offset, sizeof(key));
+  return key;
+}
+
+static inline int prv_compare(const SortContext *ctx, const uint8_t *a, const uint8_t *b) {
+  if (ctx->comp) {
+    return ctx->comp(a, b);
+  }
+  const int16_t key_a = prv_key(ctx, a);
+  const int16_t key_b = prv_key(ctx, b);
+  return (key_a > key_b) - (key_a < key_b);
+}
+
+static inline void prv_swap(uint8_t *a, uint8_t *b, size_t elem_size) {
+  // Fixed-size copies for the common sizes compile to a pair of loads and stores
+  if (elem_size == sizeof(uint16_t)) {
+    uint16_t a_val, b_val;
+    memcpy(&a_val, a, sizeof(a_val));
+    memcpy(&b_val, b, sizeof(b_val));
+    memcpy(a, &b_val, sizeof(b_val));
+    memcpy(b, &a_val, sizeof(a_val));
+  } else if (elem_size == sizeof(uint32_t)) {
+    uint32_t a_val, b_val;
+    memcpy(&a_val, a, sizeof(a_val));
+    memcpy(&b_val, b, sizeof(b_val));
+    memcpy(a, &b_val, sizeof(b_val));
+    memcpy(b, &a_val, sizeof(a_val));
+  } else {
+    for (size_t i = 0; i < elem_size; i++) {
+      uint8_t tmp = a[i];
+      a[i] = b[i];
+      b[i] = tmp;
+    }
+  }
+}
+
+static inline void prv_copy(uint8_t *dest, const uint8_t *src, size_t elem_size) {
+  if (elem_size == sizeof(uint16_t)) {
+    memcpy(dest, src, sizeof(uint16_t));
+  } else if (elem_size == sizeof(uint32_t)) {
+    memcpy(dest, src, sizeof(uint32_t));
+  } else {
+    memcpy(dest, src, elem_size);
+  }
+}
+
+static void prv_insertion_sort(uint8_t *base, size_t num_elem, const SortContext *ctx) {
+  const size_t size = ctx->elem_size;
+  if (size > SORT_TMP_SIZE) {
+    for (size_t i = 1; i < num_elem; i++) {
+      for (uint8_t *cur = base + i * size;
+           cur > base && prv_compare(ctx, cur - size, cur) > 0;
+           cur -= size) {
+        prv_swap(cur - size, cur, size);
+      }
+    }
+    return;
+  }
+
+  // Lift each element out, shift the larger ones up and drop it into the gap
+  uint8_t tmp[SORT_TMP_SIZE];
+  if (!ctx->comp) {
+    // Same as below, but the key of the element being placed is only read once
+    for (size_t i = 1; i < num_elem; i++) {
+      uint8_t *cur = base + i * size;
+      const int16_t key = prv_key(ctx, cur);
+      if (prv_key(ctx, cur - size) <= key) {
+        continue;
+      }
+      prv_copy(tmp, cur, size);
+      do {
+        prv_copy(cur, cur - size, size);
+        cur -= size;
+      } while (cur > base && prv_key(ctx, cur - size) > key);
+      prv_copy(cur, tmp, size);
+    }
+    return;
+  }
+  for (size_t i = 1; i < num_elem; i++) {
+    uint8_t *cur = base + i * size;
+    if (prv_compare(ctx, cur - size, cur) <= 0) {
+      continue;
+    }
+    prv_copy(tmp, cur, size);
+    do {
+      prv_copy(cur, cur - size, size);
+      cur -= size;
+    } while (cur > base && prv_compare(ctx, cur - size, tmp) > 0);
+    prv_copy(cur, tmp, size);
+  }
+}
+
+static void prv_sift_down(uint8_t *base, size_t root, size_t num_elem, const SortContext *ctx) {
+  const size_t size = ctx->elem_size;
+  for (;;) {
+    size_t child = 2 * root + 1;
+    if (child >= num_elem) {
+      return;
+    }
+    if (child + 1 < num_elem &&
+        prv_compare(ctx, base + child * size, base + (child + 1) * size) < 0) {
+      child++;
+    }
+    if (prv_compare(ctx, base + root * size, base + child * size) >= 0) {
+      return;
+    }
+    prv_swap(base + root * size, base + child * size, size);
+    root = child;
+  }
+}
+
+static void prv_heap_sort(uint8_t *base, size_t num_elem, const SortContext *ctx) {
+  const size_t size = ctx->elem_size;
+  for (size_t i = num_elem / 2; i > 0; i--) {
+    prv_sift_down(base, i - 1, num_elem, ctx);
+  }
+  for (size_t end = num_elem - 1; end > 0; end--) {
+    prv_swap(base, base + end * size, size);
+    prv_sift_down(base, 0, end, ctx);
+  }
+}
+
+// Sorts base[0], base[1] and base[num_elem - 1] and leaves the median in base[1] as the pivot.
+// base[0] and base[num_elem - 1] then bound the partition scans without range checks.
+static void prv_median_of_three(uint8_t *base, size_t num_elem, const SortContext *ctx) {
+  const size_t size = ctx->elem_size;
+  uint8_t *first = base;
+  uint8_t *second = base + size;
+  uint8_t *last = base + (num_elem - 1) * size;
+  prv_swap(second, base + (num_elem / 2) * size, size);
+  if (prv_compare(ctx, second, first) < 0) {
+    prv_swap(second, first, size);
+  }
+  if (prv_compare(ctx, last, second) < 0) {
+    prv_swap(last, second, size);
+    if (prv_compare(ctx, second, first) < 0) {
+      prv_swap(second, first, size);
+    }
+  }
+}
+
+static void prv_intro_sort(uint8_t *base, size_t num_elem, unsigned int depth_limit,
+                           const SortContext *ctx) {
+  const size_t size = ctx->elem_size;
+  while (num_elem > SORT_INSERTION_THRESHOLD) {
+    if (depth_limit == 0) {
+      prv_heap_sort(base, num_elem, ctx);
+      return;
+    }
+    depth_limit--;
 
-static void prv_swap(void *a, void *b, size_t elem_size) {
-  uint8_t *a_ptr = (uint8_t *)a;
-  uint8_t *b_ptr = (uint8_t *)b;
-  for (size_t i = 0; i < elem_size; i++) {
-    uint8_t tmp = *a_ptr;
-    *a_ptr++ = *b_ptr;
-    *b_ptr++ = tmp;
-  }
-}
-
-void sort_bubble(void *array, size_t num_elem, size_t elem_size, SortComparator comp) {
-  // as the number of sessions is expected to be small (<=16), and we don't seem to have a generic
-  // sort implementation, we do a simple bubble sort here
-  for (uint32_t i = 0; i + 1 < num_elem; i++) {
-    for (uint32_t j = i + 1; j < num_elem; j++) {
-      uint8_t *val1 = ((uint8_t *)array) + (i * elem_size);
-      uint8_t *val2 = ((uint8_t *)array) + (j * elem_size);
-      if (comp(val1, val2) > 0) {
-        prv_swap(val1, val2, elem_size);
+    prv_median_of_three(base, num_elem, ctx);
+    uint8_t *pivot = base + size;
+    size_t i = 1;
+    size_t j = num_elem - 1;
+    // Both scans stop on keys equal to the pivot, so runs of equal keys split evenly
+    for (;;) {
+      do {
+        i++;
+      } while (prv_compare(ctx, base + i * size, pivot) < 0);
+      do {
+        j--;
+      } while (prv_compare(ctx, pivot, base + j * size) < 0);
+      if (i >= j) {
+        break;
       }
+      prv_swap(base + i * size, base + j * size, size);
+    }
+    prv_swap(pivot, base + j * size, size);
+
+    // Recurse into the smaller side and loop on the larger one to bound the stack
+    const size_t left = j;
+    const size_t right = num_elem - j - 1;
+    if (left < right) {
+      prv_intro_sort(base, left, depth_limit, ctx);
+      base += (j + 1) * size;
+      num_elem = right;
+    } else {
+      prv_intro_sort(base + (j + 1) * size, right, depth_limit, ctx);
+      num_elem = left;
     }
   }
+  prv_insertion_sort(base, num_elem, ctx);
+}
+
+// Partitioning this many times without getting down to insertion sort means the pivots are being
+// chosen badly, so heapsort takes over: 2 * log2(num_elem)
+static unsigned int prv_depth_limit(size_t num_elem) {
+  unsigned int depth_limit = 0;
+  for (size_t n = num_elem; n > 1; n >>= 1) {
+    depth_limit += 2;
+  }
+  return depth_limit;
+}
+
+static void prv_sort_intro(void *array, size_t num_elem, const SortContext *ctx) {
+  if (!array || num_elem < 2) {
+    return;
+  }
+  prv_intro_sort(array, num_elem, prv_depth_limit(num_elem), ctx);
+}
+
+static void prv_reverse(uint8_t *first, uint8_t *last, size_t size) {
+  while (first < last) {
+    last -= size;
+    prv_swap(first, last, size);
+    first += size;
+  }
+}
+
+// Turns [first, middle)[middle, last) into [middle, last)[first, middle)
+static void prv_rotate(uint8_t *first, uint8_t *middle, uint8_t *last, size_t size) {
+  prv_reverse(first, middle, size);
+  prv_reverse(middle, last, size);
+  prv_reverse(first, last, size);
+}
+
+// Index of the first of the num_elem elements at base that does not compare less than key
+static size_t prv_lower_bound(const uint8_t *base, size_t num_elem, const uint8_t *key,
+                              const SortContext *ctx) {
+  size_t lo = 0;
+  while (num_elem > 0) {
+    const size_t half = num_elem / 2;
+    if (prv_compare(ctx, base + (lo + half) * ctx->elem_size, key) < 0) {
+      lo += half + 1;
+      num_elem -= half + 1;
+    } else {
+      num_elem = half;
+    }
+  }
+  return lo;
+}
+
+// Index of the first of the num_elem elements at base that compares greater than key
+static size_t prv_upper_bound(const uint8_t *base, size_t num_elem, const uint8_t *key,
+                              const SortContext *ctx) {
+  size_t lo = 0;
+  while (num_elem > 0) {
+    const size_t half = num_elem / 2;
+    if (prv_compare(ctx, key, base + (lo + half) * ctx->elem_size) >= 0) {
+      lo += half + 1;
+      num_elem -= half + 1;
+    } else {
+      num_elem = half;
+    }
+  }
+  return lo;
+}
+
+// Merges two adjacent sorted runs when the shorter one fits in SORT_MERGE_BUFFER_SIZE. Kept out of line
+// so only the innermost merge has the buffer on its stack.
+static NOINLINE void prv_merge_buffered(uint8_t *first, size_t len1, size_t len2,
+                                        const SortContext *ctx) {
+  uint8_t buf[SORT_MERGE_BUFFER_SIZE];
+  const size_t size = ctx->elem_size;
+  uint8_t *middle = first + len1 * size;
+  uint8_t *last = middle + len2 * size;
+  if (len1 <= len2) {
+    // Move the left run out of the way and merge front to back
+    memcpy(buf, first, len1 * size);
+    uint8_t *left = buf;
+    uint8_t *left_end = buf + len1 * size;
+    uint8_t *right = middle;
+    uint8_t *out = first;
+    while (left < left_end && right < last) {
+      if (prv_compare(ctx, right, left) < 0) {
+        prv_copy(out, right, size);
+        right += size;
+      } else {
+        prv_copy(out, left, size);
+        left += size;
+      }
+      out += size;
+    }
+    memcpy(out, left, left_end - left);
+  } else {
+    // Move the right run out of the way and merge back to front
+    memcpy(buf, middle, len2 * size);
+    uint8_t *left = middle;
+    uint8_t *right_end = buf + len2 * size;
+    uint8_t *out = last;
+    while (left > first && right_end > buf) {
+      out -= size;
+      if (prv_compare(ctx, right_end - size, left - size) < 0) {
+        left -= size;
+        prv_copy(out, left, size);
+      } else {
+        right_end -= size;
+        prv_copy(out, right_end, size);
+      }
+    }
+    memcpy(first, buf, right_end - buf);
+  }
+}
+
+// Merges the sorted runs [first, first + len1) and [first + len1, first + len1 + len2) without
+// a buffer: split the longer run in half, find where its middle element lands in the other run,
+// rotate the two inner pieces past each other and merge both halves the same way.
+static void prv_merge(uint8_t *first, size_t len1, size_t len2, const SortContext *ctx) {
+  const size_t size = ctx->elem_size;
+  while (len1 > 0 && len2 > 0) {
+    uint8_t *middle = first + len1 * size;
+    if (prv_compare(ctx, middle - size, middle) <= 0) {
+      return;  // Already in order
+    }
+    if (len1 + len2 == 2) {
+      prv_swap(first, middle, size);
+      return;
+    }
+    if (((len1 < len2) ? len1 : len2) * size <= SORT_MERGE_BUFFER_SIZE) {
+      prv_merge_buffered(first, len1, len2, ctx);
+      return;
+    }
+
+    size_t cut1, cut2;
+    if (len1 > len2) {
+      cut1 = len1 / 2;
+      cut2 = prv_lower_bound(middle, len2, first + cut1 * size, ctx);
+    } else {
+      cut2 = len2 / 2;
+      cut1 = prv_upper_bound(first, len1, middle + cut2 * size, ctx);
+    }
+    prv_rotate(first + cut1 * size, middle, middle + cut2 * size, size);
+
+    uint8_t *new_middle = first + (cut1 + cut2) * size;
+    const size_t right_len1 = len1 - cut1;
+    const size_t right_len2 = len2 - cut2;
+    if (cut1 + cut2 < right_len1 + right_len2) {
+      prv_merge(first, cut1, cut2, ctx);
+      first = new_middle;
+      len1 = right_len1;
+      len2 = right_len2;
+    } else {
+      prv_merge(new_middle, right_len1, right_len2, ctx);
+      len1 = cut1;
+      len2 = cut2;
+    }
+  }
+}
+
+static void prv_sort_stable(void *array, size_t num_elem, const SortContext *ctx) {
+  if (!array || num_elem < 2) {
+    return;
+  }
+  uint8_t *base = array;
+  const size_t size = ctx->elem_size;
+  for (size_t start = 0; start < num_elem; start += SORT_INSERTION_THRESHOLD) {
+    const size_t run = num_elem - start;
+    prv_insertion_sort(base + start * size,
+                       (run < SORT_INSERTION_THRESHOLD) ? run : SORT_INSERTION_THRESHOLD, ctx);
+  }
+  for (size_t width = SORT_INSERTION_THRESHOLD; width < num_elem; width *= 2) {
+    for (size_t start = 0; start + width < num_elem; start += 2 * width) {
+      const size_t remaining = num_elem - start - width;
+      prv_merge(base + start * size, width, (remaining < width) ? remaining : width, ctx);
+    }
+  }
+}
+
+void sort_intro(void *array, size_t num_elem, size_t elem_size, SortComparator comp) {
+  const SortContext ctx = { .elem_size = elem_size, .comp = comp };
+  prv_sort_intro(array, num_elem, &ctx);
+}
+
+void sort_stable(void *array, size_t num_elem, size_t elem_size, SortComparator comp) {
+  const SortContext ctx = { .elem_size = elem_size, .comp = comp };
+  prv_sort_stable(array, num_elem, &ctx);
+}
+
+void sort_stable_by_int16_key(void *array, size_t num_elem, size_t elem_size,
+                              size_t key_offset) {
+  const SortContext ctx = { .elem_size = elem_size, .key_offset = key_offset };
+  prv_sort_stable(array, num_elem, &ctx);
 }
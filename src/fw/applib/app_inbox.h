@@ -41,7 +41,8 @@ AppInbox *app_inbox_create_and_register(size_t buffer_size, uint32_t min_num_mes
 //! to be consumed.
 uint32_t app_inbox_destroy_and_deregister(AppInbox *app_inbox_ref);
 
-//! Call this function from a AppInboxMessageHandler to immediately consume the message and free
-//! up the space in the buffer that was occupied by the message.
+//! Call this function from a AppInboxMessageHandler to mark the message as consumed. The handler
+//! reads the message in place, so the space it occupied is freed up once all messages that were
+//! pending when the handler got called have been handled.
 //! @param consume_info The opaque context object as passed into the AppInboxMessageHandler.
 void app_inbox_consume(AppInboxConsumerInfo *consume_info);
@@ -11,9 +11,11 @@
 #include <pbl/logging/logging.h>
 #include "system/passert.h"
 #include "pbl/util/math.h"
+#include "pbl/util/sort.h"
 #include "util/swap.h"
 #include "pbl/util/trig.h"
 
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -60,32 +62,12 @@ static GPoint rotate_offset_point(const GPoint *orig, int32_t rotation, const GP
   return result;
 }
 
-static void sort16(int16_t *values, size_t length) {
-  for (unsigned int i = 0; i < length; i++) {
-    for (unsigned int j = i+1; j < length; j++) {
-      if (values[i] > values[j]) {
-        swap16(&values[i], &values[j]);
-      }
-    }
-  }
-}
-
 #if PBL_COLOR
 static void swapIntersections(Intersection *a, Intersection *b) {
   Intersection t = *a;
   *a = *b;
   *b = t;
 }
-
-static void sortIntersections(Intersection *values, size_t length) {
-  for (unsigned int i = 0; i < length; i++) {
-    for (unsigned int j = i+1; j < length; j++) {
-      if (values[i].x.raw_value > values[j].x.raw_value) {
-        swapIntersections(&values[i], &values[j]);
-      }
-    }
-  }
-}
 #endif
 
 static inline bool prv_is_in_range(int16_t min_a, int16_t max_a, int16_t min_b, int16_t max_b) {
@@ -197,255 +179,165 @@ GRect gpath_outer_rect(GPath *path) {
   return GRect(min_x, min_y, (max_x - min_x), (max_y - min_y));
 }
 
-#if PBL_COLOR
-void prv_fill_path_with_cb_aa(GContext *ctx, GPath *path, GPathDrawFilledCallback cb,
-                              void *user_data) {
-  /*
-   * Filling gpaths with antialiasing for integral-coordinates based paths:
-   *
-   * Custom linescanner using simple mathematic trick to determine anti-aliased edges
-   *  1. Rotate all points in path
-   *  2. Progress line-by-line finding intersections with paths
-   *  2.1 Calculate delta (angle) of the intersecting lines
-   *  2.2 Sort intersections
-   *  2.3 Draw lines between intersections
-   *
-   * This algorithm relies on few tricks:
-   *  - For intersections with delta less than 1 (angle is less than 45°) we will use exact
-   *      position of the intersection and fill edge pixel based on that information
-   *  - For intersections with delta bigger than 1 (angle is bigger than 45°) we will use delta to
-   *      draw gradient line responding to the angle
-   *      + If gradient is bigger than distance from the start/end of the intersecting line
-   *          we will adjust the delta to match starting/ending point and avoid nasty
-   *          gradients diving in/out the path
-   *      + Gradients too close to clipping rect will be properly cut off
-   */
-
+//! A non-horizontal path segment in the scanline fill's edge table.
+//! Coordinates are in fill units: pixels, or Fixed_S16_3 raw values when antialiasing.
+//! Kept to 16 bytes since the edge table holds one for every point of the path.
+typedef struct GPathEdge {
+  //! First scanline the edge intersects, the key the edge table is sorted by
+  int16_t y_first;
+  //! Last scanline the edge intersects
+  int16_t y_last;
+  //! Index of the segment in the path, see prv_active_edges_sort()
+  uint16_t index;
+  //! Intersection with the current scanline
+  int16_t x;
+  int16_t x_start;
+  int16_t y_start;
+  int16_t delta_x;
+  //! Never 0, positive for a segment going down
+  int16_t delta_y;
+} GPathEdge;
+
+static bool prv_edge_is_down(const GPathEdge *edge) {
+  return edge->delta_y > 0;
+}
 
-  // Protect against apps calling with no points to draw (Upright watchface)
-  if (!path || path->num_points < 2) {
+static void prv_edge_init(GPathEdge *edge, uint16_t index, GPoint start, GPoint end,
+                          bool antialiased) {
+  *edge = (GPathEdge) {
+    .y_first = MIN(start.y, end.y),
+    .y_last = MAX(start.y, end.y),
+    .index = index,
+  };
+#if PBL_COLOR
+  if (antialiased) {
+    const GPointPrecise precise_start = GPointPreciseFromGPoint(start);
+    const GPointPrecise precise_end = GPointPreciseFromGPoint(end);
+    edge->x_start = precise_start.x.raw_value;
+    edge->y_start = precise_start.y.raw_value;
+    edge->delta_x = precise_end.x.raw_value - precise_start.x.raw_value;
+    edge->delta_y = precise_end.y.raw_value - precise_start.y.raw_value;
     return;
   }
+#endif
+  edge->x_start = start.x;
+  edge->y_start = start.y;
+  edge->delta_x = end.x - start.x;
+  edge->delta_y = end.y - start.y;
+}
 
-  GPointPrecise* rot_points = applib_malloc(path->num_points * sizeof(GPointPrecise));
-  if (!rot_points) {
-    return;
-  }
+//! Interpolates the intersection with scanline y, truncating towards the start point
+static void prv_edge_update_x(GPathEdge *edge, int16_t y, int32_t scale) {
+  const int32_t offset =
+      ABS(edge->delta_x) * ABS(y * scale - edge->y_start) / ABS(edge->delta_y);
+  edge->x = edge->x_start + ((edge->delta_x < 0) ? -offset : offset);
+}
 
-  int min_x, max_x, min_y, max_y;
-  GPointPrecise rot_start, rot_end;
-  bool found_start_direction = false;
-  bool start_is_down = false;
-  Intersection *intersections_up = NULL;
-  Intersection *intersections_down = NULL;
-
-  rot_points[0] = rot_end = GPointPreciseFromGPoint(
-      rotate_offset_point(&path->points[0], path->rotation, &path->offset));
-  min_x = max_x = rot_points[0].x.integer;
-  min_y = max_y = rot_points[0].y.integer;
-
-  // begin finding the last path segment's direction going backwards through the path
-  // we must go backwards because we find intersections going forwards
-  for (int i = path->num_points - 1; i > 0; --i) {
-    rot_points[i] = rot_start = GPointPreciseFromGPoint(
-        rotate_offset_point(&path->points[i], path->rotation, &path->offset));
-    if (min_x > rot_points[i].x.integer) { min_x = rot_points[i].x.integer; }
-    if (max_x < rot_points[i].x.integer) { max_x = rot_points[i].x.integer; }
-    if (min_y > rot_points[i].y.integer) { min_y = rot_points[i].y.integer; }
-    if (max_y < rot_points[i].y.integer) { max_y = rot_points[i].y.integer; }
-
-    if (found_start_direction) {
+//! Drops the edges that ended above scanline y and moves the others down to it
+static void prv_active_edges_advance(GPathEdge *edges, uint16_t *active, size_t *num_active,
+                                     int16_t y, int32_t scale) {
+  size_t kept = 0;
+  for (size_t i = 0; i < *num_active; i++) {
+    GPathEdge *edge = &edges[active[i]];
+    if (edge->y_last < y) {
       continue;
     }
-
-    // use the first non-horizontal path segment's direction as the start direction
-    if (rot_end.y.integer != rot_start.y.integer) {
-      start_is_down = rot_end.y.integer > rot_start.y.integer;
-      found_start_direction = true;
-    }
-
-    rot_end = rot_start;
-  }
-
-  const int16_t clip_min_x = ctx->draw_state.clip_box.origin.x
-      - ctx->draw_state.drawing_box.origin.x;
-  const int16_t clip_max_x = ctx->draw_state.clip_box.size.w + clip_min_x;
-  if (!prv_is_in_range(min_x, max_x, clip_min_x, clip_max_x)) {
-    goto cleanup;
+    prv_edge_update_x(edge, y, scale);
+    active[kept++] = active[i];
   }
+  *num_active = kept;
+}
 
-  // x-intersections of path segments whose direction is up
-  intersections_up = applib_zalloc(path->num_points * sizeof(Intersection));
-  // x-intersections of path segments whose direction is down
-  intersections_down = applib_zalloc(path->num_points * sizeof(Intersection));
+static void prv_swap_active(uint16_t *a, uint16_t *b) {
+  const uint16_t t = *a;
+  *a = *b;
+  *b = t;
+}
 
-  // If either malloc failed, log message and cleanup
-  if (!intersections_up || !intersections_down) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, GPATH_ERROR);
-    goto cleanup;
+//! Sorts the active edges by x the same way the fill always has, so that intersections sharing an
+//! x pair up as before. That sort is an exchange sort of the intersections in segment order, which
+//! isn't stable, so put the edges back in segment order first. Only the few edges crossing the
+//! scanline are sorted, and those rarely change between scanlines.
+static void prv_active_edges_sort(const GPathEdge *edges, uint16_t *active, size_t num_active) {
+  for (size_t i = 1; i < num_active; i++) {
+    const uint16_t current = active[i];
+    size_t j = i;
+    while ((j > 0) && (edges[active[j - 1]].index > edges[current].index)) {
+      active[j] = active[j - 1];
+      j--;
+    }
+    active[j] = current;
   }
-
-  int intersection_up_count;
-  int intersection_down_count;
-
-  // convert clip coordinates to drawing coordinates
-  const int16_t clip_min_y = ctx->draw_state.clip_box.origin.y
-      - ctx->draw_state.drawing_box.origin.y;
-  const int16_t clip_max_y = ctx->draw_state.clip_box.size.h + clip_min_y;
-  min_y = MAX(min_y, clip_min_y);
-  max_y = MIN(max_y, clip_max_y);
-
-  // filling color hack
-  GColor tmp = ctx->draw_state.stroke_color;
-  ctx->draw_state.stroke_color = ctx->draw_state.fill_color;
-
-  // find all of the horizontal intersections and draw them
-  for (int16_t i = min_y; i <= max_y; ++i) {
-    // initialize with 0 intersections
-    intersection_down_count = 0;
-    intersection_up_count = 0;
-
-    // horizontal path segments don't have a direction and depend
-    // upon the last path segment's direction
-    // keep track of the last path direction for horizontal path segments to use
-    bool last_is_down = start_is_down;
-    rot_end = rot_points[0];
-
-    // find the intersections
-    for (uint32_t j = 0; j < path->num_points; ++j) {
-      rot_start = rot_points[j];
-      if (j + 1 < path->num_points) {
-        rot_end = rot_points[j + 1];
-      } else {
-        // wrap to the first point
-        rot_end = rot_points[0];
-      }
-
-      // if the line is on/crosses this height
-      if ((rot_start.y.integer - i) * (rot_end.y.integer - i) <= 0) {
-        bool is_down = rot_end.y.integer != rot_start.y.integer ?
-                       rot_end.y.integer > rot_start.y.integer : last_is_down;
-        // don't count end points in the same direction to avoid double intersections
-        if (!(rot_start.y.integer == i && last_is_down == is_down)) {
-          // linear interpolation of the line intersection
-
-          int16_t delta_x = rot_end.x.raw_value - rot_start.x.raw_value;
-          int16_t delta_y = rot_end.y.raw_value - rot_start.y.raw_value;
-
-          Fixed_S16_3 x = (Fixed_S16_3){.raw_value = rot_start.x.raw_value + delta_x
-                          * (i * FIXED_S16_3_ONE.raw_value - rot_start.y.raw_value) / delta_y};
-
-          Fixed_S16_3 delta = (Fixed_S16_3){.raw_value = ABS(delta_x / delta_y) *
-                                                          FIXED_S16_3_ONE.raw_value};
-
-          if (delta.integer > 1) {
-            // this is where we try to fix edges diving in and out of paths
-            int16_t min_x = rot_end.x.raw_value < rot_start.x.raw_value ?
-                              rot_end.x.raw_value : rot_start.x.raw_value;
-            int16_t max_x = rot_end.x.raw_value > rot_start.x.raw_value ?
-                              rot_end.x.raw_value : rot_start.x.raw_value;
-
-            if (x.raw_value - (delta.raw_value / 2) < min_x) {
-              delta.raw_value = (x.raw_value - min_x) * 2;
-            }
-
-            if (x.raw_value + (delta.raw_value / 2) > max_x) {
-              delta.raw_value = (max_x - x.raw_value) * 2;
-            }
-          }
-
-          if (is_down) {
-            intersections_down[intersection_down_count].x.raw_value = x.raw_value;
-            intersections_down[intersection_down_count].delta = delta;
-            intersection_down_count++;
-          } else {
-            intersections_up[intersection_up_count].x.raw_value = x.raw_value;
-            intersections_up[intersection_up_count].delta = delta;
-            intersection_up_count++;
-          }
-        }
-        last_is_down = is_down;
+  for (size_t i = 0; i < num_active; i++) {
+    for (size_t j = i + 1; j < num_active; j++) {
+      if (edges[active[i]].x > edges[active[j]].x) {
+        prv_swap_active(&active[i], &active[j]);
       }
     }
+  }
+}
 
-    // sort the intersections
-    sortIntersections(intersections_up, intersection_up_count);
-    sortIntersections(intersections_down, intersection_down_count);
-
-    // draw the line segments
-    for (int j = 0; j < MIN(intersection_up_count, intersection_down_count); j++) {
-      Intersection x_a = intersections_up[j];
-      Intersection x_b = intersections_down[j];
-      if (x_a.x.integer != x_b.x.integer) {
-        if (x_a.x.integer > x_b.x.integer) {
-          swapIntersections(&x_a, &x_b);
-        }
-        // this is done by callback now...
-        // x_a.x.integer++;
-        // x_b.x.integer--;
+#if PBL_COLOR
+static Intersection prv_edge_intersection_aa(const GPathEdge *edge) {
+  const Fixed_S16_3 x = (Fixed_S16_3){.raw_value = edge->x};
+  Fixed_S16_3 delta = (Fixed_S16_3){.raw_value = ABS(edge->delta_x / edge->delta_y) *
+                                                  FIXED_S16_3_ONE.raw_value};
+
+  if (delta.integer > 1) {
+    // this is where we try to fix edges diving in and out of paths
+    const int16_t x_end = edge->x_start + edge->delta_x;
+    const int16_t min_x = MIN(edge->x_start, x_end);
+    const int16_t max_x = MAX(edge->x_start, x_end);
+
+    if (x.raw_value - (delta.raw_value / 2) < min_x) {
+      delta.raw_value = (x.raw_value - min_x) * 2;
+    }
 
-        cb(ctx, i, x_a.x, x_b.x, x_a.delta, x_b.delta, user_data);
-      }
+    if (x.raw_value + (delta.raw_value / 2) > max_x) {
+      delta.raw_value = (max_x - x.raw_value) * 2;
     }
   }
-
-  // restore original stroke color
-  ctx->draw_state.stroke_color = tmp;
-
-cleanup:
-  applib_free(rot_points);
-  applib_free(intersections_up);
-  applib_free(intersections_down);
+  return (Intersection) { .x = x, .delta = delta };
 }
-#endif // PBL_COLOR
+#endif
 
-void gpath_draw_filled_with_cb(GContext *ctx, GPath *path, GPathDrawFilledCallback cb,
-                               void *user_data) {
-  //Protect against apps calling with no points to draw (Upright watchface)
+static void prv_fill_path_with_cb(GContext *ctx, GPath *path, bool antialiased,
+                                  GPathDrawFilledCallback cb, void *user_data) {
+  // Protect against apps calling with no points to draw (Upright watchface)
   if (!path || path->num_points < 2) {
     return;
   }
 
-  GPoint* rot_points = applib_malloc(path->num_points * sizeof(GPoint));
-  if (!rot_points) {
+  // The edge table and the lists of active up and down edges share a single allocation
+  const size_t num_points = path->num_points;
+  GPathEdge *edges = applib_malloc(num_points * (sizeof(GPathEdge) + 2 * sizeof(uint16_t)));
+  if (!edges) {
     APP_LOG(APP_LOG_LEVEL_ERROR, GPATH_ERROR);
     return;
   }
-
-  int min_x, max_x, min_y, max_y;
-  GPoint rot_start, rot_end;
-  bool found_start_direction = false;
-  bool start_is_down = false;
-  int16_t *intersections_up = NULL;
-  int16_t *intersections_down = NULL;
-
-  rot_points[0] = rot_end = rotate_offset_point(&path->points[0], path->rotation, &path->offset);
-  min_x = max_x = rot_points[0].x;
-  min_y = max_y = rot_points[0].y;
-
-  // begin finding the last path segment's direction going backwards through the path
-  // we must go backwards because we find intersections going forwards
-  for (int i = path->num_points - 1; i > 0; --i) {
-    rot_points[i] = rot_start = rotate_offset_point(&path->points[i], path->rotation, &path->offset);
-    if (min_x > rot_points[i].x) { min_x = rot_points[i].x; }
-    if (max_x < rot_points[i].x) { max_x = rot_points[i].x; }
-    if (min_y > rot_points[i].y) { min_y = rot_points[i].y; }
-    if (max_y < rot_points[i].y) { max_y = rot_points[i].y; }
-
-    if (found_start_direction) {
-      continue;
-    }
-
-    // use the first non-horizontal path segment's direction as the start direction
-    if (rot_end.y != rot_start.y) {
-      start_is_down = rot_end.y > rot_start.y;
-      found_start_direction = true;
+  uint16_t *active_up = (uint16_t *)&edges[num_points];
+  uint16_t *active_down = &active_up[num_points];
+
+  // rotate every point once, building an edge for each non-horizontal segment
+  const GPoint first = rotate_offset_point(&path->points[0], path->rotation, &path->offset);
+  int min_x = first.x, max_x = first.x;
+  int min_y = first.y, max_y = first.y;
+  size_t num_edges = 0;
+  GPoint start = first;
+  for (size_t i = 0; i < num_points; i++) {
+    const GPoint end = (i + 1 < num_points) ?
+        rotate_offset_point(&path->points[i + 1], path->rotation, &path->offset) : first;
+    if (min_x > end.x) { min_x = end.x; }
+    if (max_x < end.x) { max_x = end.x; }
+    if (min_y > end.y) { min_y = end.y; }
+    if (max_y < end.y) { max_y = end.y; }
+    if (end.y != start.y) {
+      prv_edge_init(&edges[num_edges++], i, start, end, antialiased);
     }
-
-    rot_end = rot_start;
+    start = end;
   }
 
-
+  // convert clip coordinates to drawing coordinates
   const int16_t clip_min_x = ctx->draw_state.clip_box.origin.x
       - ctx->draw_state.drawing_box.origin.x;
   const int16_t clip_max_x = ctx->draw_state.clip_box.size.w + clip_min_x;
@@ -453,87 +345,142 @@ void gpath_draw_filled_with_cb(GContext *ctx, GPath *path, GPathDrawFilledCallba
     goto cleanup;
   }
 
-  // x-intersections of path segments whose direction is up
-  intersections_up = applib_zalloc(path->num_points * sizeof(int16_t));
-  // x-intersections of path segments whose direction is down
-  intersections_down = applib_zalloc(path->num_points * sizeof(int16_t));
-
-  // If either malloc failed, log message and cleanup
-  if (!intersections_up || !intersections_down) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, GPATH_ERROR);
-    goto cleanup;
-  }
-
-  int intersection_up_count;
-  int intersection_down_count;
-
   const int16_t clip_min_y = ctx->draw_state.clip_box.origin.y
       - ctx->draw_state.drawing_box.origin.y;
   const int16_t clip_max_y = ctx->draw_state.clip_box.size.h + clip_min_y;
   min_y = MAX(min_y, clip_min_y);
   max_y = MIN(max_y, clip_max_y);
 
-  // find all of the horizontal intersections and draw them
-  for (int16_t i = min_y; i <= max_y; ++i) {
-    // initialize with 0 intersections
-    intersection_down_count = 0;
-    intersection_up_count = 0;
-
-    // horizontal path segments don't have a direction and depend upon the last path segment's direction
-    // keep track of the last path direction for horizontal path segments to use
-    bool last_is_down = start_is_down;
-    rot_end = rot_points[0];
-
-    // find the intersections
-    for (uint32_t j = 0; j < path->num_points; ++j) {
-      rot_start = rot_points[j];
-      if (j + 1 < path->num_points) {
-        rot_end = rot_points[j + 1];
+  // Horizontal segments don't have a direction and take the direction of the segment before
+  // them. A segment that keeps going the same way as the one before doesn't count its start
+  // point, which the previous segment already counted as its end point.
+  bool last_is_down = (num_edges > 0) ? prv_edge_is_down(&edges[num_edges - 1]) : false;
+  size_t num_visible = 0;
+  for (size_t i = 0; i < num_edges; i++) {
+    GPathEdge edge = edges[i];
+    const bool is_down = prv_edge_is_down(&edge);
+    if (is_down == last_is_down) {
+      if (is_down) {
+        edge.y_first++;
       } else {
-        // wrap to the first point
-        rot_end = rot_points[0];
+        edge.y_last--;
       }
+    }
+    last_is_down = is_down;
 
-      // if the line is on/crosses this height
-      if ((rot_start.y - i) * (rot_end.y - i) <= 0) {
-        bool is_down = rot_end.y != rot_start.y ? rot_end.y > rot_start.y : last_is_down;
-        // don't count end points in the same direction to avoid double intersections
-        if (!(rot_start.y == i && last_is_down == is_down)) {
-          // linear interpolation of the line intersection
-          int16_t x = rot_start.x + (rot_end.x - rot_start.x) * (i - rot_start.y) / (rot_end.y - rot_start.y);
-          if (is_down) {
-            intersections_down[intersection_down_count] = x;
-            intersection_down_count++;
-          } else {
-            intersections_up[intersection_up_count] = x;
-            intersection_up_count++;
-          }
-        }
-        last_is_down = is_down;
-      }
+    edge.y_first = MAX(edge.y_first, min_y);
+    edge.y_last = MIN(edge.y_last, max_y);
+    if (edge.y_first <= edge.y_last) {
+      edges[num_visible++] = edge;
     }
+  }
+  num_edges = num_visible;
 
-    // sort the intersections
-    sort16(intersections_up, intersection_up_count);
-    sort16(intersections_down, intersection_down_count);
+  // the edge table, in the order the edges start intersecting scanlines
+  sort_stable_by_int16_key(edges, num_edges, sizeof(GPathEdge), offsetof(GPathEdge, y_first));
 
-    // draw the line segments
-    for (int j = 0; j < MIN(intersection_up_count, intersection_down_count); j++) {
-      int16_t x_a = intersections_up[j];
-      int16_t x_b = intersections_down[j];
+#if PBL_COLOR
+  // filling color hack
+  const GColor tmp = ctx->draw_state.stroke_color;
+  if (antialiased) {
+    ctx->draw_state.stroke_color = ctx->draw_state.fill_color;
+  }
+  const int32_t scale = antialiased ? FIXED_S16_3_ONE.raw_value : 1;
+#else
+  const int32_t scale = 1;
+#endif
+
+  size_t next_edge = 0;
+  size_t num_up = 0;
+  size_t num_down = 0;
+  for (int16_t y = min_y; y <= max_y; ++y) {
+    if ((next_edge == num_edges) && (num_up == 0) && (num_down == 0)) {
+      break;
+    }
+
+    prv_active_edges_advance(edges, active_up, &num_up, y, scale);
+    prv_active_edges_advance(edges, active_down, &num_down, y, scale);
+    while ((next_edge < num_edges) && (edges[next_edge].y_first == y)) {
+      prv_edge_update_x(&edges[next_edge], y, scale);
+      if (prv_edge_is_down(&edges[next_edge])) {
+        active_down[num_down++] = next_edge;
+      } else {
+        active_up[num_up++] = next_edge;
+      }
+      next_edge++;
+    }
+    prv_active_edges_sort(edges, active_up, num_up);
+    prv_active_edges_sort(edges, active_down, num_down);
+
+    // draw the line segments between the n-th up and the n-th down intersection
+    for (size_t j = 0; j < MIN(num_up, num_down); j++) {
+      const GPathEdge *edge_a = &edges[active_up[j]];
+      const GPathEdge *edge_b = &edges[active_down[j]];
+#if PBL_COLOR
+      if (antialiased) {
+        Intersection x_a = prv_edge_intersection_aa(edge_a);
+        Intersection x_b = prv_edge_intersection_aa(edge_b);
+        if (x_a.x.integer != x_b.x.integer) {
+          if (x_a.x.integer > x_b.x.integer) {
+            swapIntersections(&x_a, &x_b);
+          }
+          // the callback moves the ends inwards by a pixel
+          cb(ctx, y, x_a.x, x_b.x, x_a.delta, x_b.delta, user_data);
+        }
+        continue;
+      }
+#endif
+      int16_t x_a = edge_a->x;
+      int16_t x_b = edge_b->x;
       if (x_a != x_b) {
         if (x_a > x_b) {
           swap16(&x_a, &x_b);
         }
-        cb(ctx, i, (Fixed_S16_3){.integer = x_a}, (Fixed_S16_3){.integer = x_b},
+        cb(ctx, y, (Fixed_S16_3){.integer = x_a}, (Fixed_S16_3){.integer = x_b},
            (Fixed_S16_3){.integer = -1}, (Fixed_S16_3){.integer = -1}, user_data);
       }
     }
   }
+
+#if PBL_COLOR
+  // restore original stroke color
+  ctx->draw_state.stroke_color = tmp;
+#endif
+
 cleanup:
-  applib_free(rot_points);
-  applib_free(intersections_up);
-  applib_free(intersections_down);
+  applib_free(edges);
+}
+
+#if PBL_COLOR
+void prv_fill_path_with_cb_aa(GContext *ctx, GPath *path, GPathDrawFilledCallback cb,
+                              void *user_data) {
+  /*
+   * Filling gpaths with antialiasing for integral-coordinates based paths:
+   *
+   * Custom linescanner using simple mathematic trick to determine anti-aliased edges
+   *  1. Rotate all points in path and build the edge table
+   *  2. Progress line-by-line through the active edges' intersections
+   *  2.1 Calculate delta (angle) of the intersecting lines
+   *  2.2 Keep the intersections sorted
+   *  2.3 Draw lines between intersections
+   *
+   * This algorithm relies on few tricks:
+   *  - For intersections with delta less than 1 (angle is less than 45°) we will use exact
+   *      position of the intersection and fill edge pixel based on that information
+   *  - For intersections with delta bigger than 1 (angle is bigger than 45°) we will use delta to
+   *      draw gradient line responding to the angle
+   *      + If gradient is bigger than distance from the start/end of the intersecting line
+   *          we will adjust the delta to match starting/ending point and avoid nasty
+   *          gradients diving in/out the path
+   *      + Gradients too close to clipping rect will be properly cut off
+   */
+  prv_fill_path_with_cb(ctx, path, true /* antialiased */, cb, user_data);
+}
+#endif // PBL_COLOR
+
+void gpath_draw_filled_with_cb(GContext *ctx, GPath *path, GPathDrawFilledCallback cb,
+                               void *user_data) {
+  prv_fill_path_with_cb(ctx, path, false /* antialiased */, cb, user_data);
 }
 
 void gpath_fill_precise_internal(GContext *ctx, GPointPrecise *points, size_t num_points) {
@@ -21,6 +21,7 @@
 #include "system/passert.h"
 #include "pbl/util/math.h"
 #include "pbl/util/size.h"
+#include "pbl/util/sort.h"
 #include "util/stats.h"
 
 
@@ -842,19 +843,22 @@ T_STATIC int64_t prv_session_compare(const ActivitySession *a, const ActivitySes
 }
 
 // ----------------------------------------------------------------------------------------------
+static int prv_session_compare_past(const void *a, const void *b) {
+  const int64_t rv = prv_session_compare(a, b, HealthIterationDirectionPast);
+  return (rv > 0) - (rv < 0);
+}
+
+static int prv_session_compare_future(const void *a, const void *b) {
+  const int64_t rv = prv_session_compare(a, b, HealthIterationDirectionFuture);
+  return (rv > 0) - (rv < 0);
+}
+
 static void prv_sessions_sort(ActivitySession *sessions, const uint32_t num_sessions,
                               HealthIterationDirection direction) {
-  // as the number of sessions is expected to be small (<=16), and we don't seem to have a generic
-  // sort implementation, we do a simple bubble sort here
-  for (uint32_t i = 0; i + 1 < num_sessions; i++) {
-    for (uint32_t j = i + 1; j < num_sessions; j++) {
-      if (prv_session_compare(&sessions[i], &sessions[j], direction) > 0) {
-        ActivitySession temp = sessions[i];
-        sessions[i] = sessions[j];
-        sessions[j] = temp;
-      }
-    }
-  }
+  // stable, so sessions that compare equal are iterated in the order they were stored
+  sort_stable(sessions, num_sessions, sizeof(*sessions),
+              (direction == HealthIterationDirectionPast) ? prv_session_compare_past
+                                                          : prv_session_compare_future);
 }
 
 // ----------------------------------------------------------------------------------------------
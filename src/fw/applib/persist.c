@@ -37,26 +37,26 @@ DEFINE_SYSCALL(size_t, persist_get_max_size, void) {
 
 DEFINE_SYSCALL(bool, persist_exists, const uint32_t key) {
   LOCK_AND_GET_STORE(store);
-  return settings_file_exists(store, &key, sizeof(key));
+  return persist_service_exists(store, key);
 }
 
 DEFINE_SYSCALL(int, persist_get_size, const uint32_t key) {
   LOCK_AND_GET_STORE(store);
-  int result = settings_file_get_len(store, &key, sizeof(key));
+  int result = persist_service_get_len(store, key);
   return result ?: E_DOES_NOT_EXIST;
 }
 
 DEFINE_SYSCALL(bool, persist_read_bool, const uint32_t key) {
   bool value = false;
   LOCK_AND_GET_STORE(store);
-  settings_file_get(store, &key, sizeof(key), &value, sizeof(value));
+  persist_service_get(store, key, &value, sizeof(value));
   return value;
 }
 
 DEFINE_SYSCALL(int32_t, persist_read_int, const uint32_t key) {
   int32_t value = 0;
   LOCK_AND_GET_STORE(store);
-  settings_file_get(store, &key, sizeof(key), &value, sizeof(value));
+  persist_service_get(store, key, &value, sizeof(value));
   return value;
 }
 
@@ -67,7 +67,7 @@ DEFINE_SYSCALL(int, persist_read_data, const uint32_t key,
   }
 
   LOCK_AND_GET_STORE(store);
-  const int len = settings_file_get_len(store, &key, sizeof(key));
+  const int len = persist_service_get_len(store, key);
   if (len == 0) {
     return E_DOES_NOT_EXIST;
   } else if (FAILED(len)) {
@@ -75,8 +75,8 @@ DEFINE_SYSCALL(int, persist_read_data, const uint32_t key,
   }
 
   const size_t restricted_size = MIN(buffer_size, (size_t)len);
-  const status_t read_result = settings_file_get(
-      store, &key, sizeof(key), buffer, restricted_size);
+  const status_t read_result = persist_service_get(
+      store, key, buffer, restricted_size);
   if (FAILED(read_result)) {
     RETURN_STATUS_UP(read_result);
   }
@@ -106,15 +106,13 @@ int persist_read_string__deprecated(const uint32_t key,
 
 DEFINE_SYSCALL(status_t, persist_write_bool, const uint32_t key, const bool value) {
   LOCK_AND_GET_STORE(store);
-  status_t result = settings_file_set(store, &key, sizeof(key),
-                                      &value, sizeof(value));
+  status_t result = persist_service_set(store, key, &value, sizeof(value));
   return PASSED(result) ? (status_t)sizeof(value) : result;
 }
 
 DEFINE_SYSCALL(status_t, persist_write_int, const uint32_t key, const int32_t value) {
   LOCK_AND_GET_STORE(store);
-  status_t result = settings_file_set(store, &key, sizeof(key),
-                                      &value, sizeof(value));
+  status_t result = persist_service_set(store, key, &value, sizeof(value));
   return PASSED(result) ? (status_t)sizeof(value) : result;
 }
 
@@ -126,8 +124,7 @@ DEFINE_SYSCALL(int, persist_write_data, const uint32_t key,
   }
   const size_t restricted_size = MIN(buffer_size, PERSIST_DATA_MAX_LENGTH);
   LOCK_AND_GET_STORE(store);
-  int result = settings_file_set(store, &key, sizeof(key),
-                                 buffer, restricted_size);
+  int result = persist_service_set(store, key, buffer, restricted_size);
   return PASSED(result) ? (int)restricted_size : result;
 }
 
@@ -150,8 +147,8 @@ DEFINE_SYSCALL(int, persist_write_string, const uint32_t key, const char *cstrin
 DEFINE_SYSCALL(status_t, persist_delete, const uint32_t key) {
   LOCK_AND_GET_STORE(store);
   status_t result;
-  if (settings_file_exists(store, &key, sizeof(key))) {
-    result = settings_file_delete(store, &key, sizeof(key));
+  if (persist_service_exists(store, key)) {
+    result = persist_service_delete(store, key);
     if (PASSED(result)) {
       result = S_TRUE;
     }
@@ -160,3 +157,13 @@ DEFINE_SYSCALL(status_t, persist_delete, const uint32_t key) {
   }
   return result;
 }
+
+DEFINE_SYSCALL(status_t, persist_begin, void) {
+  LOCK_AND_GET_STORE(store);
+  return persist_service_begin_transaction(store);
+}
+
+DEFINE_SYSCALL(status_t, persist_commit, void) {
+  LOCK_AND_GET_STORE(store);
+  return persist_service_commit_transaction(store);
+}
@@ -138,6 +138,23 @@ int persist_write_string(const uint32_t key, const char *cstring);
 //! @return S_TRUE if successful, E_DOES_NOT_EXIST if a value was not set, or another error value from \ref StatusCode.
 status_t persist_delete(const uint32_t key);
 
+//! Starts batching persistent storage writes. Until \ref persist_commit is called, writes and
+//! deletes are held in memory and only reads made by the same app or worker see them. Writing the
+//! same key several times keeps only the last value. Calling this again discards any writes that
+//! have not been committed yet.
+//! @return S_SUCCESS if successful, a value from \ref StatusCode otherwise.
+status_t persist_begin(void);
+
+//! Writes out the writes and deletes made since \ref persist_begin. The commit is atomic: if it
+//! fails, for instance because the writes would not all fit in the space available to the app, or
+//! the watch loses power part way through, none of them are made. The batch is discarded either
+//! way.
+//! @note A commit of more than one write rewrites all of the app's persistent storage, so it
+//! takes about as long as that storage is large.
+//! @return S_SUCCESS if successful, E_OUT_OF_STORAGE if the writes did not fit, or another value
+//! from \ref StatusCode.
+status_t persist_commit(void);
+
 //!   @} // end addtogroup Storage
 //! @} // end addtogroup Foundation
 
@@ -878,6 +878,14 @@ void command_log_dump_generation(const char* generation_str) {
   prompt_command_continues_after_returning();
 }
 
+void command_log_dump_since(const char* generation_str, const char* minutes_str) {
+  int generation = atoi(generation_str);
+  time_t since_utc = rtc_get_time() - atoi(minutes_str) * SECONDS_PER_MINUTE;
+  flash_dump_log_file_since(generation, since_utc, prv_serial_dump_chunk_callback,
+                            prv_serial_dump_completed_callback);
+  prompt_command_continues_after_returning();
+}
+
 static void spam_callback(void *data) {
   uint32_t iteration = (uintptr_t) data;
   uint8_t buffer[128];
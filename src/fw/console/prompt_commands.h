@@ -18,6 +18,7 @@ extern void command_log_dump_current(void);
 extern void command_log_dump_last(void);
 extern void command_log_dump_spam(void);
 extern void command_log_dump_generation(const char*);
+extern void command_log_dump_since(const char*, const char*);
 
 extern void command_put_raw_button_event(const char*, const char*);
 extern void command_put_button_event(const char*, const char*);
@@ -468,6 +469,7 @@ static const Command s_prompt_commands[] = {
   { "log dump last", command_log_dump_last, 0 },
   { "log spam", command_log_dump_spam, 0 },
   { "log dump gen", command_log_dump_generation, 1 },
+  { "log dump since", command_log_dump_since, 2 },
 
   { "ble mode", command_change_le_mode, 1 },
   { "ble ind svc", command_ble_send_service_changed_indication, 0 },
@@ -238,34 +238,46 @@ static void prv_domain_read_cb(void *data) {
   PulseTransferFD *pulse_fd = &s_transfer_fds[fd_num];
 
   const size_t max_read_len = (PULSE_MAX_SEND_SIZE - sizeof(ReadResponse));
-  size_t read_len = MIN(pulse_fd->transfer_state.bytes_left, max_read_len);
 
-  ReadResponse *resp = pulse_reliable_send_begin(PULSE2_BULKIO_PROTOCOL);
-  resp->opcode = BULKIO_RESP_DOMAIN_READ;
-  resp->offset = pulse_fd->transfer_state.offset;
+  // Queue up a whole window of packets so the link isn't idle while waiting for each ACK.
+  // pulse_reliable_send_begin only blocks once the window is full.
+  for (int i = 0; i < PULSE_RELIABLE_WINDOW_SIZE && pulse_fd->transfer_state.bytes_left > 0;
+       ++i) {
+    size_t read_len = MIN(pulse_fd->transfer_state.bytes_left, max_read_len);
+
+    ReadResponse *resp = pulse_reliable_send_begin(PULSE2_BULKIO_PROTOCOL);
+    if (!resp) {
+      // Transport is down, the transfer is abandoned
+      return;
+    }
+    resp->opcode = BULKIO_RESP_DOMAIN_READ;
+    resp->offset = pulse_fd->transfer_state.offset;
+
+    int ret = pulse_fd->impl->read_proc(resp->data, resp->offset, read_len,
+                                        pulse_fd->domain_state);
+    if (ret <= 0) {
+      pulse_reliable_send_cancel(resp);
+
+      Command cmd = {
+        .opcode = BULKIO_CMD_DOMAIN_READ,
+        .read = {
+          .fd = fd_num
+        }
+      };
+
+      prv_respond_internal_error(&cmd, sizeof(cmd), ret);
+      return;
+    }
 
-  int ret = pulse_fd->impl->read_proc(resp->data, resp->offset, read_len, pulse_fd->domain_state);
-  if (ret > 0) {
     read_len = ret;
     pulse_fd->transfer_state.bytes_left -= read_len;
     pulse_fd->transfer_state.offset += read_len;
 
     pulse_reliable_send(resp, read_len + sizeof(ReadResponse));
+  }
 
-    if (pulse_fd->transfer_state.bytes_left > 0) {
-      system_task_add_callback(prv_domain_read_cb, (void*)(uintptr_t)fd_num);
-    }
-  } else {
-    pulse_reliable_send_cancel(resp);
-
-    Command cmd = {
-      .opcode = BULKIO_CMD_DOMAIN_READ,
-      .read = {
-        .fd = fd_num
-      }
-    };
-
-    prv_respond_internal_error(&cmd, sizeof(cmd), ret);
+  if (pulse_fd->transfer_state.bytes_left > 0) {
+    system_task_add_callback(prv_domain_read_cb, (void*)(uintptr_t)fd_num);
   }
 }
 
@@ -9,6 +9,10 @@
 //! Maximum number of data bytes that an outgoing PULSE frame can hold.
 #define PULSE_MAX_SEND_SIZE (520)
 
+//! Number of reliable transport frames which may be un-ACKed at once. Senders can have this many
+//! frames in flight before pulse_reliable_send_begin blocks.
+#define PULSE_RELIABLE_WINDOW_SIZE (4)
+
 //! Possible link states for the PULSE link, used to notify protocol handlers
 typedef enum {
   PulseLinkState_Open,
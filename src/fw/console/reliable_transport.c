@@ -13,6 +13,7 @@
 #include "console/pulse_control_message_protocol.h"
 #include "kernel/events.h"
 #include "kernel/pbl_malloc.h"
+#include "pbl/os/mutex.h"
 #include "pbl/services/system_task.h"
 #include "system/passert.h"
 #include <pbl/util/attributes.h>
@@ -29,6 +30,9 @@
 
 //! Modulus for sequence numbers
 #define MODULUS (128u)
+//! Number of Information packets which may be sent before the oldest of them is ACKed.
+//! k in the LAPB spec.
+#define WINDOW_SIZE (PULSE_RELIABLE_WINDOW_SIZE)
 #define MAX_RETRANSMITS (10)
 #define RETRANSMIT_TIMEOUT_MS (200)
 
@@ -80,17 +84,29 @@ _Static_assert(sizeof((ReliablePacket){0}.s) == 2,
                "sizeof ReliablePacket.s is wrong");
 _Static_assert(sizeof((ReliablePacket){0}.i) == sizeof(ReliablePacket),
                "Something is really wrong here");
+_Static_assert(MODULUS % WINDOW_SIZE == 0 && WINDOW_SIZE < MODULUS,
+               "Un-ACKed packets must map to distinct window slots");
 
 static bool s_layer_up = false;
-static ReliableInfoBuffer *s_tx_buffer;
+//! Buffers for packets being filled in by senders and for un-ACKed packets
+static ReliableInfoBuffer *s_tx_buffers[WINDOW_SIZE];
+static bool s_tx_buffer_in_use[WINDOW_SIZE];
+//! The buffer of each un-ACKed packet, indexed by sequence number modulo the window size
+static ReliableInfoBuffer *s_unacked[WINDOW_SIZE];
+//! Counts the tx buffers which are not in use
 static SemaphoreHandle_t s_tx_lock;
+//! Guards the tx buffers and the send and ACK state variables
+static PebbleMutex *s_tx_state_lock;
 
 //! The sequence number of the next in-sequence I-packet to be transmitted.
 //! V(S) in the LAPB spec.
 static uint8_t s_send_variable;
+//! The sequence number of the oldest un-ACKed I-packet. V(A) in the LAPB spec.
+static uint8_t s_ack_variable;
 static uint8_t s_retransmit_count;
-static uint8_t s_last_ack_number;  //!< N(R) of most recently received packet.
 static uint8_t s_receive_variable;  //!< V(R) in the LAPB spec.
+//! A REJ was sent for the packets missing before V(R) and none of them arrived yet
+static bool s_reject_sent;
 
 static void prv_bounce_ncp_state(void);
 
@@ -132,15 +148,93 @@ static void prv_send_info_packet(uint8_t sequence_number,
   pulse_link_send(packet, packet_size);
 }
 
+static uint8_t prv_num_unacked(void) {
+  return (uint8_t)(s_send_variable - s_ack_variable) % MODULUS;
+}
+
+static void prv_release_tx_buffer(ReliableInfoBuffer *tx_buffer) {
+  for (int i = 0; i < WINDOW_SIZE; ++i) {
+    if (s_tx_buffers[i] == tx_buffer) {
+      s_tx_buffer_in_use[i] = false;
+      xSemaphoreGive(s_tx_lock);
+      return;
+    }
+  }
+}
+
+//! Forgets all un-ACKed packets, releasing their buffers to any waiting sender
+static void prv_release_unacked(void) {
+  while (prv_num_unacked()) {
+    ReliableInfoBuffer **slot = &s_unacked[s_ack_variable % WINDOW_SIZE];
+    prv_release_tx_buffer(*slot);
+    *slot = NULL;
+    s_ack_variable = (s_ack_variable + 1) % MODULUS;
+  }
+}
+
+static void prv_start_retransmit_timer(uint8_t sequence_number) {
+  pulse2_reliable_retransmit_timer_start(
+      RETRANSMIT_TIMEOUT_MS, sequence_number);
+}
+
+static void prv_retransmit(uint8_t sequence_number) {
+  const ReliableInfoBuffer *tx_buffer = s_unacked[sequence_number % WINDOW_SIZE];
+  prv_send_info_packet(sequence_number, tx_buffer->app_protocol,
+                       &tx_buffer->information[0], tx_buffer->length);
+}
+
+//! Must be called with s_tx_state_lock held.
 static void prv_process_ack(uint8_t ack_number) {
-  if ((ack_number - 1) % MODULUS == s_send_variable) {
+  // N(R) acknowledges every packet before it
+  uint8_t num_acked = (uint8_t)(ack_number - s_ack_variable) % MODULUS;
+  if (num_acked == 0 || num_acked > prv_num_unacked()) {
+    // Nothing new, or a stale N(R) from before the window
+    return;
+  }
+  for (; num_acked; --num_acked) {
+    ReliableInfoBuffer **slot = &s_unacked[s_ack_variable % WINDOW_SIZE];
+    prv_release_tx_buffer(*slot);
+    *slot = NULL;
+    s_ack_variable = (s_ack_variable + 1) % MODULUS;
+  }
+
+  s_retransmit_count = 0;
+  if (prv_num_unacked()) {
+    // Time the oldest packet which is still un-ACKed
+    prv_start_retransmit_timer(s_ack_variable);
+  } else {
     pulse2_reliable_retransmit_timer_cancel();
-    s_retransmit_count = 0;
-    s_send_variable = (s_send_variable + 1) % MODULUS;
-    xSemaphoreGive(s_tx_lock);
   }
 }
 
+//! Sends every un-ACKed packet again, oldest first, and times the oldest one.
+//! Must be called with s_tx_state_lock held.
+static void prv_go_back(void) {
+  for (uint8_t sequence_number = s_ack_variable; sequence_number != s_send_variable;
+       sequence_number = (sequence_number + 1) % MODULUS) {
+    prv_retransmit(sequence_number);
+  }
+  if (prv_num_unacked()) {
+    prv_start_retransmit_timer(s_ack_variable);
+  }
+}
+
+//! The peer discarded everything from N(R) on, send all of it again.
+//! Must be called with s_tx_state_lock held.
+static void prv_process_reject(uint8_t ack_number) {
+  prv_process_ack(ack_number);
+  if (ack_number != s_ack_variable) {
+    // N(R) isn't one of our un-ACKed packets
+    return;
+  }
+  prv_go_back();
+}
+
+//! Whether an I-packet is one past V(R), as opposed to a retransmission of one already received
+static bool prv_is_ahead_of_receive_variable(uint8_t sequence_number) {
+  return ((uint8_t)(sequence_number - s_receive_variable) % MODULUS) < MODULUS / 2;
+}
+
 static void prv_send_port_closed_message(void *context) {
   net16 bad_port;
   memcpy(&bad_port, &context, sizeof(bad_port));
@@ -169,7 +263,13 @@ void pulse2_reliable_transport_on_command_packet(
               (uint8_t)packet->s.kind);
       // Pretend it is an RR packet
     }
-    prv_process_ack(packet->s.ack_number);
+    mutex_lock(s_tx_state_lock);
+    if (packet->s.kind == SupervisoryKind_Reject) {
+      prv_process_reject(packet->s.ack_number);
+    } else {
+      prv_process_ack(packet->s.ack_number);
+    }
+    mutex_unlock(s_tx_state_lock);
     if (packet->s.poll_or_final) {
       prv_send_supervisory_response(SupervisoryKind_ReceiveReady,
                                     /* final */ true);
@@ -180,8 +280,14 @@ void pulse2_reliable_transport_on_command_packet(
       prv_bounce_ncp_state();
       return;
     }
+    // Information packets carry an ACK for our packets too
+    mutex_lock(s_tx_state_lock);
+    prv_process_ack(packet->i.ack_number);
+    mutex_unlock(s_tx_state_lock);
+
     if (packet->i.sequence_number == s_receive_variable) {
       s_receive_variable = (s_receive_variable + 1) % MODULUS;
+      s_reject_sent = false;
       if (ntoh16(packet->i.length) <= length) {
         size_t info_length = ntoh16(packet->i.length) - sizeof(ReliablePacket);
         // This variable is read in the macro-expansion below, but linters
@@ -219,6 +325,13 @@ void pulse2_reliable_transport_on_command_packet(
                 "Discarding.", ntoh16(packet->i.length), (uint16_t)length);
         return;
       }
+    } else if (!s_reject_sent &&
+               prv_is_ahead_of_receive_variable(packet->i.sequence_number)) {
+      // A packet went missing. Ask for it and everything after it once, rather than waiting for
+      // the peer's retransmit timer to expire for each of them.
+      s_reject_sent = true;
+      prv_send_supervisory_response(SupervisoryKind_Reject, packet->i.poll);
+      return;
     }
     prv_send_supervisory_response(SupervisoryKind_ReceiveReady, packet->i.poll);
   }
@@ -244,7 +357,13 @@ void pulse2_reliable_transport_on_response_packet(
     return;
   }
 
-  prv_process_ack(packet->s.ack_number);
+  mutex_lock(s_tx_state_lock);
+  if (packet->s.kind == SupervisoryKind_Reject) {
+    prv_process_reject(packet->s.ack_number);
+  } else {
+    prv_process_ack(packet->s.ack_number);
+  }
+  mutex_unlock(s_tx_state_lock);
 
   if (packet->s.kind != SupervisoryKind_ReceiveReady &&
       packet->s.kind != SupervisoryKind_Reject) {
@@ -254,36 +373,38 @@ void pulse2_reliable_transport_on_response_packet(
   }
 }
 
-static void prv_start_retransmit_timer(uint8_t sequence_number);
-
 void pulse2_reliable_retransmit_timer_expired_handler(
     uint8_t retransmit_sequence_number) {
-  if (s_send_variable != retransmit_sequence_number) {
+  mutex_lock(s_tx_state_lock);
+  if (!prv_num_unacked() || s_ack_variable != retransmit_sequence_number) {
     // ACK was received and processed between the time that the
     // retransmit timer expired and this callback ran.
+    mutex_unlock(s_tx_state_lock);
     return;
   }
-  if (++s_retransmit_count < MAX_RETRANSMITS) {
-        prv_send_info_packet(retransmit_sequence_number,
-                             s_tx_buffer->app_protocol,
-                             &s_tx_buffer->information[0],
-                             s_tx_buffer->length);
-    prv_start_retransmit_timer(retransmit_sequence_number);
-  } else {
+  const bool give_up = (++s_retransmit_count >= MAX_RETRANSMITS);
+  if (!give_up) {
+    // A peer which doesn't send REJ (such as the host's pulse2 transport) discards everything
+    // after a lost packet, so everything after the oldest packet has to be sent again too
+    prv_go_back();
+  }
+  mutex_unlock(s_tx_state_lock);
+
+  if (give_up) {
     PBL_LOG_DBG("Reached maximum number of retransmit attempts.");
     prv_bounce_ncp_state();
   }
 }
 
-static void prv_start_retransmit_timer(uint8_t sequence_number) {
-  pulse2_reliable_retransmit_timer_start(
-      RETRANSMIT_TIMEOUT_MS, sequence_number);
-}
-
-static void prv_assert_reliable_buffer(void *buf) {
-  PBL_ASSERT(buf == &s_tx_buffer->information[0],
-             "The passed-in buffer pointer is not a buffer given by "
+static ReliableInfoBuffer *prv_get_tx_buffer(void *buf) {
+  for (int i = 0; i < WINDOW_SIZE; ++i) {
+    if (buf == &s_tx_buffers[i]->information[0]) {
+      return s_tx_buffers[i];
+    }
+  }
+  PBL_ASSERT(false, "The passed-in buffer pointer is not a buffer given by "
              "pulse_reliable_send_begin");
+  return NULL;
 }
 
 void *pulse_reliable_send_begin(const uint16_t app_protocol) {
@@ -293,6 +414,7 @@ void *pulse_reliable_send_begin(const uint16_t app_protocol) {
   if (!s_layer_up) {
     return NULL;
   }
+  // Only blocks once the whole window is un-ACKed or being filled in
   xSemaphoreTake(s_tx_lock, portMAX_DELAY);
   if (!s_layer_up) {
     // Transport went down while waiting for the lock
@@ -300,46 +422,70 @@ void *pulse_reliable_send_begin(const uint16_t app_protocol) {
     xSemaphoreGive(s_tx_lock);
     return NULL;
   }
-  s_tx_buffer->app_protocol = app_protocol;
-  return &s_tx_buffer->information[0];
+
+  ReliableInfoBuffer *tx_buffer = NULL;
+  mutex_lock(s_tx_state_lock);
+  for (int i = 0; i < WINDOW_SIZE; ++i) {
+    if (!s_tx_buffer_in_use[i]) {
+      s_tx_buffer_in_use[i] = true;
+      tx_buffer = s_tx_buffers[i];
+      break;
+    }
+  }
+  mutex_unlock(s_tx_state_lock);
+  PBL_ASSERTN(tx_buffer);
+
+  tx_buffer->app_protocol = app_protocol;
+  return &tx_buffer->information[0];
 }
 
 void pulse_reliable_send_cancel(void *buf) {
-  prv_assert_reliable_buffer(buf);
-  xSemaphoreGive(s_tx_lock);
+  ReliableInfoBuffer *tx_buffer = prv_get_tx_buffer(buf);
+  mutex_lock(s_tx_state_lock);
+  prv_release_tx_buffer(tx_buffer);
+  mutex_unlock(s_tx_state_lock);
 }
 
 void pulse_reliable_send(void *buf, const size_t length) {
+  ReliableInfoBuffer *tx_buffer = prv_get_tx_buffer(buf);
+
+  mutex_lock(s_tx_state_lock);
   if (!s_layer_up) {
     PBL_LOG_DBG("Transport went down before send");
+    prv_release_tx_buffer(tx_buffer);
+    mutex_unlock(s_tx_state_lock);
     return;
   }
-  prv_assert_reliable_buffer(buf);
 
-  s_tx_buffer->length = length;
+  tx_buffer->length = length;
   uint8_t sequence_number = s_send_variable;
+  s_unacked[sequence_number % WINDOW_SIZE] = tx_buffer;
+  s_send_variable = (s_send_variable + 1) % MODULUS;
 
-  prv_start_retransmit_timer(sequence_number);
+  if (prv_num_unacked() == 1) {
+    prv_start_retransmit_timer(sequence_number);
+  }
 
   prv_send_info_packet(sequence_number,
-                       s_tx_buffer->app_protocol,
-                       &s_tx_buffer->information[0],
-                       s_tx_buffer->length);
-
-  // As soon as we send the packet we could get ACK'd, preempting this thread and releasing the
-  // s_tx_lock. Don't do anything here that assumes the s_tx_lock is held.
+                       tx_buffer->app_protocol,
+                       &tx_buffer->information[0],
+                       tx_buffer->length);
+  mutex_unlock(s_tx_state_lock);
 }
 
 // Reliable Transport Control Protocol
 // ===================================
 
 static void prv_on_this_layer_up(PPPControlProtocol *this) {
+  mutex_lock(s_tx_state_lock);
+  prv_release_unacked();
   s_layer_up = true;
   s_send_variable = 0;
+  s_ack_variable = 0;
   s_receive_variable = 0;
   s_retransmit_count = 0;
-  s_last_ack_number = 0;
-  xSemaphoreGive(s_tx_lock);
+  s_reject_sent = false;
+  mutex_unlock(s_tx_state_lock);
 
 #define ON_PACKET(...)
 #define ON_TRANSPORT_STATE_CHANGE(UP_HANDLER, DOWN_HANDLER) \
@@ -351,8 +497,11 @@ static void prv_on_this_layer_up(PPPControlProtocol *this) {
 
 static void prv_on_this_layer_down(PPPControlProtocol *this) {
   pulse2_reliable_retransmit_timer_cancel();
+  mutex_lock(s_tx_state_lock);
   s_layer_up = false;
-  xSemaphoreGive(s_tx_lock);
+  // Wakes up senders waiting for a buffer, which will see that the layer is down
+  prv_release_unacked();
+  mutex_unlock(s_tx_state_lock);
 
 #define ON_PACKET(...)
 #define ON_TRANSPORT_STATE_CHANGE(UP_HANDLER, DOWN_HANDLER) \
@@ -394,12 +543,14 @@ void pulse2_reliable_on_link_down(void) {
 }
 
 void pulse2_reliable_init(void) {
+  s_tx_state_lock = mutex_create();
   ppp_control_protocol_init(PULSE2_TRAINCP);
   ppp_control_protocol_open(PULSE2_TRAINCP);
-  s_tx_buffer = kernel_zalloc_check(sizeof(ReliableInfoBuffer) +
-                                    pulse_reliable_max_send_size());
-  s_tx_lock = xSemaphoreCreateBinary();
-  xSemaphoreGive(s_tx_lock);
+  for (int i = 0; i < WINDOW_SIZE; ++i) {
+    s_tx_buffers[i] = kernel_zalloc_check(sizeof(ReliableInfoBuffer) +
+                                          pulse_reliable_max_send_size());
+  }
+  s_tx_lock = xSemaphoreCreateCounting(WINDOW_SIZE, WINDOW_SIZE);
 }
 
 static void prv_bounce_ncp_state(void) {
@@ -21,6 +21,9 @@ static PebbleMutex *s_buffer_mutex = INVALID_MUTEX_HANDLE; //!< Protects s_buffe
 static PebbleMutex *s_flash_write_mutex = INVALID_MUTEX_HANDLE; //!< Protects log line consistency
 static bool s_is_flash_write_scheduled; //!< true if handle_buffer_sync KernelBG callback is scheduled
 
+//! How long a software failure waits for a write in progress before giving up on the flush
+#define FAILURE_FLUSH_TIMEOUT_MS (200)
+
 static void write_message(void) {
   // Note that we should enter this function with the buffer mutex held.
 
@@ -37,8 +40,9 @@ static void write_message(void) {
     return; // Not ready yet, consume nothing.
   }
 
-  // Flash_logging_log_start can trigger a flash erase. Release the buffer mutex
-  // to allow logging while the (slow) erase completes.
+  // Flash_logging_log_start can trigger a flash erase (if the next unit wasn't
+  // erased ahead of time). Release the buffer mutex to allow logging while the
+  // (slow) erase completes.
   mutex_unlock(s_buffer_mutex);
   uint32_t flash_addr = flash_logging_log_start(msg_length);
   mutex_lock(s_buffer_mutex);
@@ -71,6 +75,8 @@ static void handle_buffer_sync(void *data) {
   const bool is_async = (uintptr_t) data;
 
   mutex_lock(s_flash_write_mutex);
+  // Stage the drained messages in RAM and program them together at the end
+  flash_logging_begin_batch();
   mutex_lock(s_buffer_mutex);
 
   // Bound the drain to what was already pending when this callback ran.  Each
@@ -104,10 +110,20 @@ static void handle_buffer_sync(void *data) {
   }
 
   mutex_unlock(s_buffer_mutex);
+  flash_logging_flush();
   mutex_unlock(s_flash_write_mutex);
 }
 
 
+void advanced_logging_flush_for_failure(void) {
+  if ((s_flash_write_mutex == INVALID_MUTEX_HANDLE) ||
+      !mutex_lock_with_timeout(s_flash_write_mutex, FAILURE_FLUSH_TIMEOUT_MS)) {
+    return;
+  }
+  flash_logging_flush();
+  mutex_unlock(s_flash_write_mutex);
+}
+
 void advanced_logging_init(void) {
   flash_logging_init();
 
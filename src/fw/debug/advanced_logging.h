@@ -9,3 +9,8 @@ void advanced_logging_init(void);
 
 void pbl_log_advanced(const char* buffer, int length, bool async);
 
+//! Programs the log messages that are staged but not in flash yet, on the way to a reset after a
+//! software failure. Gives up if another write doesn't finish in time, or if the calling task is
+//! the one in the middle of a write.
+void advanced_logging_flush_for_failure(void);
+
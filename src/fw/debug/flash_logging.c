@@ -4,6 +4,7 @@
 #include "debug/flash_logging.h"
 
 #include <pbl/drivers/flash.h>
+#include <pbl/drivers/rtc.h>
 #include "flash_region/flash_region.h"
 #include "kernel/pbl_malloc.h"
 #include "pbl/services/system_task.h"
@@ -13,6 +14,8 @@
 #include "system/version.h"
 #include "pbl/util/attributes.h"
 #include "pbl/util/build_id.h"
+#include "pbl/util/crc32.h"
+#include "pbl/util/math.h"
 #include "pbl/util/size.h"
 #include "pbl/util/string.h"
 
@@ -34,6 +37,19 @@
 // one or more pages. Multiple log generations can be stored at any given
 // time. The oldest pages will be removed as the log buffer wraps around.
 //
+// Records are assembled in a small RAM stage and programmed in bursts: once
+// with their valid flags still erased and then once more to flip the flags of
+// every record in the burst. A power loss part way through either program can
+// only ever lose whole records. Outside of a batch (see
+// flash_logging_begin_batch()) each record is programmed as soon as it is
+// complete, so callers that don't batch see no change in durability.
+//
+// When a page fills up, a summary is programmed at its end recording how many
+// records it holds, where they end and when the page was in use. Dumps use it to
+// skip pages that are older than what was asked for. Pages without an intact
+// summary (the page still being written, or one cut short by a power loss) are
+// scanned record by record until a record marks the end of the page.
+//
 // Since our logging routines call into this module, we should NOT have any
 // PBL_LOGs in this file, else you could generate infinite loops!
 
@@ -50,6 +66,13 @@
 
 #define MAX_POSSIBLE_LOG_GENS (LOG_REGION_SIZE / LOG_PAGE_SIZE)
 
+// One flash program page. The longest record (header + MAX_MSG_LEN) fits exactly.
+#define LOG_STAGE_SIZE (256)
+
+// Once this much of the last page of an erase unit is used, start erasing the
+// next unit in the background so crossing into it doesn't have to wait
+#define PRE_ERASE_THRESHOLD (LOG_PAGE_SIZE * 3 / 4)
+
 static bool s_flash_logging_enabled = false;
 
 typedef struct PACKED {
@@ -73,6 +96,23 @@ typedef struct PACKED {
 
 #define LOG_FLAGS_VALID (0x1 << 0)
 
+//! Programmed at the end of each page once it fills up. Its first two bytes read as an empty
+//! record, so scanning the records of a full page stops right in front of it.
+typedef struct PACKED {
+  LogRecordHeader end_of_page; // all zeros
+  uint16_t  magic;
+  uint16_t  record_count; // records in the page, including abandoned ones
+  uint16_t  end_offset; // offset in the page just past its last record
+  uint32_t  first_timestamp; // UTC time the first record of the page was started
+  uint32_t  last_timestamp; // UTC time the page filled up
+  uint32_t  crc; // of all the fields above
+} LogPageSummary;
+
+#define LOG_PAGE_SUMMARY_MAGIC 0x5347 /* GS */
+
+// Records have to end before the page summary
+#define LOG_PAGE_DATA_END (LOG_PAGE_SIZE - sizeof(LogPageSummary))
+
 typedef struct {
   uint32_t page_start_addr; // absolute start addr of the page we are logging to
   uint32_t offset_in_log_page; // the offset we writing to in a given page
@@ -80,10 +120,35 @@ typedef struct {
   uint8_t  bytes_remaining; // the bytes left to write for the current log
   uint8_t  log_chunk_id;  // the id of the current page being logged to
   uint8_t  log_file_id; // the id of the current log generation
+  uint16_t page_record_count; // records started in the current page
+  uint32_t page_first_timestamp; // when the first record of the current page was started
 } CurrentLoggingState;
 
 static CurrentLoggingState s_curr_state;
 
+//! Records waiting to be programmed. They are contiguous in flash, starting at flash_addr.
+typedef struct {
+  uint32_t flash_addr; // where buf[0] goes
+  uint16_t len; // bytes reserved in buf, including the record still being written
+  uint16_t committed_len; // bytes of records that are complete (or were abandoned)
+  uint16_t record_offset; // offset in buf of the record still being written
+  bool batching; // hold complete records until flash_logging_flush()
+  uint8_t buf[LOG_STAGE_SIZE];
+} LogStage;
+
+static LogStage s_stage;
+
+typedef enum {
+  PreEraseState_Idle,
+  PreEraseState_Erasing,
+  PreEraseState_Erased,
+} PreEraseState;
+
+static struct {
+  uint32_t unit_addr;
+  volatile PreEraseState state; // updated from the flash driver's completion callback
+} s_pre_erase;
+
 #define CHUNK_ID_BITWIDTH (sizeof(((FlashLoggingHeader *)0)->log_chunk_id) * 8)
 #define LOG_ID_BITWIDTH   (sizeof(((FlashLoggingHeader *)0)->log_file_id) * 8)
 #define MAX_LOG_FILE_ID   (0x1UL << LOG_ID_BITWIDTH)
@@ -93,15 +158,17 @@ static CurrentLoggingState s_curr_state;
 // less than that
 #define MAX_MSG_LEN  ((0x1UL << sizeof(((LogRecordHeader *)0)->length) * 8) - 2)
 
-// This is the state used while performing flash_log_file(). Each log message gets handled
-// by a separate system task callback
+// This is the state used while performing flash_log_file(). Each system task callback handles
+// as many log messages as it can within DUMP_LOG_TIME_BUDGET_MS
 typedef struct {
   uint8_t   page_index;               // which page we are currently dumping
   uint8_t   num_pages;                // number of pages to dump
   uint8_t   retry_count;              // How many retries we have performed at this offset
   bool      sent_build_id;            // True after we've sent the build ID
   uint16_t  page_offset;              // current offset within the page
+  uint16_t  page_end;                 // offset the records of the current page end by
   uint32_t  log_start_addr;           // start address of the log file we are dumping
+  time_t    since_utc;                // skip pages that filled up before this time
   DumpLineCallback  line_cb;          // Called to send each line
   DumpCompletedCallback completed_cb; // Called when completed
   uint8_t   msg_buf[MAX_MSG_LEN];     // Message buffer
@@ -109,6 +176,9 @@ typedef struct {
 
 #define DUMP_LOG_MAX_RETRIES          3
 
+// How long a single system task callback may spend handing log messages to the DumpLineCallback
+#define DUMP_LOG_TIME_BUDGET_MS       20
+
 typedef enum {
   DumpStatus_DoneFailure,
   DumpStatus_InProgress,
@@ -135,6 +205,10 @@ _Static_assert(LOG_PAGE_SIZE <= ERASE_UNIT_SIZE,
      "Log pages must fit within an erase unit");
 _Static_assert((ERASE_UNIT_SIZE % LOG_PAGE_SIZE) == 0,
      "The log page size must be divisible by the erase unit size");
+_Static_assert(sizeof(LogRecordHeader) + MAX_MSG_LEN <= LOG_STAGE_SIZE,
+     "The longest log record must fit in the stage");
+_Static_assert(sizeof(FlashLoggingHeader) + sizeof(LogRecordHeader) + MAX_MSG_LEN <=
+     LOG_PAGE_DATA_END, "The longest log record must fit in a page");
 
 //! Given the current address and amount to increment it by, handles wrapping
 //! and computes the valid flash address
@@ -170,6 +244,67 @@ static void prv_erase_unit(uint32_t addr) {
 #endif
 }
 
+static void prv_pre_erase_complete_cb(void *context, status_t result) {
+  // Ignore an erase which completes after its unit was already taken into use
+  if ((s_pre_erase.state != PreEraseState_Erasing) ||
+      (s_pre_erase.unit_addr != (uintptr_t)context)) {
+    return;
+  }
+  s_pre_erase.state = PASSED(result) ? PreEraseState_Erased : PreEraseState_Idle;
+}
+
+//! Starts erasing the unit following the current page if the page is the last
+//! one of its unit and is filling up
+static void prv_pre_erase_next_unit_if_due(void) {
+  if (s_curr_state.offset_in_log_page < PRE_ERASE_THRESHOLD) {
+    return;
+  }
+  const uint32_t next_page_addr = prv_get_page_addr(s_curr_state.page_start_addr, LOG_PAGE_SIZE);
+  const uint32_t next_unit_addr = prv_get_unit_base_address(next_page_addr);
+  if ((next_unit_addr == prv_get_unit_base_address(s_curr_state.page_start_addr)) ||
+      ((s_pre_erase.unit_addr == next_unit_addr) &&
+       (s_pre_erase.state != PreEraseState_Idle))) {
+    return;
+  }
+
+  s_pre_erase.unit_addr = next_unit_addr;
+  s_pre_erase.state = PreEraseState_Erasing;
+#if defined(CONFIG_BOARD_ASTERIX) || defined(CONFIG_BOARD_OBELIX) || defined(CONFIG_BOARD_GETAFIX) || defined(CONFIG_BOARD_QEMU_EMERY) || defined(CONFIG_BOARD_QEMU_FLINT) || defined(CONFIG_BOARD_QEMU_GABBRO)
+  flash_erase_subsector(next_unit_addr, prv_pre_erase_complete_cb,
+                        (void *)(uintptr_t)next_unit_addr);
+#else
+#error "Invalid platform!"
+#endif
+}
+
+//! Erases the unit at addr unless it was already erased ahead of time. An erase
+//! that is still in progress is polled to completion from here, as the timer
+//! which would otherwise poll it runs on the timer task, which may be the one
+//! logging or be waiting on it.
+static void prv_erase_unit_for_use(uint32_t addr) {
+  if (s_pre_erase.state == PreEraseState_Erasing) {
+    flash_erase_wait_for_completion();
+  }
+  const bool pre_erased = (s_pre_erase.unit_addr == addr) &&
+                          (s_pre_erase.state == PreEraseState_Erased);
+  s_pre_erase.state = PreEraseState_Idle;
+  if (!pre_erased) {
+    prv_erase_unit(addr);
+  }
+}
+
+//! Erases the unit holding a free page that is about to be used if a power loss
+//! left part of a page header in it
+static void prv_prepare_free_page(uint32_t page_addr) {
+  FlashLoggingHeader hdr;
+  flash_read_bytes((uint8_t *)&hdr, page_addr, sizeof(hdr));
+  FlashLoggingHeader erased_hdr;
+  memset(&erased_hdr, 0xff, sizeof(erased_hdr));
+  if (memcmp(&erased_hdr, &hdr, sizeof(hdr)) != 0) {
+    prv_erase_unit(prv_get_unit_base_address(page_addr));
+  }
+}
+
 static void prv_format_flash_logging_region(void) {
   uint32_t sector_addr;
   for (sector_addr = FLASH_REGION_DEBUG_DB_BEGIN;
@@ -202,11 +337,11 @@ static uint32_t prv_validate_flash_log_region(uint8_t *first_log_file_id) {
     FlashLoggingHeader hdr;
     flash_read_bytes((uint8_t *)&hdr, flash_addr, sizeof(hdr));
 
-    if (!prv_flash_log_valid(&hdr)) { // is the region erased ?
-      FlashLoggingHeader erased_hdr;
-      memset(&erased_hdr, 0xff, sizeof(erased_hdr));
-      bool region_erased = (memcmp(&erased_hdr, &hdr, sizeof(hdr)) == 0);
-      if (!region_erased) { // unrecognized format, erase everything
+    if (!prv_flash_log_valid(&hdr)) { // is the region free ?
+      // A page whose header never got all of its magic programmed is free, if
+      // not erased
+      bool region_free = ((hdr.magic & LOG_MAGIC) == LOG_MAGIC) && (hdr.magic != LOG_MAGIC);
+      if (!region_free) { // unrecognized format, erase everything
         prv_format_flash_logging_region();
         return (UINT32_MAX); // no region in use after formatting
       }
@@ -284,8 +419,120 @@ static void prv_allocate_page_for_use(void) {
   const uint8_t *build_id = version_get_build_id(&len);
   memcpy(hdr.build_id, build_id, sizeof(hdr.build_id));
 
+  // The magic goes last so a page whose header was cut short by a power loss
+  // still reads as free rather than as an unrecognized format
+  hdr.magic = LOG_MAGIC_PAGE_FREE;
   flash_write_bytes((uint8_t *)&hdr, s_curr_state.page_start_addr, sizeof(hdr));
+  hdr.magic = LOG_MAGIC;
+  flash_write_bytes((uint8_t *)&hdr.magic, s_curr_state.page_start_addr, sizeof(hdr.magic));
   s_curr_state.offset_in_log_page = sizeof(hdr);
+  s_curr_state.page_record_count = 0;
+}
+
+static uint32_t prv_page_summary_crc(const LogPageSummary *summary) {
+  return crc32(CRC32_INIT, summary, offsetof(LogPageSummary, crc));
+}
+
+//! Programs the summary of the current page, which has no room for another record
+static void prv_write_page_summary(void) {
+  LogPageSummary summary = {
+    .magic = LOG_PAGE_SUMMARY_MAGIC,
+    .record_count = s_curr_state.page_record_count,
+    .end_offset = s_curr_state.offset_in_log_page,
+    .first_timestamp = s_curr_state.page_first_timestamp,
+    .last_timestamp = rtc_get_time(),
+  };
+  summary.crc = prv_page_summary_crc(&summary);
+  flash_write_bytes((uint8_t *)&summary, s_curr_state.page_start_addr + LOG_PAGE_DATA_END,
+                    sizeof(summary));
+}
+
+//! @return true if the page at page_addr has an intact summary, which is read into summary
+static bool prv_read_page_summary(uint32_t page_addr, LogPageSummary *summary) {
+  flash_read_bytes((uint8_t *)summary, page_addr + LOG_PAGE_DATA_END, sizeof(*summary));
+  return (summary->magic == LOG_PAGE_SUMMARY_MAGIC) &&
+         (summary->crc == prv_page_summary_crc(summary)) &&
+         (summary->end_offset >= sizeof(FlashLoggingHeader)) &&
+         (summary->end_offset <= LOG_PAGE_DATA_END);
+}
+
+static void prv_stage_reset(void) {
+  s_stage = (LogStage) {};
+  memset(s_stage.buf, 0xff, sizeof(s_stage.buf));
+}
+
+//! Programs the complete records in the stage and keeps the one still being written, if any
+static void prv_stage_flush(void) {
+  const uint16_t len = s_stage.committed_len;
+  if (len == 0) {
+    return;
+  }
+
+  // First pass: everything but the valid flags
+  uint8_t valid_records[LOG_STAGE_SIZE / sizeof(LogRecordHeader) / 8] = {};
+  uint16_t first_valid = len;
+  uint16_t last_valid = 0;
+  for (uint16_t off = 0, i = 0; off < len;
+       off += sizeof(LogRecordHeader) + ((LogRecordHeader *)&s_stage.buf[off])->length, i++) {
+    LogRecordHeader *hdr = (LogRecordHeader *)&s_stage.buf[off];
+    if ((~hdr->flags & LOG_FLAGS_VALID) != 0) {
+      valid_records[i / 8] |= (1 << (i % 8));
+      hdr->flags = 0xff;
+      first_valid = MIN(first_valid, off);
+      last_valid = off;
+    }
+  }
+  flash_write_bytes(s_stage.buf, s_stage.flash_addr, len);
+
+  // Second pass: the flags alone. Programming the erased bytes in between is a no-op.
+  if (first_valid < len) {
+    for (uint16_t off = 0, i = 0; off < len; i++) {
+      const uint16_t next = off + sizeof(LogRecordHeader) +
+                            ((LogRecordHeader *)&s_stage.buf[off])->length;
+      memset(&s_stage.buf[off], 0xff, next - off);
+      if (valid_records[i / 8] & (1 << (i % 8))) {
+        s_stage.buf[off] = ~(LOG_FLAGS_VALID);
+      }
+      off = next;
+    }
+    flash_write_bytes(&s_stage.buf[first_valid], s_stage.flash_addr + first_valid,
+                      last_valid - first_valid + 1);
+  }
+
+  // Move the record still being written, if any, to the front
+  const uint16_t remaining = s_stage.len - len;
+  memmove(s_stage.buf, &s_stage.buf[len], remaining);
+  memset(&s_stage.buf[remaining], 0xff, sizeof(s_stage.buf) - remaining);
+  s_stage.flash_addr += len;
+  s_stage.len = remaining;
+  s_stage.committed_len = 0;
+  s_stage.record_offset = (remaining > 0) ? (s_stage.record_offset - len) : 0;
+}
+
+//! Reserves room in the stage for a record of the given length at addr and stages its header
+static void prv_stage_begin_record(uint32_t addr, uint8_t msg_length) {
+  const uint16_t rec_size = sizeof(LogRecordHeader) + msg_length;
+  if (s_stage.len + rec_size > LOG_STAGE_SIZE) {
+    prv_stage_flush();
+  }
+  if (s_stage.len == 0) {
+    s_stage.flash_addr = addr;
+  }
+  PBL_ASSERTN(s_stage.flash_addr + s_stage.len == addr);
+
+  s_stage.record_offset = s_stage.len;
+  LogRecordHeader *hdr = (LogRecordHeader *)&s_stage.buf[s_stage.record_offset];
+  hdr->length = msg_length;
+  s_stage.len += rec_size;
+}
+
+void flash_logging_begin_batch(void) {
+  s_stage.batching = true;
+}
+
+void flash_logging_flush(void) {
+  s_stage.batching = false;
+  prv_stage_flush();
 }
 
 void flash_logging_set_enabled(bool enabled) {
@@ -294,12 +541,15 @@ void flash_logging_set_enabled(bool enabled) {
 
 void flash_logging_init(void) {
   s_curr_state = (CurrentLoggingState){};
+  prv_stage_reset();
+  s_pre_erase.state = PreEraseState_Idle;
 
   uint8_t prev_log_id = 0;
   uint32_t first_used_region = prv_validate_flash_log_region(&prev_log_id);
 
   if (first_used_region == UINT32_MAX) { // no logs exist so start at region 0
     s_curr_state.page_start_addr = FLASH_REGION_DEBUG_DB_BEGIN;
+    prv_prepare_free_page(s_curr_state.page_start_addr);
     goto done;
   }
 
@@ -326,6 +576,8 @@ void flash_logging_init(void) {
 
       // we have found a page to use, but we need to erase the contents first
       prv_erase_unit(prv_get_unit_base_address(flash_addr));
+    } else {
+      prv_prepare_free_page(flash_addr);
     }
 
     s_curr_state.log_file_id = prv_get_next_log_file_id(prev_log_id);
@@ -353,21 +605,6 @@ done: // we have allocated a region to be used
   flash_logging_set_enabled(true);
 }
 
-//! Writes the log record header to flash and advances the
-//! s_curr_state.offset_in_log_page field
-//!
-//! @param msg_length - the length of the message to be written
-static void prv_write_flash_log_record_header(uint8_t msg_length) {
-  LogRecordHeader record_hdr;
-  memset((uint8_t *)&record_hdr, 0xff, sizeof(record_hdr));
-
-  record_hdr.length = msg_length;
-
-  uint32_t addr = s_curr_state.page_start_addr + s_curr_state.offset_in_log_page;
-  flash_write_bytes((uint8_t *)&record_hdr, addr, sizeof(record_hdr));
-  s_curr_state.offset_in_log_page += sizeof(record_hdr);
-}
-
 uint32_t flash_logging_log_start(uint8_t msg_length) {
   if ((msg_length == 0) || (msg_length > MAX_MSG_LEN) ||
       !s_flash_logging_enabled) {
@@ -375,22 +612,26 @@ uint32_t flash_logging_log_start(uint8_t msg_length) {
   }
 
   // bytes_remaining should always be 0, but if for some reason this gets called
-  // again, just skip onto the next record spot
+  // again, just skip onto the next record spot. The abandoned record is
+  // programmed without its valid flag.
   s_curr_state.offset_in_log_page += s_curr_state.bytes_remaining;
+  s_stage.committed_len = s_stage.len;
 
   uint32_t payload_size = sizeof(LogRecordHeader) + msg_length;
-  if ((s_curr_state.offset_in_log_page + payload_size) <= LOG_PAGE_SIZE) {
+  if ((s_curr_state.offset_in_log_page + payload_size) <= LOG_PAGE_DATA_END) {
     goto done; // there is enough space in the current page
   }
 
   // out of space, mark end of page
+  prv_stage_flush();
+  prv_write_page_summary();
   uint32_t new_flash_addr = prv_get_page_addr(s_curr_state.page_start_addr,
       LOG_PAGE_SIZE);
 
   uint32_t curr_sector = s_curr_state.page_start_addr / ERASE_UNIT_SIZE;
   uint32_t new_sector = new_flash_addr / ERASE_UNIT_SIZE;
   if (curr_sector != new_sector) { // have we crossed into a new erase region ?
-    prv_erase_unit(prv_get_unit_base_address(new_flash_addr));
+    prv_erase_unit_for_use(prv_get_unit_base_address(new_flash_addr));
   }
 
   s_curr_state.page_start_addr = new_flash_addr;
@@ -400,8 +641,13 @@ done:
   s_curr_state.log_start_addr = s_curr_state.offset_in_log_page +
       s_curr_state.page_start_addr;
   s_curr_state.bytes_remaining = msg_length;
+  if (s_curr_state.page_record_count++ == 0) {
+    s_curr_state.page_first_timestamp = rtc_get_time();
+  }
 
-  prv_write_flash_log_record_header(msg_length);
+  prv_stage_begin_record(s_curr_state.log_start_addr, msg_length);
+  s_curr_state.offset_in_log_page += sizeof(LogRecordHeader);
+  prv_pre_erase_next_unit_if_due();
   return (s_curr_state.log_start_addr);
 }
 
@@ -413,101 +659,128 @@ bool flash_logging_write(const uint8_t *data_to_write, uint32_t flash_addr,
   }
 
   uint32_t addr = s_curr_state.page_start_addr + s_curr_state.offset_in_log_page;
-  flash_write_bytes(data_to_write, addr, read_length);
+  memcpy(&s_stage.buf[addr - s_stage.flash_addr], data_to_write, read_length);
 
   s_curr_state.offset_in_log_page += read_length;
   s_curr_state.bytes_remaining -= read_length;
 
   if (s_curr_state.bytes_remaining == 0) {
     // we are done with the current log record, mark it valid
-    uint8_t flags = ~(LOG_FLAGS_VALID);
-    flash_write_bytes((uint8_t *)&flags, s_curr_state.log_start_addr,
-        sizeof(flags));
+    s_stage.buf[s_stage.record_offset] = ~(LOG_FLAGS_VALID);
+    s_stage.committed_len = s_stage.len;
+    if (!s_stage.batching) {
+      prv_stage_flush();
+    }
   }
 
   return (true);
 }
 
-// Extract the next log message out of flash and send it using the DumpLineCallback.
-// This system task callback is used by flash_dump_log_file()
-static void prv_dump_log_system_cb(void *context) {
-  DumpStatus status = DumpStatus_DoneFailure;
-  DumpLogState *state = (DumpLogState *)context;
+static uint32_t prv_dump_page_addr(const DumpLogState *state) {
+  return prv_get_page_addr(state->log_start_addr, state->page_index * LOG_PAGE_SIZE);
+}
 
-  // Get the start address of the current page
-  uint32_t flash_addr = prv_get_page_addr(state->log_start_addr, state->page_index * LOG_PAGE_SIZE);
-
-  if (!state->sent_build_id) {
-    // dump header data first
-
-    // use the read buffer to also hold build id str. Each byte of the build ID requires 2
-    // characters.
-    const int off = MEMBER_SIZE(DumpLogState, msg_buf)
-                    - 2 * MEMBER_SIZE(FlashLoggingHeader, build_id) - 1;
-    uint8_t build_id[MEMBER_SIZE(FlashLoggingHeader, build_id)];
-    uint32_t build_id_addr = flash_addr + offsetof(FlashLoggingHeader, build_id);
-
-    flash_read_bytes((uint8_t *)build_id, build_id_addr, sizeof(build_id));
-    byte_stream_to_hex_string((char *)&state->msg_buf[off], MAX_MSG_LEN - off, (uint8_t *)build_id,
-                              sizeof(build_id), false);
-    int len = pbl_log_get_bin_format((char *)state->msg_buf, MAX_MSG_LEN, LOG_LEVEL_INFO, "", 0,
-                                     "Build ID: %s", &state->msg_buf[off]);
-
-    if (!state->line_cb(state->msg_buf, len)) {
-      // Failed to send, if we expired our retry count, fail
-      if (++state->retry_count >= DUMP_LOG_MAX_RETRIES) {
-        goto exit;
-      }
-    } else {
-      // Go into reading the log messages now.
-      state->sent_build_id = true;
-      state->retry_count = 0;
-      state->page_offset = sizeof(FlashLoggingHeader);
+//! Sets the dump up to start on the page at state->page_index or, if that page and the ones after
+//! it filled up before state->since_utc, on the first page that didn't
+static void prv_dump_start_page(DumpLogState *state) {
+  state->page_offset = sizeof(FlashLoggingHeader);
+  for (; state->page_index < state->num_pages; state->page_index++) {
+    LogPageSummary summary;
+    if (!prv_read_page_summary(prv_dump_page_addr(state), &summary)) {
+      // Fall back to scanning records until one marks the end of the page
+      state->page_end = LOG_PAGE_SIZE;
+      return;
+    }
+    if ((time_t)summary.last_timestamp >= state->since_utc) {
+      state->page_end = summary.end_offset;
+      return;
     }
-    status = DumpStatus_InProgress;
-    goto exit;
   }
+}
 
-  // Read next log message and send it out
-  LogRecordHeader rec;
-  flash_read_bytes((uint8_t *)&rec, flash_addr + state->page_offset, sizeof(rec));
-  bool page_done = false;
-  if ((rec.length > MAX_MSG_LEN) || (rec.length == 0)) {
-    // The record contents indicate the end of a page
-    page_done = true;
-
+static DumpStatus prv_dump_build_id(DumpLogState *state) {
+  // use the read buffer to also hold build id str. Each byte of the build ID requires 2
+  // characters.
+  const int off = MEMBER_SIZE(DumpLogState, msg_buf)
+                  - 2 * MEMBER_SIZE(FlashLoggingHeader, build_id) - 1;
+  uint8_t build_id[MEMBER_SIZE(FlashLoggingHeader, build_id)];
+  // The first page of the log holds it even if we aren't dumping its messages
+  uint32_t build_id_addr = prv_get_page_addr(state->log_start_addr, 0) +
+                           offsetof(FlashLoggingHeader, build_id);
+
+  flash_read_bytes((uint8_t *)build_id, build_id_addr, sizeof(build_id));
+  byte_stream_to_hex_string((char *)&state->msg_buf[off], MAX_MSG_LEN - off, (uint8_t *)build_id,
+                            sizeof(build_id), false);
+  int len = pbl_log_get_bin_format((char *)state->msg_buf, MAX_MSG_LEN, LOG_LEVEL_INFO, "", 0,
+                                   "Build ID: %s", &state->msg_buf[off]);
+
+  if (!state->line_cb(state->msg_buf, len)) {
+    // Failed to send, if we expired our retry count, fail
+    if (++state->retry_count >= DUMP_LOG_MAX_RETRIES) {
+      return DumpStatus_DoneFailure;
+    }
   } else {
-    // This record has data, read it out
+    // Go into reading the log messages now.
+    state->sent_build_id = true;
+    state->retry_count = 0;
+  }
+  return DumpStatus_InProgress;
+}
+
+//! Sends log messages using the DumpLineCallback until we run out of time or messages
+static DumpStatus prv_dump_records(DumpLogState *state) {
+  const RtcTicks deadline = rtc_get_ticks() + (DUMP_LOG_TIME_BUDGET_MS * RTC_TICKS_HZ) / 1000;
+  do {
+    if (state->page_index >= state->num_pages) {
+      return DumpStatus_DoneSuccess;
+    }
+    const uint32_t flash_addr = prv_dump_page_addr(state);
+
+    // Read next log message and send it out
+    LogRecordHeader rec;
+    bool page_done = (state->page_offset + sizeof(rec) >= state->page_end);
+    if (!page_done) {
+      flash_read_bytes((uint8_t *)&rec, flash_addr + state->page_offset, sizeof(rec));
+      // The record contents indicate the end of a page
+      page_done = (rec.length > MAX_MSG_LEN) || (rec.length == 0) ||
+                  (state->page_offset + sizeof(rec) + rec.length > state->page_end);
+    }
+
+    // If we're done with this page, onto the next
+    if (page_done) {
+      state->page_index++;
+      prv_dump_start_page(state);
+      PBL_LOG_DBG("Dumping page %d of %d", state->page_index, state->num_pages-1);
+      continue;
+    }
+
     if ((~rec.flags & LOG_FLAGS_VALID) != 0) {
       // read data and execute callback to dump data
       flash_read_bytes(state->msg_buf, flash_addr + state->page_offset + sizeof(rec), rec.length);
       if (!state->line_cb(state->msg_buf, rec.length)) {
-        if (++state->retry_count >= DUMP_LOG_MAX_RETRIES) {
-          goto exit;
-        }
+        // Give the receiver some time and retry this message from the next callback
+        return (++state->retry_count >= DUMP_LOG_MAX_RETRIES) ? DumpStatus_DoneFailure
+                                                               : DumpStatus_InProgress;
       }
     }
 
     // Onto the next record
-    status = DumpStatus_InProgress;
     state->retry_count = 0;
     state->page_offset += rec.length + sizeof(rec);
-  }
+  } while (rtc_get_ticks() < deadline);
 
+  return DumpStatus_InProgress;
+}
 
-  // If we're done with this page, onto the next
-  if (page_done || state->page_offset + sizeof(LogRecordHeader) >= LOG_PAGE_SIZE) {
-    state->page_index++;
-    state->page_offset = sizeof(FlashLoggingHeader);
-    if (state->page_index >= state->num_pages) {
-      status = DumpStatus_DoneSuccess;
-    } else {
-      status = DumpStatus_InProgress;
-      PBL_LOG_DBG("Dumping page %d of %d", state->page_index, state->num_pages-1);
-    }
-  }
+// Extract log messages out of flash and send them using the DumpLineCallback.
+// This system task callback is used by flash_dump_log_file_since()
+static void prv_dump_log_system_cb(void *context) {
+  DumpLogState *state = (DumpLogState *)context;
+
+  // dump header data first
+  const DumpStatus status = state->sent_build_id ? prv_dump_records(state)
+                                                 : prv_dump_build_id(state);
 
-exit:
   if (status == DumpStatus_DoneFailure || status == DumpStatus_DoneSuccess) {
     state->completed_cb(status == DumpStatus_DoneSuccess);
     kernel_free(state);
@@ -520,6 +793,11 @@ exit:
 
 bool flash_dump_log_file(int generation, DumpLineCallback line_cb,
                          DumpCompletedCallback completed_cb) {
+  return flash_dump_log_file_since(generation, 0, line_cb, completed_cb);
+}
+
+bool flash_dump_log_file_since(int generation, time_t since_utc, DumpLineCallback line_cb,
+                               DumpCompletedCallback completed_cb) {
   uint8_t log_file_id = generation_to_log_file_id(generation);
 
   uint32_t log_start_addr;
@@ -538,11 +816,13 @@ bool flash_dump_log_file(int generation, DumpLineCallback line_cb,
     .log_start_addr = log_start_addr,
     .page_index = 0,
     .num_pages = num_log_pages,
-    .page_offset = sizeof(FlashLoggingHeader),
+    .since_utc = since_utc,
     .line_cb = line_cb,
     .completed_cb = completed_cb,
   };
 
+  prv_dump_start_page(state);
+
   // Kick it off
   system_task_add_callback(prv_dump_log_system_cb, state);
   return (true);
@@ -550,9 +830,9 @@ bool flash_dump_log_file(int generation, DumpLineCallback line_cb,
 
 //! For unit tests
 void test_flash_logging_get_info(uint32_t *tot_size, uint32_t *erase_unit_size,
-    uint32_t *chunk_size, uint32_t *page_hdr_size) {
+    uint32_t *chunk_size, uint32_t *page_overhead) {
   *tot_size = LOG_REGION_SIZE;
   *erase_unit_size = ERASE_UNIT_SIZE;
   *chunk_size = LOG_PAGE_SIZE;
-  *page_hdr_size = sizeof(FlashLoggingHeader);
+  *page_overhead = sizeof(FlashLoggingHeader) + sizeof(LogPageSummary);
 }
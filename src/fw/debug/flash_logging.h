@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include "util/time/time.h"
+
 #include <inttypes.h>
 #include <stdbool.h>
 
@@ -28,6 +30,16 @@ uint32_t flash_logging_log_start(uint8_t msg_length);
 bool flash_logging_write(const uint8_t *data_to_write, uint32_t flash_addr,
     uint32_t data_length);
 
+//! Holds complete log messages in RAM instead of programming each one as soon
+//! as it is written, until flash_logging_flush() is called. Messages are still
+//! programmed whenever the RAM stage fills up or the log moves to a new page.
+void flash_logging_begin_batch(void);
+
+//! Programs every complete log message that is still held in RAM and ends the
+//! batch started by flash_logging_begin_batch(). Also called on the way to a
+//! reset after a software failure so the last messages make it to flash.
+void flash_logging_flush(void);
+
 //! Allows a user to disable/enable flash logging after flash_logging_init()
 //! has been called.
 void flash_logging_set_enabled(bool enabled);
@@ -50,3 +62,13 @@ typedef void (*DumpCompletedCallback)(bool success);
 //! @return True if the log generation existed
 bool flash_dump_log_file(int generation, DumpLineCallback line_cb,
                          DumpCompletedCallback completed_cb);
+
+//! Like flash_dump_log_file() but skips the pages of the generation that filled up before
+//! since_utc, going by the summary each page gets once it is full. Messages are only filtered
+//! page by page, so some of the ones sent may be older than since_utc.
+//!
+//! @param since_utc - The UTC time to dump messages from. 0 dumps the whole generation.
+//!
+//! @return True if the log generation existed
+bool flash_dump_log_file_since(int generation, time_t since_utc, DumpLineCallback line_cb,
+                               DumpCompletedCallback completed_cb);
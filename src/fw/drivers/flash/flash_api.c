@@ -236,6 +236,11 @@ static uint32_t prv_flash_erase_start(uint32_t addr,
 // completed callback before returning 0.
 static uint32_t prv_flash_erase_poll(void) {
   mutex_lock(s_flash_lock);
+  if (!s_erase.in_progress) {
+    // Another task polled the erase to completion first
+    mutex_unlock(s_flash_lock);
+    return 0;
+  }
   status_t status = flash_impl_get_erase_status();
   bool erase_finished;
   struct FlashEraseContext saved_ctx = s_erase;
@@ -305,11 +310,10 @@ static void prv_blocking_erase_complete(void *context, status_t status) {
   PBL_ASSERT(PASSED(status), "Flash erase failure: %" PRId32, status);
 }
 
-static void prv_flash_erase_blocking(uint32_t sector_addr, bool is_subsector) {
+// Polls the erase in progress from the calling task until it completes
+static void prv_flash_erase_wait(uint32_t remaining_ms) {
   uint32_t total_time_spent_waiting_ms = 0;
 
-  uint32_t remaining_ms = prv_flash_erase_start(
-      sector_addr, prv_blocking_erase_complete, NULL, is_subsector, 0);
   while (remaining_ms) {
     psleep(remaining_ms);
     total_time_spent_waiting_ms += remaining_ms;
@@ -353,6 +357,12 @@ static void prv_flash_erase_blocking(uint32_t sector_addr, bool is_subsector) {
   }
 }
 
+static void prv_flash_erase_blocking(uint32_t sector_addr, bool is_subsector) {
+  uint32_t remaining_ms = prv_flash_erase_start(
+      sector_addr, prv_blocking_erase_complete, NULL, is_subsector, 0);
+  prv_flash_erase_wait(remaining_ms);
+}
+
 void flash_erase_sector(uint32_t sector_addr,
                         FlashOperationCompleteCb on_complete_cb,
                         void *context) {
@@ -373,6 +383,20 @@ void flash_erase_subsector_blocking(uint32_t subsector_addr) {
   prv_flash_erase_blocking(subsector_addr, true /* is_subsector */);
 }
 
+void flash_erase_wait_for_completion(void) {
+  if ((pebble_task_get_current() == PebbleTask_NewTimers) &&
+      (new_timer_debug_get_current_callback() == prv_flash_erase_timer_cb)) {
+    // Called from the poll itself, which completes the erase once this returns
+    return;
+  }
+  // The poll timer runs on the timer task, which may be the caller or be waiting on it, so stop
+  // it and poll from here instead. If its callback is running right now, let that poll finish.
+  while (!new_timer_stop(s_erase_poll_timer)) {
+    psleep(1);
+  }
+  prv_flash_erase_wait(prv_flash_erase_poll());
+}
+
 void flash_enable_write_protection(void) {
   flash_impl_enable_write_protection();
 }
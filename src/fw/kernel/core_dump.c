@@ -21,6 +21,7 @@ extern char *itoa(int value, char *str, int base);
 
 #include "kernel/core_dump.h"
 #include "kernel/core_dump_private.h"
+#include "kernel/core_dump_writer.h"
 
 #include "console/dbgserial.h"
 #include "logging/logging_private.h"
@@ -84,7 +85,6 @@ void cd_flash_read_bytes(void* buffer_ptr, uint32_t start_addr, uint32_t buffer_
 // ----------------------------------------------------------------------------------------
 // Private globals
 
-static uint32_t s_flash_addr;                   // next address in flash to write to
 // Saved registers before we trigger our interrupt: [r0-r12, sp, lr, pc, xpsr]
 static ALIGN(4) CoreDumpSavedRegisters s_saved_registers;
 static uint32_t s_time_stamp;
@@ -400,54 +400,21 @@ static void prvTaskInfoCallback( const xPORT_TASK_INFO * const task_info, void *
     }
   }
 
-  // Write out this thread info
+  // Write out this thread info. Flush it right away in case the next thread's structures are
+  // corrupted and fault.
   chunk_hdr.key = CORE_DUMP_CHUNK_KEY_THREAD;
   chunk_hdr.size = sizeof(packed_info);
-  s_flash_addr += prv_flash_write_bytes(&chunk_hdr, s_flash_addr,
-                                        sizeof(chunk_hdr));
-  s_flash_addr += prv_flash_write_bytes(&packed_info, s_flash_addr,
-                                        chunk_hdr.size);
+  core_dump_writer_write(&chunk_hdr, sizeof(chunk_hdr));
+  core_dump_writer_write(&packed_info, chunk_hdr.size);
+  core_dump_writer_flush();
 }
 
-static void prv_write_memory_regions(const MemoryRegion *regions, unsigned int count,
-                                     uint32_t flash_base) {
-  CoreDumpChunkHeader chunk_hdr;
-  chunk_hdr.key = CORE_DUMP_CHUNK_KEY_MEMORY;
-
+static void prv_write_memory_regions(const MemoryRegion *regions, unsigned int count) {
   for (unsigned int i = 0; i < count; i++) {
-    chunk_hdr.size = regions[i].length + sizeof(CoreDumpMemoryHeader);
-    CD_ASSERTN(s_flash_addr + chunk_hdr.size - flash_base < CORE_DUMP_MAX_SIZE);
-    s_flash_addr += prv_flash_write_bytes(&chunk_hdr, s_flash_addr,
-                                          sizeof(chunk_hdr));
-    CoreDumpMemoryHeader mem_hdr;
-    mem_hdr.start = (uint32_t)regions[i].start;
-    s_flash_addr += prv_flash_write_bytes(&mem_hdr, s_flash_addr,
-                                          sizeof(mem_hdr));
-
-    if (regions[i].word_reads_only) {
-      // Copy the memory into a temporary buffer before writing it to flash so
-      // that we can be sure that the memory is only being accessed by word.
-      uint32_t temp;
-      for (uint32_t offset = 0;
-           offset < regions[i].length;
-           offset += sizeof(temp)) {
-        temp = *(volatile uint32_t*)((char *)regions[i].start + offset);
-        s_flash_addr += prv_flash_write_bytes(&temp, s_flash_addr,
-                                              sizeof(temp));
-        watchdog_feed();
-      }
-    } else {
-      uint32_t bytes_remaining = regions[i].length;
-      for (uint32_t offset = 0; offset < regions[i].length; offset += SECTOR_SIZE_BYTES) {
-        uint32_t bytes_to_write = MIN(bytes_remaining, SECTOR_SIZE_BYTES);
-        s_flash_addr += prv_flash_write_bytes(
-            (void *) ((uint32_t)regions[i].start + offset),
-            s_flash_addr, bytes_to_write);
-        bytes_remaining -= bytes_to_write;
-        watchdog_feed();
-      }
-    }
+    core_dump_writer_write_memory(regions[i].start, regions[i].length,
+                                  regions[i].word_reads_only);
   }
+  core_dump_writer_flush();
 }
 
 #if defined(CONFIG_SOC_SF32LB52)
@@ -456,9 +423,9 @@ static void prv_write_memory_regions(const MemoryRegion *regions, unsigned int c
 // the LCPU to ack; if it is fully powered down this blocks until the watchdog
 // reboots us, costing only this dump. We reset right after, so the wake request
 // is never balanced.
-static void prv_dump_lcpu_ram(uint32_t flash_base) {
+static void prv_dump_lcpu_ram(void) {
   HAL_HPAON_WakeCore(CORE_ID_LCPU);
-  prv_write_memory_regions(&LCPU_MEMORY_REGION, 1, flash_base);
+  prv_write_memory_regions(&LCPU_MEMORY_REGION, 1);
 }
 #endif
 
@@ -637,27 +604,29 @@ EXTERNALLY_VISIBLE void core_dump_handler_c(void) {
   //              uint32_t registers[17]; // thread registers [r0-r12, sp, lr, pc, xpsr]
   //            }
   //
+  // Memory is stored run-length encoded, see CORE_DUMP_CHUNK_KEY_MEMORY_RLE.
+  //
 
   // Start at the core dump image header
-  s_flash_addr = flash_base + sizeof(CoreDumpFlashRegionHeader);
+  uint32_t flash_addr = flash_base + sizeof(CoreDumpFlashRegionHeader);
 
   // Write out the core dump header -----------------------------------
-  s_flash_addr += prv_write_image_header(s_flash_addr, CORE_ID_MAIN_MCU, &TINTIN_BUILD_ID,
-                                         s_time_stamp);
+  flash_addr += prv_write_image_header(flash_addr, CORE_ID_MAIN_MCU, &TINTIN_BUILD_ID,
+                                       s_time_stamp);
+
+  // Everything after the header is staged and programmed a page at a time
+  core_dump_writer_init(flash_addr, flash_base + CORE_DUMP_MAX_SIZE);
 
   // Write out the memory chunks ----------------------------------------
-  prv_write_memory_regions(MEMORY_REGIONS_DUMP, ARRAY_LENGTH(MEMORY_REGIONS_DUMP),
-                           flash_base);
+  prv_write_memory_regions(MEMORY_REGIONS_DUMP, ARRAY_LENGTH(MEMORY_REGIONS_DUMP));
 
   // Write out the extra registers chunk --------------------------------------------
   CoreDumpChunkHeader chunk_hdr;
   chunk_hdr.key = CORE_DUMP_CHUNK_KEY_EXTRA_REG;
   chunk_hdr.size = sizeof(CoreDumpExtraRegInfo);
-  CD_ASSERTN(s_flash_addr + chunk_hdr.size - flash_base < CORE_DUMP_MAX_SIZE);
-  s_flash_addr += prv_flash_write_bytes(&chunk_hdr, s_flash_addr,
-                                        sizeof(chunk_hdr));
-  s_flash_addr += prv_flash_write_bytes(&s_saved_registers.extra_reg,
-                                        s_flash_addr, chunk_hdr.size);
+  core_dump_writer_write(&chunk_hdr, sizeof(chunk_hdr));
+  core_dump_writer_write(&s_saved_registers.extra_reg, chunk_hdr.size);
+  core_dump_writer_flush();
 
   // Write out each of the thread chunks ----------------------------------
   // Note that we leave the threads for last just in case we encounter corrupted FreeRTOS structures.
@@ -681,17 +650,17 @@ EXTERNALLY_VISIBLE void core_dump_handler_c(void) {
 
 #if defined(CONFIG_SOC_SF32LB52)
   // Last: its read can hang/fault, so do it after the essential chunks are saved.
-  prv_dump_lcpu_ram(flash_base);
+  prv_dump_lcpu_ram();
 #endif
 
   // Write out chunk terminator
   chunk_hdr.key = CORE_DUMP_CHUNK_KEY_TERMINATOR;
   chunk_hdr.size = 0;
-  s_flash_addr += prv_flash_write_bytes(&chunk_hdr, s_flash_addr,
-                                        sizeof(chunk_hdr));
+  core_dump_writer_write(&chunk_hdr, sizeof(chunk_hdr));
+  core_dump_writer_flush();
 
   // Reset!
-  uint32_t total_size = s_flash_addr - flash_base;
+  uint32_t total_size = core_dump_writer_get_addr() - flash_base;
   prv_debug_str_int("CD: size (bytes) ", total_size, 10);
   prv_debug_str("CD: completed");
   prv_reset();
@@ -712,7 +681,8 @@ status_t core_dump_size(uint32_t flash_base, uint32_t *size) {
     } else if (chunk_hdr.key == CORE_DUMP_CHUNK_KEY_RAM
            || chunk_hdr.key == CORE_DUMP_CHUNK_KEY_THREAD
            || chunk_hdr.key == CORE_DUMP_CHUNK_KEY_EXTRA_REG
-           || chunk_hdr.key == CORE_DUMP_CHUNK_KEY_MEMORY) {
+           || chunk_hdr.key == CORE_DUMP_CHUNK_KEY_MEMORY
+           || chunk_hdr.key == CORE_DUMP_CHUNK_KEY_MEMORY_RLE) {
       current_offset += sizeof(chunk_hdr) + chunk_hdr.size;
     } else {
       return E_INTERNAL;
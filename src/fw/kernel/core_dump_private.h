@@ -87,7 +87,8 @@ typedef struct {
 // The first item in a core dump image is a CoreDumpImageHeader. That is followed by one or more
 // CoreDumpChunkHeader's, terminated by one with a key of CORE_DUMP_CHUNK_KEY_TERMINATOR
 #define CORE_DUMP_MAGIC                   0xF00DCAFE
-#define CORE_DUMP_VERSION                 1                   // Current version
+#define CORE_DUMP_VERSION                 2                   // Current version
+// Version 2 added CORE_DUMP_CHUNK_KEY_MEMORY_RLE
 typedef struct PACKED {
   uint32_t    magic;                // Set to CORE_DUMP_MAGIC
 
@@ -105,6 +106,7 @@ typedef struct PACKED {
 #define CORE_DUMP_CHUNK_KEY_THREAD        2
 #define CORE_DUMP_CHUNK_KEY_EXTRA_REG     3
 #define CORE_DUMP_CHUNK_KEY_MEMORY        4
+#define CORE_DUMP_CHUNK_KEY_MEMORY_RLE    5
 typedef struct PACKED {
   uint32_t    key;          // CORE_DUMP_CHUNK_KEY_.*
   uint32_t    size;
@@ -117,6 +119,14 @@ typedef struct PACKED {
   // uint8_t data[size - sizeof(CoreDumpMemoryHeader)];
 } CoreDumpMemoryHeader;
 
+// A CORE_DUMP_CHUNK_KEY_MEMORY_RLE chunk starts with a CoreDumpMemoryHeader too. The memory follows
+// as a series of records, each of them a uint32_t header followed by:
+//  - if CORE_DUMP_RLE_RUN is set, one uint32_t which repeats (header & CORE_DUMP_RLE_COUNT_MASK)
+//    times in memory
+//  - otherwise (header & CORE_DUMP_RLE_COUNT_MASK) uint32_t's which are copied as is
+#define CORE_DUMP_RLE_RUN                 0x80000000
+#define CORE_DUMP_RLE_COUNT_MASK          0x7FFFFFFF
+
 void coredump_assert(int line);
 #define CD_ASSERTN(expr) \
   do { \
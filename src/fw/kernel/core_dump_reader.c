@@ -0,0 +1,138 @@
+/* SPDX-FileCopyrightText: 2026 Core Devices LLC */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include "kernel/core_dump_reader.h"
+#include "kernel/core_dump_private.h"
+
+#include <pbl/drivers/flash.h>
+
+#include "pbl/util/math.h"
+
+typedef struct {
+  uint32_t length; // bytes of memory the record holds
+  uint32_t size; // bytes the record takes in flash
+  bool run;
+} RleRecord;
+
+static bool prv_read_record(const CoreDumpMemoryReader *reader, uint32_t record_addr,
+                            RleRecord *record) {
+  const uint32_t data_end = reader->data_addr + reader->data_size;
+  if (data_end - record_addr < sizeof(uint32_t)) {
+    return false;
+  }
+  uint32_t record_hdr;
+  flash_read_bytes((uint8_t *)&record_hdr, record_addr, sizeof(record_hdr));
+  const uint32_t count = record_hdr & CORE_DUMP_RLE_COUNT_MASK;
+  if ((count == 0) || (count > (UINT32_MAX - sizeof(uint32_t)) / sizeof(uint32_t))) {
+    return false;
+  }
+  *record = (RleRecord) {
+    .length = count * sizeof(uint32_t),
+    .run = (record_hdr & CORE_DUMP_RLE_RUN),
+  };
+  record->size = sizeof(record_hdr) + (record->run ? sizeof(uint32_t) : record->length);
+  return (record->size <= data_end - record_addr);
+}
+
+static bool prv_index_records(CoreDumpMemoryReader *reader) {
+  const uint32_t data_end = reader->data_addr + reader->data_size;
+  RleRecord record;
+
+  // Find out how much memory the records hold first so that the index can be spread over it
+  uint32_t length = 0;
+  for (uint32_t record_addr = reader->data_addr; record_addr < data_end;
+       record_addr += record.size) {
+    if (!prv_read_record(reader, record_addr, &record) ||
+        (record.length > UINT32_MAX - length)) {
+      return false;
+    }
+    length += record.length;
+  }
+  reader->length = length;
+  reader->index_stride = MAX(DIVIDE_CEIL(length, CORE_DUMP_READER_INDEX_SIZE), 1);
+
+  uint32_t offset = 0;
+  uint32_t next_entry = 0;
+  for (uint32_t record_addr = reader->data_addr; record_addr < data_end;
+       record_addr += record.size) {
+    prv_read_record(reader, record_addr, &record);
+    while (next_entry * reader->index_stride < offset + record.length) {
+      reader->index[next_entry++] = (CoreDumpReaderIndexEntry) {
+        .record_addr = record_addr,
+        .offset = offset,
+      };
+    }
+    offset += record.length;
+  }
+  return true;
+}
+
+bool core_dump_reader_init(CoreDumpMemoryReader *reader, uint32_t chunk_addr) {
+  CoreDumpChunkHeader chunk_hdr;
+  flash_read_bytes((uint8_t *)&chunk_hdr, chunk_addr, sizeof(chunk_hdr));
+  if (((chunk_hdr.key != CORE_DUMP_CHUNK_KEY_MEMORY) &&
+       (chunk_hdr.key != CORE_DUMP_CHUNK_KEY_MEMORY_RLE)) ||
+      (chunk_hdr.size < sizeof(CoreDumpMemoryHeader))) {
+    return false;
+  }
+  CoreDumpMemoryHeader mem_hdr;
+  flash_read_bytes((uint8_t *)&mem_hdr, chunk_addr + sizeof(chunk_hdr), sizeof(mem_hdr));
+
+  *reader = (CoreDumpMemoryReader) {
+    .start = mem_hdr.start,
+    .data_addr = chunk_addr + sizeof(chunk_hdr) + sizeof(mem_hdr),
+    .data_size = chunk_hdr.size - sizeof(mem_hdr),
+    .rle = (chunk_hdr.key == CORE_DUMP_CHUNK_KEY_MEMORY_RLE),
+  };
+  if (!reader->rle) {
+    reader->length = reader->data_size;
+    return true;
+  }
+  return prv_index_records(reader);
+}
+
+bool core_dump_reader_read(const CoreDumpMemoryReader *reader, uint32_t addr, void *buf,
+                           uint32_t length) {
+  if ((addr < reader->start) || (length > reader->length) ||
+      (addr - reader->start > reader->length - length)) {
+    return false;
+  }
+  uint32_t offset = addr - reader->start;
+  uint8_t *out = buf;
+  if (!reader->rle) {
+    flash_read_bytes(out, reader->data_addr + offset, length);
+    return true;
+  }
+  if (length == 0) {
+    return true;
+  }
+
+  const CoreDumpReaderIndexEntry *entry = &reader->index[offset / reader->index_stride];
+  uint32_t record_addr = entry->record_addr;
+  uint32_t record_offset = entry->offset;
+  while (length) {
+    RleRecord record;
+    if (!prv_read_record(reader, record_addr, &record)) {
+      return false;
+    }
+    if (offset < record_offset + record.length) {
+      const uint32_t offset_in_record = offset - record_offset;
+      const uint32_t bytes_to_copy = MIN(length, record.length - offset_in_record);
+      if (record.run) {
+        uint8_t value[sizeof(uint32_t)];
+        flash_read_bytes(value, record_addr + sizeof(uint32_t), sizeof(value));
+        for (uint32_t i = 0; i < bytes_to_copy; i++) {
+          out[i] = value[(offset_in_record + i) % sizeof(value)];
+        }
+      } else {
+        flash_read_bytes(out, record_addr + sizeof(uint32_t) + offset_in_record, bytes_to_copy);
+      }
+      out += bytes_to_copy;
+      offset += bytes_to_copy;
+      length -= bytes_to_copy;
+    }
+    record_offset += record.length;
+    record_addr += record.size;
+  }
+  return true;
+}
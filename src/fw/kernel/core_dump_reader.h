@@ -0,0 +1,39 @@
+/* SPDX-FileCopyrightText: 2026 Core Devices LLC */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Reads memory back out of a CORE_DUMP_CHUNK_KEY_MEMORY or CORE_DUMP_CHUNK_KEY_MEMORY_RLE chunk
+//! of a core dump image in flash, at any address the chunk holds. The records of a run-length
+//! encoded chunk are walked once up front to index where the memory they hold is in flash, so
+//! reads don't have to walk the chunk from its start.
+
+#define CORE_DUMP_READER_INDEX_SIZE (64)
+
+typedef struct {
+  uint32_t record_addr; //!< flash address of a record
+  uint32_t offset; //!< offset in the memory of the first byte the record holds
+} CoreDumpReaderIndexEntry;
+
+typedef struct {
+  uint32_t start; //!< address of the first byte of memory held
+  uint32_t length; //!< bytes of memory held
+  uint32_t data_addr; //!< flash address of the data following the CoreDumpMemoryHeader
+  uint32_t data_size; //!< bytes of data in flash
+  bool rle;
+  //! Entry i is the record holding the byte at offset i * index_stride
+  uint32_t index_stride;
+  CoreDumpReaderIndexEntry index[CORE_DUMP_READER_INDEX_SIZE];
+} CoreDumpMemoryReader;
+
+//! @param chunk_addr flash address of the chunk's CoreDumpChunkHeader
+//! @return false if the chunk doesn't hold memory or its records are corrupt
+bool core_dump_reader_init(CoreDumpMemoryReader *reader, uint32_t chunk_addr);
+
+//! Copies length bytes of the memory held starting at addr into buf
+//! @return false if the chunk doesn't hold all of them
+bool core_dump_reader_read(const CoreDumpMemoryReader *reader, uint32_t addr, void *buf,
+                           uint32_t length);
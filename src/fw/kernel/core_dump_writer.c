@@ -0,0 +1,222 @@
+/* SPDX-FileCopyrightText: 2026 Core Devices LLC */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include "kernel/core_dump_writer.h"
+#include "kernel/core_dump_private.h"
+
+#include <pbl/drivers/watchdog.h>
+
+#include "pbl/util/math.h"
+#include "pbl/util/size.h"
+
+#include <stddef.h>
+#include <string.h>
+
+uint32_t cd_flash_write_bytes(const void* buffer_ptr, uint32_t start_addr, uint32_t buffer_size);
+
+//! Page size of all of our SPI flash parts. Programming a page takes as long as programming a
+//! word of it, so nothing is programmed until a page has been filled.
+#define WRITE_PAGE_SIZE (256)
+
+//! A run record takes two words, so shorter runs are cheaper to leave in a literal record
+#define RLE_MIN_RUN_WORDS (3)
+#define RLE_MAX_LITERAL_WORDS (32)
+
+//! How much smaller than the memory its records must be for a region to be run-length encoded.
+//! A word of the writer's buffers which changes between the dry run and the real encode can split
+//! a run in two around a literal record, which takes four words more, so this is four times the
+//! size of the buffers.
+#define RLE_SIZE_MARGIN (4 * (WRITE_PAGE_SIZE + RLE_MAX_LITERAL_WORDS * sizeof(uint32_t)))
+
+static uint32_t s_flash_addr;                   // next address in flash to write to
+static uint32_t s_flash_end;
+
+//! Staged data, which ends at s_flash_addr and never crosses a page boundary
+static uint8_t s_page_buffer[WRITE_PAGE_SIZE];
+static uint32_t s_page_buffer_length;
+
+//! When set, records are only counted in s_encoded_size rather than written out
+static bool s_dry_run;
+static uint32_t s_encoded_size;
+
+//! Words waiting to be written out as a literal record
+static uint32_t s_literals[RLE_MAX_LITERAL_WORDS];
+static uint32_t s_num_literals;
+//! The last word read and how many times in a row it was read
+static uint32_t s_run_value;
+static uint32_t s_run_length;
+
+void core_dump_writer_init(uint32_t flash_addr, uint32_t flash_end) {
+  s_flash_addr = flash_addr;
+  s_flash_end = flash_end;
+  s_page_buffer_length = 0;
+  s_dry_run = false;
+  s_num_literals = 0;
+  s_run_length = 0;
+}
+
+uint32_t core_dump_writer_get_addr(void) {
+  return s_flash_addr;
+}
+
+void core_dump_writer_flush(void) {
+  if (s_page_buffer_length == 0) {
+    return;
+  }
+  cd_flash_write_bytes(s_page_buffer, s_flash_addr - s_page_buffer_length,
+                       s_page_buffer_length);
+  s_page_buffer_length = 0;
+  watchdog_feed();
+}
+
+void core_dump_writer_write(const void *data, uint32_t length) {
+  CD_ASSERTN(s_flash_addr + length <= s_flash_end);
+
+  const uint8_t *bytes = data;
+  while (length) {
+    const uint32_t page_remaining = WRITE_PAGE_SIZE - (s_flash_addr % WRITE_PAGE_SIZE);
+    const uint32_t bytes_to_stage = MIN(length, page_remaining);
+    memcpy(&s_page_buffer[s_page_buffer_length], bytes, bytes_to_stage);
+    s_page_buffer_length += bytes_to_stage;
+    s_flash_addr += bytes_to_stage;
+    bytes += bytes_to_stage;
+    length -= bytes_to_stage;
+
+    if (bytes_to_stage == page_remaining) {
+      core_dump_writer_flush();
+    }
+  }
+}
+
+//! Overwrites bytes which were already appended as all ones
+static void prv_patch(uint32_t flash_addr, const void *data, uint32_t length) {
+  const uint32_t staged_addr = s_flash_addr - s_page_buffer_length;
+  if (flash_addr >= staged_addr) {
+    memcpy(&s_page_buffer[flash_addr - staged_addr], data, length);
+  } else {
+    // Programming all ones left the flash erased, so it can still be programmed. Any part of the
+    // patch which is still staged is all ones too and won't undo it when it is flushed.
+    cd_flash_write_bytes(data, flash_addr, length);
+  }
+}
+
+static void prv_write_record(const void *data, uint32_t length) {
+  if (s_dry_run) {
+    s_encoded_size += length;
+  } else {
+    core_dump_writer_write(data, length);
+  }
+}
+
+static void prv_flush_literals(void) {
+  if (s_num_literals == 0) {
+    return;
+  }
+  const uint32_t record_hdr = s_num_literals;
+  prv_write_record(&record_hdr, sizeof(record_hdr));
+  prv_write_record(s_literals, s_num_literals * sizeof(s_literals[0]));
+  s_num_literals = 0;
+}
+
+static void prv_end_run(void) {
+  if (s_run_length >= RLE_MIN_RUN_WORDS) {
+    prv_flush_literals();
+    const uint32_t record[] = { CORE_DUMP_RLE_RUN | s_run_length, s_run_value };
+    prv_write_record(record, sizeof(record));
+  } else {
+    for (uint32_t i = 0; i < s_run_length; i++) {
+      s_literals[s_num_literals++] = s_run_value;
+      if (s_num_literals == ARRAY_LENGTH(s_literals)) {
+        prv_flush_literals();
+      }
+    }
+  }
+  s_run_length = 0;
+}
+
+static void prv_encode_word(uint32_t word) {
+  if (s_run_length > 0 && word == s_run_value) {
+    s_run_length++;
+    return;
+  }
+  prv_end_run();
+  s_run_value = word;
+  s_run_length = 1;
+}
+
+static void prv_encode_memory(const volatile uint32_t *words, uint32_t num_words) {
+  for (uint32_t i = 0; i < num_words; i++) {
+    prv_encode_word(words[i]);
+  }
+  prv_end_run();
+  prv_flush_literals();
+}
+
+//! @return how many bytes of records the memory encodes to
+static uint32_t prv_encoded_size(const volatile uint32_t *words, uint32_t num_words) {
+  s_dry_run = true;
+  s_encoded_size = 0;
+  prv_encode_memory(words, num_words);
+  s_dry_run = false;
+  return s_encoded_size;
+}
+
+static void prv_write_raw_memory(const void *start, uint32_t length, bool word_reads_only) {
+  CoreDumpChunkHeader chunk_hdr = {
+    .key = CORE_DUMP_CHUNK_KEY_MEMORY,
+    .size = length + sizeof(CoreDumpMemoryHeader),
+  };
+  CoreDumpMemoryHeader mem_hdr = {
+    .start = (uint32_t)(uintptr_t)start,
+  };
+  core_dump_writer_write(&chunk_hdr, sizeof(chunk_hdr));
+  core_dump_writer_write(&mem_hdr, sizeof(mem_hdr));
+  if (!word_reads_only) {
+    core_dump_writer_write(start, length);
+    return;
+  }
+  // Copy a word at a time so that the memory is only ever accessed by word
+  const volatile uint32_t *words = start;
+  for (uint32_t i = 0; i < length / sizeof(uint32_t); i++) {
+    const uint32_t word = words[i];
+    core_dump_writer_write(&word, sizeof(word));
+  }
+}
+
+void core_dump_writer_write_memory(const void *start, uint32_t length, bool word_reads_only) {
+  if (((uintptr_t)start % sizeof(uint32_t)) || (length % sizeof(uint32_t))) {
+    CD_ASSERTN(!word_reads_only);
+    prv_write_raw_memory(start, length, word_reads_only);
+    return;
+  }
+
+  // Reading peripheral registers twice may have side effects, so those are only read once and
+  // stored as is. Anything else is encoded once to find out whether the records would be smaller
+  // than the memory itself. The dry run and the real encode read live memory, which can include
+  // the writer's own buffers and stack, so the records can come out bigger the second time. Leave
+  // room for those buffers changing so that in practice a chunk doesn't take more room than the
+  // memory it holds. This isn't guaranteed; the end of the slot still bounds what is written.
+  const volatile uint32_t *words = start;
+  const uint32_t num_words = length / sizeof(uint32_t);
+  if (word_reads_only || (prv_encoded_size(words, num_words) + RLE_SIZE_MARGIN >= length)) {
+    prv_write_raw_memory(start, length, word_reads_only);
+    return;
+  }
+
+  // The writer's own state and stack may be part of the memory being dumped, so the records can
+  // come out a few bytes different from the dry run. Leave the size erased until they're written.
+  const uint32_t chunk_hdr_addr = s_flash_addr;
+  CoreDumpChunkHeader chunk_hdr = {
+    .key = CORE_DUMP_CHUNK_KEY_MEMORY_RLE,
+    .size = UINT32_MAX,
+  };
+  CoreDumpMemoryHeader mem_hdr = {
+    .start = (uint32_t)(uintptr_t)start,
+  };
+  core_dump_writer_write(&chunk_hdr, sizeof(chunk_hdr));
+  core_dump_writer_write(&mem_hdr, sizeof(mem_hdr));
+  prv_encode_memory(words, num_words);
+
+  const uint32_t size = s_flash_addr - chunk_hdr_addr - sizeof(chunk_hdr);
+  prv_patch(chunk_hdr_addr + offsetof(CoreDumpChunkHeader, size), &size, sizeof(size));
+}
@@ -0,0 +1,28 @@
+/* SPDX-FileCopyrightText: 2026 Core Devices LLC */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Appends to the core dump image from the core dump handler. Data is staged in RAM and flash is
+//! programmed a page at a time with the core dump flash driver.
+
+//! Start appending at flash_addr. Appending past flash_end is a core dump assert.
+void core_dump_writer_init(uint32_t flash_addr, uint32_t flash_end);
+
+void core_dump_writer_write(const void *data, uint32_t length);
+
+//! Appends a chunk holding a region of memory. Regions made of whole words which encode to
+//! clearly fewer bytes than they hold are stored as a CORE_DUMP_CHUNK_KEY_MEMORY_RLE chunk,
+//! anything else is stored as is in a CORE_DUMP_CHUNK_KEY_MEMORY chunk. Use core_dump_reader to
+//! read either kind back.
+//! @param word_reads_only the region can only be read 32 bits at a time
+void core_dump_writer_write_memory(const void *start, uint32_t length, bool word_reads_only);
+
+//! Programs whatever is still staged
+void core_dump_writer_flush(void);
+
+//! @return the flash address the next byte will be appended at
+uint32_t core_dump_writer_get_addr(void);
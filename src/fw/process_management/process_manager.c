@@ -29,6 +29,7 @@
 #include "pbl/services/app_cache.h"
 #include "pbl/services/data_logging/data_logging_service.h"
 #include "pbl/services/persist.h"
+#include "pbl/services/timeline/timeline.h"
 #include "pbl/services/voice/voice.h"
 #include "shell/normal/watchface.h"
 
@@ -552,6 +553,7 @@ void process_manager_process_cleanup(PebbleTask task) {
   dls_inactivate_sessions(task);
 
   if (task == PebbleTask_App) {
+    timeline_process_cleanup();
   }
 #endif // CONFIG_RECOVERY_FW
 
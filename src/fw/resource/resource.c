@@ -15,6 +15,8 @@
 #include <pbl/logging/logging.h>
 #include "system/passert.h"
 
+#include <string.h>
+
 // TODO: this may be replaced once apps become more dynamic
 
 typedef struct {
@@ -27,15 +29,82 @@ PebbleRecursiveMutex *s_resource_mutex = NULL;
 
 static CachedResource *s_resource_list = NULL;
 
-// Last-resolved app resource; invalidated in resource_init_app().
+// Recently resolved resources of both the system and app banks. Resolving a resource re-reads
+// the manifest and table entry from flash or PFS, which adds up on the glyph and bitmap hot path
+// when an app alternates between a few fonts or images. Entries only hold offsets, so they
+// survive GC, but they have to be dropped whenever a bank is replaced.
+#define RESOURCE_CACHE_SETS 4
+#define RESOURCE_CACHE_WAYS 4
+
 typedef struct {
   bool valid;
   ResAppNum app_num;
   uint32_t id;
   ResourceStoreEntry entry;
-} AppResourceCache;
+} ResourceCacheLine;
+
+// Each set is kept in most to least recently used order
+static ResourceCacheLine s_resource_cache[RESOURCE_CACHE_SETS][RESOURCE_CACHE_WAYS];
+
+static uint32_t s_resource_cache_hits;
+static uint32_t s_resource_cache_misses;
+
+static ResourceCacheLine *prv_cache_get_set(ResAppNum app_num, uint32_t id) {
+  return s_resource_cache[(app_num + id) % RESOURCE_CACHE_SETS];
+}
+
+//! Moves the line at the given way of the set to the front, making it the most recently used
+static void prv_cache_move_to_front(ResourceCacheLine *set, int way, const ResourceCacheLine *line) {
+  memmove(&set[1], &set[0], way * sizeof(*set));
+  set[0] = *line;
+}
 
-static AppResourceCache s_app_resource_cache;
+static bool prv_cache_lookup(ResAppNum app_num, uint32_t id, ResourceStoreEntry *entry) {
+  ResourceCacheLine *set = prv_cache_get_set(app_num, id);
+  for (int way = 0; way < RESOURCE_CACHE_WAYS; way++) {
+    if (set[way].valid && set[way].app_num == app_num && set[way].id == id) {
+      const ResourceCacheLine line = set[way];
+      prv_cache_move_to_front(set, way, &line);
+      *entry = line.entry;
+      s_resource_cache_hits++;
+      return true;
+    }
+  }
+  s_resource_cache_misses++;
+  return false;
+}
+
+static void prv_cache_insert(ResAppNum app_num, uint32_t id, const ResourceStoreEntry *entry) {
+  // Files can be rewritten at any time (see resource_watch()), so only cache resources of banks
+  // that are replaced through resource_init_app() or resource_storage_clear()
+  if (entry->impl->type == ResourceStoreTypeFile) {
+    return;
+  }
+
+  ResourceCacheLine *set = prv_cache_get_set(app_num, id);
+  // Take the first free way, or evict the least recently used one
+  int way = 0;
+  while (way < RESOURCE_CACHE_WAYS - 1 && set[way].valid) {
+    way++;
+  }
+  const ResourceCacheLine line = {
+    .valid = true,
+    .app_num = app_num,
+    .id = id,
+    .entry = *entry,
+  };
+  prv_cache_move_to_front(set, way, &line);
+}
+
+static void prv_cache_invalidate(ResAppNum app_num) {
+  for (int set = 0; set < RESOURCE_CACHE_SETS; set++) {
+    for (int way = 0; way < RESOURCE_CACHE_WAYS; way++) {
+      if (s_resource_cache[set][way].app_num == app_num) {
+        s_resource_cache[set][way].valid = false;
+      }
+    }
+  }
+}
 
 static bool prv_resource_filter(ListNode *found_node, void *data) {
   CachedResource *resource = (CachedResource *)found_node;
@@ -60,22 +129,15 @@ static void prv_get_resource(ResAppNum app_num, uint32_t id, ResourceStoreEntry
     return;
   }
 
-  // App resource resolution re-reads the PFS manifest + table every call (costly
-  // on the glyph hot path). Cache the last one; it holds offsets, so it survives
-  // GC.
-  if (app_num != SYSTEM_APP && s_app_resource_cache.valid &&
-      s_app_resource_cache.app_num == app_num && s_app_resource_cache.id == id) {
-    *entry = s_app_resource_cache.entry;
+  if (prv_cache_lookup(app_num, id, entry)) {
     mutex_unlock_recursive(s_resource_mutex);
     return;
   }
 
   resource_storage_get_resource(app_num, id, entry);
 
-  if (app_num != SYSTEM_APP && entry->id >= 1) {
-    s_app_resource_cache = (AppResourceCache){
-      .valid = true, .app_num = app_num, .id = id, .entry = *entry,
-    };
+  if (entry->id >= 1) {
+    prv_cache_insert(app_num, id, entry);
   }
 
   mutex_unlock_recursive(s_resource_mutex);
@@ -86,7 +148,7 @@ bool resource_init_app(ResAppNum app_num, const ResourceVersion *expected_versio
   // resource_id is ignored in this case, so we set it to 0
   mutex_lock_recursive(s_resource_mutex);
   // Drop the cache: a reused app slot must not serve a stale entry.
-  s_app_resource_cache.valid = false;
+  prv_cache_invalidate(app_num);
   bool rv = resource_storage_check(app_num, 0, expected_version);
   mutex_unlock_recursive(s_resource_mutex);
   return rv;
@@ -95,10 +157,24 @@ bool resource_init_app(ResAppNum app_num, const ResourceVersion *expected_versio
 void resource_init(void) {
   // see if there's a system bank waiting to be loaded
   resource_storage_init();
+  memset(s_resource_cache, 0, sizeof(s_resource_cache));
 
   s_resource_mutex = mutex_create_recursive();
 }
 
+void resource_cache_invalidate(ResAppNum app_num) {
+  mutex_lock_recursive(s_resource_mutex);
+  prv_cache_invalidate(app_num);
+  mutex_unlock_recursive(s_resource_mutex);
+}
+
+#if UNITTEST
+void resource_cache_get_stats(uint32_t *hits, uint32_t *misses) {
+  *hits = s_resource_cache_hits;
+  *misses = s_resource_cache_misses;
+}
+#endif
+
 uint32_t resource_get_and_cache(ResAppNum app_num, uint32_t resource_id) {
   PBL_ASSERTN(app_num == SYSTEM_APP);
   // get from resource store
@@ -52,6 +52,11 @@ bool resource_is_valid(ResAppNum app_num, uint32_t resource_id);
 //! @internal
 uint32_t resource_get_and_cache(ResAppNum app_num, uint32_t resource_id);
 
+//! @internal
+//! Forget the resources of a bank that were looked up recently. Must be called whenever the
+//! bank is replaced or removed.
+void resource_cache_invalidate(ResAppNum app_num);
+
 //! @internal
 //! @param buffer[out] a buffer to load the data into. Must be at least max_length in bytes.
 //! @return Number of bytes actually read. Should be num_bytes for a successful read.
@@ -184,6 +184,8 @@ uint32_t resource_store_get_metadata_size(ResourceStoreEntry *entry) {
 }
 
 void resource_storage_clear(ResAppNum app_num) {
+  resource_cache_invalidate(app_num);
+
   ResourceStoreEntry entry;
   prv_get_store_entry(app_num, 0, &entry);
   if (entry.impl) {
@@ -5,10 +5,12 @@
 #include "resource_storage_file.h"
 
 #include "kernel/util/sleep.h"
+#include "pbl/services/filesystem/app_file.h"
 #include "pbl/services/filesystem/pfs.h"
 #include <pbl/logging/logging.h>
 
 #include <stdint.h>
+#include <string.h>
 
 extern const FileResourceData g_file_resource_stores[];
 extern const uint32_t g_num_file_resource_stores;
@@ -187,6 +189,137 @@ const ResourceStoreImplementation g_file_impl = {
 ///////////////////////////////////////////////////////////////////////////////
 // ResourceStoreTypeAppFile implementation
 
+// App banks that passed a full validation since they were installed. Validating a whole bank CRCs
+// every byte of it, which adds hundreds of milliseconds to every launch of an app with a large
+// bank. Once a bank has been validated, a small marker file is written next to it with the version
+// and file length it was validated with. Launching it again with the same file length and version,
+// even after a reboot, only checks each of its resources the first time it is loaded.
+//
+// The marker is an app file, so it goes away with the rest of the app's files. Clearing the bank,
+// which put_bytes also does before it installs a new one, removes it too. Writing or removing the
+// bank's file some other way while it is being tracked marks it stale, and the next launch removes
+// the marker and validates the bank in full.
+#define VALIDATED_APP_BANKS 4
+#define VALIDATED_MARKER_FILENAME_SUFFIX "resv"
+
+typedef struct PACKED {
+  ResourceVersion version;
+  uint32_t length;
+} ValidatedBankMarker;
+
+//! A validated bank that was launched since boot
+typedef struct {
+  bool valid;
+  //! The bank's file changed since it was validated
+  bool stale;
+  ResAppNum app_num;
+  ValidatedBankMarker marker;
+  PFSCallbackHandle watch_handle;
+  //! Resources checked since the bank was last launched, indexed by resource_id - 1
+  uint32_t checked[MAX_RESOURCES_PER_STORE / 32];
+} ValidatedAppBank;
+
+static ValidatedAppBank s_validated_banks[VALIDATED_APP_BANKS];
+static unsigned int s_next_validated_bank;
+
+static void prv_get_marker_file_name(char *name, size_t buf_length, ResAppNum app_num) {
+  app_file_name_make(name, buf_length, app_num, VALIDATED_MARKER_FILENAME_SUFFIX,
+                     strlen(VALIDATED_MARKER_FILENAME_SUFFIX));
+}
+
+static bool prv_marker_file_read(ResAppNum app_num, ValidatedBankMarker *marker_out) {
+  char filename[APP_RESOURCE_FILENAME_MAX_LENGTH + 1]; // extra for null terminator
+  prv_get_marker_file_name(filename, sizeof(filename), app_num);
+  const int fd = pfs_open(filename, OP_FLAG_READ, FILE_TYPE_STATIC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  const int rv = pfs_read(fd, marker_out, sizeof(*marker_out));
+  pfs_close(fd);
+  return (rv == sizeof(*marker_out));
+}
+
+static void prv_marker_file_write(ResAppNum app_num, const ValidatedBankMarker *marker) {
+  char filename[APP_RESOURCE_FILENAME_MAX_LENGTH + 1]; // extra for null terminator
+  prv_get_marker_file_name(filename, sizeof(filename), app_num);
+  const int fd = pfs_open(filename, OP_FLAG_WRITE, FILE_TYPE_STATIC, sizeof(*marker));
+  if (fd < 0) {
+    // Not fatal, the bank is just validated in full again on its next launch
+    PBL_LOG_WRN("Could not create resource marker file <%s>, fd: %d", filename, fd);
+    return;
+  }
+  pfs_write(fd, marker, sizeof(*marker));
+  pfs_close(fd);
+}
+
+static void prv_marker_file_remove(ResAppNum app_num) {
+  char filename[APP_RESOURCE_FILENAME_MAX_LENGTH + 1]; // extra for null terminator
+  prv_get_marker_file_name(filename, sizeof(filename), app_num);
+  pfs_remove(filename);
+}
+
+static void prv_validated_bank_file_changed(void *data) {
+  // Called with the PFS lock held, so only flag the bank here and remove its marker file on the
+  // next launch
+  ((ValidatedAppBank *)data)->stale = true;
+}
+
+static void prv_validated_bank_release(ValidatedAppBank *bank) {
+  if (bank->watch_handle) {
+    pfs_unwatch_file(bank->watch_handle);
+  }
+  *bank = (ValidatedAppBank) {0};
+}
+
+static ValidatedAppBank *prv_validated_bank_find(ResAppNum app_num) {
+  for (unsigned int i = 0; i < VALIDATED_APP_BANKS; i++) {
+    if (s_validated_banks[i].valid && s_validated_banks[i].app_num == app_num) {
+      return &s_validated_banks[i];
+    }
+  }
+  return NULL;
+}
+
+//! Forgets that the bank was ever validated, so its next launch validates it in full
+static void prv_validated_bank_drop(ResAppNum app_num) {
+  ValidatedAppBank *bank = prv_validated_bank_find(app_num);
+  if (bank) {
+    prv_validated_bank_release(bank);
+  }
+  prv_marker_file_remove(app_num);
+}
+
+//! Starts tracking a validated bank in RAM, without any of its resources checked yet
+static ValidatedAppBank *prv_validated_bank_track(ResAppNum app_num,
+                                                  const ValidatedBankMarker *marker) {
+  ValidatedAppBank *bank = prv_validated_bank_find(app_num);
+  if (!bank) {
+    // Take a free entry, or recycle the entries in the order they were handed out
+    for (unsigned int i = 0; i < VALIDATED_APP_BANKS; i++) {
+      if (!s_validated_banks[i].valid) {
+        bank = &s_validated_banks[i];
+        break;
+      }
+    }
+    if (!bank) {
+      bank = &s_validated_banks[s_next_validated_bank];
+      s_next_validated_bank = (s_next_validated_bank + 1) % VALIDATED_APP_BANKS;
+    }
+  }
+  prv_validated_bank_release(bank);
+
+  char filename[APP_RESOURCE_FILENAME_MAX_LENGTH + 1]; // extra for null terminator
+  resource_storage_get_file_name(filename, sizeof(filename), app_num);
+  *bank = (ValidatedAppBank) {
+    .valid = true,
+    .app_num = app_num,
+    .marker = *marker,
+  };
+  bank->watch_handle = pfs_watch_file(filename, prv_validated_bank_file_changed,
+                                      FILE_CHANGED_EVENT_ALL, bank);
+  return bank;
+}
+
 static int prv_app_file_open(ResourceStoreEntry *entry, uint8_t op_flags) {
   ResAppNum app_num = (ResAppNum)entry->store_data;
   if (app_num == SYSTEM_APP) {
@@ -213,11 +346,19 @@ static bool resource_storage_app_file_find_resource(ResourceStoreEntry *entry, R
   return true;
 }
 
+static void resource_storage_app_file_init(void) {
+  for (unsigned int i = 0; i < VALIDATED_APP_BANKS; i++) {
+    prv_validated_bank_release(&s_validated_banks[i]);
+  }
+  s_next_validated_bank = 0;
+}
+
 static void resource_storage_app_file_clear(ResourceStoreEntry *entry) {
   ResAppNum app_num = (ResAppNum)entry->store_data;
   if (app_num == SYSTEM_APP) {
     return;
   }
+  prv_validated_bank_drop(app_num);
   char filename[APP_RESOURCE_FILENAME_MAX_LENGTH + 1]; // extra for null terminator
   resource_storage_get_file_name(filename, sizeof(filename), app_num);
   pfs_remove(filename);
@@ -228,6 +369,69 @@ static uint32_t resource_storage_app_file_get_length(ResourceStoreEntry *entry)
   return prv_file_common_get_length_and_close(prv_app_file_open(entry, op_flags));
 }
 
+static bool resource_storage_app_file_check(ResAppNum app_num, uint32_t resource_id,
+                                            ResourceStoreEntry *entry,
+                                            const ResourceVersion *expected_version) {
+  if (resource_id != 0) {
+    return resource_storage_generic_check(app_num, resource_id, entry, expected_version);
+  }
+
+  const ValidatedBankMarker marker = {
+    .version = resource_storage_get_version(app_num, 0),
+    .length = resource_storage_app_file_get_length(entry),
+  };
+  ValidatedAppBank *bank = prv_validated_bank_find(app_num);
+  if (bank && bank->stale) {
+    prv_validated_bank_drop(app_num);
+    bank = NULL;
+  }
+  bool has_marker_file = (bank != NULL);
+  if (!bank) {
+    // First launch since boot, look for the marker left by an earlier validation
+    ValidatedBankMarker stored_marker;
+    has_marker_file = prv_marker_file_read(app_num, &stored_marker);
+    if (has_marker_file && (memcmp(&stored_marker, &marker, sizeof(marker)) == 0)) {
+      bank = prv_validated_bank_track(app_num, &marker);
+    }
+  }
+  if (bank && (memcmp(&bank->marker, &marker, sizeof(marker)) == 0)) {
+    if (expected_version && !resource_version_matches(&marker.version, expected_version)) {
+      return false;
+    }
+    // Check each resource again the first time it's loaded by this launch
+    memset(bank->checked, 0, sizeof(bank->checked));
+    return true;
+  }
+
+  if (has_marker_file) {
+    prv_validated_bank_drop(app_num);
+  }
+  if (!resource_storage_generic_check(app_num, 0, entry, expected_version)) {
+    return false;
+  }
+  bank = prv_validated_bank_track(app_num, &marker);
+  // The whole bank was just checked
+  memset(bank->checked, 0xff, sizeof(bank->checked));
+  prv_marker_file_write(app_num, &marker);
+  return true;
+}
+
+static bool resource_storage_app_file_get_resource(ResourceStoreEntry *entry) {
+  const ResAppNum app_num = (ResAppNum)entry->store_data;
+  ValidatedAppBank *bank = prv_validated_bank_find(app_num);
+  const uint32_t index = entry->id - 1;
+  if (bank && !bank->stale && (index < MAX_RESOURCES_PER_STORE) &&
+      !(bank->checked[index / 32] & (1u << (index % 32)))) {
+    if (!resource_storage_check(app_num, entry->id, NULL)) {
+      // The bank changed behind our back, make the next launch validate all of it
+      prv_validated_bank_drop(app_num);
+      return false;
+    }
+    bank->checked[index / 32] |= (1u << (index % 32));
+  }
+  return resource_storage_generic_get_resource(entry);
+}
+
 static uint32_t resource_storage_app_file_get_crc(ResourceStoreEntry *entry, uint32_t num_bytes,
                                                   uint32_t entry_offset) {
   const uint8_t op_flags = OP_FLAG_READ;
@@ -243,13 +447,13 @@ static uint32_t resource_storage_app_file_read(ResourceStoreEntry *entry, uint32
 const ResourceStoreImplementation g_app_file_impl = {
   .type = ResourceStoreTypeAppFile,
 
-  .init = resource_storage_generic_init,
+  .init = resource_storage_app_file_init,
   .clear = resource_storage_app_file_clear,
-  .check = resource_storage_generic_check,
+  .check = resource_storage_app_file_check,
 
   .metadata_size = resource_storage_generic_metadata_size,
   .find_resource = resource_storage_app_file_find_resource,
-  .get_resource = resource_storage_generic_get_resource,
+  .get_resource = resource_storage_app_file_get_resource,
 
   .get_length = resource_storage_app_file_get_length,
   .get_crc = resource_storage_app_file_get_crc,
@@ -301,16 +301,15 @@ static void prv_dispatch_data(bool post_event) {
       continue;
     }
 
-    // If buffer has room, read more data
-    uint32_t samples_drained = 0;
-    while (state->num_samples < state->samples_per_update) {
-      // Read available data.
-      AccelManagerBufferData data;
-      if (!shared_circular_buffer_read_subsampled(
-          &s_buffer, &state->buffer_client, sizeof(data), &data, 1)) {
-        // we have drained all available samples
-        break;
-      }
+    // If buffer has room, read as much data as fits in one go, copying only the AccelRawData
+    // of each sample. The whole of the first sample comes back too, for its timestamp.
+    if (state->num_samples < state->samples_per_update) {
+      const bool starts_batch = (state->num_samples == 0);
+      AccelManagerBufferData first;
+      const size_t samples_read = shared_circular_buffer_read_subsampled_batch(
+          &s_buffer, &state->buffer_client, sizeof(AccelManagerBufferData),
+          sizeof(AccelRawData), state->raw_buffer + state->num_samples,
+          state->samples_per_update - state->num_samples, starts_batch ? &first : NULL);
 
       // Note: the accel_service currently only buffers AccelRawData (i.e it
       // does not track the timestamp explicitly.) The accel service drains a
@@ -319,14 +318,10 @@ static void prv_dispatch_data(bool post_event) {
       // does. Therefore, we provide the real time for the first sample. In
       // the future, we could phase out legacy accel code and provide the
       // exact timestamp with every sample
-      if (state->num_samples == 0) {
-        state->timestamp_ms = s_last_empty_timestamp_ms + data.timestamp_delta_ms;
+      if (starts_batch && samples_read) {
+        state->timestamp_ms = s_last_empty_timestamp_ms + first.timestamp_delta_ms;
       }
-
-      memcpy(state->raw_buffer + state->num_samples, &data,
-             sizeof(AccelRawData));
-        state->num_samples++;
-        samples_drained++;
+      state->num_samples += samples_read;
     }
 
     // If buffer is full, notify subscriber to process it
@@ -532,6 +532,32 @@ static uint32_t prv_real_counts_from_raw(uint32_t raw) {
 }
 
 
+// -----------------------------------------------------------------------------------------
+// Twiddle factors for prv_fft_2radix_real(): sin_lookup(i * TRIG_MAX_ANGLE / KALG_FFT_WIDTH)
+// for the first quadrant. Every angle the transform needs is a multiple of
+// TRIG_MAX_ANGLE / KALG_FFT_WIDTH strictly inside the first quadrant, and its cosine is the sine
+// of the complementary entry. The values are exactly what sin_lookup() returns so the transform
+// is bit for bit the one that called it in the inner loop.
+static const uint16_t s_fft_sin_table[KALG_FFT_WIDTH / 4] = {
+  0, 3215, 6423, 9616, 12785, 15923, 19024, 22078,
+  25079, 28020, 30893, 33692, 36409, 39039, 41575, 44010,
+  46340, 48558, 50659, 52638, 54490, 56211, 57797, 59243,
+  60546, 61704, 62713, 63571, 64276, 64825, 65219, 65456,
+};
+
+// Bit reversal of the indices 0 to KALG_FFT_WIDTH - 1. Narrower transforms use the top bits.
+static const uint8_t s_fft_bit_reverse[KALG_FFT_WIDTH] = {
+  0, 64, 32, 96, 16, 80, 48, 112, 8, 72, 40, 104, 24, 88, 56, 120,
+  4, 68, 36, 100, 20, 84, 52, 116, 12, 76, 44, 108, 28, 92, 60, 124,
+  2, 66, 34, 98, 18, 82, 50, 114, 10, 74, 42, 106, 26, 90, 58, 122,
+  6, 70, 38, 102, 22, 86, 54, 118, 14, 78, 46, 110, 30, 94, 62, 126,
+  1, 65, 33, 97, 17, 81, 49, 113, 9, 73, 41, 105, 25, 89, 57, 121,
+  5, 69, 37, 101, 21, 85, 53, 117, 13, 77, 45, 109, 29, 93, 61, 125,
+  3, 67, 35, 99, 19, 83, 51, 115, 11, 75, 43, 107, 27, 91, 59, 123,
+  7, 71, 39, 103, 23, 87, 55, 119, 15, 79, 47, 111, 31, 95, 63, 127,
+};
+
+
 // -----------------------------------------------------------------------------------------
 // Real-valued, in-place, 2-radix Fourier transform
 //
@@ -543,10 +569,12 @@ static uint32_t prv_real_counts_from_raw(uint32_t raw) {
 //   descretization introduces some discrepancies between the results of this
 //   function and the floating point equivalents that are not important for its
 //   use here, but nonetheless documented in the accompaning Julia test code.
+//   The sin and cos values come from the tables above rather than from the
+//   lookup functions.
 //
 //   INPUT
 //     d = input signal array pointer
-//     width the width of d (must be a power of 2)
+//     width the width of d (must be a power of 2, no larger than KALG_FFT_WIDTH)
 //     width_log_2 the log base 2 of width: 2^width_log_2 = width
 //
 //   OUTPUT
@@ -554,23 +582,18 @@ static uint32_t prv_real_counts_from_raw(uint32_t raw) {
 //       [Re(0), Re(1),..., Re(N/2-1), Re(N/2), Im(N/2-1),..., Im(1)]
 //
 static void prv_fft_2radix_real(int16_t *d, int16_t width, int16_t width_log_2) {
+  PBL_ASSERTN(width <= KALG_FFT_WIDTH);
   int16_t n = width;
-  int16_t j = 1;
-  int16_t n1 = n -1;
-  int16_t k, dt;
+  int16_t dt;
 
-  for (int16_t i = 1; i <= n1; i++) {
+  const int16_t rev_shift = KALG_FFT_WIDTH_PWR_TWO - width_log_2;
+  for (int16_t i = 0; i < n; i++) {
+    const int16_t j = s_fft_bit_reverse[i] >> rev_shift;
     if (i < j) {
-      dt = d[j-1];
-      d[j-1] = d[i-1];
-      d[i-1] = dt;
+      dt = d[j];
+      d[j] = d[i];
+      d[i] = dt;
     }
-    k = n/2;
-    while (k < j) {
-      j = j - k;
-      k = k / 2;
-    }
-    j = j + k;
   }
 
   for (int16_t i = 1; i <= n; i += 2) {
@@ -579,33 +602,36 @@ static void prv_fft_2radix_real(int16_t *d, int16_t width, int16_t width_log_2)
     d[i] = dt - d[i];
   }
 
+  int16_t n1;
   int16_t n2 = 1;
   int16_t n4, i1, i2, i3, i4, t1, t2;
-  int32_t E, A, ss, cc;
+  int32_t ss, cc;
 
   for (int16_t k = 2; k <= width_log_2 ; k++) {
     n4 = n2;
     n2 = 2 * n4;
     n1 = 2 * n2;
-    E = TRIG_MAX_ANGLE / n1;
+    // Table steps between the angles TRIG_MAX_ANGLE / n1 apart
+    const int16_t stride = KALG_FFT_WIDTH / n1;
 
     for (int16_t i = 1; i<= n; i+=n1) {
       dt = d[i-1];
       d[i-1] = dt + d[i+n2-1];
       d[i+n2-1] = dt - d[i+n2-1];
       d[i+n4+n2-1] = -1 * d[i+n4+n2-1];
-      A = E;
+      int16_t a = stride;
       for (int16_t j = 1; j <= (n4-1); j++) {
         i1 = i + j;
         i2 = i - j + n2;
         i3 = i + j + n2;
         i4 = i - j + n1;
 
-        ss = sin_lookup(A);
-        cc = cos_lookup(A);
+        ss = s_fft_sin_table[a];
+        cc = s_fft_sin_table[ARRAY_LENGTH(s_fft_sin_table) - a];
 
-        A = A + E;
+        a += stride;
 
+        // Signed division by a constant power of two, which the compiler turns into shifts
         t1 = (int16_t) ((d[i3-1] * cc + d[i4-1] * ss) / TRIG_MAX_ANGLE);
         t2 = (int16_t) ((d[i3-1] * ss - d[i4-1] * cc) / TRIG_MAX_ANGLE);
 
@@ -619,6 +645,13 @@ static void prv_fft_2radix_real(int16_t *d, int16_t width, int16_t width_log_2)
 }
 
 
+#if UNITTEST
+void kalg_fft_2radix_real(int16_t *d, int16_t width, int16_t width_log_2) {
+  prv_fft_2radix_real(d, width, width_log_2);
+}
+#endif
+
+
 // -----------------------------------------------------------------------------------------
 // Evaluate the magnitude of the FFT coefficents and write back to the first width/2 elements
 // NOTE! this function modifies the input array in place
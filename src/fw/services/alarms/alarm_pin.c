@@ -6,6 +6,7 @@
 #include "apps/system_app_ids.h"
 #include "kernel/pbl_malloc.h"
 #include "pbl/services/i18n/i18n.h"
+#include "pbl/services/blob_db/api.h"
 #include "pbl/services/blob_db/pin_db.h"
 #include "pbl/services/timeline/attribute.h"
 #include "pbl/services/timeline/timeline.h"
@@ -57,7 +58,7 @@ void alarm_pin_add(time_t alarm_time, AlarmId id, AlarmType type, AlarmKind kind
   item->header.from_watch = true;
   item->header.parent_id = (Uuid)UUID_ALARMS_DATA_SOURCE;
 
-  pin_db_insert_item_without_event(item);
+  pin_db_insert_item(item);
 
   i18n_free_all(&pin_attr_list);
   i18n_free_all(&edit_attr_list);
@@ -74,5 +75,7 @@ void alarm_pin_add(time_t alarm_time, AlarmId id, AlarmType type, AlarmKind kind
 
 // ----------------------------------------------------------------------------------------------
 void alarm_pin_remove(Uuid *alarm_id) {
-  pin_db_delete((uint8_t *)alarm_id, sizeof(Uuid));
+  if (pin_db_delete((uint8_t *)alarm_id, sizeof(Uuid)) == S_SUCCESS) {
+    blob_db_event_put(BlobDBEventTypeDelete, BlobDBIdPins, (uint8_t *)alarm_id, sizeof(Uuid));
+  }
 }
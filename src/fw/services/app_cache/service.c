@@ -25,6 +25,8 @@
 #include "util/time/time.h"
 #include "util/units.h"
 
+#include <string.h>
+
 PBL_LOG_MODULE_DEFINE(service_app_cache, CONFIG_SERVICE_APP_CACHE_LOG_LEVEL);
 
 //! @file
@@ -45,6 +47,10 @@ PBL_LOG_MODULE_DEFINE(service_app_cache, CONFIG_SERVICE_APP_CACHE_LOG_LEVEL);
 //! It is assumed that there will ALWAYS be space for a single application of maximum size based
 //! on the platform. The only time when this isn't true is the time between "add_entry" and the
 //! callback to clean up the cache.
+//!
+//! A copy of every record's id, size and priority is kept in RAM (see AppCacheIndex) so that
+//! eviction decisions and size queries don't have to scan the settings file in flash. It is
+//! rebuilt from flash in app_cache_init and updated alongside every write to the file.
 
 #define APP_CACHE_FILE_NAME "appcache"
 
@@ -81,6 +87,28 @@ typedef struct {
   uint32_t priority;
 } EvictListNode;
 
+//! In-RAM summary of a single cache record
+typedef struct {
+  AppInstallId id;
+  uint32_t size;
+  uint32_t priority;
+} AppCacheIndexEntry;
+
+//! In-RAM copy of the cache records. Entries are kept in the order settings_file_each would visit
+//! the records: every write to a settings file appends a new record (and compaction preserves
+//! order), so an updated entry moves to the end. Keeping that order means ties are broken exactly
+//! like the flash scans used to break them.
+typedef struct {
+  AppCacheIndexEntry *entries;
+  uint16_t count;
+  uint16_t capacity;
+  uint32_t total_size;
+} AppCacheIndex;
+
+#define APP_CACHE_INDEX_MIN_CAPACITY (8)
+
+static AppCacheIndex s_index;
+
 typedef struct {
   EvictListNode *list;
   uint32_t bytes_needed;
@@ -164,27 +192,103 @@ static bool prv_is_in_list(AppInstallId id, const AppInstallId list[], uint8_t l
 }
 
 //////////////////////
-// Settings Helpers
+// Index Helpers
 //////////////////////
 
-//! Settings iterator function that finds the entry with the lowest calculated priority
-static bool prv_each_free_up_space(SettingsFile *file, SettingsRecordInfo *info, void *context) {
+static void prv_index_reset(void) {
+  kernel_free(s_index.entries);
+  s_index = (AppCacheIndex) { 0 };
+}
+
+static int prv_index_find(AppInstallId id) {
+  for (int i = 0; i < s_index.count; i++) {
+    if (s_index.entries[i].id == id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void prv_index_remove(AppInstallId id) {
+  const int idx = prv_index_find(id);
+  if (idx < 0) {
+    return;
+  }
+  s_index.total_size -= s_index.entries[idx].size;
+  s_index.count--;
+  memmove(&s_index.entries[idx], &s_index.entries[idx + 1],
+          (s_index.count - idx) * sizeof(AppCacheIndexEntry));
+}
+
+//! Record that the entry for id was just written to the settings file
+static void prv_index_put(AppInstallId id, AppCacheEntry *entry) {
+  prv_index_remove(id);
+
+  if (s_index.count == s_index.capacity) {
+    const uint16_t capacity = MAX(APP_CACHE_INDEX_MIN_CAPACITY, s_index.capacity * 2);
+    AppCacheIndexEntry *entries = kernel_malloc_check(capacity * sizeof(AppCacheIndexEntry));
+    if (s_index.entries) {
+      memcpy(entries, s_index.entries, s_index.count * sizeof(AppCacheIndexEntry));
+      kernel_free(s_index.entries);
+    }
+    s_index.entries = entries;
+    s_index.capacity = capacity;
+  }
+
+  s_index.entries[s_index.count++] = (AppCacheIndexEntry) {
+    .id = id,
+    .size = entry->total_size,
+    .priority = prv_calculate_priority(entry),
+  };
+  s_index.total_size += entry->total_size;
+}
+
+//! Settings iterator function that adds every record to the index
+static bool prv_each_build_index(SettingsFile *file, SettingsRecordInfo *info, void *context) {
+  if (info->val_len == 0) {
+    return true; // deleted record, continue iterating
+  }
+
   // check entry is valid
   if ((info->key_len != sizeof(AppInstallId)) || (info->val_len != sizeof(AppCacheEntry))) {
     PBL_LOG_WRN("Invalid cache entry with key_len: %u and val_len: %u, flushing",
             info->key_len, info->val_len);
-    system_task_add_callback(prv_delete_cache_callback, NULL);
+    *(bool *)context = false;
     return false; // stop iterating, delete the file and binaries
   }
 
-  EachEvictData *data = (EachEvictData *)context;
-
   AppInstallId id;
   AppCacheEntry entry;
 
   info->get_key(file, (uint8_t *)&id, info->key_len);
   info->get_val(file, (uint8_t *)&entry, info->val_len);
 
+  prv_index_put(id, &entry);
+
+  return true; // continue iterating
+}
+
+//! Rebuild the index from the settings file. Returns false if the file holds an invalid record.
+static bool prv_index_rebuild(void) {
+  prv_index_reset();
+
+  SettingsFile file;
+  if (settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE) != S_SUCCESS) {
+    return true;
+  }
+  bool valid = true;
+  settings_file_each(&file, prv_each_build_index, &valid);
+  settings_file_close(&file);
+
+  if (!valid) {
+    prv_index_reset();
+  }
+  return valid;
+}
+
+//! Adds an eviction candidate to the list, keeping only the lowest priority entries needed to
+//! free up the requested number of bytes
+static void prv_add_evict_candidate(EachEvictData *data, const AppCacheIndexEntry *entry) {
   // create node
   EvictListNode *node = kernel_malloc_check(sizeof(EvictListNode));
   list_init((ListNode *)node);
@@ -192,14 +296,14 @@ static bool prv_each_free_up_space(SettingsFile *file, SettingsRecordInfo *info,
   // give them an extremely high priority so that we only remove them if we really NEED to
   // This list contains defaults that we shouldn't be removing.
   uint32_t priority = 0;
-  if (prv_is_in_list(id, data->do_not_evict, DO_NOT_EVICT_LIST_SIZE)) {
+  if (prv_is_in_list(entry->id, data->do_not_evict, DO_NOT_EVICT_LIST_SIZE)) {
     priority = MAX_PRIORITY;
   }
 
   *node = (EvictListNode) {
-    .id = id,
-    .size = entry.total_size,
-    .priority = MAX(priority, prv_calculate_priority(&entry)),
+    .id = entry->id,
+    .size = entry->size,
+    .priority = MAX(priority, entry->priority),
   };
 
   data->list = (EvictListNode *)list_sorted_add((ListNode *)data->list, (ListNode *)node,
@@ -209,8 +313,6 @@ static bool prv_each_free_up_space(SettingsFile *file, SettingsRecordInfo *info,
   if (data->bytes_in_list > data->bytes_needed) {
     prv_trim_top_priorities(&data->list, &data->bytes_in_list, data->bytes_needed);
   }
-
-  return true; // continue iterating
 }
 
 //////////////////////////
@@ -239,9 +341,13 @@ status_t app_cache_app_launched(AppInstallId app_id) {
 
       rv = settings_file_set(&file, (uint8_t *)&app_id, sizeof(AppInstallId),
           (uint8_t *)&entry, sizeof(AppCacheEntry));
+      if (rv == S_SUCCESS) {
+        prv_index_put(app_id, &entry);
+      }
     } else {
       app_storage_delete_app(app_id);
       settings_file_delete(&file, (uint8_t *)&app_id, sizeof(AppInstallId));
+      prv_index_remove(app_id);
     }
 
     settings_file_close(&file);
@@ -258,15 +364,8 @@ status_t app_cache_free_up_space(uint32_t bytes_needed) {
     return E_INVALID_ARGUMENT;
   }
 
-  status_t rv;
   mutex_lock_recursive(s_app_cache_mutex);
   {
-    SettingsFile file;
-    rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
-    if (rv != S_SUCCESS) {
-      goto unlock;
-    }
-
     // we don't want to remove any default apps or quick launch apps, so keep them in a list.
     EachEvictData evict_data = (EachEvictData) {
       .bytes_needed = bytes_needed,
@@ -286,8 +385,9 @@ status_t app_cache_free_up_space(uint32_t bytes_needed) {
       },
     };
 
-    settings_file_each(&file, prv_each_free_up_space, &evict_data);
-    settings_file_close(&file);
+    for (int i = 0; i < s_index.count; i++) {
+      prv_add_evict_candidate(&evict_data, &s_index.entries[i]);
+    }
 
     // remove all nodes found
     EvictListNode *node = evict_data.list;
@@ -300,65 +400,40 @@ status_t app_cache_free_up_space(uint32_t bytes_needed) {
       kernel_free(temp);
     }
   }
-unlock:
   mutex_unlock_recursive(s_app_cache_mutex);
-  return rv;
+  return S_SUCCESS;
 }
 
 //////////////////////
 // AppCache Helpers
 //////////////////////
 
-// Remove the filename entry in the PFSFileList (via context) that corresponds to the
-// app install id passed in via info
-static bool prv_remove_matching_resource_file_callback(SettingsFile *file,
-                                                       SettingsRecordInfo *info,
-                                                       void *context) {
-  AppInstallId id;
-  // examine the SettingsRecordInfo and extract the AppInstallId from it
-  info->get_key(file, (uint8_t *)&id, info->key_len);
-  // the context passed in is really a pointer to the resource_list
-  PFSFileListEntry **resource_list = context;
+// Delete files from resource_list that don't correspond to entries in the app cache
+static void prv_app_cache_find_and_delete_orphans(PFSFileListEntry **resource_list) {
+  mutex_lock_recursive(s_app_cache_mutex);
+
+  // resource_list contains all of the resource files we found.  We only
+  // want to delete orphans so we can remove any entries from the list that correspond
+  // to items in the app cache...
   PFSFileListEntry *iter = *resource_list;
   while (iter) {
     // grab the next entry right now since we may delete the node we're looking at
     PFSFileListEntry *next = (PFSFileListEntry *)iter->list_node.next;
-    if (app_file_parse_app_id(iter->name) == id) {
-      // the AppInstallId of the file matches the one in the cache so we can remove this
+    if (prv_index_find(app_file_parse_app_id(iter->name)) >= 0) {
+      // the AppInstallId of the file matches one in the cache so we can remove this
       // entry from the resource_list (since we don't want to delete it)
       // note: resource_list may be updated if we happen to remove the first entry in the list
       list_remove(&(iter->list_node), (ListNode**)resource_list, NULL);
       kernel_free(iter);  // free up the memory for the node we just removed
-      break; // we can quit now that we've found a match for this id
     }
     iter = next;
   }
-  return true;
-}
-
-// Delete files from resource_list that don't correspond to entries in the app cache
-static void prv_app_cache_find_and_delete_orphans(PFSFileListEntry **resource_list) {
-  mutex_lock_recursive(s_app_cache_mutex);
-
-  SettingsFile file;
-  status_t rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
-  if (rv != S_SUCCESS) {
-    mutex_unlock_recursive(s_app_cache_mutex);
-    return;
-  }
-  // resource_list contains all of the resource files we found.  We only
-  // want to delete orphans so we can remove any entries from the list that correspond
-  // to items in the app cache...
-  // prv_remove_matching_resource_file_callback scans resource_list and removes the entry
-  // corresponding to the passed-in application's id
-  settings_file_each(&file, prv_remove_matching_resource_file_callback, resource_list);
-  settings_file_close(&file);
 
   mutex_unlock_recursive(s_app_cache_mutex);
 
   // resource_list now only contains filenames of resource files that don't have corresponding
   // entries in the app cache. We can safely delete these files.
-  PFSFileListEntry *iter = *resource_list;
+  iter = *resource_list;
   while (iter) {
     PBL_LOG_INFO("Orphaned resource file removed: %s", iter->name);
     pfs_remove(iter->name);
@@ -391,10 +466,15 @@ void app_cache_init(void) {
     // if no cache file exists, then we should go ahead and clean up any files that are left over
     int fd = pfs_open(APP_CACHE_FILE_NAME, OP_FLAG_READ, FILE_TYPE_STATIC, 0);
     if (fd < 0) {
+      prv_index_reset();
       prv_delete_cached_files();
       goto unlock;
     }
     pfs_close(fd);
+
+    if (!prv_index_rebuild()) {
+      system_task_add_callback(prv_delete_cache_callback, NULL);
+    }
   }
 
 unlock:
@@ -423,6 +503,9 @@ status_t app_cache_add_entry(AppInstallId app_id, uint32_t total_size) {
 
     rv = settings_file_set(&file, (uint8_t *)&app_id, sizeof(AppInstallId),
         (uint8_t *)&entry, sizeof(AppCacheEntry));
+    if (rv == S_SUCCESS) {
+      prv_index_put(app_id, &entry);
+    }
 
     settings_file_close(&file);
 
@@ -449,6 +532,7 @@ bool app_cache_entry_exists(AppInstallId app_id) {
 
     if (exists && !app_storage_app_exists(app_id)) {
       settings_file_delete(&file, (uint8_t *)&app_id, sizeof(AppInstallId));
+      prv_index_remove(app_id);
       exists = false;
     }
 
@@ -471,6 +555,7 @@ status_t app_cache_remove_entry(AppInstallId app_id) {
     }
 
     rv = settings_file_delete(&file, (uint8_t *)&app_id, sizeof(AppInstallId));
+    prv_index_remove(app_id);
     if (rv == S_SUCCESS) {
       // Will delete an app from the filesystem.
       app_storage_delete_app(app_id);
@@ -500,6 +585,7 @@ void app_cache_flush(void) {
   mutex_lock_recursive(s_app_cache_mutex);
   {
     pfs_remove(APP_CACHE_FILE_NAME);
+    prv_index_reset();
     prv_delete_cached_files();
   }
   mutex_unlock_recursive(s_app_cache_mutex);
@@ -509,88 +595,27 @@ void app_cache_flush(void) {
 // Testing only
 ////////////////////////////////
 
-static bool prv_each_get_size(SettingsFile *file, SettingsRecordInfo *info, void *context) {
-  if ((info->key_len != sizeof(AppInstallId)) || (info->val_len != sizeof(AppCacheEntry))) {
-    return true; // continue iterating
-  }
-
-  uint32_t *cache_size = (uint32_t *)context;
-  AppCacheEntry entry;
-  info->get_val(file, (uint8_t *)&entry, info->val_len);
-  *cache_size += entry.total_size;
-
-  return true; // continue iterating
-}
-
 uint32_t app_cache_get_size(void) {
-  uint32_t cache_size = 0;
   mutex_lock_recursive(s_app_cache_mutex);
-  {
-    SettingsFile file;
-    status_t rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
-    if (rv != S_SUCCESS) {
-      goto unlock;
-    }
-
-    settings_file_each(&file, prv_each_get_size, &cache_size);
-    settings_file_close(&file);
-  }
-unlock:
+  const uint32_t cache_size = s_index.total_size;
   mutex_unlock_recursive(s_app_cache_mutex);
   return cache_size;
 }
 
-typedef struct {
-  AppInstallId id;
-  uint32_t priority;
-} AppCacheEachData;
-
-//! Settings iterator function that finds the entry with the lowest calculated priority
-static bool prv_each_min_priority(SettingsFile *file, SettingsRecordInfo *info, void *context) {
-  // check entry is valid
-  if ((info->key_len != sizeof(AppInstallId)) || (info->val_len != sizeof(AppCacheEntry))) {
-    return true; // continue iterating
-  }
-
-  AppCacheEachData *to_evict = (AppCacheEachData *)context;
-
-  AppInstallId id;
-  AppCacheEntry entry;
-
-  info->get_key(file, (uint8_t *)&id, info->key_len);
-  info->get_val(file, (uint8_t *)&entry, info->val_len);
-
-  uint32_t entry_priority = prv_calculate_priority(&entry);
-  if (entry_priority < to_evict->priority) {
-    to_evict->id = id;
-    to_evict->priority = entry_priority;
-  }
-
-  return true; // continue iterating
-}
-
 //! Find the entry in the app cache with the lowest calculated priority
 AppInstallId app_cache_get_next_eviction(void) {
   AppInstallId ret_value = INSTALL_ID_INVALID;
   mutex_lock_recursive(s_app_cache_mutex);
   {
-    SettingsFile file;
-    status_t rv = settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE);
-    if (rv != S_SUCCESS) {
-      goto unlock;
-    }
-
     // set max so that any application will have a lower priority.
-    AppCacheEachData to_evict = {
-      .id = INSTALL_ID_INVALID,
-      .priority = MAX_PRIORITY,
-    };
-    settings_file_each(&file, prv_each_min_priority, (void *)&to_evict);
-
-    settings_file_close(&file);
-    ret_value = to_evict.id;
+    uint32_t min_priority = MAX_PRIORITY;
+    for (int i = 0; i < s_index.count; i++) {
+      if (s_index.entries[i].priority < min_priority) {
+        ret_value = s_index.entries[i].id;
+        min_priority = s_index.entries[i].priority;
+      }
+    }
   }
-unlock:
   mutex_unlock_recursive(s_app_cache_mutex);
   return ret_value;
 }
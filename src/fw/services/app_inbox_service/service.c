@@ -56,6 +56,8 @@ typedef struct AppInboxConsumerInfo {
   uint32_t num_success;
   uint8_t *it;
   uint8_t *end;
+  //! Set once every message of the batch has been passed to the message handler
+  bool is_batch_done;
 } AppInboxConsumerInfo;
 
 
@@ -202,7 +204,13 @@ static AppInboxNode *prv_find_inbox_by_tag_and_log_if_not_found(AppInboxServiceT
 //! Note that it's in theory possible for a misbehaving app to pass in a consumed_up_to_ptr that is
 //! mid-way in a message. If it does so, it won't crash the kernel, but it will result in delivery
 //! of broken messages to the app, but it won't be our fault...
+//! Messages are handed to the app in place, so space is only reclaimed once the whole batch has
+//! been handled. Compacting after every message would move all messages queued behind it to the
+//! front of the buffer again and again, while the app is still going to read them.
 static void prv_consume(AppInboxConsumerInfo *consumer_info) {
+  if (!consumer_info->is_batch_done) {
+    return;
+  }
   prv_lock();
   {
     AppInboxNode *inbox = prv_find_inbox_by_tag_and_log_if_not_found(consumer_info->tag);
@@ -317,6 +325,7 @@ static void prv_callback_event_handler(void *ctx) {
   }
 
   // Report back up to which byte we've consumed the data.
+  info.is_batch_done = true;
   sys_app_inbox_service_consume(&info);
 }
 
@@ -135,9 +135,9 @@ static void prv_handle_wb_write_response(const uint8_t *data,
 
   BlobDBSyncSession *sync_session = blob_db_sync_get_session_for_token(token);
   if (sync_session) {
-    if (response_code != BLOB_DB_SUCCESS) {
+    BlobDBDirtyItem *dirty_item = blob_db_sync_get_item_for_token(sync_session, token);
+    if (response_code != BLOB_DB_SUCCESS && dirty_item) {
       // Log rejected items but still mark synced to avoid spamming phone on every sync
-      BlobDBDirtyItem *dirty_item = sync_session->dirty_list;
       char key_str[32];
       int copy_len = (dirty_item->key_len < (int)sizeof(key_str) - 1) ?
                       dirty_item->key_len : (int)sizeof(key_str) - 1;
@@ -145,7 +145,7 @@ static void prv_handle_wb_write_response(const uint8_t *data,
       key_str[copy_len] = '\0';
       PBL_LOG_WRN("Writeback rejected: key=%s response=%d", key_str, response_code);
     }
-    blob_db_sync_next(sync_session);
+    blob_db_sync_next(sync_session, token);
   } else {
     // No session
     PBL_LOG_WRN("received blob db wb response with an invalid token: %d", token);
@@ -33,8 +33,13 @@ static TimelineItemStorage s_pin_db_storage;
 // Pin DB specific API
 /////////////////////////
 
+static void prv_handle_pin_removed(const Uuid *id) {
+  blob_db_event_put(BlobDBEventTypeDelete, BlobDBIdPins, (const uint8_t *)id, sizeof(*id));
+}
+
 status_t pin_db_delete_with_parent(const TimelineItemId *parent_id) {
-  return (timeline_item_storage_delete_with_parent(&s_pin_db_storage, parent_id, NULL));
+  return (timeline_item_storage_delete_with_parent(&s_pin_db_storage, parent_id,
+                                                   prv_handle_pin_removed));
 }
 
 //! Caution: CommonTimelineItemHeader .flags & .status are stored inverted and not auto-restored
@@ -146,8 +151,13 @@ status_t pin_db_insert_item_without_event(TimelineItem *item) {
   return prv_insert_item(item, false /* emit_event */);
 }
 status_t pin_db_set_status_bits(const TimelineItemId *id, uint8_t status) {
-  return timeline_item_storage_set_status_bits(&s_pin_db_storage, (uint8_t *)id, sizeof(*id),
-                                               status);
+  const status_t rv = timeline_item_storage_set_status_bits(&s_pin_db_storage, (uint8_t *)id,
+                                                            sizeof(*id), status);
+  if (rv == S_SUCCESS) {
+    // The pin changed, so anything holding a copy of it needs to hear about it
+    blob_db_event_put(BlobDBEventTypeInsert, BlobDBIdPins, (uint8_t *)id, sizeof(*id));
+  }
+  return rv;
 }
 
 status_t pin_db_get(const TimelineItemId *id, TimelineItem *pin) {
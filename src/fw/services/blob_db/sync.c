@@ -12,6 +12,7 @@
 #include "pbl/util/list.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 PBL_LOG_MODULE_DECLARE(service_blob_db, CONFIG_SERVICE_BLOB_DB_LOG_LEVEL);
 
@@ -19,13 +20,26 @@ PBL_LOG_MODULE_DECLARE(service_blob_db, CONFIG_SERVICE_BLOB_DB_LOG_LEVEL);
 #define SYNC_TIMEOUT_SECONDS 30
 #define SYNC_ABANDON_TIMEOUT_SECONDS (5 * 60)  // 5 minutes to fully abandon
 
+_Static_assert(CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW <= BLOB_DB_SYNC_MAX_WINDOW,
+               "Sync window larger than the in-flight table");
+
+typedef enum {
+  SendResultSent,
+  //! The record is gone, nothing to send
+  SendResultSkipped,
+  //! The session was cancelled and freed
+  SendResultCancelled,
+} SendResult;
+
 static BlobDBSyncSession *s_sync_sessions = NULL;
 
 //! Ids are handed out monotonically and never reused, so a stale id can never
 //! resolve to a different session that happens to reuse the same allocation.
 static uint32_t s_next_session_id = 1;
 
-static void prv_send_writeback(BlobDBSyncSession *session);
+static void prv_fill_window(BlobDBSyncSession *session);
+static SendResult prv_send_item(BlobDBSyncSession *session, BlobDBDirtyItem *dirty_item);
+static void prv_item_done(BlobDBSyncSession *session, BlobDBDirtyItem *dirty_item);
 
 static bool prv_session_uid_filter_callback(ListNode *node, void *data) {
   BlobDBSyncSession *session = (BlobDBSyncSession *)node;
@@ -50,10 +64,19 @@ static bool prv_session_id_filter_callback(ListNode *node, void *data) {
   return session->db_id == db_id;
 }
 
+static int prv_in_flight_index(const BlobDBSyncSession *session, BlobDBToken token) {
+  for (int i = 0; i < session->num_in_flight; i++) {
+    if (session->in_flight[i].token == token) {
+      return i;
+    }
+  }
+  return -1;
+}
+
 static bool prv_session_token_filter_callback(ListNode *node, void *data) {
   uint16_t token = (uint16_t)(uintptr_t)data;
   BlobDBSyncSession *session = (BlobDBSyncSession *)node;
-  return session->current_token == token;
+  return prv_in_flight_index(session, token) >= 0;
 }
 
 static void prv_abandon_kernelbg_callback(void *data) {
@@ -81,76 +104,152 @@ static void prv_timeout_kernelbg_callback(void *data) {
     regular_timer_add_multisecond_callback(&session->abandon_timer, SYNC_ABANDON_TIMEOUT_SECONDS);
   }
 
-  // Retry sending the current item
-  PBL_LOG_WRN("Blob DB Sync timeout, retrying (db %d)", session->db_id);
+  // Retry every unacked item under a fresh token. Late acks for the old tokens no longer
+  // match anything in flight and are dropped.
+  PBL_LOG_WRN("Blob DB Sync timeout, retrying %d items (db %d)",
+              session->num_in_flight, session->db_id);
+  BlobDBDirtyItem *unacked[BLOB_DB_SYNC_MAX_WINDOW];
+  const int num_unacked = session->num_in_flight;
+  for (int i = 0; i < num_unacked; i++) {
+    unacked[i] = session->in_flight[i].item;
+  }
+  session->num_in_flight = 0;
   session->state = BlobDBSyncSessionStateIdle;
-  prv_send_writeback(session);
+
+  for (int i = 0; i < num_unacked; i++) {
+    const SendResult result = prv_send_item(session, unacked[i]);
+    if (result == SendResultCancelled) {
+      return;
+    } else if (result == SendResultSkipped) {
+      prv_item_done(session, unacked[i]);
+    }
+  }
+  prv_fill_window(session);
 }
 
 static void prv_timeout_timer_callback(void *data) {
   system_task_add_callback(prv_timeout_kernelbg_callback, data);
 }
 
-static void prv_send_writeback(BlobDBSyncSession *session) {
-  // we want to write-back the first item in the dirty list
-  BlobDBDirtyItem *dirty_item = session->dirty_list;
+//! Read a dirty item and send it to the phone, recording it as in flight.
+//! The session is freed if this returns SendResultCancelled.
+static SendResult prv_send_item(BlobDBSyncSession *session, BlobDBDirtyItem *dirty_item) {
   int item_size = blob_db_get_len(session->db_id, dirty_item->key, dirty_item->key_len);
   if (item_size == 0) {
-    // item got removed during the sync. Go to the next one
-    blob_db_sync_next(session);
-    return;
+    // item got removed during the sync
+    return SendResultSkipped;
   }
 
   if (!comm_session_get_system_session()) {
     PBL_LOG_DBG("Cancelling sync: No route to phone");
     blob_db_sync_cancel(session);
-    return;
+    return SendResultCancelled;
   }
 
-  // read item into a temporary buffer
-  void *item_buf = kernel_malloc_check(item_size);
+  // The endpoint copies the record into the outgoing message, so one scratch buffer
+  // sized for the largest record seen so far serves every item in the window.
+  if (item_size > session->item_buf_size) {
+    kernel_free(session->item_buf);
+    session->item_buf = kernel_malloc_check(item_size);
+    session->item_buf_size = item_size;
+  }
   status_t status = blob_db_read(session->db_id,
                                  dirty_item->key,
                                  dirty_item->key_len,
-                                 item_buf, item_size);
-  // Both blob_db_sync_next() and blob_db_sync_cancel() can free the session, so
-  // neither it nor dirty_item may be touched after calling them.
+                                 session->item_buf, item_size);
   if (status == E_DOES_NOT_EXIST) {
     // item was removed
-    kernel_free(item_buf);
-    blob_db_sync_next(session);
-    return;
+    return SendResultSkipped;
   } else if (!PASSED(status)) {
     // something went terribly wrong
     PBL_LOG_ERR("Failed to read blob DB during sync. Error code: 0x%"PRIx32, status);
-    kernel_free(item_buf);
     blob_db_sync_cancel(session);
-    return;
+    return SendResultCancelled;
   }
 
   regular_timer_add_multisecond_callback(&session->timeout_timer, SYNC_TIMEOUT_SECONDS);
 
-  // only one writeback in flight at a time
   session->state = BlobDBSyncSessionStateWaitingForAck;
 
-
+  BlobDBToken token;
   if (session->session_type == BlobDBSyncSessionTypeDB) {
-    session->current_token = blob_db_endpoint_send_writeback(session->db_id,
-                                                             dirty_item->last_updated,
-                                                             dirty_item->key,
-                                                             dirty_item->key_len,
-                                                             item_buf,
-                                                             item_size);
+    token = blob_db_endpoint_send_writeback(session->db_id,
+                                            dirty_item->last_updated,
+                                            dirty_item->key,
+                                            dirty_item->key_len,
+                                            session->item_buf,
+                                            item_size);
   } else {
-    session->current_token = blob_db_endpoint_send_write(session->db_id,
-                                                         dirty_item->last_updated,
-                                                         dirty_item->key,
-                                                         dirty_item->key_len,
-                                                         item_buf,
-                                                         item_size);
+    token = blob_db_endpoint_send_write(session->db_id,
+                                        dirty_item->last_updated,
+                                        dirty_item->key,
+                                        dirty_item->key_len,
+                                        session->item_buf,
+                                        item_size);
   }
 
-  kernel_free(item_buf);
+  session->in_flight[session->num_in_flight++] = (BlobDBSyncWriteback) {
+    .item = dirty_item,
+    .token = token,
+  };
+  return SendResultSent;
+}
+
+//! Mark an item synced and drop it from the dirty list
+static void prv_item_done(BlobDBSyncSession *session, BlobDBDirtyItem *dirty_item) {
+  blob_db_mark_synced(session->db_id, dirty_item->key, dirty_item->key_len);
+  list_remove((ListNode *)dirty_item, (ListNode **)&session->dirty_list, NULL);
+  kernel_free(dirty_item);
+}
+
+static void prv_free_session(BlobDBSyncSession *session) {
+  if (regular_timer_is_scheduled(&session->timeout_timer)) {
+    regular_timer_remove_callback(&session->timeout_timer);
+  }
+  if (regular_timer_is_scheduled(&session->abandon_timer)) {
+    regular_timer_remove_callback(&session->abandon_timer);
+  }
+  list_remove((ListNode *)session, (ListNode **)&s_sync_sessions, NULL);
+  kernel_free(session->item_buf);
+  kernel_free(session);
+}
+
+//! Send dirty items until CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW are in flight. Finishes the
+//! session (freeing it) once every item has been acked and nothing new became dirty.
+static void prv_fill_window(BlobDBSyncSession *session) {
+  while (session->num_in_flight < CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW) {
+    BlobDBDirtyItem *dirty_item = session->next_item;
+    if (!dirty_item) {
+      if (session->num_in_flight > 0) {
+        // Wait for the outstanding acks so a refreshed list can't contain in-flight items
+        return;
+      }
+      // Check if new records became dirty while syncing the current list
+      // New records could have been added while we were syncing OR
+      // the list could be incomplete because we ran out of memory
+      session->dirty_list = blob_db_get_dirty_list(session->db_id);
+      session->next_item = session->dirty_list;
+      if (!session->dirty_list) {
+        PBL_LOG_DBG("Finished syncing db %d, session type: %d", session->db_id,
+                                                                            session->session_type);
+        if (session->session_type == BlobDBSyncSessionTypeDB) {
+          // Only send the sync done when syncing an entire db
+          blob_db_endpoint_send_sync_done(session->db_id);
+        }
+        prv_free_session(session);
+        return;
+      }
+      continue;
+    }
+
+    session->next_item = (BlobDBDirtyItem *)dirty_item->node.next;
+    const SendResult result = prv_send_item(session, dirty_item);
+    if (result == SendResultCancelled) {
+      return;
+    } else if (result == SendResultSkipped) {
+      prv_item_done(session, dirty_item);
+    }
+  }
 }
 
 BlobDBSyncSession* prv_create_sync_session(BlobDBId db_id, BlobDBDirtyItem *dirty_list,
@@ -159,6 +258,7 @@ BlobDBSyncSession* prv_create_sync_session(BlobDBId db_id, BlobDBDirtyItem *dirt
   session->state = BlobDBSyncSessionStateIdle;
   session->db_id = db_id;
   session->dirty_list = dirty_list;
+  session->next_item = dirty_list;
   session->session_type = session_type;
   session->session_id = s_next_session_id++;
   if (s_next_session_id == 0) {
@@ -192,6 +292,11 @@ BlobDBSyncSession *blob_db_sync_get_session_for_token(uint16_t token) {
                                         (void *)(uintptr_t)token);
 }
 
+BlobDBDirtyItem *blob_db_sync_get_item_for_token(BlobDBSyncSession *session, BlobDBToken token) {
+  const int index = prv_in_flight_index(session, token);
+  return (index >= 0) ? session->in_flight[index].item : NULL;
+}
+
 status_t blob_db_sync_db(BlobDBId db_id) {
   if (db_id >= NumBlobDBs) {
     return E_INVALID_ARGUMENT;
@@ -212,7 +317,7 @@ status_t blob_db_sync_db(BlobDBId db_id) {
 
   session = prv_create_sync_session(db_id, dirty_list, BlobDBSyncSessionTypeDB);
 
-  prv_send_writeback(session);
+  prv_fill_window(session);
 
   return S_SUCCESS;
 }
@@ -241,64 +346,40 @@ status_t blob_db_sync_record(BlobDBId db_id, const void *key, int key_len, time_
 
   session = prv_create_sync_session(db_id, dirty_list, BlobDBSyncSessionTypeRecord);
 
-  prv_send_writeback(session);
+  prv_fill_window(session);
 
   return S_SUCCESS;
 }
 
 void blob_db_sync_cancel(BlobDBSyncSession *session) {
   PBL_LOG_DBG("Cancelling session %d sync", session->db_id);
-  if (regular_timer_is_scheduled(&session->timeout_timer)) {
-    regular_timer_remove_callback(&session->timeout_timer);
-  }
-  if (regular_timer_is_scheduled(&session->abandon_timer)) {
-    regular_timer_remove_callback(&session->abandon_timer);
-  }
   blob_db_util_free_dirty_list(session->dirty_list);
-  list_remove((ListNode *)session, (ListNode **)&s_sync_sessions, NULL);
-  kernel_free(session);
+  prv_free_session(session);
 }
 
-void blob_db_sync_next(BlobDBSyncSession *session) {
+void blob_db_sync_next(BlobDBSyncSession *session, BlobDBToken token) {
   PBL_LOG_DBG("blob_db_sync_next");
 
+  const int index = prv_in_flight_index(session, token);
+  if (index < 0) {
+    PBL_LOG_WRN("Ignoring ack for token %d, not in flight", token);
+    return;
+  }
+
   // Cancel abandon timer - we got a successful response, so connection is working
   if (regular_timer_is_scheduled(&session->abandon_timer)) {
     regular_timer_remove_callback(&session->abandon_timer);
   }
 
-  BlobDBDirtyItem *dirty_item = session->dirty_list;
-  blob_db_mark_synced(session->db_id, dirty_item->key, dirty_item->key_len);
-
-  // we're done with this item, we pop it off the stack
-  list_remove((ListNode *)dirty_item, (ListNode **)&session->dirty_list, NULL);
-  kernel_free(dirty_item);
-
-  if (session->dirty_list) {
-    prv_send_writeback(session);
-  } else {
-    // Check if new records became dirty while syncing the current list
-    // New records could have been added while we were syncing OR
-    // the list could be incomplete because we ran out of memory
-    session->dirty_list = blob_db_get_dirty_list(session->db_id);
-    if (session->dirty_list) {
-      prv_send_writeback(session);
-    } else {
-      PBL_LOG_DBG("Finished syncing db %d, session type: %d", session->db_id,
-                                                                          session->session_type);
-      if (regular_timer_is_scheduled(&session->timeout_timer)) {
-        regular_timer_remove_callback(&session->timeout_timer);
-      }
-      if (regular_timer_is_scheduled(&session->abandon_timer)) {
-        regular_timer_remove_callback(&session->abandon_timer);
-      }
-      if (session->session_type == BlobDBSyncSessionTypeDB) {
-        // Only send the sync done when syncing an entire db
-        blob_db_endpoint_send_sync_done(session->db_id);
-      }
-      list_remove((ListNode *)session, (ListNode **)&s_sync_sessions, NULL);
-      kernel_free(session);
-    }
+  // Acks can arrive out of order, keep the rest of the window in send order
+  BlobDBDirtyItem *dirty_item = session->in_flight[index].item;
+  session->num_in_flight--;
+  memmove(&session->in_flight[index], &session->in_flight[index + 1],
+          (session->num_in_flight - index) * sizeof(session->in_flight[0]));
+  if (session->num_in_flight == 0) {
+    session->state = BlobDBSyncSessionStateIdle;
   }
-}
 
+  prv_item_done(session, dirty_item);
+  prv_fill_window(session);
+}
@@ -55,15 +55,6 @@ static time_t prv_migrate_local_time_to_UTC(time_t local_time) {
   return time_local_to_utc(local_time);
 }
 
-// Should only called by prv_update_time_info_and_generate_event()!
-static void prv_handle_timezone_set(TimezoneInfo *tz_info) {
-  time_util_update_timezone(tz_info);
-
-  // Update the RTC registers with the latest timezone info
-  rtc_set_timezone(tz_info);
-
-}
-
 typedef struct PACKED {
 // This struct is packed because it mirrors the endpoint definition:
 // https://pebbletechnology.atlassian.net/wiki/pages/viewpage.action?pageId=491698#PebbleProtocol(BluetoothSerial)-0xb(11)-Time/Clock(bigendian)
@@ -141,50 +132,98 @@ static time_t prv_clock_dstrule_to_timestamp(
 }
 #endif // CONFIG_RECOVERY_FW
 
-T_STATIC void prv_update_dstrule_timestamps_by_dstzone_id(TimezoneInfo *tz_info, time_t utc_time) {
-  if (tz_info->dst_id == 0) {
-    tz_info->dst_start = 0;
-    tz_info->dst_end = 0;
-    return;
+#if !defined(CONFIG_RECOVERY_FW)
+// Calculate the timestamps of the start and ends of DST for the previous year, the current
+// year, and the next year.
+#define DST_YEARS_RANGE 3
+#define DST_YEARS_OFFSET 1
+
+//! The DST transitions of the last DST rule evaluated, almost always the active timezone's. It is
+//! keyed on everything the transitions depend on, so a timezone change simply misses it. Finding
+//! the DST period of another moment in the same year is then just a matter of picking the right
+//! pair instead of going back to the database and evaluating the rules again.
+typedef struct {
+  bool valid;
+  bool observes_dst;
+  uint8_t dst_id;
+  int32_t tm_gmtoff;
+  int year; //!< tm_year the transitions are centered on
+  time_t dst_start_stamps[DST_YEARS_RANGE];
+  time_t dst_end_stamps[DST_YEARS_RANGE];
+} DSTTransitionCache;
+
+static DSTTransitionCache s_dst_transitions;
+
+static const DSTTransitionCache *prv_get_dst_transitions(const TimezoneInfo *tz_info, int year) {
+  DSTTransitionCache *cache = &s_dst_transitions;
+  if (cache->valid && cache->dst_id == tz_info->dst_id && cache->tm_gmtoff == tz_info->tm_gmtoff &&
+      cache->year == year) {
+    return cache;
   }
 
-#if defined(CONFIG_RECOVERY_FW)
-  return;
-#else
+  *cache = (DSTTransitionCache) {
+    .valid = true,
+    .dst_id = tz_info->dst_id,
+    .tm_gmtoff = tz_info->tm_gmtoff,
+    .year = year,
+  };
 
   // Load the pair of TimezoneDSTRule objects from the timezone database
 
   TimezoneDSTRule dst_rule_begin;
   TimezoneDSTRule dst_rule_end;
 
-  if (!timezone_database_load_dst_rule(tz_info->dst_id, &dst_rule_begin, &dst_rule_end)) {
-    // No DST rule or invalid DST ID. Either way just clear the DST information.
+  // No DST rule or invalid DST ID. Either way there is no DST information.
+  cache->observes_dst =
+      timezone_database_load_dst_rule(tz_info->dst_id, &dst_rule_begin, &dst_rule_end);
+  if (!cache->observes_dst) {
+    return cache;
+  }
+
+  for (int i = 0; i < DST_YEARS_RANGE; i++) {
+    const int rule_year = year + (i - DST_YEARS_OFFSET);
+
+    cache->dst_start_stamps[i] =
+        prv_clock_dstrule_to_timestamp(false, tz_info, &dst_rule_begin, rule_year);
+    cache->dst_end_stamps[i] =
+        prv_clock_dstrule_to_timestamp(true, tz_info, &dst_rule_end, rule_year);
+  }
+  return cache;
+}
+
+#if UNITTEST
+//! Forget the cached DST transitions so the next lookup evaluates the DST rules again
+void prv_dst_transitions_invalidate(void) {
+  s_dst_transitions.valid = false;
+}
+#endif
+#endif // CONFIG_RECOVERY_FW
+
+T_STATIC void prv_update_dstrule_timestamps_by_dstzone_id(TimezoneInfo *tz_info, time_t utc_time) {
+  if (tz_info->dst_id == 0) {
     tz_info->dst_start = 0;
     tz_info->dst_end = 0;
     return;
   }
 
+#if defined(CONFIG_RECOVERY_FW)
+  return;
+#else
+
   struct tm current_tm;
   gmtime_r(&utc_time, &current_tm);
 
-  // Calculate the timestamps of the start and ends of DST for the previous year, the current
-  // year, and the next year.
-
-#define DST_YEARS_RANGE 3
-#define DST_YEARS_OFFSET 1
-  time_t dst_start_stamps[DST_YEARS_RANGE];
-  time_t dst_end_stamps[DST_YEARS_RANGE];
-  for (int i = 0; i < DST_YEARS_RANGE; i++) {
-    const int year = current_tm.tm_year + (i - DST_YEARS_OFFSET);
-
-    dst_start_stamps[i] =
-        prv_clock_dstrule_to_timestamp(false, tz_info, &dst_rule_begin, year);
-    dst_end_stamps[i] =
-        prv_clock_dstrule_to_timestamp(true, tz_info, &dst_rule_end, year);
+  const DSTTransitionCache *transitions = prv_get_dst_transitions(tz_info, current_tm.tm_year);
+  if (!transitions->observes_dst) {
+    tz_info->dst_start = 0;
+    tz_info->dst_end = 0;
+    return;
   }
 
   //  Figure out which timestamps are relevant to us
 
+  const time_t *dst_start_stamps = transitions->dst_start_stamps;
+  const time_t *dst_end_stamps = transitions->dst_end_stamps;
   int start_idx = DST_YEARS_OFFSET;
   int end_idx = DST_YEARS_OFFSET;
 
@@ -203,6 +242,16 @@ T_STATIC void prv_update_dstrule_timestamps_by_dstzone_id(TimezoneInfo *tz_info,
 #endif // CONFIG_RECOVERY_FW
 }
 
+// Should only called by prv_update_time_info_and_generate_event() and
+// prv_advance_passed_dst_period()!
+static void prv_handle_timezone_set(TimezoneInfo *tz_info) {
+  time_util_update_timezone(tz_info);
+
+  // Update the RTC registers with the latest timezone info
+  rtc_set_timezone(tz_info);
+
+}
+
 static void prv_clock_get_timezone_info_from_region_id(
     int16_t region_id, time_t utc_time, TimezoneInfo *tz_info) {
 
@@ -386,12 +435,33 @@ void clock_protocol_msg_callback(CommSession *session, const uint8_t* data, unsi
   }
 }
 
+#ifndef CONFIG_RECOVERY_FW
+//! Once the current DST period is over, moves the timezone on to the next one so that the next
+//! DST transition still happens without the phone having to set the time again
+static void prv_advance_passed_dst_period(time_t utc_time) {
+  const time_t dst_end = time_get_dst_end();
+  if (dst_end == 0 || utc_time < dst_end) {
+    return;
+  }
+
+  TimezoneInfo tz_info;
+  rtc_get_timezone(&tz_info);
+  prv_update_dstrule_timestamps_by_dstzone_id(&tz_info, utc_time);
+  if (tz_info.dst_end > dst_end) {
+    prv_handle_timezone_set(&tz_info);
+  }
+}
+#endif
+
 // TODO: Using a regular timer is pretty gross...
 //! Runs once a minute from the regular_timer minutes list. DST transitions and
 //! the top of the hour both land on minute boundaries, so minute granularity
 //! detects them at the same instant the old per-second poll did.
 T_STATIC void prv_watch_dst(void* user) {
   const bool was_dst = (bool)user;
+#ifndef CONFIG_RECOVERY_FW
+  prv_advance_passed_dst_period(rtc_get_time());
+#endif
   const bool is_dst = time_get_isdst(rtc_get_time());
 
 #ifndef CONFIG_RECOVERY_FW
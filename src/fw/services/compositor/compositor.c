@@ -3,6 +3,7 @@
 
 #include "pbl/services/compositor/compositor.h"
 #include "pbl/services/compositor/compositor_display.h"
+#include "pbl/services/compositor/compositor_scaling.h"
 
 #include "applib/graphics/bitblt.h"
 #include "applib/graphics/framebuffer.h"
@@ -600,6 +601,10 @@ void compositor_scaled_app_fb_copy_offset(const GRect update_rect, bool copy_rel
     const uint32_t scale_y = ((uint32_t)app_height << 16) / scale_to.size.h;
     const int16_t app_shift_y = timeline_peek_get_origin_y() - scale_to.size.h;
 
+    int16_t cached_src_y = -1;
+    GBitmapDataRowInfo src_row_info;
+    GBitmapDataRowInfo src_row_info_next;
+    bool has_src_row_next = false;
     for (int16_t dst_y = 0; dst_y < update_rect.size.h; dst_y++) {
       const int16_t dst_y_offset = dst_y + update_rect.origin.y + offset_y;
       if (dst_y_offset < 0 || dst_y_offset >= disp_height) continue;
@@ -629,87 +634,34 @@ void compositor_scaled_app_fb_copy_offset(const GRect update_rect, bool copy_rel
       if (src_y < 0 || src_y >= app_height) continue;
 
       GBitmapDataRowInfo dst_row_info = gbitmap_get_data_row_info(&dst_bitmap, dst_y_offset);
-      GBitmapDataRowInfo src_row_info = gbitmap_get_data_row_info(&src_bitmap, src_y);
-
-      // For bilinear, also get the next row (clamped to bounds)
-      const int16_t src_y1 = MIN(src_y + 1, app_height - 1);
-      GBitmapDataRowInfo src_row_info_next;
-      if (bilinear && src_y1 != src_y) {
-        src_row_info_next = gbitmap_get_data_row_info(&src_bitmap, src_y1);
-      } else {
-        src_row_info_next = src_row_info;
+      // Upscaling repeats each app row over several display rows, so only look it up once
+      if (src_y != cached_src_y) {
+        src_row_info = gbitmap_get_data_row_info(&src_bitmap, src_y);
+        // For bilinear, also get the next row (clamped to bounds)
+        has_src_row_next = bilinear && (src_y + 1 < app_height);
+        if (has_src_row_next) {
+          src_row_info_next = gbitmap_get_data_row_info(&src_bitmap, src_y + 1);
+        }
+        cached_src_y = src_y;
       }
 
       // Fractional Y weight for bilinear (0-16 range, using 4 bits from fixed-point)
       const uint8_t fy = (src_y_fixed >> 12) & 0xF;
 
-      uint8_t *dst_line = dst_row_info.data;
-
-      for (int16_t dst_x = 0; dst_x < update_rect.size.w; dst_x++) {
-        const int16_t dst_x_offset = dst_x + update_rect.origin.x;
-        if (dst_x_offset < dst_row_info.min_x || dst_x_offset > dst_row_info.max_x) {
-          continue;
-        }
-        if (squish_watchface_for_peek &&
-            (dst_x_offset < scale_to.origin.x ||
-             dst_x_offset >= scale_to.origin.x + scale_to.size.w)) {
-          continue;
-        }
-
-        const uint16_t dst_x_coord = squish_watchface_for_peek
-            ? (dst_x_offset - scale_to.origin.x)
-            : copy_relative_to_origin ? CLIP(dst_x_offset, 0, disp_width - 1) : dst_x;
-        const uint32_t src_x_fixed = (uint32_t)dst_x_coord * scale_x;
-        const int16_t src_x = src_x_fixed >> 16;
-
-        if (src_x < src_row_info.min_x || src_x > src_row_info.max_x) {
-          continue;
-        }
-
-        if (!bilinear) {
-          // Nearest-neighbor: copy pixel directly
-          dst_line[dst_x_offset] = src_row_info.data[src_x];
-        } else {
-          // Bilinear interpolation on ARGB2222 pixels
-          const int16_t src_x1 = MIN(src_x + 1, app_width - 1);
-
-          // Sample 2x2 neighborhood
-          const uint8_t p00 = src_row_info.data[src_x];
-          const uint8_t p10 = (src_x1 <= src_row_info.max_x) ?
-              src_row_info.data[src_x1] : p00;
-          const uint8_t p01 = (src_y1 != src_y && src_x >= src_row_info_next.min_x &&
-                               src_x <= src_row_info_next.max_x) ?
-              src_row_info_next.data[src_x] : p00;
-          const uint8_t p11 = (src_y1 != src_y && src_x1 >= src_row_info_next.min_x &&
-                               src_x1 <= src_row_info_next.max_x) ?
-              src_row_info_next.data[src_x1] : p10;
-
-          // Fractional X weight (0-16 range, using 4 bits from fixed-point)
-          const uint8_t fx = (src_x_fixed >> 12) & 0xF;
-
-          // Interpolate each 2-bit channel (b, g, r) using 16-bit intermediates
-          // Channel layout: [b1:b0 g1:g0 r1:r0 a1:a0]
-          // Using 4-bit fractional weights so we can divide by shift (16*16=256)
-          uint8_t result = 0xC0; // Alpha = 3 (fully opaque)
-          for (int shift = 0; shift < 6; shift += 2) {
-            const uint16_t c00 = (p00 >> shift) & 0x3;
-            const uint16_t c10 = (p10 >> shift) & 0x3;
-            const uint16_t c01 = (p01 >> shift) & 0x3;
-            const uint16_t c11 = (p11 >> shift) & 0x3;
-
-            // Bilinear: lerp in X for both rows, then lerp in Y
-            const uint16_t top = c00 * (16 - fx) + c10 * fx;    // 0..48
-            const uint16_t bot = c01 * (16 - fx) + c11 * fx;    // 0..48
-            const uint16_t val = top * (16 - fy) + bot * fy;    // 0..768
-
-            // Scale back to 2-bit: divide by 256 with rounding
-            const uint8_t channel = (val + 128) >> 8;
-            result |= (channel & 0x3) << shift;
-          }
-
-          dst_line[dst_x_offset] = result;
-        }
+      int16_t x_begin = MAX(update_rect.origin.x, dst_row_info.min_x);
+      int16_t x_end = MIN(update_rect.origin.x + update_rect.size.w, dst_row_info.max_x + 1);
+      int16_t coord_origin;
+      if (squish_watchface_for_peek) {
+        x_begin = MAX(x_begin, scale_to.origin.x);
+        x_end = MIN(x_end, scale_to.origin.x + scale_to.size.w);
+        coord_origin = scale_to.origin.x;
+      } else {
+        // x_begin..x_end is already within the display, so relative copies need no clipping
+        coord_origin = copy_relative_to_origin ? 0 : update_rect.origin.x;
       }
+      compositor_scale_row(dst_row_info.data, x_begin, x_end, coord_origin, &src_row_info,
+                           has_src_row_next ? &src_row_info_next : NULL, fy, bilinear,
+                           app_width, scale_x);
     }
   } else if (shift_watchface_for_peek) {
     const int16_t app_offset_x = (disp_width - app_width) / 2;
@@ -0,0 +1,150 @@
+/* SPDX-FileCopyrightText: 2026 Core Devices LLC */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include "pbl/services/compositor/compositor_scaling.h"
+
+#include <pbl/drivers/display/display.h>
+#include "pbl/util/math.h"
+#include "pbl/util/size.h"
+
+// Only the compositor's legacy app scaling uses these, so other platforms don't pay for the table
+#if PBL_COLOR && defined(CONFIG_APP_SCALING) && !defined(CONFIG_RECOVERY_FW)
+
+//! Where a destination column samples the app framebuffer
+typedef struct ScaledColumn {
+  uint16_t src_x;
+  //! 1 if the column blends with src_x + 1, 0 on the last app column
+  uint8_t next;
+  //! Bilinear weight of src_x + 1, 0-15
+  uint8_t fx;
+} ScaledColumn;
+
+//! Indexed by destination column relative to the scaled app's origin
+static ScaledColumn s_columns[DISP_COLS];
+static uint32_t s_columns_scale_x;
+static int16_t s_columns_app_width;
+
+static int16_t prv_src_x(uint16_t dst_x_coord, uint32_t scale_x) {
+  return ((uint32_t)dst_x_coord * scale_x) >> 16;
+}
+
+static void prv_update_columns(uint32_t scale_x, int16_t app_width) {
+  if (scale_x == s_columns_scale_x && app_width == s_columns_app_width) {
+    return;
+  }
+  for (uint16_t i = 0; i < ARRAY_LENGTH(s_columns); i++) {
+    const uint32_t src_x_fixed = (uint32_t)i * scale_x;
+    const uint16_t src_x = src_x_fixed >> 16;
+    s_columns[i] = (ScaledColumn) {
+      .src_x = src_x,
+      .next = (src_x + 1 < app_width) ? 1 : 0,
+      .fx = (src_x_fixed >> 12) & 0xF,
+    };
+  }
+  s_columns_scale_x = scale_x;
+  s_columns_app_width = app_width;
+}
+
+//! Spreads the b, g and r channels of an ARGB2222 pixel 10 bits apart so that all three can be
+//! weighted with a single multiply without carrying into each other
+static uint32_t prv_spread_channels(uint8_t pixel) {
+  return (pixel & 0x03) | ((uint32_t)(pixel & 0x0c) << 8) | ((uint32_t)(pixel & 0x30) << 16);
+}
+
+uint8_t compositor_scale_blend_bilinear(uint8_t p00, uint8_t p10, uint8_t p01, uint8_t p11,
+                                        uint8_t fx, uint8_t fy) {
+  // Each channel sums to at most 3 * 16 * 16 + 128 = 896, which fits in its 10 bit lane
+  const uint32_t rounding = 128 | (128 << 10) | (128 << 20);
+  const uint32_t sum = prv_spread_channels(p00) * ((16 - fx) * (16 - fy)) +
+                       prv_spread_channels(p10) * (fx * (16 - fy)) +
+                       prv_spread_channels(p01) * ((16 - fx) * fy) +
+                       prv_spread_channels(p11) * (fx * fy) + rounding;
+  // Divide each lane by 256 and pack the 2-bit channels back together, fully opaque
+  const uint32_t channels = sum >> 8;
+  return 0xC0 | (channels & 0x03) | ((channels >> 8) & 0x0c) | ((channels >> 16) & 0x30);
+}
+
+//! Whether every app column of the row holds valid data (max_x may run past the app's width)
+static bool prv_is_full_row(const GBitmapDataRowInfo *row, int16_t app_width) {
+  return (row->min_x <= 0) && (row->max_x >= app_width - 1);
+}
+
+//! Handles any row shape and any column, checking bounds pixel by pixel
+static void prv_scale_row_checked(uint8_t *dst_line, int16_t x_begin, int16_t x_end,
+                                  int16_t coord_origin, const GBitmapDataRowInfo *src_row,
+                                  const GBitmapDataRowInfo *src_row_next, uint8_t fy,
+                                  bool bilinear, int16_t app_width, uint32_t scale_x) {
+  for (int16_t x = x_begin; x < x_end; x++) {
+    const uint32_t src_x_fixed = (uint32_t)(uint16_t)(x - coord_origin) * scale_x;
+    const int16_t src_x = src_x_fixed >> 16;
+    if (src_x < src_row->min_x || src_x > src_row->max_x) {
+      continue;
+    }
+    if (!bilinear) {
+      dst_line[x] = src_row->data[src_x];
+      continue;
+    }
+
+    const int16_t src_x1 = MIN(src_x + 1, app_width - 1);
+    const uint8_t p00 = src_row->data[src_x];
+    const uint8_t p10 = (src_x1 <= src_row->max_x) ? src_row->data[src_x1] : p00;
+    const uint8_t p01 = (src_row_next && src_x >= src_row_next->min_x &&
+                         src_x <= src_row_next->max_x) ? src_row_next->data[src_x] : p00;
+    const uint8_t p11 = (src_row_next && src_x1 >= src_row_next->min_x &&
+                         src_x1 <= src_row_next->max_x) ? src_row_next->data[src_x1] : p10;
+    dst_line[x] = compositor_scale_blend_bilinear(p00, p10, p01, p11,
+                                                  (src_x_fixed >> 12) & 0xF, fy);
+  }
+}
+
+void compositor_scale_row(uint8_t *dst_line, int16_t x_begin, int16_t x_end,
+                          int16_t coord_origin, const GBitmapDataRowInfo *src_row,
+                          const GBitmapDataRowInfo *src_row_next, uint8_t fy, bool bilinear,
+                          int16_t app_width, uint32_t scale_x) {
+  // The source column only ever grows with x, so the destination columns that sample inside the
+  // source row are a single run
+  while (x_begin < x_end && prv_src_x(x_begin - coord_origin, scale_x) < src_row->min_x) {
+    x_begin++;
+  }
+  while (x_end > x_begin && prv_src_x(x_end - 1 - coord_origin, scale_x) > src_row->max_x) {
+    x_end--;
+  }
+  if (x_begin >= x_end) {
+    return;
+  }
+
+  const bool columns_in_table = (x_begin >= coord_origin) &&
+                                (x_end - coord_origin <= (int)ARRAY_LENGTH(s_columns));
+  const bool full_rows = prv_is_full_row(src_row, app_width) &&
+                         (!src_row_next || prv_is_full_row(src_row_next, app_width));
+  if (!columns_in_table || (bilinear && !full_rows)) {
+    prv_scale_row_checked(dst_line, x_begin, x_end, coord_origin, src_row, src_row_next, fy,
+                          bilinear, app_width, scale_x);
+    return;
+  }
+
+  prv_update_columns(scale_x, app_width);
+  const ScaledColumn *column = &s_columns[x_begin - coord_origin];
+  uint8_t *dst = &dst_line[x_begin];
+  uint8_t *const dst_end = &dst_line[x_end];
+  const uint8_t *top = src_row->data;
+
+  if (!bilinear) {
+    while (dst < dst_end) {
+      *dst++ = top[(column++)->src_x];
+    }
+    return;
+  }
+
+  // Without a row below, the bottom pixels are the top ones, as if the last row repeated
+  const uint8_t *bottom = src_row_next ? src_row_next->data : top;
+  while (dst < dst_end) {
+    const uint16_t x0 = column->src_x;
+    const uint16_t x1 = x0 + column->next;
+    *dst++ = compositor_scale_blend_bilinear(top[x0], top[x1], bottom[x0], bottom[x1],
+                                             column->fx, fy);
+    column++;
+  }
+}
+
+#endif // PBL_COLOR && defined(CONFIG_APP_SCALING) && !defined(CONFIG_RECOVERY_FW)
@@ -311,9 +311,25 @@ void dls_set_send_enable_pp(bool setting) {
   s_sends_enabled_pp = setting;
 }
 
+// ----------------------------------------------------------------------------------------
+static bool prv_write_session_to_flash(DataLoggingSession* session, void *data) {
+  dls_storage_write_session(session);
+  return true;
+}
+
+static void prv_write_all_sessions_to_flash(void *data) {
+  dls_list_for_each_session(prv_write_session_to_flash, NULL);
+}
+
+
 // ----------------------------------------------------------------------------------------
 // Set the send_enable setting
 void dls_set_send_enable_run_level(bool setting) {
+  if (s_sends_enabled_run_level && !setting) {
+    // We're leaving the normal run level (e.g. entering low power mode). Don't leave logged data
+    // sitting in the session buffers in RAM, get it out to flash now.
+    system_task_add_callback(prv_write_all_sessions_to_flash, NULL);
+  }
   s_sends_enabled_run_level = setting;
 }
 
@@ -504,17 +520,6 @@ exit:
 }
 
 
-// ----------------------------------------------------------------------------------------
-static bool prv_write_session_to_flash(DataLoggingSession* session, void *data) {
-  dls_storage_write_session(session);
-  return true;
-}
-
-static void prv_write_all_sessions_to_flash(void *data) {
-  dls_list_for_each_session(prv_write_session_to_flash, NULL);
-}
-
-
 // ----------------------------------------------------------------------------------------
 DataLoggingResult dls_log(DataLoggingSession *session, const void* data, uint32_t num_items) {
 #ifndef CONFIG_RELEASE
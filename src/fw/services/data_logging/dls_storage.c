@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 PBL_LOG_MODULE_DECLARE(service_data_logging, CONFIG_SERVICE_DATA_LOGGING_LOG_LEVEL);
 
@@ -66,6 +67,10 @@ typedef struct PACKED {
 _Static_assert(DLS_MAX_CHUNK_SIZE_BYTES < DLS_CHUNK_HDR_NUM_BYTES_UNINITIALIZED,
     "DLS_MAX_CHUNK_SIZE_BYTES must be less than DLS_CHUNK_HDR_NUM_BYTES_UNINITIALIZED");
 
+// The most chunks we pack into the staging buffer for a single write. This bounds the size of
+// the buffer prv_write_data() allocates.
+#define DLS_MAX_CHUNKS_PER_WRITE  10
+
 // Forward declarations
 static bool prv_realloc_storage(DataLoggingSession *session, uint32_t new_size);
 static bool prv_get_session_file(DataLoggingSession *session, uint32_t space_needed);
@@ -411,39 +416,80 @@ exit:
 
 
 // -----------------------------------------------------------------------------------------
+// Write data out in chunks. When there is more than one chunk to write, the chunks are packed
+// into a RAM staging buffer as [data 0][hdr 1][data 1]...[hdr n][data n] and written out with a
+// single write, followed by the header of the first chunk. Until that header is written it reads
+// as DLS_CHUNK_HDR_NUM_BYTES_UNINITIALIZED, which is where dls_storage_read() stops, so a reset
+// part way through never exposes a partially written chunk.
 static bool prv_write_data(DataLoggingSessionStorage *storage, const void *data,
                            uint32_t remaining_bytes) {
   const uint8_t *data_ptr = data;
 
-  // Write out in chunks
+  // If we can't get a staging buffer, we still work, just one chunk per write
+  uint8_t *staging_buf = NULL;
+  uint32_t staging_size = 0;
+  if (remaining_bytes > DLS_MAX_CHUNK_SIZE_BYTES) {
+    const uint32_t num_chunks = MIN(DIVIDE_CEIL(remaining_bytes, DLS_MAX_CHUNK_SIZE_BYTES),
+                                    DLS_MAX_CHUNKS_PER_WRITE);
+    staging_size = num_chunks * (sizeof(DLSChunkHeader) + DLS_MAX_CHUNK_SIZE_BYTES)
+                   - sizeof(DLSChunkHeader);
+    staging_buf = kernel_malloc(staging_size);
+  }
+
+  bool success = false;
   while (remaining_bytes > 0) {
-    uint8_t data_chunk_length = MIN(DLS_MAX_CHUNK_SIZE_BYTES, remaining_bytes);
+    const uint8_t first_chunk_length = MIN(DLS_MAX_CHUNK_SIZE_BYTES, remaining_bytes);
+    const uint8_t *batch = data_ptr;
+    uint32_t batch_length = first_chunk_length;
+    uint32_t batch_data_bytes = first_chunk_length;
+
+    if (staging_buf) {
+      memcpy(staging_buf, data_ptr, first_chunk_length);
+      while (batch_data_bytes < remaining_bytes) {
+        const uint8_t chunk_length = MIN(DLS_MAX_CHUNK_SIZE_BYTES,
+                                         remaining_bytes - batch_data_bytes);
+        if (batch_length + sizeof(DLSChunkHeader) + chunk_length > staging_size) {
+          break;
+        }
+        const DLSChunkHeader chunk_hdr = { .num_bytes = chunk_length, .valid = true };
+        memcpy(&staging_buf[batch_length], &chunk_hdr, sizeof(chunk_hdr));
+        batch_length += sizeof(chunk_hdr);
+        memcpy(&staging_buf[batch_length], &data_ptr[batch_data_bytes], chunk_length);
+        batch_length += chunk_length;
+        batch_data_bytes += chunk_length;
+      }
+      batch = staging_buf;
+    }
 
     // Write the data first, so if an error occurs, the header is left in the uninitialized state
     if (!prv_pfs_seek(storage->fd, storage->write_offset + sizeof(DLSChunkHeader), FSeekSet)) {
-      return false;
+      goto exit;
     }
-    if (!prv_pfs_write(storage->fd, (void *)data_ptr, data_chunk_length)) {
-      return false;
+    if (!prv_pfs_write(storage->fd, (void *)batch, batch_length)) {
+      goto exit;
     }
 
-    // Write data chunk header now
+    // Write the first chunk's header now, which makes the whole batch visible
     if (!prv_pfs_seek(storage->fd, storage->write_offset, FSeekSet)) {
-      return false;
+      goto exit;
     }
-    DLSChunkHeader data_hdr = { .num_bytes = data_chunk_length, .valid = true };
+    DLSChunkHeader data_hdr = { .num_bytes = first_chunk_length, .valid = true };
     if (!prv_pfs_write(storage->fd, &data_hdr, sizeof(DLSChunkHeader))) {
-      return false;
+      goto exit;
     }
 
     // Bump pointer and count
-    storage->write_offset += data_chunk_length + sizeof(DLSChunkHeader);
-    storage->num_bytes += data_chunk_length;
+    storage->write_offset += sizeof(DLSChunkHeader) + batch_length;
+    storage->num_bytes += batch_data_bytes;
 
-    remaining_bytes -= data_chunk_length;
-    data_ptr += data_chunk_length;
+    remaining_bytes -= batch_data_bytes;
+    data_ptr += batch_data_bytes;
   }
-  return true;
+  success = true;
+
+exit:
+  kernel_free(staging_buf);
+  return success;
 }
 
 
@@ -854,6 +900,43 @@ exit:
 }
 
 
+// -----------------------------------------------------------------------------------------
+// prv_write_data() programs a batch before the header of its first chunk, so a reset part way
+// through can leave up to a batch of programmed bytes past the write offset. Flash can't be
+// programmed again until it's erased, so check whether anything there was written.
+// Returns the size of the file if so, 0 if the flash past the write offset is still erased.
+static uint32_t prv_get_size_if_tail_programmed(DataLoggingSession *session) {
+  uint32_t file_size = 0;
+  if (!prv_get_session_file(session, 0)) {
+    return 0;
+  }
+  const uint32_t size = prv_pfs_get_file_size(session->storage.fd);
+  const uint32_t max_batch_size = DLS_MAX_CHUNKS_PER_WRITE
+                                  * (sizeof(DLSChunkHeader) + DLS_MAX_CHUNK_SIZE_BYTES);
+  const uint32_t end = MIN(size, session->storage.write_offset + max_batch_size);
+  if (!prv_pfs_seek(session->storage.fd, session->storage.write_offset, FSeekSet)) {
+    goto exit;
+  }
+  uint8_t buf[DLS_MAX_CHUNK_SIZE_BYTES];
+  for (uint32_t offset = session->storage.write_offset; offset < end; offset += sizeof(buf)) {
+    const uint32_t read_size = MIN(sizeof(buf), end - offset);
+    if (!prv_pfs_read(session->storage.fd, buf, read_size)) {
+      goto exit;
+    }
+    for (uint32_t i = 0; i < read_size; i++) {
+      if (buf[i] != 0xff) {
+        file_size = size;
+        goto exit;
+      }
+    }
+  }
+
+exit:
+  prv_release_session_file(session);
+  return file_size;
+}
+
+
 // -----------------------------------------------------------------------------------------
 // Called from dls_init() during boot time to scan for existing DLS storage files in the file
 // system and recreate sessions from them.
@@ -926,6 +1009,13 @@ void dls_storage_rebuild(void) {
       goto bad_session;
     }
 
+    // Move the unread data to a new file if an interrupted write left the flash past it
+    // programmed, so that the next write lands on erased flash
+    const uint32_t file_size = prv_get_size_if_tail_programmed(session);
+    if (file_size && !prv_realloc_storage(session, file_size)) {
+      goto bad_session;
+    }
+
     PBL_LOG_DBG("Restored session %"PRIu8
             " num_bytes:%"PRIu32", read_offset:%"PRIu32", write_offset:%"PRIu32,
             session->comm.session_id, session->storage.num_bytes,
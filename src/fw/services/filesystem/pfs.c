@@ -195,9 +195,13 @@ typedef struct GCBlock {
 
 static GCBlock s_gc_block;
 
+//! The first page pfs_reboot_cleanup() hasn't looked at yet
+static uint16_t s_reboot_cleanup_pg;
+
 // This is used by unit tests to clear out static state and simulate a reboot.
 void pfs_reset_all_state(void) {
   s_gc_block = (GCBlock){};
+  s_reboot_cleanup_pg = 0;
   memset(s_pfs_avail_fd, 0, sizeof(s_pfs_avail_fd));
   time_closed_counter = 0;
 }
@@ -1277,10 +1281,28 @@ bool pfs_active(void) {
   return pfs_active_in_region(0, s_pfs_size);
 }
 
+// A temp file replaces its original by deleting the original and then marking
+// itself done (see pfs_close()). If the original is gone, we rebooted between
+// the two and the temp file is the only copy left.
+static bool prv_tmp_file_lost_original(uint16_t tmp_pg) {
+  FileHeader file_hdr;
+  prv_flash_read((uint8_t *)&file_hdr.file_namelen, sizeof(file_hdr.file_namelen),
+      prv_page_to_flash_offset(tmp_pg) + FILEHEADER_OFFSET +
+      offsetof(FileHeader, file_namelen));
+
+  char file_name[file_hdr.file_namelen + 1];
+  prv_flash_read((uint8_t *)file_name, file_hdr.file_namelen,
+      prv_page_to_flash_offset(tmp_pg) + FILE_NAME_OFFSET);
+  file_name[file_hdr.file_namelen] = '\0';
+
+  uint16_t orig_pg;
+  return (locate_flash_file(file_name, &orig_pg) == E_DOES_NOT_EXIST);
+}
+
 // Scans through the filesystem to see if we rebooted while a file was in the
 // middle of being created and cleans up these partial files.
 void pfs_reboot_cleanup(void) {
-  static uint16_t curr_pg = 0;
+  uint16_t curr_pg = s_reboot_cleanup_pg;
 
   for (; curr_pg < s_pfs_page_count; curr_pg++) {
     uint8_t page_flags = prv_get_page_flags(curr_pg);
@@ -1291,8 +1313,13 @@ void pfs_reboot_cleanup(void) {
             curr_pg);
         unlink_flash_file(curr_pg);
       } else if (is_tmp_file(curr_pg)) { // make sure this isn't a temp file
-        PBL_LOG_WRN("Removing temp file at %d", curr_pg);
-        unlink_flash_file(curr_pg);
+        if (prv_tmp_file_lost_original(curr_pg)) {
+          PBL_LOG_WRN("Finishing replacing original with temp file at %d", curr_pg);
+          update_curr_state(curr_pg, TMP_STATE_OFFSET, TMP_STATE_DONE);
+        } else {
+          PBL_LOG_WRN("Removing temp file at %d", curr_pg);
+          unlink_flash_file(curr_pg);
+        }
       }
     } else if (page_type_bits_set(page_flags, DELETED_START_PAGE_MASK) &&
         !is_delete_complete(curr_pg)) {
@@ -1300,6 +1327,7 @@ void pfs_reboot_cleanup(void) {
       unlink_flash_file(curr_pg);
     }
   }
+  s_reboot_cleanup_pg = curr_pg;
 
   update_last_written_page();
 }
@@ -1443,10 +1471,8 @@ status_t pfs_close(int fd) {
       PFS_FD(orig_fd).time_closed = time_closed_counter++;
     }
     pfs_remove(f->name);
-    // Note: if we reboot before updating the tmp state flag to done, the tmp &
-    // original file will be deleted. This is an extremely small window, but
-    // could be resolved by checking on reboot to see if both versions exist.
-    // If both exist, the orig is valid. Iff tmp exists, the tmp file is valid
+    // Note: if we reboot before updating the tmp state flag to done, only the
+    // tmp file is left, and pfs_reboot_cleanup() finishes marking it done.
     update_curr_state(f->start_page, TMP_STATE_OFFSET, TMP_STATE_DONE);
     f->is_tmp = false;
   }
@@ -96,6 +96,49 @@ static bool prv_needs_expiring_event(HRMSubscriberState *state, time_t utc_now)
       - MAX(HRM_SUBSCRIPTION_EXPIRING_WARNING_SEC, (int)state->update_interval_s)));
 }
 
+// Return the time at which hrm_manager_new_data_cb() next has to look at this subscriber's
+// expiration: when it's due a HRMEvent_SubscriptionExpiring event, or else when it expires. 0 if
+// the subscription never expires.
+static time_t prv_next_expiration_utc(const HRMSubscriberState *state) {
+  if (!state->expire_utc) {
+    return 0;
+  }
+  // KernelBG subscribers get their expiring event from prv_system_task_hrm_handler()
+  if (!state->sent_expiration_event && !state->callback_handler) {
+    return state->expire_utc
+        - MAX(HRM_SUBSCRIPTION_EXPIRING_WARNING_SEC, (int)state->update_interval_s);
+  }
+  return state->expire_utc;
+}
+
+// Recompute the summary of the subscriber list kept in s_manager_state. Must be called whenever a
+// subscription is added, removed or changed. Assumes that s_manager_state.lock is held.
+static void prv_update_subscriber_summary(void) {
+  HRMFeature subscribed_features = (HRMFeature)0;
+  time_t next_expiration_utc = 0;
+  bool has_short_interval_subscriber = false;
+
+  HRMSubscriberState *state = (HRMSubscriberState *)s_manager_state.subscribers;
+  for (; state != NULL; state = (HRMSubscriberState *)state->list_node.next) {
+    subscribed_features |= state->features;
+
+    const time_t expiration_utc = prv_next_expiration_utc(state);
+    if (expiration_utc && (!next_expiration_utc || expiration_utc < next_expiration_utc)) {
+      next_expiration_utc = expiration_utc;
+    }
+
+    // A subscriber that wants updates more often than the sensor takes to spin up never lets
+    // prv_update_hrm_enable_system_cb() turn the sensor off
+    if (state->update_interval_s <= HRM_SENSOR_SPIN_UP_SEC) {
+      has_short_interval_subscriber = true;
+    }
+  }
+
+  s_manager_state.subscribed_features = subscribed_features;
+  s_manager_state.next_expiration_utc = next_expiration_utc;
+  s_manager_state.has_short_interval_subscriber = has_short_interval_subscriber;
+}
+
 T_STATIC void prv_read_event_from_buffer_and_consume(CircularBuffer *buffer,
                                                      PebbleHRMEvent *event) {
   const uint16_t total_size = sizeof(*event);
@@ -120,6 +163,7 @@ T_STATIC void prv_read_event_from_buffer_and_consume(CircularBuffer *buffer,
 static void prv_remove_and_free_subscription(HRMSubscriberState *state) {
   list_remove((ListNode *)state, &s_manager_state.subscribers, NULL);
   kernel_free(state);
+  prv_update_subscriber_summary();
 }
 
 #if UNITTEST
@@ -522,32 +566,38 @@ void hrm_manager_new_data_cb(const HRMData *data) {
   RtcTicks cur_ticks = rtc_get_ticks();
   HRMFeature kernel_bg_features_sent = 0;
 
+  // Only count Good+ or OffWrist as "served" for sensor power cycling
+  const bool is_valid_bpm = (data->features & HRMFeature_BPM) &&
+                            (data->hrm_quality >= HRMQuality_Good ||
+                             data->hrm_quality == HRMQuality_OffWrist);
+  // Features in this sample that at least one subscriber wants
+  const HRMFeature features_to_send = data->features & s_manager_state.subscribed_features;
+  // Most samples arrive well before any subscription is due an expiring event or expires
+  const bool check_expiration = s_manager_state.next_expiration_utc &&
+                                (utc_now >= s_manager_state.next_expiration_utc);
+  bool removed_expired = false;
+
   HRMSubscriberState *state = (HRMSubscriberState *)s_manager_state.subscribers;
   while (state) {
     HRMSubscriberState *expired_state = NULL;
 
-    // Only count Good+ or OffWrist as "served" for sensor power cycling
-    if ((data->features & HRMFeature_BPM) &&
-        (data->hrm_quality >= HRMQuality_Good ||
-         data->hrm_quality == HRMQuality_OffWrist)) {
+    if (is_valid_bpm) {
       state->last_valid_bpm_ticks = cur_ticks;
     }
 
     PebbleHRMEvent hrm_event;
-    for (uint8_t i = 0; i < HRMFeatureShiftMax; ++i) {
-      HRMFeature feature = (1 << i);
-      if (!(state->features & feature) || !(data->features & feature)) {
-        continue;
-      }
-      if (state->callback_handler) {
-        // For kernel BG subscribers, we only queue one event of each type (which is then
-        // dispatched to all KernelBG subscribers from the KernelBG callback) so that we don't
-        // overfill our limited size circular buffer.
-        if (kernel_bg_features_sent & feature) {
-          continue;
-        }
-        kernel_bg_features_sent |= feature;
-      }
+    HRMFeature pending_features = state->features & features_to_send;
+    if (state->callback_handler) {
+      // For kernel BG subscribers, we only queue one event of each type (which is then
+      // dispatched to all KernelBG subscribers from the KernelBG callback) so that we don't
+      // overfill our limited size circular buffer.
+      pending_features &= ~kernel_bg_features_sent;
+      kernel_bg_features_sent |= pending_features;
+    }
+    while (pending_features) {
+      // Send the features lowest bit first
+      const HRMFeature feature = (HRMFeature)(pending_features & -pending_features);
+      pending_features &= ~feature;
       prv_populate_hrm_event(&hrm_event, feature, data);
       if (!prv_event_put(state, &hrm_event)) {
         // Consumer queue full (e.g. app not draining events); drop instead of panicking.
@@ -555,24 +605,26 @@ void hrm_manager_new_data_cb(const HRMData *data) {
       }
     }
 
-    // If this is an app subscription, see if we need to send an "expiring" event. We check
-    // KernelBG subscribers from the system callback function (prv_system_task_hrm_handler).
-    if (!state->callback_handler && prv_needs_expiring_event(state, utc_now)) {
-      hrm_event = (PebbleHRMEvent) {
-        .event_type = HRMEvent_SubscriptionExpiring,
-        .expiring.session_ref = state->session_ref,
-      };
-      if (prv_event_put(state, &hrm_event)) {
-        state->sent_expiration_event = true;
-      } else {
-        // Retry on the next sample rather than panicking.
-        ++s_manager_state.dropped_events;
+    if (check_expiration) {
+      // If this is an app subscription, see if we need to send an "expiring" event. We check
+      // KernelBG subscribers from the system callback function (prv_system_task_hrm_handler).
+      if (!state->callback_handler && prv_needs_expiring_event(state, utc_now)) {
+        hrm_event = (PebbleHRMEvent) {
+          .event_type = HRMEvent_SubscriptionExpiring,
+          .expiring.session_ref = state->session_ref,
+        };
+        if (prv_event_put(state, &hrm_event)) {
+          state->sent_expiration_event = true;
+        } else {
+          // Retry on the next sample rather than panicking.
+          ++s_manager_state.dropped_events;
+        }
       }
-    }
 
-    if (state->expire_utc && (utc_now >= state->expire_utc)) {
-      // This subscription has expired
-      expired_state = state;
+      if (state->expire_utc && (utc_now >= state->expire_utc)) {
+        // This subscription has expired
+        expired_state = state;
+      }
     }
     state = (HRMSubscriberState *)state->list_node.next;
 
@@ -580,15 +632,28 @@ void hrm_manager_new_data_cb(const HRMData *data) {
     if (expired_state) {
       PBL_LOG_DBG("Subscription %"PRIu32" expired", expired_state->session_ref);
       prv_remove_and_free_subscription(expired_state);
+      removed_expired = true;
     }
   }
 
-  // Update the HRM enable state. If no subscribers need an update for a while, we can turn off the
-  // HR sensor and set a timer to turn it on again later. To avoid this overhead on every callback,
-  // we only check it once every HRM_CHECK_SENSOR_DISABLE_COUNT times
-  if (++s_manager_state.check_disable_counter >= HRM_CHECK_SENSOR_DISABLE_COUNT) {
-    s_manager_state.check_disable_counter = 0;
+  if (check_expiration) {
+    // Pick up the expiring events we just sent
+    prv_update_subscriber_summary();
+  }
+
+  if (removed_expired) {
+    // The remaining subscribers may not need the sensor, or need a different feature mix
     system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
+  } else if (!s_manager_state.has_short_interval_subscriber) {
+    // Update the HRM enable state. If no subscribers need an update for a while, we can turn off
+    // the HR sensor and set a timer to turn it on again later. To avoid this overhead on every
+    // callback, we only check it once every HRM_CHECK_SENSOR_DISABLE_COUNT times. Subscribers
+    // with a short update interval keep the sensor on, and subscription changes schedule their
+    // own update, so there is nothing to check while one of them is around.
+    if (++s_manager_state.check_disable_counter >= HRM_CHECK_SENSOR_DISABLE_COUNT) {
+      s_manager_state.check_disable_counter = 0;
+      system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
+    }
   }
 unlock:
   mutex_unlock_recursive(s_manager_state.lock);
@@ -663,6 +728,7 @@ HRMSessionRef hrm_manager_subscribe_with_callback(AppInstallId app_id, uint32_t
   };
   s_manager_state.subscribers =
     list_insert_before(s_manager_state.subscribers, &state->list_node);
+  prv_update_subscriber_summary();
 
   // Update the HR enablement state
   system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
@@ -759,6 +825,9 @@ DEFINE_SYSCALL(bool, sys_hrm_manager_set_features, HRMSessionRef session, HRMFea
   HRMSubscriberState *state = prv_get_subscriber_state_from_ref(session);
   if (state) {
     state->features = features;
+    prv_update_subscriber_summary();
+    // The sensor may need to be restarted with a different feature mix
+    system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
     success = true;
   }
   mutex_unlock_recursive(s_manager_state.lock);
@@ -775,6 +844,7 @@ DEFINE_SYSCALL(bool, sys_hrm_manager_set_update_interval, HRMSessionRef session,
     state->update_interval_s = update_interval_s;
     state->expire_utc = (expire_s != 0) ? (rtc_get_time() + expire_s) : 0;
     state->sent_expiration_event = false;
+    prv_update_subscriber_summary();
     success = true;
   }
   system_task_add_callback(prv_update_hrm_enable_system_cb, NULL);
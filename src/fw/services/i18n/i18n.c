@@ -47,11 +47,23 @@ PBL_LOG_MODULE_DEFINE(service_i18n, CONFIG_SERVICE_I18N_LOG_LEVEL);
 // See mo.h for a description of the MO file format //
 //////////////////////////////////////////////////////
 
+//! The lengths of the original strings are kept in RAM for packs with up to this many strings,
+//! a byte each, so that a probe only reads an entry of the pack's original string table once a
+//! length matches. Bigger packs read the entry for every probe.
+#define MO_OLENGTHS_MAX_COUNT 2048
+
+//! How many entries of the original string table are read at once to fill in their lengths
+#define MO_OTABLE_READ_COUNT 16
+
+//! The strings handed out by i18n_get(), looked up by original string and owner. Open addressed
+//! with linear probing, and grown once it's three quarters full.
 typedef struct {
-  uint32_t hash;
-  const char *string;
-  const void *owner;
-} StringLookupInfo;
+  I18nString **slots;
+  uint32_t capacity;  //!< always a power of two
+  uint32_t count;
+} StringCache;
+
+#define STRING_CACHE_MIN_CAPACITY 32
 
 static struct DomainBinding {
   uint32_t resource_id;
@@ -59,13 +71,13 @@ static struct DomainBinding {
   bool need_reload;
   ResourceVersion version;
   MoHandle mohandle;
-  I18nString *strings_list;
+  StringCache strings;
   char iso_locale[ISO_LOCALE_LENGTH];
   char lang_name[LOCALE_NAME_LENGTH];
   uint16_t lang_version;
 } s_system_domain;
 
-static void prv_list_flush(void);
+static void prv_string_cache_flush(void);
 
 ///////////////////////////////////////////////////
 // MO File Hash Table
@@ -122,9 +134,14 @@ static void prv_lookup(const char *msgid, struct DomainBinding *db,
       /* unexpected miss */
       return;
     }
+    if (mohandle->mo.mo_olengths &&
+        mohandle->mo.mo_olengths[strno] != MIN(len, UINT8_MAX)) {
+      idx = prv_next_index(idx, mohandle->mo.hdr.mo_hsize, step);
+      continue;
+    }
     MoEntry oentry;
     if (resource_load_byte_range_system(0, db->resource_id, mohandle->mo.hdr.mo_otable
-            + sizeof(MoEntry) * strno, (uint8_t *)&oentry, sizeof(MoEntry)) != sizeof(MoEntry)) {
+        + sizeof(MoEntry) * strno, (uint8_t *)&oentry, sizeof(MoEntry)) != sizeof(MoEntry)) {
       return;
     }
     if (len == oentry.len) {
@@ -238,6 +255,8 @@ static int prv_unmapit(struct DomainBinding *db) {
 
   kernel_free(mohandle->mo.mo_htable);
   mohandle->mo.mo_htable = NULL;
+  kernel_free(mohandle->mo.mo_olengths);
+  mohandle->mo.mo_olengths = NULL;
   mohandle->mo = (Mo){};
   strcpy(db->iso_locale, "en_US");
   strcpy(db->lang_name, "English");
@@ -257,7 +276,7 @@ static bool prv_mapit(const uint32_t resource_id, struct DomainBinding *db) {
 
   /* save version */
   db->version = resource_get_version(SYSTEM_APP, resource_id);
-  prv_list_flush();
+  prv_string_cache_flush();
   prv_unmapit(db);
 
   unsigned int size;
@@ -280,7 +299,7 @@ static bool prv_mapit(const uint32_t resource_id, struct DomainBinding *db) {
 
   mohandle->len = size;
     /* validate htable */
-  if (mohandle->mo.hdr.mo_hsize < 2) {
+  if (mohandle->mo.hdr.mo_hsize < 2 || mohandle->mo.hdr.mo_nstring == 0) {
     goto fail;
   }
 
@@ -301,6 +320,25 @@ static bool prv_mapit(const uint32_t resource_id, struct DomainBinding *db) {
     }
   }
 
+  if (mohandle->mo.hdr.mo_nstring <= MO_OLENGTHS_MAX_COUNT) {
+    uint8_t *olengths = kernel_malloc_check(mohandle->mo.hdr.mo_nstring);
+    mohandle->mo.mo_olengths = olengths;
+    for (uint32_t i = 0; i < mohandle->mo.hdr.mo_nstring; i += MO_OTABLE_READ_COUNT) {
+      MoEntry oentries[MO_OTABLE_READ_COUNT];
+      const uint32_t count = MIN(MO_OTABLE_READ_COUNT, mohandle->mo.hdr.mo_nstring - i);
+      const size_t read_size = sizeof(MoEntry) * count;
+      if (resource_load_byte_range_system(SYSTEM_APP, resource_id,
+          mohandle->mo.hdr.mo_otable + sizeof(MoEntry) * i, (uint8_t *)oentries,
+          read_size) != read_size) {
+        prv_unmapit(db);
+        goto fail;
+      }
+      for (uint32_t j = 0; j < count; j++) {
+        olengths[i + j] = MIN(oentries[j].len, UINT8_MAX);
+      }
+    }
+  }
+
   if (!prv_get_metadata(db)) {
       prv_unmapit(db);
       goto fail;
@@ -313,53 +351,99 @@ fail:
 }
 
 ///////////////////////////////////////////////////
-// Strings List Manipulation
+// Strings Cache Manipulation
 
-void prv_list_flush(void) {
-  ListNode *cur = (ListNode *)s_system_domain.strings_list;
-  while (cur) {
-    ListNode *next = list_get_next(cur);
-    kernel_free(cur);
-    cur = next;
+static void prv_string_cache_flush(void) {
+  StringCache *cache = &s_system_domain.strings;
+  for (uint32_t i = 0; i < cache->capacity; i++) {
+    kernel_free(cache->slots[i]);
   }
-  s_system_domain.strings_list = NULL;
+  kernel_free(cache->slots);
+  *cache = (StringCache){};
 }
 
-static bool prv_list_string_filter_callback(ListNode *found_node, void *data) {
-  I18nString *i18n_string = (I18nString *)found_node;
-  StringLookupInfo *lookup_info = data;
-  if (i18n_string->original_hash == lookup_info->hash &&
-      lookup_info->owner == i18n_string->owner &&
-      strcmp(i18n_string->original_string, lookup_info->string) == 0) {
-    return true;
-  } else {
-    return false;
+static uint32_t prv_string_cache_index(const StringCache *cache, uint32_t hash,
+                                       const void *owner) {
+  // Owners are often shared by many strings, mix them in so they don't all start probing at
+  // the same slot
+  const uint32_t key = hash ^ ((uint32_t)(uintptr_t)owner * 2654435761u);
+  return key & (cache->capacity - 1);
+}
+
+//! @return the slot holding the string, or the empty slot where it would be inserted
+static uint32_t prv_string_cache_probe(const StringCache *cache, const char *string,
+                                       uint32_t hash, const void *owner) {
+  uint32_t idx = prv_string_cache_index(cache, hash, owner);
+  while (cache->slots[idx]) {
+    const I18nString *i18n_string = cache->slots[idx];
+    if (i18n_string->original_hash == hash && i18n_string->owner == owner &&
+        strcmp(i18n_string->original_string, string) == 0) {
+      break;
+    }
+    idx = (idx + 1) & (cache->capacity - 1);
   }
+  return idx;
 }
 
-static bool prv_list_owner_filter_callback(ListNode *found_node, void *owner) {
-  I18nString *i18n_string = (I18nString *)found_node;
-  if (i18n_string->owner == owner) {
-    return true;
-  } else {
-    return false;
+static void prv_string_cache_grow(StringCache *cache) {
+  I18nString **old_slots = cache->slots;
+  const uint32_t old_capacity = cache->capacity;
+
+  cache->capacity = old_capacity ? (old_capacity * 2) : STRING_CACHE_MIN_CAPACITY;
+  cache->slots = kernel_zalloc_check(sizeof(I18nString *) * cache->capacity);
+  for (uint32_t i = 0; i < old_capacity; i++) {
+    I18nString *i18n_string = old_slots[i];
+    if (i18n_string) {
+      uint32_t idx = prv_string_cache_index(cache, i18n_string->original_hash,
+                                            i18n_string->owner);
+      while (cache->slots[idx]) {
+        idx = (idx + 1) & (cache->capacity - 1);
+      }
+      cache->slots[idx] = i18n_string;
+    }
   }
+  kernel_free(old_slots);
+}
+
+//! Frees the string in a slot, moving back the strings probed past it so that no probe stops
+//! short of them
+static void prv_string_cache_remove_slot(StringCache *cache, uint32_t idx) {
+  kernel_free(cache->slots[idx]);
+  const uint32_t mask = cache->capacity - 1;
+  uint32_t hole = idx;
+  uint32_t next = (idx + 1) & mask;
+  while (cache->slots[next]) {
+    const I18nString *i18n_string = cache->slots[next];
+    const uint32_t home = prv_string_cache_index(cache, i18n_string->original_hash,
+                                                 i18n_string->owner);
+    // The string can fill the hole if the hole is on its probe path from its home slot
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      cache->slots[hole] = cache->slots[next];
+      hole = next;
+    }
+    next = (next + 1) & mask;
+  }
+  cache->slots[hole] = NULL;
+  cache->count--;
 }
 
 // Not static because we call this from unit test code
-I18nString *prv_list_find_string(const char *string, const void *owner) {
-  StringLookupInfo lookup_info = {
-    .string = string,
-    .hash = prv_gettext_hash(string),
-    .owner = owner
-  };
-  return (I18nString *)list_find((ListNode *)s_system_domain.strings_list,
-      prv_list_string_filter_callback, (void *)&lookup_info);
+I18nString *prv_string_cache_find(const char *string, const void *owner) {
+  StringCache *cache = &s_system_domain.strings;
+  if (cache->count == 0) {
+    return NULL;
+  }
+  const uint32_t idx = prv_string_cache_probe(cache, string, prv_gettext_hash(string), owner);
+  return cache->slots[idx];
 }
 
+static const char *prv_string_cache_add(const char *original_string,
+                                        const char *translated_string, const void *owner) {
+  StringCache *cache = &s_system_domain.strings;
+  if ((cache->count + 1) * 4 > cache->capacity * 3) {
+    prv_string_cache_grow(cache);
+  }
 
-static const char *prv_list_add_string(const char *original_string, const char *translated_string,
-                                       const void *owner) {
   uint32_t translated_len = strlen(translated_string);
 
   // Allocate enough space to hold the original and translated strings. The translated string
@@ -367,18 +451,19 @@ static const char *prv_list_add_string(const char *original_string, const char *
   I18nString *i18n_string = kernel_malloc_check(sizeof(I18nString) + translated_len + 1
               + strlen(original_string) + 1);
 
-  list_init(&i18n_string->node);
   i18n_string->owner = owner;
 
   strcpy(i18n_string->translated_string, translated_string);
 
   i18n_string->original_hash = prv_gettext_hash(original_string);
-  // Store the original string immediately after the translated one in memory. 
+  // Store the original string immediately after the translated one in memory.
   i18n_string->original_string = &i18n_string->translated_string[translated_len + 1];
   strcpy(i18n_string->original_string, original_string);
 
-  I18nString **strings_list = &s_system_domain.strings_list;
-  *strings_list = (I18nString *)list_prepend((ListNode *)*strings_list, &i18n_string->node);
+  const uint32_t idx = prv_string_cache_probe(cache, original_string, i18n_string->original_hash,
+                                              owner);
+  cache->slots[idx] = i18n_string;
+  cache->count++;
 
   if (translated_len > 0) {
     return (i18n_string->translated_string);
@@ -387,9 +472,28 @@ static const char *prv_list_add_string(const char *original_string, const char *
   }
 }
 
-static void prv_list_remove_string(I18nString *i18n_string) {
-  list_remove(&i18n_string->node, (ListNode **)&s_system_domain.strings_list, NULL);
-  kernel_free(i18n_string);
+static void prv_string_cache_remove(const char *string, const void *owner) {
+  StringCache *cache = &s_system_domain.strings;
+  if (cache->count == 0) {
+    return;
+  }
+  const uint32_t idx = prv_string_cache_probe(cache, string, prv_gettext_hash(string), owner);
+  if (cache->slots[idx]) {
+    prv_string_cache_remove_slot(cache, idx);
+  }
+}
+
+static void prv_string_cache_remove_owner(const void *owner) {
+  StringCache *cache = &s_system_domain.strings;
+  uint32_t idx = 0;
+  while (cache->count && idx < cache->capacity) {
+    if (cache->slots[idx] && cache->slots[idx]->owner == owner) {
+      // Another string may have moved into this slot, so look at it again
+      prv_string_cache_remove_slot(cache, idx);
+    } else {
+      idx++;
+    }
+  }
 }
 
 static bool prv_check_domain(struct DomainBinding *db) {
@@ -426,7 +530,7 @@ const char *i18n_get(const char *msgid, const void *owner) {
     goto fail;
   }
   // See if this original has been cached.
-  I18nString *i18n_string = prv_list_find_string(msgid, owner);
+  I18nString *i18n_string = prv_string_cache_find(msgid, owner);
   if (i18n_string) {
     if (i18n_string->translated_string[0]) {
       return i18n_string->translated_string;
@@ -445,10 +549,10 @@ const char *i18n_get(const char *msgid, const void *owner) {
   }
 
   if (len) {
-    return prv_list_add_string(msgid, translated, owner);
+    return prv_string_cache_add(msgid, translated, owner);
   } else {
     // Add to cache as an untranslatable string so we don't waste time looking for it again.
-    prv_list_add_string(msgid, (const char *)"", owner);
+    prv_string_cache_add(msgid, (const char *)"", owner);
   }
 
 fail:
@@ -511,21 +615,11 @@ fail:
 
 void i18n_free(const char *original, const void *owner) {
   PBL_ASSERTN(owner);
-  I18nString *i18n_string = prv_list_find_string(original, owner);
-  if (i18n_string) {
-    prv_list_remove_string(i18n_string);
-  }
+  prv_string_cache_remove(original, owner);
 }
 
 void i18n_free_all(const void *owner) {
-  I18nString *cur_string = (I18nString *)list_find((ListNode *)s_system_domain.strings_list,
-      prv_list_owner_filter_callback, (void*)owner);
-  while (cur_string) {
-    I18nString *next_string = (I18nString *)list_find_next(&cur_string->node,
-        prv_list_owner_filter_callback, false, (void*)owner);
-    prv_list_remove_string(cur_string);
-    cur_string = next_string;
-  }
+  prv_string_cache_remove_owner(owner);
 }
 
 static void prv_resource_changed_handler(void *data) {
@@ -549,7 +643,7 @@ static void prv_resource_changed_callback(void *data) {
 
 static void prv_unset(void) {
   s_system_domain.need_reload = false;
-  prv_list_flush();
+  prv_string_cache_flush();
   prv_unmapit(&s_system_domain);
 }
 
@@ -8,6 +8,7 @@
 #include <string.h>
 
 #include "kernel/pbl_malloc.h"
+#include "kernel/pebble_tasks.h"
 #include "pbl/os/mutex.h"
 #include "process_management/app_install_manager.h"
 #include "pbl/services/filesystem/app_file.h"
@@ -18,12 +19,30 @@
 #include "pbl/util/attributes.h"
 #include "pbl/util/list.h"
 #include "pbl/util/math.h"
+#include "pbl/util/misc.h"
 #include "util/units.h"
 
 PBL_LOG_MODULE_DEFINE(service_persist, CONFIG_SERVICE_PERSIST_LOG_LEVEL);
 
 #define PERSIST_STORAGE_MAX_SPACE MiBYTES(1)
 #define PERSIST_STORAGE_INITIAL_ALLOC KiBYTES(4)
+//! Upper bound on the RAM a single open transaction may buffer, headers included
+#define PERSIST_TRANSACTION_MAX_SIZE KiBYTES(2)
+
+//! A write buffered by an open transaction. Repeated writes to a key replace its entry.
+typedef struct PersistPendingWrite {
+  ListNode list_node;
+  uint32_t key;
+  uint16_t val_len;             //!< 0 for a pending delete
+  uint8_t val[];
+} PersistPendingWrite;
+
+typedef struct PersistTransaction {
+  ListNode list_node;
+  PebbleTask task;              //!< Only this task's accesses go through the transaction
+  PersistPendingWrite *writes;
+  size_t size;                  //!< RAM held by writes
+} PersistTransaction;
 
 typedef struct PersistStore {
   ListNode  list_node;
@@ -31,6 +50,8 @@ typedef struct PersistStore {
   SettingsFile file;
   bool file_open;
   uint8_t usage_count;          //!< How many clients are using this store
+  //! Open transactions, at most one per client task
+  PersistTransaction *transactions;
 } PersistStore;
 
 // Each open client has a PersistStore structure linked into this list. If both
@@ -236,6 +257,192 @@ void persist_service_unlock_store(SettingsFile *store) {
   prv_unlock();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Transactions
+//
+// A transaction buffers one task's writes and deletes in RAM and applies them
+// atomically when committed. The store's mutex must be held (i.e. the store was
+// obtained from persist_service_lock_and_get_store()) for all of these.
+
+static PersistStore *prv_store_for_file(SettingsFile *file) {
+  return container_of(file, PersistStore, file);
+}
+
+static bool prv_transaction_task_filter(ListNode *node, void *data) {
+  return ((PersistTransaction *)node)->task == (PebbleTask)(uintptr_t)data;
+}
+
+static PersistTransaction *prv_find_transaction(PersistStore *store) {
+  return (PersistTransaction *)list_find(
+      &store->transactions->list_node, prv_transaction_task_filter,
+      (void *)(uintptr_t)pebble_task_get_current());
+}
+
+static bool prv_pending_key_filter(ListNode *node, void *data) {
+  return ((PersistPendingWrite *)node)->key == *(uint32_t *)data;
+}
+
+static PersistPendingWrite *prv_find_pending_write(SettingsFile *file, uint32_t key) {
+  PersistTransaction *txn = prv_find_transaction(prv_store_for_file(file));
+  if (!txn) {
+    return NULL;
+  }
+  return (PersistPendingWrite *)list_find(&txn->writes->list_node, prv_pending_key_filter, &key);
+}
+
+static size_t prv_pending_write_size(const PersistPendingWrite *write) {
+  return sizeof(*write) + write->val_len;
+}
+
+static void prv_free_transaction(PersistTransaction *txn) {
+  PersistPendingWrite *write = txn->writes;
+  while (write) {
+    PersistPendingWrite *next = (PersistPendingWrite *)write->list_node.next;
+    kernel_free(write);
+    write = next;
+  }
+  kernel_free(txn);
+}
+
+static void prv_discard_transaction(PersistStore *store, PersistTransaction *txn) {
+  list_remove(&txn->list_node, (ListNode **)&store->transactions, NULL);
+  prv_free_transaction(txn);
+}
+
+// Hands the whole batch to the settings file in one go, so that it lands
+// atomically and is refused as a whole if it would take the store over quota.
+static status_t prv_apply_transaction(SettingsFile *file, PersistTransaction *txn) {
+  const size_t num_writes = list_count(&txn->writes->list_node);
+  if (num_writes == 0) {
+    return S_SUCCESS;
+  }
+  SettingsFileBatchWrite *batch = kernel_malloc(num_writes * sizeof(*batch));
+  if (!batch) {
+    return E_OUT_OF_MEMORY;
+  }
+  size_t i = 0;
+  for (PersistPendingWrite *write = txn->writes; write;
+       write = (PersistPendingWrite *)write->list_node.next) {
+    batch[i++] = (SettingsFileBatchWrite) {
+      .key = &write->key,
+      .key_len = sizeof(write->key),
+      .val = write->val,
+      .val_len = write->val_len,
+    };
+  }
+  status_t rv = settings_file_set_batch(file, batch, num_writes);
+  if (FAILED(rv)) {
+    PBL_LOG_ERR("Failed to commit %u persist keys: %"PRIi32, (unsigned)num_writes, rv);
+  }
+  kernel_free(batch);
+  return rv;
+}
+
+status_t persist_service_begin_transaction(SettingsFile *file) {
+  PersistStore *store = prv_store_for_file(file);
+  PersistTransaction *txn = prv_find_transaction(store);
+  if (txn) {
+    // Transactions don't nest, and one left open by a process that exited while
+    // another client kept the store open must not leak into the next one.
+    prv_discard_transaction(store, txn);
+  }
+
+  txn = kernel_malloc(sizeof(*txn));
+  if (!txn) {
+    return E_OUT_OF_MEMORY;
+  }
+  *txn = (PersistTransaction) {
+    .task = pebble_task_get_current(),
+  };
+  store->transactions = (PersistTransaction *)list_prepend(&store->transactions->list_node,
+                                                           &txn->list_node);
+  return S_SUCCESS;
+}
+
+status_t persist_service_commit_transaction(SettingsFile *file) {
+  PersistStore *store = prv_store_for_file(file);
+  PersistTransaction *txn = prv_find_transaction(store);
+  if (!txn) {
+    return E_INVALID_OPERATION;
+  }
+  // Take it out first so the writes below go straight to the file
+  list_remove(&txn->list_node, (ListNode **)&store->transactions, NULL);
+
+  status_t rv = prv_apply_transaction(file, txn);
+  prv_free_transaction(txn);
+  return rv;
+}
+
+bool persist_service_exists(SettingsFile *file, uint32_t key) {
+  return (persist_service_get_len(file, key) > 0);
+}
+
+int persist_service_get_len(SettingsFile *file, uint32_t key) {
+  PersistPendingWrite *write = prv_find_pending_write(file, key);
+  if (write) {
+    return write->val_len;
+  }
+  return settings_file_get_len(file, &key, sizeof(key));
+}
+
+status_t persist_service_get(SettingsFile *file, uint32_t key, void *val_out, size_t val_len) {
+  PersistPendingWrite *write = prv_find_pending_write(file, key);
+  if (!write) {
+    return settings_file_get(file, &key, sizeof(key), val_out, val_len);
+  }
+  if (write->val_len == 0 || val_len > write->val_len) {
+    memset(val_out, 0, val_len);
+    return (write->val_len == 0) ? E_DOES_NOT_EXIST : E_RANGE;
+  }
+  memcpy(val_out, write->val, val_len);
+  return S_SUCCESS;
+}
+
+status_t persist_service_set(SettingsFile *file, uint32_t key, const void *val, size_t val_len) {
+  PersistTransaction *txn = prv_find_transaction(prv_store_for_file(file));
+  if (!txn) {
+    return settings_file_set(file, &key, sizeof(key), val, val_len);
+  }
+  if (val_len > SETTINGS_VAL_MAX_LEN) {
+    return E_RANGE;
+  }
+
+  PersistPendingWrite *old = (PersistPendingWrite *)list_find(
+      &txn->writes->list_node, prv_pending_key_filter, &key);
+  const size_t old_size = old ? prv_pending_write_size(old) : 0;
+  const size_t new_size = sizeof(PersistPendingWrite) + val_len;
+  if (txn->size - old_size + new_size > PERSIST_TRANSACTION_MAX_SIZE) {
+    return E_OUT_OF_RESOURCES;
+  }
+  PersistPendingWrite *write = kernel_malloc(new_size);
+  if (!write) {
+    return E_OUT_OF_MEMORY;
+  }
+  *write = (PersistPendingWrite) {
+    .key = key,
+    .val_len = val_len,
+  };
+  memcpy(write->val, val, val_len);
+
+  if (old) {
+    list_remove(&old->list_node, (ListNode **)&txn->writes, NULL);
+    kernel_free(old);
+    txn->size -= old_size;
+  }
+  // Kept in the order keys were last written
+  txn->writes = (PersistPendingWrite *)list_get_head(
+      list_append(&txn->writes->list_node, &write->list_node));
+  txn->size += new_size;
+  return S_SUCCESS;
+}
+
+status_t persist_service_delete(SettingsFile *file, uint32_t key) {
+  if (prv_find_transaction(prv_store_for_file(file))) {
+    return persist_service_set(file, key, NULL, 0);
+  }
+  return settings_file_delete(file, &key, sizeof(key));
+}
+
 // Create a store for a client of the given UUID it doesn't already exist. If it
 // exists already (another client with the same UUID is running), then just
 // increment its usage count. This is called by the process startup code
@@ -271,6 +478,10 @@ void persist_service_client_close(const Uuid *uuid) {
                 store->usage_count >= 1);
 
     if (--store->usage_count == 0) {
+      // Uncommitted writes are dropped along with the store
+      while (store->transactions) {
+        prv_discard_transaction(store, store->transactions);
+      }
       if (store->file_open) {
         settings_file_close(&store->file);
       }
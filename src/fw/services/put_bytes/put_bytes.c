@@ -653,6 +653,8 @@ static bool prv_setup_storage_for_init_request(const InitRequest *request, uint3
       // The +1 is to make up for the fact that app banks start at 0, res banks start at 1. Fixing
       // in D641
       resource_storage_get_file_name(filename, sizeof(filename), index);
+      // Replacing the bank, so forget it was ever validated along with whatever is cached from it
+      resource_storage_clear(index);
       storage_info = kernel_malloc_check(sizeof(PutBytesStorageInfo) + strlen(filename) + 1);
       strcpy(storage_info->filename, filename);
       break;
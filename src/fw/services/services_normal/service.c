@@ -31,6 +31,7 @@
 #include "pbl/services/speaker/speaker_service.h"
 #include "pbl/services/stationary.h"
 #include "pbl/services/timeline/event.h"
+#include "pbl/services/timeline/timeline.h"
 #include "pbl/services/wakeup.h"
 #include "pbl/services/weather/weather_service.h"
 #include "pbl/services/runlevel_impl.h"
@@ -93,6 +94,7 @@ void services_normal_init(void) {
   music_init();
   alarm_init();
   timeline_event_init();
+  timeline_pin_cache_init();
   dls_init();
 
   wakeup_init();
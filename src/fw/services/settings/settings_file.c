@@ -216,8 +216,28 @@ static void compute_stats(SettingsFile *file) {
   }
 }
 
-status_t settings_file_rewrite_filtered(
-    SettingsFile *file, SettingsFileRewriteFilterCallback filter_cb, void *context) {
+static void prv_write_batch_record(SettingsRawIter *iter, const SettingsFileBatchWrite *write,
+                                   uint32_t timestamp) {
+  SettingsRecordHeader hdr;
+  memset(&hdr, 0xff, sizeof(hdr));
+  hdr.last_modified = timestamp;
+  hdr.key_hash = crc8_calculate_bytes(write->key, write->key_len, true /* big_endian */);
+  hdr.key_len = write->key_len;
+  hdr.val_len = write->val_len;
+  // The new file is thrown away unless it gets swapped in, by which point every
+  // record in it is complete, so there is no need to write the header twice.
+  set_flag(&hdr, SETTINGS_FLAG_WRITE_COMPLETE);
+  settings_raw_iter_write_header(iter, &hdr);
+  settings_raw_iter_write_key(iter, write->key);
+  settings_raw_iter_write_val(iter, write->val);
+  settings_raw_iter_next(iter);
+}
+
+// Copies the records of file which pass filter_cb into a new file of the same
+// name, appends the records for writes, and swaps the new file in.
+static status_t prv_rewrite(SettingsFile *file, int alloc_used_space,
+                            SettingsFileRewriteFilterCallback filter_cb, void *context,
+                            const SettingsFileBatchWrite *writes, size_t num_writes) {
   // One reusable buffer for key+val per record; sized for the worst case.
   // Avoids two malloc/free pairs per record over what can be thousands of
   // records on a large persist file.
@@ -236,7 +256,7 @@ status_t settings_file_rewrite_filtered(
 
   SettingsFile new_file;
   status_t status = prv_open(&new_file, file->name, OP_FLAG_OVERWRITE | OP_FLAG_READ,
-                             file->max_used_space, file->alloc_used_space,
+                             file->max_used_space, alloc_used_space,
                              file->min_alloc_used_space);
   if (status < 0) {
     PBL_LOG_ERR("Could not open temporary file to compact settings file. Error %"PRIi32".",
@@ -285,23 +305,40 @@ status_t settings_file_rewrite_filtered(
     }
   }
   kernel_free(kv_buf);
+
+  const uint32_t timestamp = utc_time();
+  for (size_t i = 0; i < num_writes; i++) {
+    prv_write_batch_record(&new_file.iter, &writes[i], timestamp);
+  }
+
   settings_file_close(file);
   // We have to close and reopen the new_file so that it's temp flag is cleared.
   // Before the close succeeds, if we reboot, we will just end up reading the
   // old file. After the close suceeds, we will end up reading the new
   // (compacted) file.
-  int alloc_used_space = new_file.alloc_used_space;
+  int new_alloc_used_space = new_file.alloc_used_space;
   int min_alloc_used_space = new_file.min_alloc_used_space;
   settings_file_close(&new_file);
   status = prv_open(file, name, OP_FLAG_READ | OP_FLAG_WRITE,
-                    file->max_used_space, alloc_used_space, min_alloc_used_space);
+                    file->max_used_space, new_alloc_used_space, min_alloc_used_space);
   kernel_free(name);
 
   task_watchdog_resume();
 
+  if (status >= 0 && s_change_callback) {
+    for (size_t i = 0; i < num_writes; i++) {
+      s_change_callback(file, writes[i].key, writes[i].key_len, timestamp);
+    }
+  }
+
   return status;
 }
 
+status_t settings_file_rewrite_filtered(
+    SettingsFile *file, SettingsFileRewriteFilterCallback filter_cb, void *context) {
+  return prv_rewrite(file, file->alloc_used_space, filter_cb, context, NULL, 0);
+}
+
 void settings_file_set_change_callback(SettingsFileChangeCallback callback) {
   s_change_callback = callback;
 }
@@ -477,7 +514,9 @@ status_t settings_file_set_byte(SettingsFile *file, const void *key,
   return S_SUCCESS;
 }
 
-static status_t prv_grow(SettingsFile *file, int needed_used_space) {
+// The smallest doubling of alloc_used_space which holds needed_used_space,
+// capped at max_used_space.
+static int prv_alloc_used_space_for(SettingsFile *file, int needed_used_space) {
   int new_alloc = file->alloc_used_space;
   while (new_alloc < needed_used_space && new_alloc < file->max_used_space) {
     new_alloc *= 2;
@@ -485,6 +524,11 @@ static status_t prv_grow(SettingsFile *file, int needed_used_space) {
   if (new_alloc > file->max_used_space) {
     new_alloc = file->max_used_space;
   }
+  return new_alloc;
+}
+
+static status_t prv_grow(SettingsFile *file, int needed_used_space) {
+  int new_alloc = prv_alloc_used_space_for(file, needed_used_space);
   if (new_alloc < needed_used_space) {
     return E_OUT_OF_STORAGE;
   }
@@ -594,6 +638,66 @@ status_t settings_file_set_with_timestamp(SettingsFile *file, const void *key, s
   return prv_settings_file_set_internal(file, key, key_len, val, val_len, timestamp);
 }
 
+typedef struct {
+  const SettingsFileBatchWrite *writes;
+  size_t num_writes;
+} BatchFilterContext;
+
+// Drops the records the batch replaces
+static bool prv_batch_filter_cb(void *key, size_t key_len, void *value, size_t value_len,
+                                void *context) {
+  const BatchFilterContext *batch = context;
+  for (size_t i = 0; i < batch->num_writes; i++) {
+    const SettingsFileBatchWrite *write = &batch->writes[i];
+    if (write->key_len == key_len && memcmp(write->key, key, key_len) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+status_t settings_file_set_batch(SettingsFile *file, const SettingsFileBatchWrite *writes,
+                                 size_t num_writes) {
+  // Cannot set keys while iterating (Try settings_file_rewrite)
+  PBL_ASSERTN(file->cur_record_pos == 0);
+  if (num_writes == 0) {
+    return S_SUCCESS;
+  }
+  if (num_writes == 1) {
+    // A single set is atomic already and doesn't need the file rewritten
+    return settings_file_set(file, writes[0].key, writes[0].key_len,
+                             writes[0].val, writes[0].val_len);
+  }
+
+  // Work out what the file will hold once the batch is in, before writing
+  // anything, so that a batch which doesn't fit is refused as a whole.
+  int used_space = file->used_space;
+  bool sets_values = false;
+  for (size_t i = 0; i < num_writes; i++) {
+    const SettingsFileBatchWrite *write = &writes[i];
+    if (write->key_len > SETTINGS_KEY_MAX_LEN || write->val_len > SETTINGS_VAL_MAX_LEN) {
+      return E_RANGE;
+    }
+    settings_raw_iter_resume(&file->iter);
+    if (search_forward(&file->iter, write->key, write->key_len) &&
+        !deleted_and_expired(&file->iter.hdr)) {
+      used_space -= record_size(&file->iter.hdr);
+    }
+    used_space += sizeof(SettingsRecordHeader) + write->key_len + write->val_len;
+    sets_values |= (write->val_len != 0);
+  }
+  if (sets_values && used_space > file->max_used_space) {
+    return E_OUT_OF_STORAGE;
+  }
+
+  BatchFilterContext context = {
+    .writes = writes,
+    .num_writes = num_writes,
+  };
+  return prv_rewrite(file, prv_alloc_used_space_for(file, used_space),
+                     prv_batch_filter_cb, &context, writes, num_writes);
+}
+
 status_t settings_file_mark_synced(SettingsFile *file, const void *key, size_t key_len) {
   // Cannot set keys while iterating (Try settings_file_rewrite)
   PBL_ASSERTN(file->cur_record_pos == 0);
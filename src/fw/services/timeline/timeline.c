@@ -14,6 +14,7 @@
 #include "kernel/event_loop.h"
 #include "kernel/pbl_malloc.h"
 #include "kernel/ui/modals/modal_manager.h"
+#include "pbl/os/mutex.h"
 #include "process_management/app_install_manager.h"
 #include "process_management/app_manager.h"
 #include "pbl/services/analytics/analytics.h"
@@ -25,6 +26,7 @@
 #include "pbl/services/notifications/notification_storage.h"
 #include "pbl/services/notifications/notifications.h"
 #include "pbl/services/phone_call_util.h"
+#include "pbl/services/system_task.h"
 #include "pbl/services/timeline/actions_endpoint.h"
 #include <pbl/logging/logging.h>
 #include "system/passert.h"
@@ -52,6 +54,42 @@ static uint32_t i18n_key;
 
 static bool s_bulk_action_mode = false;
 
+// How many shown pins on each side of an iterator's cursor are prefetched after it moves
+#define TIMELINE_PIN_PREFETCH_DEPTH (2)
+// Room for the cursor pin plus its prefetched neighbours
+#define TIMELINE_PIN_CACHE_SIZE ((2 * TIMELINE_PIN_PREFETCH_DEPTH) + 1)
+
+typedef struct {
+  bool valid;
+  TimelineItem item;
+} PinCacheEntry;
+
+static PebbleMutex *s_pin_cache_mutex;
+static PinCacheEntry s_pin_cache[TIMELINE_PIN_CACHE_SIZE];
+//! Iterators between timeline_iter_init and timeline_iter_deinit
+static unsigned int s_pin_cache_users;
+//! Ring slot the next prefetched pin replaces
+static unsigned int s_pin_cache_next_slot;
+//! Bumped on every invalidation so a prefetch that raced a pin change drops what it read
+static uint32_t s_pin_cache_generation;
+//! Pins the pending KernelBG prefetch should load, replaced by every iterator move
+static Uuid s_prefetch_ids[2 * TIMELINE_PIN_PREFETCH_DEPTH];
+static unsigned int s_num_prefetch_ids;
+static bool s_prefetch_scheduled;
+
+//! The nodes of the list that timeline_init() last built, in list order, so that iterators can
+//! binary search for their first pin rather than walk the list from one of its ends. It is
+//! allocated on the app heap like the nodes and nodes are dropped from it as they are removed.
+typedef struct {
+  TimelineNode *head;
+  TimelineNode **nodes;
+  int num_nodes;
+  //! Longest duration of any of the nodes, in minutes
+  uint16_t max_duration;
+} TimelineNodeIndex;
+
+static TimelineNodeIndex s_node_index;
+
 /////////////////////////
 // Timeline Iterator
 /////////////////////////
@@ -117,12 +155,78 @@ static bool prv_show_event(TimelineNode *node, time_t timestamp, time_t midnight
   }
 }
 
+static TimelineNodeIndex *prv_node_index_for(TimelineNode *head) {
+  return (head && (s_node_index.head == head)) ? &s_node_index : NULL;
+}
+
+static void prv_node_index_free(void) {
+  task_free(s_node_index.nodes);
+  s_node_index = (TimelineNodeIndex){};
+}
+
+static void prv_node_index_build(TimelineNode *head) {
+  const int num_nodes = list_count((ListNode *)head);
+  if (num_nodes == 0) {
+    return;
+  }
+  // Without the index iterators just walk the list, so don't fail building the timeline over it
+  TimelineNode **nodes = task_malloc(num_nodes * sizeof(TimelineNode *));
+  if (!nodes) {
+    return;
+  }
+  uint16_t max_duration = 0;
+  TimelineNode *node = head;
+  for (int i = 0; i < num_nodes; i++) {
+    nodes[i] = node;
+    max_duration = MAX(max_duration, node->duration);
+    node = (TimelineNode *)list_get_next((ListNode *)node);
+  }
+  s_node_index = (TimelineNodeIndex) {
+    .head = head,
+    .nodes = nodes,
+    .num_nodes = num_nodes,
+    .max_duration = max_duration,
+  };
+}
+
+//! @return the position of the first node at or after timestamp, or num_nodes if there is none
+static int prv_node_index_lower_bound(const TimelineNodeIndex *index, time_t timestamp) {
+  int lo = 0;
+  int hi = index->num_nodes;
+  while (lo < hi) {
+    const int mid = lo + (hi - lo) / 2;
+    if (index->nodes[mid]->timestamp < timestamp) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void prv_node_index_remove(TimelineNodeIndex *index, TimelineNode *node) {
+  for (int i = prv_node_index_lower_bound(index, node->timestamp); i < index->num_nodes; i++) {
+    if (index->nodes[i] == node) {
+      index->num_nodes--;
+      memmove(&index->nodes[i], &index->nodes[i + 1],
+              (index->num_nodes - i) * sizeof(TimelineNode *));
+      return;
+    }
+  }
+}
+
 // All day events show up in future if no timed events have passed today,
 // i.e. no events exist between midnight today and now
 // iterate and figure out if we had a timed event pass today
 static bool prv_should_show_all_day_events(TimelineNode *head, time_t now, time_t today_midnight,
   TimelineIterDirection direction) {
   TimelineNode *current = head;
+  const TimelineNodeIndex *index = prv_node_index_for(head);
+  if (index) {
+    // nothing before midnight today can be a timed event that passed today
+    const int first = prv_node_index_lower_bound(index, today_midnight);
+    current = (first < index->num_nodes) ? index->nodes[first] : NULL;
+  }
   // show in future / hide in past all day events unless we find a timed event
   // between midnight and now
   bool show = direction == TimelineIterDirectionFuture;
@@ -141,7 +245,16 @@ static bool prv_should_show_all_day_events(TimelineNode *head, time_t now, time_
 
 static TimelineNode *prv_find_first_past(TimelineNode *head, time_t timestamp,
   time_t today_midnight, bool show_all_day_events) {
-  TimelineNode *current = (TimelineNode *)list_get_tail((ListNode *)head);
+  TimelineNode *current;
+  const TimelineNodeIndex *index = prv_node_index_for(head);
+  if (index) {
+    // Nodes after timestamp have neither started nor are all day events of today, so they
+    // can't be in the past
+    const int last = prv_node_index_lower_bound(index, timestamp + 1) - 1;
+    current = (last >= 0) ? index->nodes[last] : NULL;
+  } else {
+    current = (TimelineNode *)list_get_tail((ListNode *)head);
+  }
   while (current) {
     if (prv_show_event(current, timestamp, today_midnight, TimelineIterDirectionPast,
      show_all_day_events)) {
@@ -155,6 +268,14 @@ static TimelineNode *prv_find_first_past(TimelineNode *head, time_t timestamp,
 static TimelineNode *prv_find_first_future(TimelineNode *head, time_t timestamp,
   time_t today_midnight, bool show_all_day_events) {
   TimelineNode *current = head;
+  const TimelineNodeIndex *index = prv_node_index_for(head);
+  if (index) {
+    // Nodes that ended before timestamp can't be in the future. All day events of today don't
+    // start before timestamp minus a day, which is never longer than the longest node.
+    const int first = prv_node_index_lower_bound(
+        index, timestamp - (index->max_duration * SECONDS_PER_MINUTE));
+    current = (first < index->num_nodes) ? index->nodes[first] : NULL;
+  }
   while (current) {
     if (prv_show_event(current, timestamp, today_midnight, TimelineIterDirectionFuture,
       show_all_day_events)) {
@@ -175,8 +296,19 @@ static TimelineNode *prv_find_first(TimelineNode *head, TimelineIterDirection di
 }
 
 static void prv_remove_node(TimelineNode **head, TimelineNode *node) {
+  TimelineNodeIndex *index = prv_node_index_for(*head);
+  if (index) {
+    prv_node_index_remove(index, node);
+  }
   list_remove((ListNode *)node, (ListNode **)head, NULL);
   task_free(node);
+  if (index) {
+    if (*head) {
+      index->head = *head;
+    } else {
+      prv_node_index_free();
+    }
+  }
 }
 
 static int prv_num_nodes_for_serialized_item(CommonTimelineItemHeader *header) {
@@ -252,7 +384,26 @@ static void prv_set_nodes_all_day(TimelineNode *nodes[], CommonTimelineItemHeade
   }
 }
 
-static void prv_add_nodes_for_serialized_item(TimelineNode **list_head,
+typedef struct {
+  TimelineNode *head;
+  TimelineNode *tail;
+  int num_nodes;
+} TimelineBuildContext;
+
+// Order used to sort the nodes once they have all been read. Each node's index holds the order in
+// which it was read at that point, which is used to break ties the same way that inserting the
+// nodes one at a time with list_sorted_add() and prv_time_comparator would have: concurrent all
+// day events end up in reverse order of reading, anything else in order of reading.
+static int prv_build_comparator(void *a, void *b) {
+  TimelineNode *node_a = (TimelineNode *)a;
+  TimelineNode *node_b = (TimelineNode *)b;
+  if ((node_a->timestamp == node_b->timestamp) && node_a->all_day && node_b->all_day) {
+    return (node_a->index - node_b->index);
+  }
+  return prv_time_comparator(a, b);
+}
+
+static void prv_add_nodes_for_serialized_item(TimelineBuildContext *ctx,
   CommonTimelineItemHeader *header) {
   int num_nodes = prv_num_nodes_for_serialized_item(header);
   TimelineNode *nodes[num_nodes];
@@ -271,9 +422,13 @@ static void prv_add_nodes_for_serialized_item(TimelineNode **list_head,
     prv_set_nodes(nodes, header, num_nodes);
   }
 
+  // Append in reading order; the whole list is sorted once at the end of timeline_init()
   for (int i = 0; i < num_nodes; i++) {
-    *list_head = (TimelineNode *)list_sorted_add((ListNode *)*list_head, (ListNode *)nodes[i],
-      prv_time_comparator, true);
+    nodes[i]->index = ctx->num_nodes++;
+    ctx->tail = (TimelineNode *)list_insert_after((ListNode *)ctx->tail, (ListNode *)nodes[i]);
+    if (ctx->head == NULL) {
+      ctx->head = nodes[i];
+    }
   }
 }
 
@@ -283,7 +438,7 @@ static bool prv_each(SettingsFile *file, SettingsRecordInfo *info, void *context
     return true; // continue iteration
   }
 
-  TimelineNode **list_head = context;
+  TimelineBuildContext *ctx = context;
 
   CommonTimelineItemHeader header;
   // we don't care about the attributes here, so we don't allocate space for them
@@ -292,7 +447,7 @@ static bool prv_each(SettingsFile *file, SettingsRecordInfo *info, void *context
   header.flags = ~header.flags;
   header.status = ~header.status;
 
-  prv_add_nodes_for_serialized_item(list_head, &header);
+  prv_add_nodes_for_serialized_item(ctx, &header);
 
   return true; // continue iteration
 }
@@ -359,6 +514,175 @@ static void prv_debug_print_pins(TimelineNode *node0) {
 }
 #endif
 
+/////////////////////////
+// Pin Cache
+/////////////////////////
+
+// Reading and deserializing a pin from flash is too slow to do on every scroll step, so each
+// iterator move queues its neighbouring pins to be loaded on KernelBG into a small ring of
+// deserialized items. Cached items live on the kernel heap; iterators get a deep copy on their own
+// heap so they keep owning (and freeing) their pin as before.
+//
+// The ring is dropped once the last iterator is deinited. The pin db invalidates a pin whenever it
+// writes or deletes it, so a changed pin is read from flash again.
+
+static void prv_pin_cache_free_entry(PinCacheEntry *entry) {
+  // Entries are always loaded on KernelBG, so they must go back to the kernel heap regardless of
+  // which task drops them
+  kernel_free(entry->item.allocated_buffer);
+  *entry = (PinCacheEntry){};
+}
+
+static PinCacheEntry *prv_pin_cache_find(const Uuid *id) {
+  for (int i = 0; i < TIMELINE_PIN_CACHE_SIZE; i++) {
+    if (s_pin_cache[i].valid && uuid_equal(&s_pin_cache[i].item.header.id, id)) {
+      return &s_pin_cache[i];
+    }
+  }
+  return NULL;
+}
+
+static bool prv_pin_cache_get(const Uuid *id, TimelineItem *pin_out) {
+  bool found = false;
+  mutex_lock(s_pin_cache_mutex);
+  PinCacheEntry *entry = prv_pin_cache_find(id);
+  if (entry) {
+    TimelineItem *copy = timeline_item_copy(&entry->item);
+    if (copy) {
+      *pin_out = *copy;
+      task_free(copy);
+      found = true;
+    }
+  }
+  mutex_unlock(s_pin_cache_mutex);
+  return found;
+}
+
+static status_t prv_get_pin(const Uuid *id, TimelineItem *pin_out) {
+  if (prv_pin_cache_get(id, pin_out)) {
+    return S_SUCCESS;
+  }
+  return pin_db_get(id, pin_out);
+}
+
+static void prv_prefetch_system_task_cb(void *PBL_UNUSED data) {
+  Uuid ids[ARRAY_LENGTH(s_prefetch_ids)];
+  mutex_lock(s_pin_cache_mutex);
+  const unsigned int num_ids = s_num_prefetch_ids;
+  memcpy(ids, s_prefetch_ids, num_ids * sizeof(Uuid));
+  s_num_prefetch_ids = 0;
+  s_prefetch_scheduled = false;
+  mutex_unlock(s_pin_cache_mutex);
+
+  for (unsigned int i = 0; i < num_ids; i++) {
+    mutex_lock(s_pin_cache_mutex);
+    const bool cached = (prv_pin_cache_find(&ids[i]) != NULL);
+    const uint32_t generation = s_pin_cache_generation;
+    mutex_unlock(s_pin_cache_mutex);
+    if (cached) {
+      continue;
+    }
+
+    TimelineItem item = {};
+    if (pin_db_get(&ids[i], &item) != S_SUCCESS) {
+      continue;
+    }
+
+    mutex_lock(s_pin_cache_mutex);
+    if (generation == s_pin_cache_generation) {
+      PinCacheEntry *entry = &s_pin_cache[s_pin_cache_next_slot];
+      prv_pin_cache_free_entry(entry);
+      *entry = (PinCacheEntry) {
+        .valid = true,
+        .item = item,
+      };
+      s_pin_cache_next_slot = (s_pin_cache_next_slot + 1) % TIMELINE_PIN_CACHE_SIZE;
+    } else {
+      timeline_item_free_allocated_buffer(&item);
+    }
+    mutex_unlock(s_pin_cache_mutex);
+  }
+}
+
+static unsigned int prv_collect_neighbours(TimelineIterState *state, bool forwards, Uuid *ids_out) {
+  unsigned int num_ids = 0;
+  TimelineNode *node = state->node;
+  while (num_ids < TIMELINE_PIN_PREFETCH_DEPTH) {
+    node = (TimelineNode *)(forwards ? node->node.next : node->node.prev);
+    if (node == NULL) {
+      break;
+    }
+    if (prv_show_event(node, state->start_time, state->midnight, state->direction,
+                       state->show_all_day_events)) {
+      ids_out[num_ids++] = node->id;
+    }
+  }
+  return num_ids;
+}
+
+static void prv_schedule_prefetch(TimelineIterState *state) {
+  mutex_lock(s_pin_cache_mutex);
+  s_num_prefetch_ids = prv_collect_neighbours(state, true /* forwards */, s_prefetch_ids);
+  s_num_prefetch_ids += prv_collect_neighbours(state, false /* forwards */,
+                                               &s_prefetch_ids[s_num_prefetch_ids]);
+  const bool schedule = (s_num_prefetch_ids > 0) && !s_prefetch_scheduled;
+  if (schedule) {
+    s_prefetch_scheduled = true;
+  }
+  mutex_unlock(s_pin_cache_mutex);
+
+  if (schedule && !system_task_add_callback(prv_prefetch_system_task_cb, NULL)) {
+    mutex_lock(s_pin_cache_mutex);
+    s_prefetch_scheduled = false;
+    mutex_unlock(s_pin_cache_mutex);
+  }
+}
+
+void timeline_pin_cache_init(void) {
+  s_pin_cache_mutex = mutex_create();
+}
+
+void timeline_pin_cache_invalidate(const Uuid *id) {
+  mutex_lock(s_pin_cache_mutex);
+  s_pin_cache_generation++;
+  for (int i = 0; i < TIMELINE_PIN_CACHE_SIZE; i++) {
+    if (s_pin_cache[i].valid && (!id || uuid_equal(&s_pin_cache[i].item.header.id, id))) {
+      prv_pin_cache_free_entry(&s_pin_cache[i]);
+    }
+  }
+  mutex_unlock(s_pin_cache_mutex);
+}
+
+static void prv_pin_cache_retain(TimelineIterState *iter_state) {
+  if (iter_state->uses_pin_cache) {
+    return;
+  }
+  iter_state->uses_pin_cache = true;
+  mutex_lock(s_pin_cache_mutex);
+  s_pin_cache_users++;
+  mutex_unlock(s_pin_cache_mutex);
+}
+
+static void prv_pin_cache_release(TimelineIterState *iter_state) {
+  if (!iter_state->uses_pin_cache) {
+    return;
+  }
+  iter_state->uses_pin_cache = false;
+  mutex_lock(s_pin_cache_mutex);
+  PBL_ASSERTN(s_pin_cache_users > 0);
+  const bool last_user = (--s_pin_cache_users == 0);
+  if (last_user) {
+    // nothing is left to scroll through, a prefetch that is already queued finds nothing to load
+    s_num_prefetch_ids = 0;
+  }
+  mutex_unlock(s_pin_cache_mutex);
+
+  if (last_user) {
+    // don't hold on to kernel heap once nothing iterates the timeline
+    timeline_pin_cache_invalidate(NULL);
+  }
+}
+
 // dummy iterator that always returns false
 // Useful for when there aren't any items in pindb
 // but we don't want an invalid iterator.
@@ -387,10 +711,11 @@ static bool prv_iter_next(IteratorState state) {
   timeline_item_free_allocated_buffer(&timeline_iter_state->pin);
   timeline_iter_state->pin = (TimelineItem){};
 
-  status_t rv = pin_db_get(&timeline_iter_state->node->id, &timeline_iter_state->pin);
+  status_t rv = prv_get_pin(&timeline_iter_state->node->id, &timeline_iter_state->pin);
   timeline_iter_state->current_day = time_util_get_midnight_of(
     timeline_iter_state->node->timestamp);
   timeline_iter_state->index = timeline_iter_state->node->index;
+  prv_schedule_prefetch(timeline_iter_state);
 #ifdef TIMELINE_SERVICE_DEBUG
   prv_debug_print_pins(timeline_iter_state->node);
 #endif
@@ -418,10 +743,11 @@ static bool prv_iter_prev(IteratorState state) {
   timeline_item_free_allocated_buffer(&timeline_iter_state->pin);
   timeline_iter_state->pin = (TimelineItem){};
 
-  status_t rv = pin_db_get(&timeline_iter_state->node->id, &timeline_iter_state->pin);
+  status_t rv = prv_get_pin(&timeline_iter_state->node->id, &timeline_iter_state->pin);
   timeline_iter_state->current_day = time_util_get_midnight_of(
     timeline_iter_state->node->timestamp);
   timeline_iter_state->index = timeline_iter_state->node->index;
+  prv_schedule_prefetch(timeline_iter_state);
 #ifdef TIMELINE_SERVICE_DEBUG
   prv_debug_print_pins(timeline_iter_state->node);
 #endif
@@ -467,9 +793,21 @@ static void prv_put_outgoing_call_event(uint32_t call_identifier, const char *ca
 
 status_t timeline_init(TimelineNode **timeline) {
   PBL_LOG_DBG("Starting to build list.");
-  status_t rv = pin_db_each(prv_each, timeline);
+  // Only one list is indexed at a time, any other list goes back to walking from its ends
+  prv_node_index_free();
+  // Nodes are appended as they are read and sorted once at the end, which is O(n log n) rather
+  // than the O(n^2) of sorted inserts. Any nodes already in the list count as read first.
+  prv_set_indices(*timeline);
+  TimelineBuildContext ctx = {
+    .head = *timeline,
+    .tail = (TimelineNode *)list_get_tail((ListNode *)*timeline),
+    .num_nodes = list_count((ListNode *)*timeline),
+  };
+  status_t rv = pin_db_each(prv_each, &ctx);
+  *timeline = (TimelineNode *)list_sort((ListNode *)ctx.head, prv_build_comparator, true);
   prv_prune_ordered_timeline_list(timeline);
   prv_set_indices(*timeline);
+  prv_node_index_build(*timeline);
   PBL_LOG_DBG("Finished building list.");
 #ifdef TIMELINE_SERVICE_DEBUG
   prv_debug_print_pins(*timeline);
@@ -477,6 +815,21 @@ status_t timeline_init(TimelineNode **timeline) {
   return rv;
 }
 
+void timeline_process_cleanup(void) {
+  // The app heap the index is on is going away, there's nothing to free
+  s_node_index = (TimelineNodeIndex){};
+
+  // Iterators the app didn't get to deinit stop using the pin cache along with it
+  mutex_lock(s_pin_cache_mutex);
+  const bool had_users = (s_pin_cache_users > 0);
+  s_pin_cache_users = 0;
+  s_num_prefetch_ids = 0;
+  mutex_unlock(s_pin_cache_mutex);
+  if (had_users) {
+    timeline_pin_cache_invalidate(NULL);
+  }
+}
+
 bool timeline_add(TimelineItem *item) {
   return (S_SUCCESS == pin_db_insert_item(item));
 }
@@ -574,6 +927,7 @@ bool timeline_iter_remove_node_with_id(TimelineNode **head, Uuid *key) {
 
 status_t timeline_iter_init(Iterator *iter, TimelineIterState *iter_state, TimelineNode **head,
     TimelineIterDirection direction, time_t timestamp) {
+  prv_pin_cache_retain(iter_state);
   iter_state->direction = direction;
   iter_state->start_time = timestamp;
   iter_state->midnight = time_util_get_midnight_of(timestamp);
@@ -587,7 +941,7 @@ status_t timeline_iter_init(Iterator *iter, TimelineIterState *iter_state, Timel
     return S_NO_MORE_ITEMS;
   }
 
-  status_t rv = pin_db_get(&node->id, &iter_state->pin);
+  status_t rv = prv_get_pin(&node->id, &iter_state->pin);
   if (rv != S_SUCCESS) {
     iter_state->pin = (TimelineItem){};
     iter_init(iter, prv_iter_dummy, prv_iter_dummy, iter_state);
@@ -597,6 +951,7 @@ status_t timeline_iter_init(Iterator *iter, TimelineIterState *iter_state, Timel
   iter_state->node = node;
   iter_state->current_day = time_util_get_midnight_of(node->timestamp);
   iter_state->index = iter_state->node->index;
+  prv_schedule_prefetch(iter_state);
   if (direction == TimelineIterDirectionPast) {
     iter_init(iter, prv_iter_prev, prv_iter_next, iter_state);
   } else { // Future
@@ -611,15 +966,24 @@ void timeline_iter_copy_state(TimelineIterState *dst_state, TimelineIterState *s
   PBL_ASSERTN(dst_state && src_state && dst_iter && src_iter);
 
   timeline_item_free_allocated_buffer(&dst_state->pin);
+  prv_pin_cache_release(dst_state);
 
   *dst_state = *src_state;
   dst_state->pin = (TimelineItem){};
+  dst_state->uses_pin_cache = false;
+  if (src_state->uses_pin_cache) {
+    prv_pin_cache_retain(dst_state);
+  }
 
   *dst_iter = *src_iter;
   dst_iter->state = dst_state;
 }
 
 void timeline_iter_deinit(Iterator *iter, TimelineIterState *iter_state, TimelineNode **head) {
+  if (prv_node_index_for(*head)) {
+    // the whole list is going away, don't shift the index down once for every node
+    prv_node_index_free();
+  }
   TimelineNode *node = *head;
   while (node) {
     TimelineNode *old = node;
@@ -631,6 +995,8 @@ void timeline_iter_deinit(Iterator *iter, TimelineIterState *iter_state, Timelin
   // free the currently allocated item in the iterator
   timeline_item_free_allocated_buffer(&iter_state->pin);
   iter_init(iter, prv_iter_dummy, prv_iter_dummy, iter_state);
+
+  prv_pin_cache_release(iter_state);
 }
 
 void timeline_iter_refresh_pin(TimelineIterState *iter_state) {
@@ -10,6 +10,7 @@
 #include "system/passert.h"
 
 #include <pbl/util/attributes.h>
+#include <pbl/util/hash.h>
 #include <pbl/util/size.h>
 
 #include <string.h>
@@ -36,6 +37,11 @@ PBL_LOG_MODULE_DEFINE(service_timezone_database, CONFIG_SERVICE_TIMEZONE_DATABAS
 //   For each link (35 bytes)
 //     2 bytes  - The region id this link maps to
 //     33 bytes - The name of the link that should be treated as an alias to the linked region
+// Name index (missing from older databases)
+//   2 bytes  - Entry count, one per region and link
+//   For each entry (6 bytes), sorted by hash and then name id:
+//     4 bytes  - Hash of the full region or link name, @see hash()
+//     2 bytes  - Name id, a region id or region count + link index
 
 typedef struct PACKED {
   uint16_t region_count;
@@ -54,6 +60,12 @@ typedef struct PACKED {
 #define LINK_NAME_LENGTH 33
 #define LINK_BYTES (LINK_REGION_LENGTH + LINK_NAME_LENGTH)
 
+typedef struct PACKED {
+  uint32_t hash;
+  uint16_t name_id;
+} TimezoneNameIndexEntry;
+#define NAME_INDEX_COUNT_BYTES (sizeof(uint16_t))
+
 
 //! Names for all the continents we support. The timezone database stores continents as indexes
 //! into this constant array.
@@ -141,29 +153,24 @@ bool timezone_database_load_region_name(uint16_t region_id, char *region_name) {
       // Skip over the regions list
       (region_id * REGION_BYTES);
 
-  // Read the continent index, which is the first byte
-  uint8_t continent_index = 0;
-  prv_database_read(region_offset, &continent_index, sizeof(continent_index));
-  PBL_ASSERTN(continent_index < ARRAY_LENGTH(CONTINENT_NAMES));
-
-  // Copy the continent name into our buffer, followed by a slash.
-  const int continent_name_length = strlen(CONTINENT_NAMES[continent_index]);
-  memcpy(region_name, CONTINENT_NAMES[continent_index], continent_name_length);
-  region_name[continent_name_length] = '/';
-
-  char *city_name = region_name + continent_name_length + 1 /* slash */;
-
-  // How many bytes left we have of our buffer to fill in the city information.
-  const int remaining_size = (region_name + TIMEZONE_NAME_LENGTH) - city_name;
+  struct PACKED {
+    uint8_t continent_index;
+    char city_name[TIMEZONE_CITY_LENGTH];
+  } name_data;
+  if (!prv_database_read(region_offset, &name_data, sizeof(name_data))) {
+    return false;
+  }
+  PBL_ASSERTN(name_data.continent_index < ARRAY_LENGTH(CONTINENT_NAMES));
 
-  // Fill the rest of our buffer with city name.
   // Our generation script will ensure that continent + slash + city name + null will always
-  // fit in our buffer with a null terminator to spare.
-  prv_database_read(region_offset + 1 /* continent index */, city_name, remaining_size);
-
-  // FIXME: Perhaps we should refactor this to do one read instead of two? The information is
-  // right beside each other and it's pretty wasteful to do a 1 byte read followed by a 15 byte
-  // read as separate reads.
+  // fit in our buffer.
+  const char *continent_name = CONTINENT_NAMES[name_data.continent_index];
+  const int continent_name_length = strlen(continent_name);
+  const int city_name_length = strnlen(name_data.city_name, TIMEZONE_CITY_LENGTH);
+  memcpy(region_name, continent_name, continent_name_length);
+  region_name[continent_name_length] = '/';
+  memcpy(region_name + continent_name_length + 1, name_data.city_name, city_name_length);
+  region_name[continent_name_length + 1 + city_name_length] = '\0';
 
   return true;
 }
@@ -208,17 +215,21 @@ static int prv_search_regions_by_name(const char *region_name, int region_name_l
   return -1;
 }
 
-static int prv_search_links_by_name(const char *region_name, int region_name_length) {
-  char name_asciz[256] = {0};
-  memcpy(name_asciz, region_name, region_name_length);
-
-  const int link_section_offset =
+static int prv_get_link_section_offset(void) {
+  return
       // Skip over the region count
       TZDATA_HEADER_BYTES +
       // Skip over the regions list
       (timezone_database_get_region_count() * REGION_BYTES) +
       // Skip over the DST list
       ((prv_get_dst_rule_count() - 1) * DST_RULE_PAIR_BYTES);
+}
+
+static int prv_search_links_by_name(const char *region_name, int region_name_length) {
+  char name_asciz[256] = {0};
+  memcpy(name_asciz, region_name, region_name_length);
+
+  const int link_section_offset = prv_get_link_section_offset();
 
   const uint16_t link_count = prv_get_link_count();
 
@@ -240,8 +251,97 @@ static int prv_search_links_by_name(const char *region_name, int region_name_len
   return -1;
 }
 
+//! Resolve a name id from the name index to a region id if its name matches exactly.
+//! @return the region id, or -1 if the name doesn't match
+static int prv_match_name_id(uint16_t name_id, int region_count, int link_section_offset,
+                             const char *name, int name_length) {
+  if (name_id < region_count) {
+    char region_name[TIMEZONE_NAME_LENGTH];
+    if (timezone_database_load_region_name(name_id, region_name) &&
+        (int)strlen(region_name) == name_length &&
+        memcmp(region_name, name, name_length) == 0) {
+      return name_id;
+    }
+    return -1;
+  }
+
+  struct PACKED {
+    uint16_t region_id;
+    char name[LINK_NAME_LENGTH];
+  } link;
+  const int link_offset = link_section_offset + ((name_id - region_count) * LINK_BYTES);
+  if (prv_database_read(link_offset, &link, sizeof(link)) &&
+      name_length <= LINK_NAME_LENGTH &&
+      (int)strnlen(link.name, LINK_NAME_LENGTH) == name_length &&
+      memcmp(link.name, name, name_length) == 0) {
+    return link.region_id;
+  }
+  return -1;
+}
+
+//! Binary search the name index for an exact region or link name, one read per probe.
+//! @return false if the database predates the name index, true otherwise with the matching
+//!         region id (or -1) in *region_id_out
+static bool prv_search_name_index(const char *region_name, int region_name_length,
+                                  int *region_id_out) {
+  const int region_count = timezone_database_get_region_count();
+  const int link_section_offset = prv_get_link_section_offset();
+  const int index_offset = link_section_offset + (prv_get_link_count() * LINK_BYTES);
+
+  uint16_t entry_count;
+  if (!prv_database_read(index_offset, &entry_count, sizeof(entry_count)) ||
+      entry_count != region_count + prv_get_link_count()) {
+    return false;
+  }
+  const int entries_offset = index_offset + NAME_INDEX_COUNT_BYTES;
+
+  // The phone may count a trailing null in the length
+  const int name_length = strnlen(region_name, region_name_length);
+  const uint32_t name_hash = hash((const uint8_t *)region_name, name_length);
+
+  // Find the first entry with our hash
+  int low = 0;
+  int high = entry_count;
+  while (low < high) {
+    const int mid = low + (high - low) / 2;
+    TimezoneNameIndexEntry entry;
+    if (!prv_database_read(entries_offset + (mid * sizeof(entry)), &entry, sizeof(entry))) {
+      return false;
+    }
+    if (entry.hash < name_hash) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  // Entries sharing a hash are ordered by name id, so regions are checked before links just
+  // like the linear search does
+  *region_id_out = -1;
+  for (int i = low; i < entry_count; i++) {
+    TimezoneNameIndexEntry entry;
+    if (!prv_database_read(entries_offset + (i * sizeof(entry)), &entry, sizeof(entry)) ||
+        entry.hash != name_hash) {
+      break;
+    }
+    const int region_id = prv_match_name_id(entry.name_id, region_count, link_section_offset,
+                                            region_name, name_length);
+    if (region_id != -1) {
+      *region_id_out = region_id;
+      break;
+    }
+  }
+  return true;
+}
+
 int timezone_database_find_region_by_name(const char *region_name, int region_name_length) {
-  int region_id = prv_search_regions_by_name(region_name, region_name_length);
+  int region_id;
+  if (prv_search_name_index(region_name, region_name_length, &region_id)) {
+    return region_id;
+  }
+
+  // Older resource packs have no name index, fall back to reading every name
+  region_id = prv_search_regions_by_name(region_name, region_name_length);
 
   if (region_id == -1) {
     // Might be a Link, let's check.
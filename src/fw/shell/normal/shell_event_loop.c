@@ -33,6 +33,7 @@
 #include "pbl/services/stationary.h"
 #include "pbl/services/system_task.h"
 #include "pbl/services/timeline/event.h"
+#include "pbl/services/timeline/timeline.h"
 #include "shell/normal/app_idle_timeout.h"
 #include "shell/normal/battery_ui.h"
 #include "shell/normal/quick_launch.h"
@@ -126,6 +127,9 @@ void shell_event_loop_handle_event(PebbleEvent *e) {
       // Calendar should only handle pin_db events
       PebbleBlobDBEvent *blobdb_event = &e->blob_db;
       if (blobdb_event->db_id == BlobDBIdPins) {
+        // Handled here before the event is forwarded to apps, so the timeline app never iterates
+        // onto a stale cached pin
+        timeline_pin_cache_invalidate((const Uuid *)blobdb_event->key);
         timeline_event_handle_blobdb_event();
       } else if (blobdb_event->db_id == BlobDBIdPrefs) {
         prefs_private_handle_blob_db_event(blobdb_event);
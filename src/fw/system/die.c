@@ -2,9 +2,11 @@
 /* SPDX-License-Identifier: Apache-2.0 */
 
 #include <pbl/drivers/vibe.h>
+#include "debug/advanced_logging.h"
 #include "kernel/core_dump.h"
 #include "logging/logging_private.h"
 #include "logging/pulse_logging.h"
+#include "pbl/mcu/interrupts.h"
 #include "system/bootbits.h"
 #include "system/passert.h"
 #include "system/reboot_reason.h"
@@ -12,14 +14,20 @@
 
 #include <cmsis_core.h>
 
-#if defined(CONFIG_NO_WATCHDOG)
 #include "FreeRTOS.h"
-#endif
+#include "task.h"
 
 void prepare_for_software_failure(void) {
 #ifdef CONFIG_PULSE_EVERYWHERE
   pulse_logging_log_buffer_flush();
 #endif
+  // Don't lose the log messages leading up to the failure. Programming flash
+  // takes the flash driver's lock and the flush takes the log writer's, so
+  // this is only possible from a task.
+  if (!mcu_state_is_isr() && !portIN_CRITICAL() &&
+      (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) {
+    advanced_logging_flush_for_failure();
+  }
 
 #ifndef CONFIG_MFG
   boot_bit_set(BOOT_BIT_SOFTWARE_FAILURE_OCCURRED);
@@ -305,11 +305,117 @@ static uint8_t* dict_copy(DictionaryIterator* iter) {
   return buf;
 }
 
+// A merge needs to look up every key of one dictionary in the other. Rather than walking the
+// dictionary with dict_find() for each of them, a temporary index of (key, offset) pairs sorted
+// by key is built once per dictionary and binary searched.
+typedef struct {
+  uint32_t key;
+  //! Offset of the tuple from the start of the Dictionary. Dictionaries are at most
+  //! UINT16_MAX bytes (see dict_init), so the same index is valid for a copy of the dictionary.
+  uint16_t offset;
+} DictIndexEntry;
+
+typedef struct {
+  DictIndexEntry *entries;
+  uint16_t count;
+} DictIndex;
+
+// Orders by key, then by position so that the first entry for a key is also the first tuple with
+// that key in the dictionary, which is the one dict_find() returns.
+static bool prv_index_entry_less(const DictIndexEntry *a, const DictIndexEntry *b) {
+  if (a->key != b->key) {
+    return (a->key < b->key);
+  }
+  return (a->offset < b->offset);
+}
+
+static void prv_index_sift_down(DictIndexEntry *entries, uint16_t root, uint16_t count) {
+  while (true) {
+    uint32_t child = (2 * (uint32_t)root) + 1;
+    if (child >= count) {
+      return;
+    }
+    if ((child + 1 < count) && prv_index_entry_less(&entries[child], &entries[child + 1])) {
+      ++child;
+    }
+    if (!prv_index_entry_less(&entries[root], &entries[child])) {
+      return;
+    }
+    const DictIndexEntry tmp = entries[root];
+    entries[root] = entries[child];
+    entries[child] = tmp;
+    root = child;
+  }
+}
+
+// Heap sort: O(n log n) without recursion or any extra memory.
+static void prv_index_sort(DictIndexEntry *entries, uint16_t count) {
+  for (uint16_t i = count / 2; i > 0; --i) {
+    prv_index_sift_down(entries, i - 1, count);
+  }
+  for (uint16_t end = count; end > 1; --end) {
+    const DictIndexEntry tmp = entries[0];
+    entries[0] = entries[end - 1];
+    entries[end - 1] = tmp;
+    prv_index_sift_down(entries, 0, end - 1);
+  }
+}
+
+static uint16_t prv_count_tuples(DictionaryIterator *iter) {
+  uint16_t count = 0;
+  for (Tuple *tuple = dict_read_first(iter); tuple; tuple = dict_read_next(iter)) {
+    ++count;
+  }
+  return count;
+}
+
+// Without entries, the index is left empty and lookups fall back to dict_find().
+static void prv_index_build(DictIndex *index, DictIndexEntry *entries,
+                            DictionaryIterator *iter) {
+  index->entries = entries;
+  index->count = 0;
+  if (entries == NULL) {
+    return;
+  }
+  for (Tuple *tuple = dict_read_first(iter); tuple; tuple = dict_read_next(iter)) {
+    entries[index->count++] = (DictIndexEntry) {
+      .key = tuple->key,
+      .offset = (uint8_t *)tuple - (uint8_t *)iter->dictionary,
+    };
+  }
+  prv_index_sort(index->entries, index->count);
+}
+
+// Equivalent to dict_find(iter, key), given an index that was built for iter's dictionary
+// (or for a copy of it).
+static Tuple *prv_index_find(const DictIndex *index, const DictionaryIterator *iter,
+                             const uint32_t key) {
+  if (index->entries == NULL) {
+    return dict_find(iter, key);
+  }
+  uint16_t lo = 0;
+  uint16_t hi = index->count;
+  while (lo < hi) {
+    const uint16_t mid = lo + ((hi - lo) / 2);
+    if (index->entries[mid].key < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == index->count || index->entries[lo].key != key) {
+    return NULL;
+  }
+  return (Tuple *)((uint8_t *)iter->dictionary + index->entries[lo].offset);
+}
+
 // Merge orig_iter and new_iter into dest_iter. Keys which exist in both
 // orig_iter and new_iter will get the value they have in new_iter.
 static DictionaryResult dict_merge_to(DictionaryIterator* dest_iter,
                                       DictionaryIterator* orig_iter,
+                                      const DictIndex* orig_index,
                                       DictionaryIterator* new_iter,
+                                      const DictIndex* new_index,
                                       const bool update_existing_keys_only,
                                       const DictionaryKeyUpdatedCallback update_key_callback,
                                       void* context) {
@@ -318,7 +424,7 @@ static DictionaryResult dict_merge_to(DictionaryIterator* dest_iter,
   // First, write the updated keys.
   for (Tuple* new = dict_read_first(new_iter); new; new = dict_read_next(new_iter)) {
     uint32_t key = new->key;
-    const Tuple* orig = dict_find(orig_iter, key);
+    const Tuple* orig = prv_index_find(orig_index, orig_iter, key);
     if (orig == NULL && update_existing_keys_only) {
       continue;
     }
@@ -337,8 +443,7 @@ static DictionaryResult dict_merge_to(DictionaryIterator* dest_iter,
   // around in memory, so their old buffers are no longer valid.
   for (Tuple* orig = dict_read_first(orig_iter); orig; orig = dict_read_next(orig_iter)) {
     uint32_t key = orig->key;
-    Tuple* new = dict_find(new_iter, key);
-    if (new != NULL) {
+    if (prv_index_find(new_index, new_iter, key) != NULL) {
       // We already wrote this key, above.
       continue;
     }
@@ -356,19 +461,23 @@ static DictionaryResult dict_merge_to(DictionaryIterator* dest_iter,
 // in dict_merge_to, except it should simply count the size, rather than
 // actually merging the results.
 static size_t dict_merge_to_size(DictionaryIterator* orig_iter,
+                                 const DictIndex* orig_index,
                                  DictionaryIterator* new_iter,
+                                 const DictIndex* new_index,
                                  const bool update_existing_keys_only) {
   size_t total_size_required = sizeof(Dictionary);
 
   // First, calculate the size of the new/updated keys.
   for (Tuple* new = dict_read_first(new_iter); new; new = dict_read_next(new_iter)) {
-    if (dict_find(orig_iter, new->key) == NULL && update_existing_keys_only) continue;
+    if (prv_index_find(orig_index, orig_iter, new->key) == NULL && update_existing_keys_only) {
+      continue;
+    }
     total_size_required += sizeof(*new) + new->length;
   }
 
   // Then, add in the size of the keys which have not changed.
   for (Tuple* orig = dict_read_first(orig_iter); orig; orig = dict_read_next(orig_iter)) {
-    if (dict_find(new_iter, orig->key) != NULL) continue;
+    if (prv_index_find(new_index, new_iter, orig->key) != NULL) continue;
     total_size_required += sizeof(*orig) + orig->length;
   }
 
@@ -385,16 +494,37 @@ DictionaryResult dict_merge(DictionaryIterator* dest_iter,
     return DICT_INVALID_ARGS;
   }
 
-  size_t required_size = dict_merge_to_size(dest_iter, new_iter, update_existing_keys_only);
+  // The index only speeds up the lookups, so running out of memory for it is not an error: the
+  // merge fails exactly like it would without it, on the size check or on copying the dictionary.
+  const uint16_t orig_count = prv_count_tuples(dest_iter);
+  const uint16_t new_count = prv_count_tuples(new_iter);
+  DictIndexEntry *index_entries = NULL;
+  if (orig_count + new_count > 0) {
+    index_entries = task_malloc((orig_count + new_count) * sizeof(DictIndexEntry));
+  }
+  DictIndex orig_index;
+  prv_index_build(&orig_index, index_entries, dest_iter);
+  DictIndex new_index;
+  prv_index_build(&new_index, index_entries ? index_entries + orig_count : NULL, new_iter);
+
+  uint8_t* orig_buffer = NULL;
+  DictionaryResult result = DICT_OK;
+
+  size_t required_size = dict_merge_to_size(dest_iter, &orig_index, new_iter, &new_index,
+                                            update_existing_keys_only);
   if (*dest_buf_length_in_out < required_size) {
-    return DICT_NOT_ENOUGH_STORAGE;
+    result = DICT_NOT_ENOUGH_STORAGE;
+    goto cleanup;
   }
 
-  uint8_t* orig_buffer = dict_copy(dest_iter);
-  if (orig_buffer == NULL) return DICT_MALLOC_FAILED;
+  orig_buffer = dict_copy(dest_iter);
+  if (orig_buffer == NULL) {
+    result = DICT_MALLOC_FAILED;
+    goto cleanup;
+  }
 
   DictionaryIterator orig_iter;
-  DictionaryResult result = dict_init(&orig_iter, orig_buffer, dict_size(dest_iter));
+  result = dict_init(&orig_iter, orig_buffer, dict_size(dest_iter));
   if (result != DICT_OK) goto cleanup;
 
   result = dict_write_begin(dest_iter,
@@ -402,7 +532,8 @@ DictionaryResult dict_merge(DictionaryIterator* dest_iter,
                             (uint16_t)*dest_buf_length_in_out);
   if (result != DICT_OK) goto cleanup;
 
-  result = dict_merge_to(dest_iter, &orig_iter, new_iter,
+  // orig_index was built against dest_iter, but its offsets are equally valid for the copy.
+  result = dict_merge_to(dest_iter, &orig_iter, &orig_index, new_iter, &new_index,
                          update_existing_keys_only,
                          update_key_callback, context);
   if (result != DICT_OK) goto cleanup;
@@ -411,6 +542,7 @@ DictionaryResult dict_merge(DictionaryIterator* dest_iter,
 
 cleanup:
   task_free(orig_buffer);
+  task_free(index_entries);
   return result;
 }
 
@@ -259,21 +259,37 @@ void subsampled_shared_circular_buffer_client_set_ratio(
 }
 
 // -------------------------------------------------------------------------------------------------
-size_t shared_circular_buffer_read_subsampled(
+// Copies length bytes starting at index out of the storage, across the wrap if there is one
+static void prv_copy_out(const SharedCircularBuffer *buffer, uint16_t index, uint8_t *out,
+                         size_t length) {
+  const size_t contiguous = buffer->buffer_size - index;
+  if (length <= contiguous) {
+    memcpy(out, &buffer->buffer[index], length);
+  } else {
+    memcpy(out, &buffer->buffer[index], contiguous);
+    memcpy(out + contiguous, buffer->buffer, length - contiguous);
+  }
+}
+
+// -------------------------------------------------------------------------------------------------
+size_t shared_circular_buffer_read_subsampled_batch(
     SharedCircularBuffer* buffer,
     SubsampledSharedCircularBufferClient *client,
-    size_t item_size, void *data, uint16_t num_items) {
-  uint16_t bytes_available = prv_get_data_length(
-      buffer, &client->buffer_client);
-
-  // Optimized case when no subsampling
-  if (client->numerator == client->denominator) {
-    num_items = MIN(num_items, bytes_available / item_size);
-    uint16_t bytes_out;
-    shared_circular_buffer_read_consume(
-        buffer, &client->buffer_client, num_items * item_size,
-        (uint8_t *)data, &bytes_out);
-    PBL_ASSERTN(bytes_out == num_items * item_size);
+    size_t item_size, size_t copy_size, void *data, uint16_t num_items,
+    void *first_item) {
+  PBL_ASSERTN(copy_size <= item_size);
+  SharedCircularBufferClient *reader = &client->buffer_client;
+  const uint32_t items_available = prv_get_data_length(buffer, reader) / item_size;
+  uint8_t *out_buf = data;
+
+  // Optimized case when no subsampling and whole items are wanted: at most two copies
+  if (client->numerator == client->denominator && copy_size == item_size) {
+    num_items = MIN(num_items, items_available);
+    if (num_items && first_item) {
+      prv_copy_out(buffer, reader->read_index, first_item, item_size);
+    }
+    prv_copy_out(buffer, reader->read_index, out_buf, num_items * item_size);
+    reader->read_index = (reader->read_index + num_items * item_size) % buffer->buffer_size;
     return num_items;
   }
 
@@ -281,24 +297,35 @@ size_t shared_circular_buffer_read_subsampled(
   // the subsampling ratio does not need to be in reduced form. It will
   // give the exact same results if the numerator and denominator have a
   // common divisor.
-  char *out_buf = data;
+  uint32_t read_index = reader->read_index;
+  uint32_t items_consumed = 0;
   size_t items_read = 0;
-  while (items_read < num_items && bytes_available >= item_size) {
-    bytes_available -= item_size;
+  while (items_read < num_items && items_consumed < items_available) {
     client->subsample_state += client->numerator;
     if (client->subsample_state >= client->denominator) {
       client->subsample_state %= client->denominator;
-      uint16_t bytes_out;
-      shared_circular_buffer_read_consume(buffer, &client->buffer_client,
-                                          item_size, (uint8_t *)out_buf,
-                                          &bytes_out);
-      PBL_ASSERTN(bytes_out == item_size);
-      out_buf += item_size;
+      if (items_read == 0 && first_item) {
+        prv_copy_out(buffer, read_index, first_item, item_size);
+      }
+      prv_copy_out(buffer, read_index, out_buf, copy_size);
+      out_buf += copy_size;
       items_read++;
-    } else {
-      PBL_ASSERTN(shared_circular_buffer_consume(buffer, &client->buffer_client,
-                                                 item_size));
+    }
+    items_consumed++;
+    read_index += item_size;
+    if (read_index >= buffer->buffer_size) {
+      read_index -= buffer->buffer_size;
     }
   }
+  reader->read_index = read_index;
   return items_read;
 }
+
+// -------------------------------------------------------------------------------------------------
+size_t shared_circular_buffer_read_subsampled(
+    SharedCircularBuffer* buffer,
+    SubsampledSharedCircularBufferClient *client,
+    size_t item_size, void *data, uint16_t num_items) {
+  return shared_circular_buffer_read_subsampled_batch(buffer, client, item_size, item_size, data,
+                                                      num_items, NULL);
+}
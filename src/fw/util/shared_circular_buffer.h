@@ -185,3 +185,27 @@ size_t shared_circular_buffer_read_subsampled(
     SharedCircularBuffer* buffer,
     SubsampledSharedCircularBufferClient *client,
     size_t item_size, void *data, uint16_t num_items);
+
+//! Read and consume up to num_items items with subsampling in one call, copying only the
+//! first copy_size bytes of each item that is kept. Items skipped by the subsampling are
+//! consumed without being copied.
+//!
+//! @param buffer The buffer to read from
+//! @param client pointer to the client struct originally passed to
+//!     shared_circular_buffer_add_subsampled_client
+//! @param item_size Size of each item in the buffer, in bytes
+//! @param copy_size How many bytes from the start of each kept item to copy out. Must not be
+//!     larger than item_size.
+//! @param data Buffer the kept items are packed into. Must be at least
+//!     copy_size * num_items bytes in size.
+//! @param num_items How many items to read. This is the number of items AFTER
+//!     subsampling.
+//! @param[out] first_item If not NULL and at least one item is read, receives the whole
+//!     first item that was kept. Must be at least item_size bytes in size.
+//! @return The number of items actually read into the data buffer after
+//!     subsampling. This may be less than num_items.
+size_t shared_circular_buffer_read_subsampled_batch(
+    SharedCircularBuffer* buffer,
+    SubsampledSharedCircularBufferClient *client,
+    size_t item_size, size_t copy_size, void *data, uint16_t num_items,
+    void *first_item);
@@ -197,7 +197,7 @@ int32_t stats_calculate_weighted_median(const int32_t *vals, const int32_t *weig
       .weight_x100 = weights_x100[i],
     };
   }
-  sort_bubble(values, num_data, sizeof(*values), prv_cmp_weighted_value);
+  sort_intro(values, num_data, sizeof(*values), prv_cmp_weighted_value);
 
   // Find the sum of all of the weights
   int32_t S_x100;
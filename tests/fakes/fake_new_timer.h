@@ -53,6 +53,9 @@ static int s_num_new_timer_stop_calls = 0;
 static int s_num_new_timer_delete_calls = 0;
 static int s_num_new_timer_schedule_calls = 0;
 
+// Callback of the timer being fired
+static NewTimerCallback s_current_cb;
+
 // Last parameters
 static TimerID s_new_timer_start_param_timer_id;
 static uint32_t s_new_timer_start_param_timeout_ms;
@@ -218,7 +221,9 @@ bool stub_new_timer_fire(TimerID timer_id) {
 
   timer->timeout_ms = 0;
   timer->executing = true;
+  s_current_cb = timer->cb;
   timer->cb(timer->cb_data);
+  s_current_cb = NULL;
   timer->executing = false;
 
   if (timer->defer_delete) {
@@ -305,3 +310,7 @@ bool new_timer_scheduled(TimerID timer, uint32_t *expire_ms_p) {
   return stub_new_timer_is_scheduled(timer);
 }
 
+void* new_timer_debug_get_current_callback(void) {
+  return s_current_cb;
+}
+
@@ -4,6 +4,7 @@
 #include "fake_spi_flash.h"
 
 #include "flash_region/flash_region.h"
+#include <pbl/drivers/flash.h>
 #include "system/status_codes.h"
 
 #include <unistd.h>
@@ -21,8 +22,17 @@ typedef struct FakeFlashState {
   uint32_t bytes_left_till_write_failure;
   jmp_buf *jmp_on_failure;
   uint8_t* storage; //! Allocated buffer of length bytes.
+  uint32_t read_count;
   uint32_t write_count;
   uint32_t erase_count;
+  bool defer_erase_completion;
+  //! Asynchronous erase waiting for flash_erase_wait_for_completion()
+  struct {
+    FlashOperationCompleteCb cb;
+    void *context;
+    uint32_t addr;
+    uint32_t length;
+  } pending_erase;
 } FakeFlashState;
 
 static FakeFlashState s_state = { 0 };
@@ -71,6 +81,7 @@ void fake_spi_flash_init(uint32_t offset, uint32_t length) {
   s_state.offset = offset;
   s_state.length = length;
   s_state.storage = malloc(length);
+  s_state.read_count = 0;
   s_state.write_count = 0;
   // Note: this is a harness failure, not a code failure.
   cl_assert(s_state.storage != NULL);
@@ -128,6 +139,7 @@ void fake_spi_flash_force_future_failure(int after_n_bytes, jmp_buf *retire_to)
 void flash_read_bytes(uint8_t* buffer, uint32_t start_addr, uint32_t buffer_size) {
   cl_assert(start_addr >= s_state.offset);
   cl_assert(start_addr + buffer_size <= s_state.offset + s_state.length);
+  ++s_state.read_count;
 
   memcpy(buffer, s_state.storage + (start_addr - s_state.offset), buffer_size);
 }
@@ -171,6 +183,7 @@ static void erase_block(uint32_t block_addr, uint32_t block_size) {
 }
 
 void flash_erase_sector_blocking(uint32_t sector_addr) {
+  flash_erase_wait_for_completion();
   erase_block(sector_addr, SECTOR_SIZE_BYTES);
 }
 
@@ -179,13 +192,61 @@ uint32_t flash_get_subsector_base_address(uint32_t flash_addr) {
 }
 
 void flash_erase_subsector_blocking(uint32_t subsector_addr) {
+  flash_erase_wait_for_completion();
   erase_block(subsector_addr, SUBSECTOR_SIZE_BYTES);
 }
 
+void fake_spi_flash_defer_erase_completion(bool defer) {
+  s_state.defer_erase_completion = defer;
+}
+
+void flash_erase_wait_for_completion(void) {
+  if (!s_state.pending_erase.cb) {
+    return;
+  }
+  FlashOperationCompleteCb cb = s_state.pending_erase.cb;
+  s_state.pending_erase.cb = NULL;
+  erase_block(s_state.pending_erase.addr, s_state.pending_erase.length);
+  cb(s_state.pending_erase.context, S_SUCCESS);
+}
+
+// The fake flash erases instantly, so the asynchronous erases complete before they return unless
+// their completion is deferred. A deferred erase doesn't touch the flash until it completes.
+static void prv_erase_async(uint32_t addr, uint32_t length, FlashOperationCompleteCb on_complete,
+                            void *context) {
+  // The real driver runs one erase at a time, so a new one waits for the last one
+  flash_erase_wait_for_completion();
+  if (s_state.defer_erase_completion) {
+    s_state.pending_erase.cb = on_complete;
+    s_state.pending_erase.context = context;
+    s_state.pending_erase.addr = addr;
+    s_state.pending_erase.length = length;
+    return;
+  }
+  erase_block(addr, length);
+  on_complete(context, S_SUCCESS);
+}
+
+void flash_erase_sector(uint32_t sector_addr, FlashOperationCompleteCb on_complete,
+                        void *context) {
+  prv_erase_async(flash_get_sector_base_address(sector_addr), SECTOR_SIZE_BYTES, on_complete,
+                  context);
+}
+
+void flash_erase_subsector(uint32_t subsector_addr, FlashOperationCompleteCb on_complete,
+                           void *context) {
+  prv_erase_async(flash_get_subsector_base_address(subsector_addr), SUBSECTOR_SIZE_BYTES,
+                  on_complete, context);
+}
+
 uint32_t flash_get_sector_base_address(uint32_t flash_addr) {
   return (flash_addr & ~(SECTOR_SIZE_BYTES - 1));
 }
 
+uint32_t fake_flash_read_count(void) {
+  return s_state.read_count;
+}
+
 uint32_t fake_flash_write_count(void) {
   return s_state.write_count;
 }
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <setjmp.h>
 
@@ -28,7 +29,12 @@ void fake_spi_flash_cleanup(void);
 //! the atomicity of algorithms which are purported to be so.
 void fake_spi_flash_force_future_failure(int after_n_bytes, jmp_buf *retire_to);
 
+//! Make asynchronous erases wait to complete until flash_erase_wait_for_completion() is called or
+//! the next one is started, as they do when the flash driver's poll timer is late
+void fake_spi_flash_defer_erase_completion(bool defer);
+
 void fake_flash_assert_region_untouched(uint32_t start_addr, uint32_t length);
 
+uint32_t fake_flash_read_count(void);
 uint32_t fake_flash_write_count(void);
 uint32_t fake_flash_erase_count(void);
@@ -94,6 +94,7 @@ static int s_message_idx;
 static struct {
   uint8_t data[BUFFER_SIZE];
   size_t length;
+  const uint8_t *ptr;
 } s_messages[TEST_ARRAY_SIZE];
 
 static int s_num_messages_to_consume_from_handler;
@@ -101,6 +102,7 @@ static int s_num_messages_to_consume_from_handler;
 void test_message_handler(const uint8_t *data, size_t length, AppInboxConsumerInfo *consumer_info) {
   cl_assert(s_message_idx < TEST_ARRAY_SIZE);
   s_messages[s_message_idx].length = length;
+  s_messages[s_message_idx].ptr = data;
   memcpy(s_messages[s_message_idx].data, data, length);
   ++s_message_idx;
   if (s_num_messages_to_consume_from_handler--) {
@@ -510,6 +512,47 @@ void test_app_inbox__multiple_writes_consume_from_message_handler(void) {
   assert_num_callback_events(0);
 }
 
+void test_app_inbox__batch_is_handled_in_place(void) {
+  prv_create_test_inbox_and_begin_write();
+
+  // Queue three messages before the app gets to run:
+  const size_t length = 2;
+  for (int i = 0; i < 3; ++i) {
+    if (i > 0) {
+      cl_assert_equal_b(true, app_inbox_service_begin(AppInboxServiceTagUnitTest,
+                                                      length, s_writer));
+    }
+    cl_assert_equal_b(true, app_inbox_service_write(AppInboxServiceTagUnitTest,
+                                                    s_test_data + i, length));
+    cl_assert_equal_b(true, app_inbox_service_end(AppInboxServiceTagUnitTest));
+  }
+
+  // The handler consumes every message as soon as it gets it:
+  s_num_messages_to_consume_from_handler = 3;
+  prv_process_callback_events();
+  assert_num_message_callbacks(3);
+
+  // Each message is handed over where it was written, consuming one message doesn't move the
+  // ones queued behind it:
+  const size_t stride = sizeof(AppInboxMessageHeader) + length;
+  for (int i = 0; i < 3; ++i) {
+    assert_message(i, s_test_data + i, length);
+    cl_assert_equal_p(s_messages[i].ptr,
+                      (uint8_t *)s_inbox + (i * stride) + sizeof(AppInboxMessageHeader));
+  }
+
+  // Once the batch is done, the whole buffer is available again:
+  cl_assert_equal_b(true, app_inbox_service_begin(AppInboxServiceTagUnitTest,
+                                                  BUFFER_SIZE, s_writer));
+  cl_assert_equal_b(true, app_inbox_service_write(AppInboxServiceTagUnitTest, s_test_data,
+                                                  BUFFER_SIZE));
+  cl_assert_equal_b(true, app_inbox_service_end(AppInboxServiceTagUnitTest));
+  prv_process_callback_events();
+  assert_num_message_callbacks(4);
+  assert_message(3, s_test_data, BUFFER_SIZE);
+  cl_assert_equal_p(s_messages[3].ptr, (uint8_t *)s_inbox + sizeof(AppInboxMessageHeader));
+}
+
 void test_app_inbox__consume_inbox_closed_in_mean_time(void) {
   prv_create_test_inbox_and_begin_write();
   cl_assert_equal_b(true, app_inbox_service_write(AppInboxServiceTagUnitTest, s_test_data, 1));
@@ -149,10 +149,17 @@ static void prv_out_failed_callback(DictionaryIterator *failed,
   cl_assert_equal_b(app_message_is_accepting_outbound(), true);
 }
 
+static int s_app_inbox_consume_call_count;
+static const void *s_pushed_dictionary;
+static const void *s_received_dictionary;
+static int s_consume_count_in_received_callback;
+
 static void prv_in_received_callback(DictionaryIterator *received, void *context) {
   cl_assert_equal_p(context, &s_context);
   prv_assert_dict_equal(received, &s_expected_iter);
   s_in_received_is_called = true;
+  s_received_dictionary = received->dictionary;
+  s_consume_count_in_received_callback = s_app_inbox_consume_call_count;
 }
 
 static void prv_in_dropped_callback(AppMessageResult reason, void *context) {
@@ -201,6 +208,7 @@ static void prv_receive_test_data(uint8_t transaction_id, const bool oversized)
   message->transaction_id = transaction_id;
   message->payload->push.uuid = s_remote_app_uuid;
   memcpy(&message->payload->push.dictionary, s_expected_buffer, dict_length);
+  s_pushed_dictionary = &message->payload->push.dictionary;
   PBL_LOG_DBG("message->transaction_id = %"PRIu32, message->transaction_id);
 
   CommSession *session = s_fake_app_comm_session;
@@ -356,7 +364,6 @@ void sys_current_process_schedule_callback(CallbackEventCallback async_cb, void
   s_process_manager_callback_data = ctx;
 }
 
-static int s_app_inbox_consume_call_count;
 void app_inbox_consume(AppInboxConsumerInfo *consumer_info) {
   ++s_app_inbox_consume_call_count;
 }
@@ -373,6 +380,9 @@ void test_app_message__initialize(void) {
 
   s_sys_psleep_last_millis = 0;
   s_app_inbox_consume_call_count = 0;
+  s_pushed_dictionary = NULL;
+  s_received_dictionary = NULL;
+  s_consume_count_in_received_callback = -1;
 
   app_message_init();
   app_message_set_context(&s_context);
@@ -667,6 +677,21 @@ void test_app_message__receive_happy_case(void) {
   check_in_accepting_again();
 }
 
+void test_app_message__receive_reads_dictionary_in_place(void) {
+  prv_set_remote_receive_handler(prv_receive_ack_nack_callback);
+  prv_receive_test_data(TEST_TRANSACTION_ID_1, false);
+  cl_assert(s_in_received_is_called == true);
+
+  // The iterator handed to the app points straight into the inbox message, nothing was copied
+  cl_assert(s_received_dictionary != NULL);
+  cl_assert_equal_p(s_received_dictionary, s_pushed_dictionary);
+
+  // The message is only released after the received handler has returned
+  cl_assert_equal_i(s_consume_count_in_received_callback, 0);
+  cl_assert_equal_i(s_app_inbox_consume_call_count, 1);
+  prv_process_sent_data();
+}
+
 void test_app_message__receive_dropped_because_buffer_too_small(void) {
   // FIXME:
   // https://pebbletechnology.atlassian.net/browse/PBL-22925
@@ -12,6 +12,7 @@
 #include "process_management/pebble_process_md.h"
 #include "pbl/services/filesystem/pfs.h"
 #include "pbl/services/persist.h"
+#include "pbl/services/settings/settings_file.h"
 #include <pbl/logging/logging.h>
 #include "pbl/util/attributes.h"
 
@@ -280,6 +281,151 @@ void test_persist__legacy2_max_usage(void) {
   //                  E_OUT_OF_STORAGE);
 }
 
+static int prv_used_space(void) {
+  SettingsFile *store = persist_service_lock_and_get_store(&test_uuid_a);
+  const int used_space = store->used_space;
+  persist_service_unlock_store(store);
+  return used_space;
+}
+
+// Reads the file directly, bypassing any open transaction
+static int prv_len_on_flash(uint32_t key) {
+  SettingsFile *store = persist_service_lock_and_get_store(&test_uuid_a);
+  const int len = settings_file_get_len(store, &key, sizeof(key));
+  persist_service_unlock_store(store);
+  return len;
+}
+
+void test_persist__commit_without_begin(void) {
+  cl_assert_equal_i(persist_commit(), E_INVALID_OPERATION);
+  cl_assert_equal_i(persist_begin(), S_SUCCESS);
+  cl_assert_equal_i(persist_commit(), S_SUCCESS);
+  cl_assert_equal_i(persist_commit(), E_INVALID_OPERATION);
+}
+
+void test_persist__transaction_commit(void) {
+  cl_assert_equal_i(persist_write_int(3, 3), sizeof(int32_t));
+
+  cl_assert_equal_i(persist_begin(), S_SUCCESS);
+  cl_assert_equal_i(persist_write_int(1, 1), sizeof(int32_t));
+  cl_assert_equal_i(persist_write_string(2, "two"), sizeof("two"));
+  cl_assert_equal_i(persist_delete(3), S_TRUE);
+
+  // Nothing reaches the file until the commit
+  cl_assert_equal_i(prv_len_on_flash(1), 0);
+  cl_assert_equal_i(prv_len_on_flash(2), 0);
+  cl_assert_equal_i(prv_len_on_flash(3), sizeof(int32_t));
+
+  cl_assert_equal_i(persist_commit(), S_SUCCESS);
+
+  cl_assert_equal_i(prv_len_on_flash(1), sizeof(int32_t));
+  cl_assert_equal_i(prv_len_on_flash(2), sizeof("two"));
+  cl_assert_equal_i(prv_len_on_flash(3), 0);
+  cl_assert_equal_i(persist_read_int(1), 1);
+  char buffer[8];
+  cl_assert_equal_i(persist_read_string(2, buffer, sizeof(buffer)), sizeof("two"));
+  cl_assert_equal_s(buffer, "two");
+  cl_assert(!persist_exists(3));
+}
+
+void test_persist__transaction_discarded(void) {
+  cl_assert_equal_i(persist_begin(), S_SUCCESS);
+  cl_assert_equal_i(persist_write_int(1, 1), sizeof(int32_t));
+  // Beginning again drops the uncommitted write
+  cl_assert_equal_i(persist_begin(), S_SUCCESS);
+  cl_assert(!persist_exists(1));
+  cl_assert_equal_i(persist_write_int(2, 2), sizeof(int32_t));
+
+  // As does the process going away
+  persist_service_client_close(&test_uuid_a);
+  persist_service_client_open(&test_uuid_a);
+  cl_assert(!persist_exists(1));
+  cl_assert(!persist_exists(2));
+  cl_assert_equal_i(persist_commit(), E_INVALID_OPERATION);
+}
+
+void test_persist__transaction_interleaved_reads(void) {
+  cl_assert_equal_i(persist_write_int(1, 10), sizeof(int32_t));
+  cl_assert_equal_i(persist_write_bool(2, true), sizeof(bool));
+
+  cl_assert_equal_i(persist_begin(), S_SUCCESS);
+  cl_assert_equal_i(persist_read_int(1), 10);
+
+  cl_assert_equal_i(persist_write_int(1, 11), sizeof(int32_t));
+  cl_assert_equal_i(persist_read_int(1), 11);
+  cl_assert_equal_i(persist_write_int(1, 12), sizeof(int32_t));
+  cl_assert_equal_i(persist_read_int(1), 12);
+
+  // A pending delete hides the stored value...
+  cl_assert_equal_i(persist_delete(2), S_TRUE);
+  cl_assert(!persist_exists(2));
+  cl_assert_equal_i(persist_get_size(2), E_DOES_NOT_EXIST);
+  cl_assert_equal_i(persist_read_bool(2), false);
+  cl_assert_equal_i(persist_delete(2), E_DOES_NOT_EXIST);
+  // ...until the key is written again
+  cl_assert_equal_i(persist_write_data(2, lipsum, 20), 20);
+  cl_assert_equal_i(persist_get_size(2), 20);
+  char buffer[40];
+  cl_assert_equal_i(persist_read_data(2, buffer, sizeof(buffer)), 20);
+  cl_assert(memcmp(buffer, lipsum, 20) == 0);
+
+  // Only the last write of each key is committed
+  const int used_space = prv_used_space();
+  cl_assert_equal_i(persist_commit(), S_SUCCESS);
+  cl_assert_equal_i(prv_used_space(), used_space - (int)sizeof(bool) + 20);
+
+  cl_assert_equal_i(persist_read_int(1), 12);
+  cl_assert_equal_i(persist_get_size(2), 20);
+}
+
+void test_persist__transaction_quota_overflow(void) {
+  uint8_t buffer[PERSIST_DATA_MAX_LENGTH];
+  memset(buffer, 1, sizeof(buffer));
+  const int record_size = sizeof(SettingsRecordHeader) + sizeof(uint32_t) + sizeof(buffer);
+
+  // Fill the store up to just under three more records from its quota, mostly
+  // with the largest records settings_file takes so that this doesn't take ages
+  static uint8_t filler[SETTINGS_VAL_MAX_LEN];
+  const size_t filler_size = sizeof(SettingsRecordHeader) + sizeof(uint32_t) + sizeof(filler);
+  uint32_t key = 0;
+  while (persist_service_get_max_size() - prv_used_space() >= 3 * record_size + filler_size) {
+    SettingsFile *store = persist_service_lock_and_get_store(&test_uuid_a);
+    cl_assert_equal_i(settings_file_set(store, &key, sizeof(key), filler, sizeof(filler)),
+                      S_SUCCESS);
+    persist_service_unlock_store(store);
+    key++;
+  }
+  while (persist_service_get_max_size() - prv_used_space() >= (size_t)(3 * record_size)) {
+    cl_assert_equal_i(persist_write_data(key++, buffer, sizeof(buffer)), sizeof(buffer));
+  }
+  const int used_space = prv_used_space();
+
+  cl_assert_equal_i(persist_begin(), S_SUCCESS);
+  for (int i = 0; i < 3; i++) {
+    cl_assert_equal_i(persist_write_data(key + i, buffer, sizeof(buffer)), sizeof(buffer));
+  }
+  cl_assert_equal_i(persist_commit(), E_OUT_OF_STORAGE);
+
+  // None of the writes were made, not even the ones that would have fit
+  cl_assert_equal_i(prv_used_space(), used_space);
+  for (int i = 0; i < 3; i++) {
+    cl_assert(!persist_exists(key + i));
+  }
+
+  // Deletes in the same transaction make room for the writes
+  cl_assert_equal_i(persist_begin(), S_SUCCESS);
+  for (int i = 0; i < 3; i++) {
+    cl_assert_equal_i(persist_write_data(key + i, buffer, sizeof(buffer)), sizeof(buffer));
+  }
+  cl_assert_equal_i(persist_delete(0), S_TRUE);
+  cl_assert_equal_i(persist_delete(1), S_TRUE);
+  cl_assert_equal_i(persist_commit(), S_SUCCESS);
+  for (int i = 0; i < 3; i++) {
+    cl_assert(persist_exists(key + i));
+  }
+  cl_assert(!persist_exists(0));
+}
+
 // Legacy persist_map layout, used to seed a migration scenario.
 typedef struct PACKED {
   uint16_t version;
@@ -69,6 +69,7 @@
 #include "stubs_sleep.h"
 #include "stubs_syscalls.h"
 #include "stubs_system_theme.h"
+#include "stubs_system_task.h"
 #include "stubs_task_watchdog.h"
 #include "stubs_timeline.h"
 #include "stubs_timeline_actions.h"
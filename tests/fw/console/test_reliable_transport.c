@@ -0,0 +1,523 @@
+/* SPDX-FileCopyrightText: 2026 Core Devices LLC */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include "console/control_protocol.h"
+#include "console/control_protocol_impl.h"
+#include "console/pulse2_reliable_retransmit_timer.h"
+#include "console/pulse2_transport_impl.h"
+#include "console/pulse_control_message_protocol.h"
+#include "console/pulse_protocol_impl.h"
+
+#include "clar.h"
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Stubs
+///////////////////////////////////////////////////////////
+
+#include "stubs_logging.h"
+#include "stubs_mutex.h"
+#include "stubs_passert.h"
+#include "stubs_pbl_malloc.h"
+#include "stubs_system_task.h"
+
+void pulse_control_message_protocol_send_port_closed_message(
+    PulseControlMessageProtocol *this, net16 port) {}
+
+void pulse_pp_transport_handle_received_data(void *packet, size_t length) {}
+void pulse_pp_transport_open_handler(void) {}
+void pulse_pp_transport_closed_handler(void) {}
+void pulse2_bulkio_link_open_handler(void) {}
+void pulse2_bulkio_link_closed_handler(void) {}
+void pulse2_prompt_packet_handler(void *packet, size_t length) {}
+
+extern PPPControlProtocol * const PULSE2_TRAINCP;
+
+void ppp_control_protocol_init(PPPControlProtocol *this) {}
+void ppp_control_protocol_open(PPPControlProtocol *this) {}
+void ppp_control_protocol_handle_incoming_packet(PPPControlProtocol *this,
+                                                 void *packet, size_t length) {}
+
+void ppp_control_protocol_lower_layer_is_up(PPPControlProtocol *this) {
+  this->on_this_layer_up(this);
+}
+
+void ppp_control_protocol_lower_layer_is_down(PPPControlProtocol *this) {
+  this->on_this_layer_down(this);
+}
+
+// Fake counting semaphore counting the free tx buffers
+///////////////////////////////////////////////////////////
+
+static int s_free_tx_buffers;
+
+QueueHandle_t xQueueCreateCountingSemaphore(UBaseType_t max_count, UBaseType_t initial_count) {
+  s_free_tx_buffers = initial_count;
+  return (QueueHandle_t)&s_free_tx_buffers;
+}
+
+signed portBASE_TYPE xQueueGenericReceive(QueueHandle_t queue, void * const buffer,
+                                          TickType_t ticks_to_wait, portBASE_TYPE just_peeking) {
+  // Nothing else runs in this test, so having to wait would deadlock
+  cl_assert(s_free_tx_buffers > 0);
+  --s_free_tx_buffers;
+  return pdTRUE;
+}
+
+signed portBASE_TYPE xQueueGenericSend(QueueHandle_t queue, const void * const item,
+                                       TickType_t ticks_to_wait, portBASE_TYPE copy_position) {
+  cl_assert(s_free_tx_buffers < PULSE_RELIABLE_WINDOW_SIZE);
+  ++s_free_tx_buffers;
+  return pdTRUE;
+}
+
+// Fake retransmit timer
+///////////////////////////////////////////////////////////
+
+static bool s_timer_running;
+static uint8_t s_timer_sequence_number;
+
+void pulse2_reliable_retransmit_timer_start(unsigned int timeout_ms, uint8_t sequence_number) {
+  s_timer_running = true;
+  s_timer_sequence_number = sequence_number;
+}
+
+void pulse2_reliable_retransmit_timer_cancel(void) {
+  s_timer_running = false;
+}
+
+static void prv_fire_retransmit_timer(void) {
+  cl_assert(s_timer_running);
+  s_timer_running = false;
+  pulse2_reliable_retransmit_timer_expired_handler(s_timer_sequence_number);
+}
+
+// Fake link, carrying frames from the watch to the peer
+///////////////////////////////////////////////////////////
+
+#define MAX_FRAMES (64)
+
+typedef struct Frame {
+  uint16_t protocol;
+  size_t length;
+  uint8_t data[PULSE_MAX_SEND_SIZE];
+} Frame;
+
+static uint8_t s_link_buffer[PULSE_MAX_SEND_SIZE];
+static uint16_t s_link_protocol;
+static Frame s_frames[MAX_FRAMES];
+static int s_num_frames;
+
+size_t pulse_link_max_send_size(void) {
+  return PULSE_MAX_SEND_SIZE;
+}
+
+void *pulse_link_send_begin(uint16_t protocol) {
+  s_link_protocol = protocol;
+  return s_link_buffer;
+}
+
+void pulse_link_send(void *buf, size_t length) {
+  cl_assert(s_num_frames < MAX_FRAMES);
+  Frame *frame = &s_frames[s_num_frames++];
+  frame->protocol = s_link_protocol;
+  frame->length = length;
+  memcpy(frame->data, buf, length);
+}
+
+void pulse_link_send_cancel(void *buf) {}
+
+// Wire format helpers
+///////////////////////////////////////////////////////////
+
+#define INFO_HEADER_SIZE (6)
+#define KIND_RR (0)
+#define KIND_REJ (2)
+
+static bool prv_is_info_command(const Frame *frame) {
+  return frame->protocol == PULSE2_RELIABLE_TRANSPORT_COMMAND && !(frame->data[0] & 1);
+}
+
+static uint8_t prv_sequence_number(const Frame *frame) {
+  return frame->data[0] >> 1;
+}
+
+static uint32_t prv_payload(const Frame *frame) {
+  uint32_t value;
+  memcpy(&value, &frame->data[INFO_HEADER_SIZE], sizeof(value));
+  return value;
+}
+
+static int prv_supervisory_kind(const Frame *frame) {
+  return (frame->data[0] >> 2) & 0x3;
+}
+
+static uint8_t prv_ack_number(const Frame *frame) {
+  return frame->data[1] >> 1;
+}
+
+static void prv_receive_supervisory(bool is_command, int kind, uint8_t ack_number) {
+  uint8_t packet[2] = { 1 | (kind << 2), ack_number << 1 };
+  if (is_command) {
+    pulse2_reliable_transport_on_command_packet(packet, sizeof(packet));
+  } else {
+    pulse2_reliable_transport_on_response_packet(packet, sizeof(packet));
+  }
+}
+
+static void prv_receive_info(uint8_t sequence_number, uint8_t ack_number, uint32_t payload) {
+  uint8_t packet[INFO_HEADER_SIZE + sizeof(payload)] = {
+    sequence_number << 1, 1 | (ack_number << 1),
+    PULSE2_BULKIO_PROTOCOL >> 8, PULSE2_BULKIO_PROTOCOL & 0xff,
+    0, sizeof(packet),
+  };
+  memcpy(&packet[INFO_HEADER_SIZE], &payload, sizeof(payload));
+  pulse2_reliable_transport_on_command_packet(packet, sizeof(packet));
+}
+
+// Fake peer: an LAPB receiver on the other end of a lossy link
+///////////////////////////////////////////////////////////
+
+#define MAX_DELIVERED (256)
+
+static uint8_t s_peer_receive_variable;
+//! Whether the peer REJs a gap. The host's pulse2 transport never does, it RRs every out of
+//! sequence frame and discards it.
+static bool s_peer_sends_reject;
+static bool s_peer_reject_sent;
+static uint32_t s_delivered[MAX_DELIVERED];
+static int s_num_delivered;
+//! Information frames the link has carried so far, lost or not
+static int s_num_info_frames_carried;
+//! Loses every Nth Information frame if non-zero
+static int s_drop_every;
+//! Loses only the Information frame with this index if non-negative
+static int s_drop_index;
+
+static bool prv_is_dropped(int index) {
+  return (index == s_drop_index) ||
+         (s_drop_every && (index % s_drop_every) == (s_drop_every - 1));
+}
+
+//! Carries everything the watch sent to the peer, then carries the peer's responses back
+static void prv_round_trip(void) {
+  Frame frames[MAX_FRAMES];
+  const int num_frames = s_num_frames;
+  memcpy(frames, s_frames, sizeof(Frame) * num_frames);
+  s_num_frames = 0;
+
+  struct {
+    int kind;
+    uint8_t ack_number;
+  } responses[MAX_FRAMES];
+  int num_responses = 0;
+
+  for (int i = 0; i < num_frames; ++i) {
+    if (!prv_is_info_command(&frames[i]) || prv_is_dropped(s_num_info_frames_carried++)) {
+      continue;
+    }
+    int kind = KIND_RR;
+    if (prv_sequence_number(&frames[i]) == s_peer_receive_variable) {
+      cl_assert(s_num_delivered < MAX_DELIVERED);
+      s_delivered[s_num_delivered++] = prv_payload(&frames[i]);
+      s_peer_receive_variable = (s_peer_receive_variable + 1) % 128;
+      s_peer_reject_sent = false;
+    } else if (s_peer_sends_reject && !s_peer_reject_sent) {
+      s_peer_reject_sent = true;
+      kind = KIND_REJ;
+    }
+    responses[num_responses].kind = kind;
+    responses[num_responses].ack_number = s_peer_receive_variable;
+    num_responses++;
+  }
+
+  for (int i = 0; i < num_responses; ++i) {
+    prv_receive_supervisory(false, responses[i].kind, responses[i].ack_number);
+  }
+}
+
+static uint32_t s_next_payload;
+
+static void prv_send_next(void) {
+  void *buf = pulse_reliable_send_begin(PULSE2_BULKIO_PROTOCOL);
+  cl_assert(buf);
+  memcpy(buf, &s_next_payload, sizeof(s_next_payload));
+  s_next_payload++;
+  pulse_reliable_send(buf, sizeof(s_next_payload));
+}
+
+//! Sends as much as the window allows
+static void prv_fill_window(uint32_t total) {
+  while (s_next_payload < total && s_free_tx_buffers > 0) {
+    prv_send_next();
+  }
+}
+
+static int prv_num_info_frames(void) {
+  int count = 0;
+  for (int i = 0; i < s_num_frames; ++i) {
+    count += prv_is_info_command(&s_frames[i]);
+  }
+  return count;
+}
+
+static void prv_assert_delivered_in_order(uint32_t total) {
+  cl_assert_equal_i(s_num_delivered, total);
+  for (uint32_t i = 0; i < total; ++i) {
+    cl_assert_equal_i(s_delivered[i], i);
+  }
+}
+
+//! Payloads the watch delivered to bulkio from the peer's Information frames
+static uint32_t s_received[MAX_DELIVERED];
+static int s_num_received;
+
+void pulse2_bulkio_packet_handler(void *packet, size_t length) {
+  cl_assert_equal_i(length, sizeof(uint32_t));
+  memcpy(&s_received[s_num_received++], packet, sizeof(uint32_t));
+}
+
+// Tests
+///////////////////////////////////////////////////////////
+
+void test_reliable_transport__initialize(void) {
+  s_num_frames = 0;
+  s_timer_running = false;
+  s_peer_receive_variable = 0;
+  s_peer_sends_reject = true;
+  s_peer_reject_sent = false;
+  s_num_delivered = 0;
+  s_num_info_frames_carried = 0;
+  s_drop_every = 0;
+  s_drop_index = -1;
+  s_next_payload = 0;
+  s_num_received = 0;
+
+  static bool s_initialized;
+  if (!s_initialized) {
+    pulse2_reliable_init();
+    s_initialized = true;
+  }
+  ppp_control_protocol_lower_layer_is_up(PULSE2_TRAINCP);
+}
+
+void test_reliable_transport__cleanup(void) {
+  ppp_control_protocol_lower_layer_is_down(PULSE2_TRAINCP);
+  cl_assert_equal_i(s_free_tx_buffers, PULSE_RELIABLE_WINDOW_SIZE);
+}
+
+void test_reliable_transport__window_of_frames_in_flight(void) {
+  prv_fill_window(100);
+
+  // A whole window is sent without waiting for any ACK
+  cl_assert_equal_i(s_next_payload, PULSE_RELIABLE_WINDOW_SIZE);
+  cl_assert_equal_i(prv_num_info_frames(), PULSE_RELIABLE_WINDOW_SIZE);
+  for (int i = 0; i < PULSE_RELIABLE_WINDOW_SIZE; ++i) {
+    cl_assert_equal_i(prv_sequence_number(&s_frames[i]), i);
+  }
+  cl_assert(s_timer_running);
+  cl_assert_equal_i(s_timer_sequence_number, 0);
+
+  prv_round_trip();
+  prv_assert_delivered_in_order(PULSE_RELIABLE_WINDOW_SIZE);
+  cl_assert_equal_i(s_free_tx_buffers, PULSE_RELIABLE_WINDOW_SIZE);
+  cl_assert(!s_timer_running);
+}
+
+void test_reliable_transport__partial_ack_opens_window(void) {
+  prv_fill_window(100);
+  s_num_frames = 0;
+
+  // The peer got the first two frames
+  prv_receive_supervisory(false, KIND_RR, 2);
+  cl_assert_equal_i(s_free_tx_buffers, 2);
+  // The timer now runs for the oldest frame still un-ACKed
+  cl_assert(s_timer_running);
+  cl_assert_equal_i(s_timer_sequence_number, 2);
+
+  // A stale ACK from before the window is ignored
+  prv_receive_supervisory(false, KIND_RR, 1);
+  cl_assert_equal_i(s_free_tx_buffers, 2);
+
+  prv_fill_window(100);
+  cl_assert_equal_i(prv_num_info_frames(), 2);
+  cl_assert_equal_i(prv_sequence_number(&s_frames[0]), 4);
+  cl_assert_equal_i(prv_sequence_number(&s_frames[1]), 5);
+}
+
+void test_reliable_transport__timeout_retransmits_lost_frame(void) {
+  // The last frame of the window is lost, which the peer can't notice
+  s_drop_index = PULSE_RELIABLE_WINDOW_SIZE - 1;
+  prv_fill_window(PULSE_RELIABLE_WINDOW_SIZE);
+  prv_round_trip();
+  cl_assert_equal_i(s_num_delivered, PULSE_RELIABLE_WINDOW_SIZE - 1);
+  cl_assert_equal_i(s_free_tx_buffers, PULSE_RELIABLE_WINDOW_SIZE - 1);
+
+  cl_assert_equal_i(s_timer_sequence_number, PULSE_RELIABLE_WINDOW_SIZE - 1);
+  prv_fire_retransmit_timer();
+  cl_assert_equal_i(prv_num_info_frames(), 1);
+  cl_assert_equal_i(prv_sequence_number(&s_frames[0]), PULSE_RELIABLE_WINDOW_SIZE - 1);
+
+  prv_round_trip();
+  prv_assert_delivered_in_order(PULSE_RELIABLE_WINDOW_SIZE);
+  cl_assert(!s_timer_running);
+}
+
+void test_reliable_transport__timeout_goes_back(void) {
+  // The second frame is lost and the peer discards the rest of the window without a REJ
+  s_peer_sends_reject = false;
+  s_drop_index = 1;
+  prv_fill_window(PULSE_RELIABLE_WINDOW_SIZE);
+  prv_round_trip();
+  cl_assert_equal_i(s_num_delivered, 1);
+  cl_assert_equal_i(prv_num_info_frames(), 0);
+
+  // Everything from the lost frame on is sent again once the timer expires
+  cl_assert_equal_i(s_timer_sequence_number, 1);
+  prv_fire_retransmit_timer();
+  cl_assert_equal_i(prv_num_info_frames(), PULSE_RELIABLE_WINDOW_SIZE - 1);
+  for (int i = 0; i < PULSE_RELIABLE_WINDOW_SIZE - 1; ++i) {
+    cl_assert_equal_i(prv_sequence_number(&s_frames[i]), i + 1);
+  }
+
+  prv_round_trip();
+  prv_assert_delivered_in_order(PULSE_RELIABLE_WINDOW_SIZE);
+  cl_assert(!s_timer_running);
+}
+
+void test_reliable_transport__reject_goes_back(void) {
+  // The second frame is lost, the peer REJs the third and discards the fourth
+  s_drop_index = 1;
+  prv_fill_window(PULSE_RELIABLE_WINDOW_SIZE);
+  prv_round_trip();
+  cl_assert_equal_i(s_num_delivered, 1);
+
+  // Everything from the lost frame on was sent again without waiting for the timer
+  cl_assert_equal_i(prv_num_info_frames(), PULSE_RELIABLE_WINDOW_SIZE - 1);
+  for (int i = 0; i < PULSE_RELIABLE_WINDOW_SIZE - 1; ++i) {
+    cl_assert_equal_i(prv_sequence_number(&s_frames[i]), i + 1);
+  }
+
+  prv_round_trip();
+  prv_assert_delivered_in_order(PULSE_RELIABLE_WINDOW_SIZE);
+  cl_assert(!s_timer_running);
+}
+
+static void prv_assert_lossy_link_delivers_in_order(void) {
+  // Enough frames for the sequence numbers to wrap
+  const uint32_t total = 200;
+  s_drop_every = 7;
+
+  for (int round = 0; s_num_delivered < (int)total; ++round) {
+    cl_assert(round < 1000);
+    prv_fill_window(total);
+    if (s_num_frames == 0) {
+      prv_fire_retransmit_timer();
+    }
+    prv_round_trip();
+  }
+  prv_assert_delivered_in_order(total);
+}
+
+void test_reliable_transport__lossy_link_delivers_in_order(void) {
+  prv_assert_lossy_link_delivers_in_order();
+}
+
+void test_reliable_transport__lossy_link_without_reject(void) {
+  s_peer_sends_reject = false;
+  prv_assert_lossy_link_delivers_in_order();
+}
+
+void test_reliable_transport__throughput(void) {
+  // A round trip per frame is what stop-and-wait managed
+  const uint32_t total = 64;
+  int round_trips = 0;
+  while (s_num_delivered < (int)total) {
+    prv_fill_window(total);
+    prv_round_trip();
+    round_trips++;
+  }
+  prv_assert_delivered_in_order(total);
+  cl_assert_equal_i(round_trips, total / PULSE_RELIABLE_WINDOW_SIZE);
+}
+
+void test_reliable_transport__receiver_rejects_gap_once(void) {
+  prv_receive_info(0, 0, 100);
+  cl_assert_equal_i(s_num_frames, 1);
+  cl_assert_equal_i(prv_supervisory_kind(&s_frames[0]), KIND_RR);
+  cl_assert_equal_i(prv_ack_number(&s_frames[0]), 1);
+
+  // Frame 1 went missing
+  prv_receive_info(2, 0, 102);
+  prv_receive_info(3, 0, 103);
+  cl_assert_equal_i(s_num_frames, 3);
+  cl_assert_equal_i(s_frames[1].protocol, PULSE2_RELIABLE_TRANSPORT_RESPONSE);
+  cl_assert_equal_i(prv_supervisory_kind(&s_frames[1]), KIND_REJ);
+  cl_assert_equal_i(prv_ack_number(&s_frames[1]), 1);
+  cl_assert_equal_i(prv_supervisory_kind(&s_frames[2]), KIND_RR);
+  cl_assert_equal_i(prv_ack_number(&s_frames[2]), 1);
+
+  // A retransmission of a frame already received isn't a gap
+  prv_receive_info(0, 0, 100);
+  cl_assert_equal_i(prv_supervisory_kind(&s_frames[3]), KIND_RR);
+
+  prv_receive_info(1, 0, 101);
+  prv_receive_info(2, 0, 102);
+  cl_assert_equal_i(s_num_received, 3);
+  for (int i = 0; i < 3; ++i) {
+    cl_assert_equal_i(s_received[i], 100 + i);
+  }
+  cl_assert_equal_i(prv_ack_number(&s_frames[s_num_frames - 1]), 3);
+}
+
+void test_reliable_transport__piggybacked_ack(void) {
+  prv_fill_window(PULSE_RELIABLE_WINDOW_SIZE);
+  prv_receive_info(0, 3, 100);
+  cl_assert_equal_i(s_free_tx_buffers, 3);
+  cl_assert_equal_i(s_timer_sequence_number, 3);
+}
+
+void test_reliable_transport__reject_command(void) {
+  prv_fill_window(PULSE_RELIABLE_WINDOW_SIZE);
+  s_num_frames = 0;
+
+  prv_receive_supervisory(true, KIND_REJ, 2);
+  cl_assert_equal_i(s_free_tx_buffers, 2);
+  cl_assert_equal_i(prv_num_info_frames(), 2);
+  cl_assert_equal_i(prv_sequence_number(&s_frames[0]), 2);
+  cl_assert_equal_i(prv_sequence_number(&s_frames[1]), 3);
+}
+
+void test_reliable_transport__layer_down_releases_window(void) {
+  prv_fill_window(PULSE_RELIABLE_WINDOW_SIZE);
+  cl_assert_equal_i(s_free_tx_buffers, 0);
+
+  ppp_control_protocol_lower_layer_is_down(PULSE2_TRAINCP);
+  cl_assert_equal_i(s_free_tx_buffers, PULSE_RELIABLE_WINDOW_SIZE);
+  cl_assert(!s_timer_running);
+  cl_assert_equal_p(pulse_reliable_send_begin(PULSE2_BULKIO_PROTOCOL), NULL);
+
+  // Coming back up starts over from sequence number 0
+  ppp_control_protocol_lower_layer_is_up(PULSE2_TRAINCP);
+  s_num_frames = 0;
+  prv_send_next();
+  cl_assert_equal_i(prv_sequence_number(&s_frames[0]), 0);
+}
+
+void test_reliable_transport__retransmit_limit_bounces_layer(void) {
+  s_drop_every = 1;
+  prv_fill_window(PULSE_RELIABLE_WINDOW_SIZE);
+  for (int i = 0; i < 9; ++i) {
+    prv_fire_retransmit_timer();
+    cl_assert_equal_i(s_free_tx_buffers, 0);
+  }
+  prv_fire_retransmit_timer();
+  // The layer was bounced, dropping the window
+  cl_assert_equal_i(s_free_tx_buffers, PULSE_RELIABLE_WINDOW_SIZE);
+  cl_assert(!s_timer_running);
+}
@@ -250,3 +250,34 @@ void test_flash_api__handle_uncorrectable_erase_error(void) {
   cl_assert(i > 1 && i < 20);
   cl_assert_equal_i(uncorrectable_erase_error_cb_called, true);
 }
+
+///////////////////////////////////////////////////////////////////////
+
+static int s_busy_polls_remaining;
+status_t erase_status_busy_for_a_while(void) {
+  if (s_busy_polls_remaining > 0) {
+    s_busy_polls_remaining--;
+    return E_BUSY;
+  }
+  return S_SUCCESS;
+}
+
+void test_flash_api__wait_for_completion_polls_from_caller(void) {
+  s_busy_polls_remaining = 5;
+  get_erase_status_fn = erase_status_busy_for_a_while;
+  TimerID erase_timer = flash_api_get_erase_poll_timer_for_test();
+  flash_erase_subsector(0, callback, (void *)1);
+  cl_assert(stub_new_timer_is_scheduled(erase_timer));
+
+  // Completes without the timer ever firing
+  flash_erase_wait_for_completion();
+  cl_assert_equal_i(callback_status, S_SUCCESS);
+  cl_assert_equal_p(callback_context, (void *)1);
+  cl_assert(!stub_new_timer_is_scheduled(erase_timer));
+  cl_assert_equal_i(s_busy_polls_remaining, 0);
+
+  // Nothing left to wait for, and the callback isn't called again
+  callback_status = -12345;
+  flash_erase_wait_for_completion();
+  cl_assert_equal_i(callback_status, -12345);
+}
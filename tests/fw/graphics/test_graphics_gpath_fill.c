@@ -0,0 +1,420 @@
+/* SPDX-FileCopyrightText: 2026 Core Devices LLC */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include "clar.h"
+
+#include "applib/graphics/gpath.h"
+#include "applib/graphics/graphics.h"
+#include "pbl/util/math.h"
+#include "pbl/util/size.h"
+#include "pbl/util/trig.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Stubs
+////////////////////////////////////
+#include "stubs_app_state.h"
+#include "stubs_graphics.h"
+#include "stubs_graphics_line.h"
+#include "stubs_logging.h"
+#include "stubs_passert.h"
+#include "stubs_pbl_malloc.h"
+
+void graphics_private_draw_horizontal_line_delta_aa(GContext *ctx, int16_t y, Fixed_S16_3 x1,
+                                                    Fixed_S16_3 x2, Fixed_S16_3 delta1,
+                                                    Fixed_S16_3 delta2) {}
+
+void prv_fill_path_with_cb_aa(GContext *ctx, GPath *path, GPathDrawFilledCallback cb,
+                              void *user_data);
+
+// Recorded fills
+////////////////////////////////////
+
+typedef struct {
+  int16_t y;
+  int16_t x_begin;
+  int16_t x_end;
+  int16_t delta_begin;
+  int16_t delta_end;
+} Span;
+
+#define MAX_SPANS (4096)
+
+typedef struct {
+  Span spans[MAX_SPANS];
+  int num_spans;
+} Spans;
+
+static Spans s_expected;
+static Spans s_actual;
+
+static void prv_record_cb(GContext *ctx, int16_t y, Fixed_S16_3 x_range_begin,
+                          Fixed_S16_3 x_range_end, Fixed_S16_3 delta_begin,
+                          Fixed_S16_3 delta_end, void *user_data) {
+  Spans *spans = user_data;
+  cl_assert(spans->num_spans < MAX_SPANS);
+  spans->spans[spans->num_spans++] = (Span) {
+    .y = y,
+    .x_begin = x_range_begin.raw_value,
+    .x_end = x_range_end.raw_value,
+    .delta_begin = delta_begin.raw_value,
+    .delta_end = delta_end.raw_value,
+  };
+}
+
+// Reference: the per-scanline fills that walked every segment on every row
+////////////////////////////////////
+
+typedef struct {
+  Fixed_S16_3 x;
+  Fixed_S16_3 delta;
+} ReferenceIntersection;
+
+static void swapIntersections(ReferenceIntersection *a, ReferenceIntersection *b) {
+  ReferenceIntersection t = *a;
+  *a = *b;
+  *b = t;
+}
+
+static void sortIntersections(ReferenceIntersection *values, size_t length) {
+  for (unsigned int i = 0; i < length; i++) {
+    for (unsigned int j = i+1; j < length; j++) {
+      if (values[i].x.raw_value > values[j].x.raw_value) {
+        swapIntersections(&values[i], &values[j]);
+      }
+    }
+  }
+}
+
+static GPoint prv_rotate_offset_point(const GPoint *orig, int32_t rotation,
+                                      const GPoint *offset) {
+  int32_t cosine = cos_lookup(rotation);
+  int32_t sine = sin_lookup(rotation);
+  GPoint result;
+  result.x = (int32_t)orig->x * cosine / TRIG_MAX_RATIO - (int32_t)orig->y * sine / TRIG_MAX_RATIO
+      + offset->x;
+  result.y = (int32_t)orig->y * cosine / TRIG_MAX_RATIO + (int32_t)orig->x * sine / TRIG_MAX_RATIO
+      + offset->y;
+  return result;
+}
+
+static void prv_reference_fill(GContext *ctx, GPath *path, bool antialiased,
+                               GPathDrawFilledCallback cb, void *user_data) {
+  if (!path || path->num_points < 2) {
+    return;
+  }
+  const uint32_t num_points = path->num_points;
+  GPoint *rot_points = malloc(num_points * sizeof(GPoint));
+  ReferenceIntersection *intersections_up = malloc(num_points * sizeof(ReferenceIntersection));
+  ReferenceIntersection *intersections_down = malloc(num_points * sizeof(ReferenceIntersection));
+
+  int min_x, max_x, min_y, max_y;
+  bool start_is_down = false;
+  rot_points[0] = prv_rotate_offset_point(&path->points[0], path->rotation, &path->offset);
+  min_x = max_x = rot_points[0].x;
+  min_y = max_y = rot_points[0].y;
+  GPoint rot_end = rot_points[0];
+  bool found_start_direction = false;
+  for (int i = num_points - 1; i > 0; --i) {
+    const GPoint rot_start = rot_points[i] =
+        prv_rotate_offset_point(&path->points[i], path->rotation, &path->offset);
+    min_x = MIN(min_x, rot_start.x);
+    max_x = MAX(max_x, rot_start.x);
+    min_y = MIN(min_y, rot_start.y);
+    max_y = MAX(max_y, rot_start.y);
+    if (found_start_direction) {
+      continue;
+    }
+    if (rot_end.y != rot_start.y) {
+      start_is_down = rot_end.y > rot_start.y;
+      found_start_direction = true;
+    }
+    rot_end = rot_start;
+  }
+
+  const int16_t clip_min_x = ctx->draw_state.clip_box.origin.x
+      - ctx->draw_state.drawing_box.origin.x;
+  const int16_t clip_max_x = ctx->draw_state.clip_box.size.w + clip_min_x;
+  if ((max_x < clip_min_x) || (min_x > clip_max_x)) {
+    goto cleanup;
+  }
+  const int16_t clip_min_y = ctx->draw_state.clip_box.origin.y
+      - ctx->draw_state.drawing_box.origin.y;
+  const int16_t clip_max_y = ctx->draw_state.clip_box.size.h + clip_min_y;
+  min_y = MAX(min_y, clip_min_y);
+  max_y = MIN(max_y, clip_max_y);
+
+  for (int16_t i = min_y; i <= max_y; ++i) {
+    int up_count = 0;
+    int down_count = 0;
+    bool last_is_down = start_is_down;
+    for (uint32_t j = 0; j < num_points; ++j) {
+      const GPoint start = rot_points[j];
+      const GPoint end = rot_points[(j + 1 < num_points) ? j + 1 : 0];
+      if ((start.y - i) * (end.y - i) > 0) {
+        continue;
+      }
+      const bool is_down = (end.y != start.y) ? (end.y > start.y) : last_is_down;
+      if (!(start.y == i && last_is_down == is_down)) {
+        ReferenceIntersection intersection = {};
+        if (antialiased) {
+          const GPointPrecise p_start = GPointPreciseFromGPoint(start);
+          const GPointPrecise p_end = GPointPreciseFromGPoint(end);
+          const int16_t delta_x = p_end.x.raw_value - p_start.x.raw_value;
+          const int16_t delta_y = p_end.y.raw_value - p_start.y.raw_value;
+          intersection.x.raw_value = p_start.x.raw_value + delta_x *
+              (i * FIXED_S16_3_ONE.raw_value - p_start.y.raw_value) / delta_y;
+          intersection.delta.raw_value = ABS(delta_x / delta_y) * FIXED_S16_3_ONE.raw_value;
+          if (intersection.delta.integer > 1) {
+            const int16_t seg_min_x = MIN(p_start.x.raw_value, p_end.x.raw_value);
+            const int16_t seg_max_x = MAX(p_start.x.raw_value, p_end.x.raw_value);
+            if (intersection.x.raw_value - (intersection.delta.raw_value / 2) < seg_min_x) {
+              intersection.delta.raw_value = (intersection.x.raw_value - seg_min_x) * 2;
+            }
+            if (intersection.x.raw_value + (intersection.delta.raw_value / 2) > seg_max_x) {
+              intersection.delta.raw_value = (seg_max_x - intersection.x.raw_value) * 2;
+            }
+          }
+        } else {
+          intersection.x.raw_value =
+              start.x + (end.x - start.x) * (i - start.y) / (end.y - start.y);
+        }
+        if (is_down) {
+          intersections_down[down_count++] = intersection;
+        } else {
+          intersections_up[up_count++] = intersection;
+        }
+      }
+      last_is_down = is_down;
+    }
+
+    sortIntersections(intersections_up, up_count);
+    sortIntersections(intersections_down, down_count);
+
+    for (int j = 0; j < MIN(up_count, down_count); j++) {
+      ReferenceIntersection a = intersections_up[j];
+      ReferenceIntersection b = intersections_down[j];
+      if (antialiased) {
+        if (a.x.integer == b.x.integer) {
+          continue;
+        }
+        if (a.x.integer > b.x.integer) {
+          swapIntersections(&a, &b);
+        }
+        cb(ctx, i, a.x, b.x, a.delta, b.delta, user_data);
+      } else {
+        int16_t x_a = a.x.raw_value;
+        int16_t x_b = b.x.raw_value;
+        if (x_a == x_b) {
+          continue;
+        }
+        if (x_a > x_b) {
+          const int16_t t = x_a;
+          x_a = x_b;
+          x_b = t;
+        }
+        cb(ctx, i, (Fixed_S16_3){.integer = x_a}, (Fixed_S16_3){.integer = x_b},
+           (Fixed_S16_3){.integer = -1}, (Fixed_S16_3){.integer = -1}, user_data);
+      }
+    }
+  }
+
+cleanup:
+  free(rot_points);
+  free(intersections_up);
+  free(intersections_down);
+}
+
+// Corpus
+////////////////////////////////////
+
+static const GPathInfo s_house_path_info = {
+  .num_points = 11,
+  .points = (GPoint []) {
+    {-40, 0}, {0, -40}, {40, 0}, {28, 0}, {28, 40}, {10, 40},
+    {10, 16}, {-10, 16}, {-10, 40}, {-28, 40}, {-28, 0},
+  },
+};
+
+static const GPathInfo s_bolt_path_info = {
+  .num_points = 6,
+  .points = (GPoint []) {{21, 0}, {14, 26}, {28, 26}, {7, 60}, {14, 34}, {0, 34}},
+};
+
+static const GPathInfo s_duplicates_path_info = {
+  .num_points = 6,
+  .points = (GPoint []) {{40, 0}, {40, 0}, {0, 40}, {0, 40}, {80, 40}, {80, 40}},
+};
+
+static const GPathInfo s_crossing_path_info = {
+  .num_points = 6,
+  .points = (GPoint []) {{0, 40}, {20, 20}, {60, 60}, {80, 40}, {60, 20}, {20, 60}},
+};
+
+static const GPathInfo s_infinite_path_info = {
+  .num_points = 16,
+  .points = (GPoint []) {
+    {-50, 0}, {-50, -60}, {10, -60}, {10, -20}, {-10, -20}, {-10, -40}, {-30, -40}, {-30, -20},
+    {50, -20}, {50, 40}, {-10, 40}, {-10, 0}, {10, 0}, {10, 20}, {30, 20}, {30, 0},
+  },
+};
+
+static const GPathInfo s_hand_path_info = {
+  .num_points = 5,
+  .points = (GPoint []) {{-4, 10}, {-2, -70}, {0, -74}, {2, -70}, {4, 10}},
+};
+
+static const GPathInfo s_sliver_path_info = {
+  .num_points = 3,
+  .points = (GPoint []) {{0, 0}, {1, 120}, {-1, 60}},
+};
+
+static const GPathInfo s_dial_path_info = {
+  .num_points = 24,
+  .points = (GPoint []) {
+    {0, -80}, {8, -60}, {40, -69}, {30, -52}, {69, -40}, {52, -30}, {80, 0}, {60, 8},
+    {69, 40}, {52, 30}, {40, 69}, {30, 52}, {0, 80}, {-8, 60}, {-40, 69}, {-30, 52},
+    {-69, 40}, {-52, 30}, {-80, 0}, {-60, -8}, {-69, -40}, {-52, -30}, {-40, -69}, {-30, -52},
+  },
+};
+
+static const GPathInfo *s_corpus[] = {
+  &s_house_path_info,
+  &s_bolt_path_info,
+  &s_duplicates_path_info,
+  &s_crossing_path_info,
+  &s_infinite_path_info,
+  &s_hand_path_info,
+  &s_sliver_path_info,
+  &s_dial_path_info,
+};
+
+static const GRect s_clip_boxes[] = {
+  {{0, 0}, {144, 168}},
+  {{20, 30}, {60, 50}},
+  {{-10, 100}, {200, 10}},
+  {{70, 0}, {1, 168}},
+};
+
+static uint32_t s_seed;
+
+static int prv_random(int range) {
+  s_seed = s_seed * 1103515245 + 12345;
+  return (int)((s_seed >> 16) % range);
+}
+
+static GContext s_ctx;
+
+static void prv_set_clip(GRect clip_box, GPoint drawing_origin) {
+  s_ctx.draw_state.clip_box = clip_box;
+  s_ctx.draw_state.drawing_box = (GRect) { drawing_origin, {144, 168} };
+}
+
+static void prv_assert_fill_matches(GPath *path, bool antialiased) {
+  s_expected.num_spans = 0;
+  s_actual.num_spans = 0;
+  prv_reference_fill(&s_ctx, path, antialiased, prv_record_cb, &s_expected);
+  if (antialiased) {
+    prv_fill_path_with_cb_aa(&s_ctx, path, prv_record_cb, &s_actual);
+  } else {
+    gpath_draw_filled_with_cb(&s_ctx, path, prv_record_cb, &s_actual);
+  }
+
+  cl_assert_equal_i(s_actual.num_spans, s_expected.num_spans);
+  for (int i = 0; i < s_expected.num_spans; i++) {
+    const Span *expected = &s_expected.spans[i];
+    const Span *actual = &s_actual.spans[i];
+    cl_assert_equal_i(actual->y, expected->y);
+    cl_assert_equal_i(actual->x_begin, expected->x_begin);
+    cl_assert_equal_i(actual->x_end, expected->x_end);
+    cl_assert_equal_i(actual->delta_begin, expected->delta_begin);
+    cl_assert_equal_i(actual->delta_end, expected->delta_end);
+  }
+}
+
+static void prv_assert_fill_matches_rotated(GPath *path) {
+  for (int32_t angle = 0; angle < TRIG_MAX_ANGLE; angle += TRIG_MAX_ANGLE / 96) {
+    gpath_rotate_to(path, angle);
+    prv_assert_fill_matches(path, false);
+    prv_assert_fill_matches(path, true);
+  }
+}
+
+// Setup
+////////////////////////////////////
+
+void test_graphics_gpath_fill__initialize(void) {
+  s_seed = 1;
+  memset(&s_ctx, 0, sizeof(s_ctx));
+  prv_set_clip(s_clip_boxes[0], GPointZero);
+  s_ctx.draw_state.stroke_color = GColorBlack;
+  s_ctx.draw_state.fill_color = GColorRed;
+}
+
+void test_graphics_gpath_fill__cleanup(void) {
+}
+
+// Tests
+////////////////////////////////////
+
+void test_graphics_gpath_fill__corpus_matches_reference(void) {
+  for (size_t i = 0; i < ARRAY_LENGTH(s_corpus); i++) {
+    GPath path;
+    gpath_init(&path, s_corpus[i]);
+    for (size_t c = 0; c < ARRAY_LENGTH(s_clip_boxes); c++) {
+      prv_set_clip(s_clip_boxes[c], (c % 2) ? GPoint(5, -7) : GPointZero);
+      gpath_move_to(&path, GPoint(72, 84));
+      prv_assert_fill_matches_rotated(&path);
+      gpath_move_to(&path, GPoint(-30, 160));
+      prv_assert_fill_matches_rotated(&path);
+    }
+  }
+}
+
+void test_graphics_gpath_fill__random_paths_match_reference(void) {
+  GPoint points[24];
+  for (int iteration = 0; iteration < 400; iteration++) {
+    const int num_points = 2 + prv_random(ARRAY_LENGTH(points) - 1);
+    // small coordinate ranges make lots of shared vertices, horizontal runs and crossings
+    const int range = (iteration % 2) ? 12 : 180;
+    for (int i = 0; i < num_points; i++) {
+      points[i] = GPoint(prv_random(range) - range / 4, prv_random(range) - range / 4);
+    }
+    GPath path;
+    gpath_init(&path, &(GPathInfo) { .num_points = num_points, .points = points });
+    prv_set_clip(s_clip_boxes[iteration % ARRAY_LENGTH(s_clip_boxes)], GPointZero);
+    gpath_move_to(&path, GPoint(prv_random(60), prv_random(60)));
+    gpath_rotate_to(&path, prv_random(TRIG_MAX_ANGLE));
+    prv_assert_fill_matches(&path, false);
+    prv_assert_fill_matches(&path, true);
+  }
+}
+
+void test_graphics_gpath_fill__degenerate_paths(void) {
+  GPath path;
+  gpath_init(&path, &(GPathInfo) { .num_points = 2, .points = (GPoint []) {{40, 0}, {40, 0}} });
+  prv_assert_fill_matches(&path, false);
+  prv_assert_fill_matches(&path, true);
+  cl_assert_equal_i(s_actual.num_spans, 0);
+
+  gpath_init(&path, &(GPathInfo) { .num_points = 3,
+                                   .points = (GPoint []) {{0, 10}, {50, 10}, {90, 10}} });
+  prv_assert_fill_matches(&path, false);
+  cl_assert_equal_i(s_actual.num_spans, 0);
+
+  gpath_init(&path, &(GPathInfo) { .num_points = 1, .points = (GPoint []) {{0, 10}} });
+  gpath_draw_filled_with_cb(&s_ctx, &path, prv_record_cb, &s_actual);
+  gpath_draw_filled_with_cb(&s_ctx, NULL, prv_record_cb, &s_actual);
+  cl_assert_equal_i(s_actual.num_spans, 0);
+}
+
+void test_graphics_gpath_fill__stroke_color_restored(void) {
+  GPath path;
+  gpath_init(&path, &s_house_path_info);
+  gpath_move_to(&path, GPoint(72, 84));
+  prv_fill_path_with_cb_aa(&s_ctx, &path, prv_record_cb, &s_actual);
+  cl_assert(s_actual.num_spans > 0);
+  cl_assert_equal_i(s_ctx.draw_state.stroke_color.argb, GColorBlackARGB8);
+}
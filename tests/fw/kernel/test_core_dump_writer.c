@@ -0,0 +1,312 @@
+/* SPDX-FileCopyrightText: 2026 Core Devices LLC */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include "kernel/core_dump_writer.h"
+#include "kernel/core_dump_private.h"
+#include "kernel/core_dump_reader.h"
+
+#include "flash_region/flash_region.h"
+#include <pbl/drivers/flash.h>
+#include "pbl/util/math.h"
+#include "pbl/util/size.h"
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clar.h"
+
+// Fakes
+///////////////////////////////////////////////////////////////////////////////
+#include "fake_spi_flash.h"
+
+void watchdog_feed(void) {
+}
+
+static jmp_buf s_assert_jmp;
+
+void coredump_assert(int line) {
+  longjmp(s_assert_jmp, 1);
+}
+
+uint32_t cd_flash_write_bytes(const void *buffer_ptr, uint32_t start_addr, uint32_t buffer_size) {
+  flash_write_bytes(buffer_ptr, start_addr, buffer_size);
+  return buffer_size;
+}
+
+// Helpers
+///////////////////////////////////////////////////////////////////////////////
+
+#define FLASH_BASE (FLASH_REGION_CD_BEGIN)
+#define FLASH_SIZE (256 * 1024)
+//! Where the first chunk goes after the region and image headers, which is not word aligned
+#define FIRST_CHUNK_ADDR (FLASH_BASE + 12 + sizeof(CoreDumpImageHeader) + 1)
+
+#define RAM_WORDS (16 * 1024)
+static uint32_t s_ram[RAM_WORDS];
+static uint32_t s_registers[8];
+static uint8_t s_bytes[13];
+static uint8_t s_expanded[RAM_WORDS * sizeof(uint32_t)];
+
+//! Fills s_ram with what RAM tends to hold: mostly zeroes, stacks painted with a fill pattern,
+//! and stretches of data that don't compress
+static void prv_fill_ram(void) {
+  srand(42);
+  memset(s_ram, 0, sizeof(s_ram));
+  for (int i = 100; i < 2100; i++) {
+    s_ram[i] = rand();
+  }
+  for (int i = 4000; i < 6000; i++) {
+    s_ram[i] = 0xa5a5a5a5;
+  }
+  // Short runs which should stay in literal records
+  for (int i = 6000; i < 6200; i++) {
+    s_ram[i] = (i / 2) * 0x01010101;
+  }
+  for (int i = 9000; i < 9500; i++) {
+    s_ram[i] = rand();
+  }
+  s_ram[RAM_WORDS - 1] = 0xdeadbeef;
+}
+
+static void prv_write_dump(void) {
+  core_dump_writer_init(FIRST_CHUNK_ADDR, FLASH_BASE + FLASH_SIZE);
+  core_dump_writer_write_memory(s_ram, sizeof(s_ram), false);
+  core_dump_writer_write_memory(s_registers, sizeof(s_registers), true);
+  core_dump_writer_write_memory(s_bytes, sizeof(s_bytes), false);
+  CoreDumpChunkHeader chunk_hdr = {
+    .key = CORE_DUMP_CHUNK_KEY_TERMINATOR,
+  };
+  core_dump_writer_write(&chunk_hdr, sizeof(chunk_hdr));
+  core_dump_writer_flush();
+}
+
+//! Expands the records of a CORE_DUMP_CHUNK_KEY_MEMORY_RLE chunk
+//! @return the number of bytes expanded
+static uint32_t prv_expand_rle(uint32_t addr, uint32_t size, uint8_t *out) {
+  const uint32_t end = addr + size;
+  uint32_t out_length = 0;
+  while (addr < end) {
+    uint32_t record_hdr;
+    flash_read_bytes((uint8_t *)&record_hdr, addr, sizeof(record_hdr));
+    addr += sizeof(record_hdr);
+    const uint32_t count = record_hdr & CORE_DUMP_RLE_COUNT_MASK;
+    cl_assert(count > 0);
+    if (record_hdr & CORE_DUMP_RLE_RUN) {
+      uint32_t value;
+      flash_read_bytes((uint8_t *)&value, addr, sizeof(value));
+      addr += sizeof(value);
+      for (uint32_t i = 0; i < count; i++) {
+        memcpy(&out[out_length], &value, sizeof(value));
+        out_length += sizeof(value);
+      }
+    } else {
+      flash_read_bytes(&out[out_length], addr, count * sizeof(uint32_t));
+      addr += count * sizeof(uint32_t);
+      out_length += count * sizeof(uint32_t);
+    }
+  }
+  cl_assert_equal_i(addr, end);
+  return out_length;
+}
+
+typedef struct {
+  uint32_t key;
+  uint32_t size;
+  uint32_t start;
+  uint32_t data_addr;
+} ParsedChunk;
+
+static ParsedChunk prv_read_chunk(uint32_t *addr) {
+  CoreDumpChunkHeader chunk_hdr;
+  flash_read_bytes((uint8_t *)&chunk_hdr, *addr, sizeof(chunk_hdr));
+  *addr += sizeof(chunk_hdr);
+  ParsedChunk chunk = {
+    .key = chunk_hdr.key,
+    .size = chunk_hdr.size,
+  };
+  if (chunk.key == CORE_DUMP_CHUNK_KEY_TERMINATOR) {
+    return chunk;
+  }
+  flash_read_bytes((uint8_t *)&chunk.start, *addr, sizeof(chunk.start));
+  chunk.data_addr = *addr + sizeof(CoreDumpMemoryHeader);
+  *addr += chunk.size;
+  return chunk;
+}
+
+static void prv_assert_rle_chunk(const ParsedChunk *chunk, const void *memory, uint32_t length) {
+  cl_assert_equal_i(chunk->key, CORE_DUMP_CHUNK_KEY_MEMORY_RLE);
+  cl_assert_equal_i(chunk->start, (uint32_t)(uintptr_t)memory);
+  memset(s_expanded, 0, sizeof(s_expanded));
+  const uint32_t expanded_length = prv_expand_rle(
+      chunk->data_addr, chunk->size - sizeof(CoreDumpMemoryHeader), s_expanded);
+  cl_assert_equal_i(expanded_length, length);
+  cl_assert(memcmp(s_expanded, memory, length) == 0);
+}
+
+static void prv_assert_raw_chunk(const ParsedChunk *chunk, const void *memory, uint32_t length) {
+  cl_assert_equal_i(chunk->key, CORE_DUMP_CHUNK_KEY_MEMORY);
+  cl_assert_equal_i(chunk->size, sizeof(CoreDumpMemoryHeader) + length);
+  cl_assert_equal_i(chunk->start, (uint32_t)(uintptr_t)memory);
+  flash_read_bytes(s_expanded, chunk->data_addr, length);
+  cl_assert(memcmp(s_expanded, memory, length) == 0);
+}
+
+// Tests
+///////////////////////////////////////////////////////////////////////////////
+
+void test_core_dump_writer__initialize(void) {
+  fake_spi_flash_init(FLASH_BASE, FLASH_SIZE);
+  prv_fill_ram();
+  for (unsigned int i = 0; i < ARRAY_LENGTH(s_registers); i++) {
+    s_registers[i] = (i < 4) ? 0x1 : (0x100 << i);
+  }
+  for (unsigned int i = 0; i < sizeof(s_bytes); i++) {
+    s_bytes[i] = i + 1;
+  }
+}
+
+void test_core_dump_writer__cleanup(void) {
+  fake_spi_flash_cleanup();
+}
+
+void test_core_dump_writer__round_trip(void) {
+  cl_assert(setjmp(s_assert_jmp) == 0);
+  prv_write_dump();
+
+  uint32_t addr = FIRST_CHUNK_ADDR;
+  ParsedChunk chunk = prv_read_chunk(&addr);
+  prv_assert_rle_chunk(&chunk, s_ram, sizeof(s_ram));
+
+  // Registers are only read once, so they are stored as is
+  chunk = prv_read_chunk(&addr);
+  prv_assert_raw_chunk(&chunk, s_registers, sizeof(s_registers));
+
+  // Not made of whole words, so it is stored as is
+  chunk = prv_read_chunk(&addr);
+  prv_assert_raw_chunk(&chunk, s_bytes, sizeof(s_bytes));
+
+  chunk = prv_read_chunk(&addr);
+  cl_assert_equal_i(chunk.key, CORE_DUMP_CHUNK_KEY_TERMINATOR);
+  cl_assert_equal_i(chunk.size, 0);
+  cl_assert_equal_i(addr, core_dump_writer_get_addr());
+
+  // Nothing was programmed past the end of the dump
+  // (the fake takes addresses relative to the start of its storage here)
+  fake_flash_assert_region_untouched(addr - FLASH_BASE, FLASH_BASE + FLASH_SIZE - addr);
+}
+
+void test_core_dump_writer__size(void) {
+  cl_assert(setjmp(s_assert_jmp) == 0);
+  core_dump_writer_init(FIRST_CHUNK_ADDR, FLASH_BASE + FLASH_SIZE);
+  core_dump_writer_write_memory(s_ram, sizeof(s_ram), false);
+  const uint32_t rle_size = core_dump_writer_get_addr() - FIRST_CHUNK_ADDR;
+  const uint32_t raw_size =
+      sizeof(CoreDumpChunkHeader) + sizeof(CoreDumpMemoryHeader) + sizeof(s_ram);
+  // 2701 words of s_ram don't compress and take an extra word every 32 words. Each of the five
+  // runs in between takes two words.
+  cl_assert(rle_size < (2701 + 2701 / 32 + 5 * 2 + 64) * sizeof(uint32_t));
+  cl_assert(rle_size < raw_size / 5);
+}
+
+void test_core_dump_writer__incompressible_stored_as_is(void) {
+  cl_assert(setjmp(s_assert_jmp) == 0);
+  for (int i = 0; i < RAM_WORDS; i++) {
+    s_ram[i] = rand();
+  }
+  // Only the length of the raw chunk is left for it. Literal records would need more than that.
+  const uint32_t raw_size =
+      sizeof(CoreDumpChunkHeader) + sizeof(CoreDumpMemoryHeader) + sizeof(s_ram);
+  core_dump_writer_init(FIRST_CHUNK_ADDR, FIRST_CHUNK_ADDR + raw_size);
+  core_dump_writer_write_memory(s_ram, sizeof(s_ram), false);
+  core_dump_writer_flush();
+  cl_assert_equal_i(core_dump_writer_get_addr() - FIRST_CHUNK_ADDR, raw_size);
+
+  uint32_t addr = FIRST_CHUNK_ADDR;
+  ParsedChunk chunk = prv_read_chunk(&addr);
+  prv_assert_raw_chunk(&chunk, s_ram, sizeof(s_ram));
+}
+
+void test_core_dump_writer__page_writes(void) {
+  cl_assert(setjmp(s_assert_jmp) == 0);
+  const uint32_t writes_before = fake_flash_write_count();
+  prv_write_dump();
+  const uint32_t size = core_dump_writer_get_addr() - FIRST_CHUNK_ADDR;
+
+  // A write per page touched, plus one to fill in the size of the big chunk
+  const uint32_t first_page = FIRST_CHUNK_ADDR / 256;
+  const uint32_t last_page = (FIRST_CHUNK_ADDR + size - 1) / 256;
+  cl_assert_equal_i(fake_flash_write_count() - writes_before, last_page - first_page + 1 + 1);
+}
+
+void test_core_dump_writer__full(void) {
+  const uint32_t flash_end = FIRST_CHUNK_ADDR + 64;
+  if (setjmp(s_assert_jmp) == 0) {
+    core_dump_writer_init(FIRST_CHUNK_ADDR, flash_end);
+    core_dump_writer_write_memory(s_ram, sizeof(s_ram), false);
+    cl_fail("Wrote past the end of the core dump slot");
+  }
+  cl_assert(core_dump_writer_get_addr() <= flash_end);
+}
+
+void test_core_dump_writer__read_back(void) {
+  cl_assert(setjmp(s_assert_jmp) == 0);
+  prv_write_dump();
+
+  uint32_t addr = FIRST_CHUNK_ADDR;
+  CoreDumpMemoryReader reader;
+  cl_assert(core_dump_reader_init(&reader, addr));
+  cl_assert(reader.rle);
+  cl_assert_equal_i(reader.start, (uint32_t)(uintptr_t)s_ram);
+  cl_assert_equal_i(reader.length, sizeof(s_ram));
+
+  // All of it, then slices of all sizes at unaligned offsets, across runs and literal records
+  uint8_t *ram_bytes = (uint8_t *)s_ram;
+  memset(s_expanded, 0, sizeof(s_expanded));
+  cl_assert(core_dump_reader_read(&reader, reader.start, s_expanded, sizeof(s_ram)));
+  cl_assert(memcmp(s_expanded, s_ram, sizeof(s_ram)) == 0);
+  for (uint32_t offset = 0; offset < sizeof(s_ram); offset += 997) {
+    const uint32_t length = MIN(offset % 3000 + 1, sizeof(s_ram) - offset);
+    memset(s_expanded, 0, length);
+    cl_assert(core_dump_reader_read(&reader, reader.start + offset, s_expanded, length));
+    cl_assert(memcmp(s_expanded, &ram_bytes[offset], length) == 0);
+  }
+  uint32_t word;
+  cl_assert(core_dump_reader_read(&reader, reader.start + sizeof(s_ram) - sizeof(word), &word,
+                                  sizeof(word)));
+  cl_assert_equal_i(word, 0xdeadbeef);
+
+  // Nothing outside of the region
+  cl_assert(!core_dump_reader_read(&reader, reader.start - 1, &word, sizeof(word)));
+  cl_assert(!core_dump_reader_read(&reader, reader.start + sizeof(s_ram) - 3, &word,
+                                   sizeof(word)));
+
+  // A chunk stored as is reads back the same way
+  prv_read_chunk(&addr);
+  cl_assert(core_dump_reader_init(&reader, addr));
+  cl_assert(!reader.rle);
+  cl_assert_equal_i(reader.length, sizeof(s_registers));
+  cl_assert(core_dump_reader_read(&reader, (uint32_t)(uintptr_t)&s_registers[5], &word,
+                                  sizeof(word)));
+  cl_assert_equal_i(word, s_registers[5]);
+
+  // The terminator doesn't hold memory
+  prv_read_chunk(&addr);
+  prv_read_chunk(&addr);
+  cl_assert(!core_dump_reader_init(&reader, addr));
+}
+
+void test_core_dump_writer__read_back_corrupt(void) {
+  cl_assert(setjmp(s_assert_jmp) == 0);
+  core_dump_writer_init(FIRST_CHUNK_ADDR, FLASH_BASE + FLASH_SIZE);
+  core_dump_writer_write_memory(s_ram, sizeof(s_ram), false);
+  core_dump_writer_flush();
+
+  // A record of no words
+  uint32_t addr = FIRST_CHUNK_ADDR;
+  const ParsedChunk chunk = prv_read_chunk(&addr);
+  const uint32_t bad_record_hdr = 0;
+  flash_write_bytes((const uint8_t *)&bad_record_hdr, chunk.data_addr, sizeof(bad_record_hdr));
+  CoreDumpMemoryReader reader;
+  cl_assert(!core_dump_reader_init(&reader, FIRST_CHUNK_ADDR));
+}
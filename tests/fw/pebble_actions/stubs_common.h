@@ -60,7 +60,8 @@ PebblePhoneCaller* phone_call_util_create_caller(const char *number, const char
 void launcher_task_add_callback(void (*callback)(void *data), void *data) {
 }
 
-void system_task_add_callback(void (*callback)(void *data), void *data) {
+bool system_task_add_callback(void (*callback)(void *data), void *data) {
+  return true;
 }
 
 void ancs_perform_action(uint32_t notification_uid, uint8_t action_id) {
@@ -29,6 +29,8 @@
 // Fakes
 #include "fake_rtc.h"
 
+#include "kraepelin_reference/fourier.h"
+
 HRMSessionRef s_hrm_next_session_ref = 1;
 HRMSessionRef hrm_manager_subscribe_with_callback(AppInstallId app_id, uint32_t update_interval_s,
                                                   uint16_t expire_s, HRMFeature features,
@@ -2208,3 +2210,49 @@ void test_kraepelin_algorithm__sleep_stats(void) {
 }
 
 
+// ---------------------------------------------------------------------------------------
+// The table driven FFT must produce exactly what the reference implementation, which calls
+// sin_lookup() and cos_lookup() for every butterfly, does on recorded accel epochs.
+void test_kraepelin_algorithm__fft_matches_reference(void) {
+  bool success = prv_sample_discovery_init(&s_accel_sample_discovery_state.common,
+                                           SampleFileType_AccelSamples, "activity/step_samples");
+  cl_assert(success);
+
+  enum {
+    k_fft_width_log_2 = 7,
+    k_fft_width = 1 << k_fft_width_log_2,
+    k_epoch_samples = 5 * KALG_SAMPLE_HZ,
+  };
+
+  int num_epochs = 0;
+  StepFileTestEntry entry;
+  while (prv_accel_sample_discovery_next(&entry)) {
+    for (int start = 0; start + k_epoch_samples <= entry.num_samples; start += k_epoch_samples) {
+      for (int axis = 0; axis < 3; axis++) {
+        int16_t d[k_fft_width];
+        int32_t sum = 0;
+        for (int i = 0; i < k_epoch_samples; i++) {
+          const AccelRawData *sample = &entry.samples[start + i];
+          const int16_t values[3] = { sample->x, sample->y, sample->z };
+          d[i] = values[axis] / 8;
+          sum += d[i];
+        }
+        // Prepared like the algorithm does: zero mean and zero padded
+        for (int i = 0; i < k_epoch_samples; i++) {
+          d[i] -= sum / k_epoch_samples;
+        }
+        for (int i = k_epoch_samples; i < k_fft_width; i++) {
+          d[i] = 0;
+        }
+
+        int16_t ref[k_fft_width];
+        memcpy(ref, d, sizeof(ref));
+        fft_2radix_real(ref, k_fft_width_log_2);
+        kalg_fft_2radix_real(d, k_fft_width, k_fft_width_log_2);
+        cl_assert_equal_m(d, ref, sizeof(ref));
+      }
+      num_epochs++;
+    }
+  }
+  cl_assert(num_epochs > 0);
+}
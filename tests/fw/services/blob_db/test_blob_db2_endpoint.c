@@ -98,7 +98,7 @@ extern BlobDBToken prv_new_token(void) {
   return token;
 }
 
-void blob_db_sync_next(BlobDBSyncSession *session) {
+void blob_db_sync_next(BlobDBSyncSession *session, BlobDBToken token) {
   did_sync_next = true;
 }
 
@@ -112,7 +112,7 @@ status_t blob_db_sync_db(BlobDBId db_id) {
 }
 
 // A fake dirty item is needed because the error path of the write/writeback response handler
-// logs the rejected item by dereferencing sync_session->dirty_list->key. Allocate a real
+// logs the rejected item by dereferencing the in-flight item's key. Allocate a real
 // BlobDBDirtyItem (which has a flexible key[] member) so that path reads valid memory.
 static const char s_fake_dirty_key[] = "fakekey";
 
@@ -129,11 +129,18 @@ BlobDBSyncSession *blob_db_sync_get_session_for_token(BlobDBToken token) {
 
   s_fake_sync_session = (BlobDBSyncSession){
     .dirty_list = dirty_item,
+    .in_flight = { { .item = dirty_item, .token = token } },
+    .num_in_flight = 1,
   };
   // Don't return NULL
   return &s_fake_sync_session;
 }
 
+BlobDBDirtyItem *blob_db_sync_get_item_for_token(BlobDBSyncSession *session, BlobDBToken token) {
+  cl_assert_equal_p(session, &s_fake_sync_session);
+  return session->in_flight[0].item;
+}
+
 extern void blob_db2_set_accepting_messages(bool ehh);
 void test_blob_db2_endpoint__initialize(void) {
   blob_db2_set_accepting_messages(true);
@@ -29,15 +29,30 @@
 
 static int s_num_writebacks;
 static int s_num_until_timeout;
+static int s_num_pending_responses;
+static BlobDBToken s_next_token;
+
+// When set, writebacks are recorded here instead of being answered, so a test can ack them
+// in whatever order it likes
+static bool s_hold_responses;
+static BlobDBToken s_held_tokens[16];
+static int s_num_held;
 
 void blob_db_endpoint_send_sync_done(BlobDBId db_id) {
   return;
 }
 
+static void prv_ack(BlobDBToken token) {
+  BlobDBSyncSession *session = blob_db_sync_get_session_for_token(token);
+  if (session) {
+    s_num_writebacks++;
+    blob_db_sync_next(session, token);
+  }
+}
+
 static void prv_handle_response_from_phone(void *data) {
-  s_num_writebacks++;
-  BlobDBSyncSession *session = data;
-  blob_db_sync_next(session);
+  s_num_pending_responses--;
+  prv_ack((BlobDBToken)(uintptr_t)data);
 }
 
 static void prv_generate_responses_from_phone(void) {
@@ -56,13 +71,19 @@ BlobDBToken blob_db_endpoint_send_writeback(BlobDBId db_id,
                                             int val_len) {
   BlobDBSyncSession *session = blob_db_sync_get_session_for_id(db_id);
   cl_assert(session != NULL);
-  if (s_num_until_timeout != 0 && s_num_writebacks >= s_num_until_timeout) {
+  const BlobDBToken token = s_next_token++;
+  if (s_hold_responses) {
+    cl_assert(s_num_held < ARRAY_LENGTH(s_held_tokens));
+    s_held_tokens[s_num_held++] = token;
+  } else if (s_num_until_timeout != 0 &&
+             s_num_writebacks + s_num_pending_responses >= s_num_until_timeout) {
     // Don't respond - simulates timeout (message lost/no response from phone)
   } else {
-    system_task_add_callback(prv_handle_response_from_phone, session);
+    s_num_pending_responses++;
+    system_task_add_callback(prv_handle_response_from_phone, (void *)(uintptr_t)token);
   }
 
-  return 12345;
+  return token;
 }
 
 BlobDBToken blob_db_endpoint_send_write(BlobDBId db_id,
@@ -82,6 +103,10 @@ void test_blob_db_sync__initialize(void) {
   blob_db_init_dbs();
   s_num_until_timeout = 0;
   s_num_writebacks = 0;
+  s_num_pending_responses = 0;
+  s_next_token = 1;
+  s_hold_responses = false;
+  s_num_held = 0;
 }
 
 void test_blob_db_sync__cleanup(void) {
@@ -392,14 +417,15 @@ void test_blob_db_sync__find_session(void) {
   cl_assert(reminders_session);
   cl_assert_equal_i(reminders_session->db_id, BlobDBIdReminders);
 
-  test_session->current_token = 1;
-  pins_session->current_token = 2;
-  reminders_session->current_token = 3;
-
-  // check we can conjure them by token
-  cl_assert(test_session == blob_db_sync_get_session_for_token(1));
-  cl_assert(pins_session == blob_db_sync_get_session_for_token(2));
-  cl_assert(reminders_session == blob_db_sync_get_session_for_token(3));
+  // check we can conjure them by any of their in-flight tokens
+  BlobDBSyncSession *sessions[] = { test_session, pins_session, reminders_session };
+  for (int i = 0; i < ARRAY_LENGTH(sessions); ++i) {
+    cl_assert_equal_i(sessions[i]->num_in_flight, CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW);
+    for (int j = 0; j < sessions[i]->num_in_flight; ++j) {
+      cl_assert(sessions[i] ==
+                blob_db_sync_get_session_for_token(sessions[i]->in_flight[j].token));
+    }
+  }
 
   // Cancel the sync sessions so they get cleaned up
   blob_db_sync_cancel(test_session);
@@ -411,3 +437,134 @@ void test_blob_db_sync__find_session(void) {
   blob_db_init_dbs();
 }
 
+
+// Windowed sync
+////////////////////////
+
+static void prv_insert_keys(int num_keys) {
+  for (int i = 0; i < num_keys; ++i) {
+    char key[8];
+    char value[8];
+    snprintf(key, sizeof(key), "key%d", i);
+    snprintf(value, sizeof(value), "val%d", i);
+    blob_db_insert(BlobDBIdTest, (uint8_t *)key, strlen(key), (uint8_t *)value, strlen(value));
+  }
+}
+
+static bool prv_all_synced(void) {
+  BlobDBDirtyItem *dirty_list = blob_db_get_dirty_list(BlobDBIdTest);
+  blob_db_util_free_dirty_list(dirty_list);
+  return (dirty_list == NULL);
+}
+
+void test_blob_db_sync__window_limits_in_flight(void) {
+  const int num_keys = CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW + 2;
+  prv_insert_keys(num_keys);
+  s_hold_responses = true;
+
+  cl_assert(blob_db_sync_db(BlobDBIdTest) == S_SUCCESS);
+  BlobDBSyncSession *session = blob_db_sync_get_session_for_id(BlobDBIdTest);
+  cl_assert_equal_i(session->num_in_flight, CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW);
+  cl_assert_equal_i(s_num_held, CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW);
+
+  // Every ack opens a slot that is refilled straight away
+  for (int i = 0; i < num_keys; ++i) {
+    prv_ack(s_held_tokens[i]);
+  }
+  cl_assert_equal_i(s_num_held, num_keys);
+  cl_assert_equal_i(s_num_writebacks, num_keys);
+  cl_assert(blob_db_sync_get_session_for_id(BlobDBIdTest) == NULL);
+  cl_assert(prv_all_synced());
+}
+
+void test_blob_db_sync__out_of_order_acks(void) {
+  const int num_keys = CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW;
+  prv_insert_keys(num_keys);
+  s_hold_responses = true;
+
+  cl_assert(blob_db_sync_db(BlobDBIdTest) == S_SUCCESS);
+  BlobDBSyncSession *session = blob_db_sync_get_session_for_id(BlobDBIdTest);
+  cl_assert_equal_i(s_num_held, num_keys);
+
+  // Ack the newest writeback first; only that item leaves the window
+  const BlobDBToken last = s_held_tokens[num_keys - 1];
+  BlobDBDirtyItem *first_item = blob_db_sync_get_item_for_token(session, s_held_tokens[0]);
+  cl_assert(first_item != NULL);
+  prv_ack(last);
+  cl_assert(blob_db_sync_get_item_for_token(session, last) == NULL);
+  cl_assert(blob_db_sync_get_item_for_token(session, s_held_tokens[0]) == first_item);
+  cl_assert_equal_i(session->num_in_flight, num_keys - 1);
+
+  // A repeated ack for a token that is no longer in flight is ignored
+  blob_db_sync_next(session, last);
+  cl_assert_equal_i(session->num_in_flight, num_keys - 1);
+
+  // Ack the rest newest to oldest
+  for (int i = num_keys - 2; i >= 0; --i) {
+    prv_ack(s_held_tokens[i]);
+  }
+  cl_assert_equal_i(s_num_writebacks, num_keys);
+  cl_assert_equal_i(s_num_held, num_keys);
+  cl_assert(blob_db_sync_get_session_for_id(BlobDBIdTest) == NULL);
+  cl_assert(prv_all_synced());
+}
+
+void test_blob_db_sync__timeout_resends_in_flight(void) {
+  const int num_keys = 3;
+  prv_insert_keys(num_keys);
+  s_hold_responses = true;
+
+  cl_assert(blob_db_sync_db(BlobDBIdTest) == S_SUCCESS);
+  BlobDBSyncSession *session = blob_db_sync_get_session_for_id(BlobDBIdTest);
+  cl_assert_equal_i(s_num_held, num_keys);
+
+  // The middle writeback gets acked, the other two are lost
+  prv_ack(s_held_tokens[1]);
+  BlobDBDirtyItem *lost_items[] = {
+    blob_db_sync_get_item_for_token(session, s_held_tokens[0]),
+    blob_db_sync_get_item_for_token(session, s_held_tokens[2]),
+  };
+
+  fake_regular_timer_trigger(&session->timeout_timer);
+  fake_system_task_callbacks_invoke_pending();
+
+  // Only the unacked items are resent, in their original order, under new tokens
+  cl_assert_equal_i(s_num_held, num_keys + 2);
+  cl_assert_equal_i(session->num_in_flight, 2);
+  cl_assert(blob_db_sync_get_item_for_token(session, s_held_tokens[3]) == lost_items[0]);
+  cl_assert(blob_db_sync_get_item_for_token(session, s_held_tokens[4]) == lost_items[1]);
+  cl_assert(regular_timer_is_scheduled(&session->abandon_timer));
+
+  // Late responses for the original tokens no longer match the session
+  cl_assert(blob_db_sync_get_session_for_token(s_held_tokens[0]) == NULL);
+  cl_assert(blob_db_sync_get_session_for_token(s_held_tokens[2]) == NULL);
+
+  prv_ack(s_held_tokens[4]);
+  cl_assert(!regular_timer_is_scheduled(&session->abandon_timer));
+  prv_ack(s_held_tokens[3]);
+  cl_assert_equal_i(s_num_writebacks, num_keys);
+  cl_assert(blob_db_sync_get_session_for_id(BlobDBIdTest) == NULL);
+  cl_assert(prv_all_synced());
+}
+
+void test_blob_db_sync__removed_item_skipped_in_window(void) {
+  const int num_keys = CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW + 1;
+  prv_insert_keys(num_keys);
+  s_hold_responses = true;
+
+  cl_assert(blob_db_sync_db(BlobDBIdTest) == S_SUCCESS);
+  cl_assert_equal_i(s_num_held, CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW);
+
+  // The one item that didn't fit in the window is deleted before a slot opens up
+  BlobDBSyncSession *session = blob_db_sync_get_session_for_id(BlobDBIdTest);
+  BlobDBDirtyItem *unsent = session->next_item;
+  cl_assert(unsent != NULL);
+  cl_assert_equal_i(S_SUCCESS, blob_db_delete(BlobDBIdTest, unsent->key, unsent->key_len));
+
+  for (int i = 0; i < CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW; ++i) {
+    prv_ack(s_held_tokens[i]);
+  }
+  cl_assert_equal_i(s_num_held, CONFIG_SERVICE_BLOB_DB_SYNC_WINDOW);
+  cl_assert(blob_db_sync_get_session_for_id(BlobDBIdTest) == NULL);
+  cl_assert(prv_all_synced());
+}
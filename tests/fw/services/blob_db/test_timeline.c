@@ -11,6 +11,9 @@
 
 #include "pbl/util/list.h"
 #include "pbl/util/size.h"
+#include "util/crc8.h"
+
+#include <stdlib.h>
 
 // Fixture
 ////////////////////////////////////////////////////////////////
@@ -18,8 +21,10 @@
 // Fakes
 ////////////////////////////////////////////////////////////////
 #include "fake_pbl_malloc.h"
+#include "fake_pebble_tasks.h"
 #include "fake_rtc.h"
 #include "fake_settings_file.h"
+#include "fake_system_task.h"
 
 static TimezoneInfo tz = {
   .tm_gmtoff = -8 * 60 * 60, // PST
@@ -44,7 +49,6 @@ static TimezoneInfo tz = {
 #include "stubs_modal_manager.h"
 #include "stubs_mutex.h"
 #include "stubs_passert.h"
-#include "stubs_pebble_tasks.h"
 #include "stubs_prompt.h"
 #include "stubs_rand_ptr.h"
 #include "stubs_regular_timer.h"
@@ -408,6 +412,10 @@ void test_timeline__initialize(void) {
 }
 
 void test_timeline__cleanup(void) {
+  fake_system_task_callbacks_invoke_pending();
+  timeline_pin_cache_invalidate(NULL);
+  // Tests leave their lists behind, like an app that exits without deiniting them
+  timeline_process_cleanup();
   fake_settings_file_reset();
   fake_pbl_malloc_clear_tracking();
 }
@@ -656,11 +664,11 @@ void test_timeline__gc_past(void) {
                                        1421395200),
                     S_NO_MORE_ITEMS);
 
+  timeline_iter_deinit(&iterator, &state, &head);
   fake_pbl_malloc_clear_tracking();
   // Thursday Jan 16 14:00:00 PST 2015
   // all items garbage collected
   rtc_set_time(1421445600);
-  head = NULL;
   timeline_init(&head);
   cl_assert_equal_i(timeline_iter_init(&iterator, &state, &head, TimelineIterDirectionPast,
                                        1421445600),
@@ -967,16 +975,17 @@ void test_timeline__two_iterators(void) {
   timeline_init(&head);
   cl_assert_equal_i(timeline_iter_init(&iterator1, &state1, &head, TimelineIterDirectionFuture,
     1421178000), 0);
-  // should have one alloc for each node in list, + 1 for the current timelineitem
+  // should have one alloc for each node in list, + 1 for the index of the list, + 1 for the
+  // current timelineitem
   cl_assert_equal_i(fake_pbl_malloc_num_net_allocs(),
-                    init_net_allocs + ARRAY_LENGTH(s_items) + 1);
+                    init_net_allocs + ARRAY_LENGTH(s_items) + 2);
 
   // second iterator should not alloc any more memory
   cl_assert_equal_i(timeline_iter_init(&iterator2, &state2, &head, TimelineIterDirectionFuture,
     1421178000), 0);
-  // should have one alloc for each node in list, + 1 for the current timelineitem
+  // should have one more alloc for its current timelineitem
   cl_assert_equal_i(fake_pbl_malloc_num_net_allocs(),
-                    init_net_allocs + ARRAY_LENGTH(s_items) + 2);
+                    init_net_allocs + ARRAY_LENGTH(s_items) + 3);
 
   // deinit should free all the memory
   timeline_iter_deinit(&iterator1, &state1, &head);
@@ -1485,3 +1494,106 @@ void test_timeline__0_duration(void) {
   cl_assert(timeline_iter_remove_node_with_id(&head, &all_day_item.header.id));
   cl_assert(!timeline_iter_remove_node_with_id(&head, &all_day_item.header.id));
 }
+
+// The fake settings file stores records by the CRC8 of their key, so keys must not collide
+static void prv_make_unique_id(Uuid *id, bool used_crcs[]) {
+  do {
+    uuid_generate(id);
+  } while (used_crcs[crc8_calculate_bytes((uint8_t *)id, sizeof(*id), false)] ||
+           (crc8_calculate_bytes((uint8_t *)id, sizeof(*id), false) == UINT8_MAX));
+  used_crcs[crc8_calculate_bytes((uint8_t *)id, sizeof(*id), false)] = true;
+}
+
+// Enough multi-day pins to get more than 500 nodes out of the fake settings file
+#define NUM_MANY_PINS (200)
+#define MANY_PINS_START (1421107200) // Tue Jan 13 midnight 2015 UTC
+
+static void prv_add_many_pins(Uuid ids_out[]) {
+  bool used_crcs[UINT8_MAX + 1] = {};
+  for (unsigned int i = 0; i < ARRAY_LENGTH(s_items); ++i) {
+    used_crcs[crc8_calculate_bytes((uint8_t *)&s_items[i].header.id, sizeof(Uuid), false)] = true;
+  }
+
+  srand(0);
+  for (int i = 0; i < NUM_MANY_PINS; i++) {
+    const bool all_day = (rand() % 4) == 0;
+    TimelineItem item = {
+      .header = {
+        .type = TimelineItemTypePin,
+        .layout = LayoutIdTest,
+        .all_day = all_day,
+      },
+    };
+    prv_make_unique_id(&item.header.id, used_crcs);
+    if (all_day) {
+      item.header.timestamp = MANY_PINS_START + (rand() % 5) * SECONDS_PER_DAY;
+      item.header.duration = (1 + rand() % 3) * MINUTES_PER_DAY;
+    } else {
+      item.header.timestamp = MANY_PINS_START + (rand() % (5 * 24 * 4)) * 15 * SECONDS_PER_MINUTE;
+      item.header.duration = (rand() % (4 * 24 * 4)) * 15;
+    }
+    cl_assert(timeline_add(&item));
+    ids_out[i] = item.header.id;
+  }
+}
+
+void test_timeline__many_pins_sorted(void) {
+  Uuid ids[NUM_MANY_PINS];
+  prv_add_many_pins(ids);
+
+  TimelineNode *head = NULL;
+  cl_assert_equal_i(timeline_init(&head), S_SUCCESS);
+  cl_assert(list_count(&head->node) > 500);
+
+  // All day events first, then by time and by duration, with consecutive indices
+  TimelineNode *node = head;
+  cl_assert_equal_i(node->index, 0);
+  TimelineNode *next;
+  while ((next = (TimelineNode *)list_get_next(&node->node))) {
+    cl_assert_equal_i(next->index, node->index + 1);
+    cl_assert(node->timestamp <= next->timestamp);
+    if (node->timestamp == next->timestamp) {
+      cl_assert(node->all_day || !next->all_day);
+      if (!node->all_day && !next->all_day) {
+        cl_assert(node->duration <= next->duration);
+      }
+    }
+    node = next;
+  }
+}
+
+// The first pin an iterator starts on is looked up in the index, whereas moving the iterator
+// walks the list. Check that there's no shown pin before the first one by walking back from it.
+static void prv_check_first_pins(TimelineNode **head) {
+  for (time_t now = MANY_PINS_START - SECONDS_PER_DAY; now < MANY_PINS_START + 8 * SECONDS_PER_DAY;
+       now += 7 * SECONDS_PER_HOUR + 13 * SECONDS_PER_MINUTE) {
+    for (int i = 0; i < 2; i++) {
+      const TimelineIterDirection direction = i ? TimelineIterDirectionPast :
+                                                  TimelineIterDirectionFuture;
+      Iterator iterator = {0};
+      TimelineIterState state = {0};
+      const status_t rv = timeline_iter_init(&iterator, &state, head, direction, now);
+      cl_assert(rv == S_SUCCESS || rv == S_NO_MORE_ITEMS);
+      if (rv == S_SUCCESS) {
+        cl_assert(!iter_prev(&iterator));
+        timeline_item_free_allocated_buffer(&state.pin);
+      }
+    }
+  }
+}
+
+void test_timeline__many_pins_first_visible(void) {
+  Uuid ids[NUM_MANY_PINS];
+  prv_add_many_pins(ids);
+
+  TimelineNode *head = NULL;
+  cl_assert_equal_i(timeline_init(&head), S_SUCCESS);
+  prv_check_first_pins(&head);
+
+  // Removing nodes, including the head of the list, keeps the lookups in step with the list
+  for (int i = 0; i < NUM_MANY_PINS; i += 3) {
+    while (timeline_iter_remove_node_with_id(&head, &ids[i])) {}
+  }
+  timeline_iter_remove_node(&head, head);
+  prv_check_first_pins(&head);
+}
@@ -0,0 +1,269 @@
+/* SPDX-FileCopyrightText: 2026 Core Devices LLC */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include "clar.h"
+
+#include "applib/graphics/gtypes.h"
+#include "pbl/services/compositor/compositor_scaling.h"
+#include "pbl/util/math.h"
+#include "pbl/util/size.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Stubs
+///////////////////////////////////////////////////////////
+
+#include "stubs_logging.h"
+#include "stubs_passert.h"
+
+// Reference implementation
+///////////////////////////////////////////////////////////
+
+//! The per-channel blend the compositor used before the packed one
+static uint8_t prv_reference_blend(uint8_t p00, uint8_t p10, uint8_t p01, uint8_t p11,
+                                   uint8_t fx, uint8_t fy) {
+  uint8_t result = 0xC0;
+  for (int shift = 0; shift < 6; shift += 2) {
+    const uint16_t c00 = (p00 >> shift) & 0x3;
+    const uint16_t c10 = (p10 >> shift) & 0x3;
+    const uint16_t c01 = (p01 >> shift) & 0x3;
+    const uint16_t c11 = (p11 >> shift) & 0x3;
+    const uint16_t top = c00 * (16 - fx) + c10 * fx;
+    const uint16_t bot = c01 * (16 - fx) + c11 * fx;
+    const uint16_t val = top * (16 - fy) + bot * fy;
+    const uint8_t channel = (val + 128) >> 8;
+    result |= (channel & 0x3) << shift;
+  }
+  return result;
+}
+
+//! The per-pixel row loop the compositor used before compositor_scale_row
+static void prv_reference_scale_row(uint8_t *dst_line, int16_t x_begin, int16_t x_end,
+                                    int16_t coord_origin, const GBitmapDataRowInfo *src_row,
+                                    const GBitmapDataRowInfo *src_row_next, uint8_t fy,
+                                    bool bilinear, int16_t app_width, uint32_t scale_x) {
+  for (int16_t x = x_begin; x < x_end; x++) {
+    const uint16_t dst_x_coord = x - coord_origin;
+    const uint32_t src_x_fixed = (uint32_t)dst_x_coord * scale_x;
+    const int16_t src_x = src_x_fixed >> 16;
+    if (src_x < src_row->min_x || src_x > src_row->max_x) {
+      continue;
+    }
+    if (!bilinear) {
+      dst_line[x] = src_row->data[src_x];
+      continue;
+    }
+    const int16_t src_x1 = MIN(src_x + 1, app_width - 1);
+    const uint8_t p00 = src_row->data[src_x];
+    const uint8_t p10 = (src_x1 <= src_row->max_x) ? src_row->data[src_x1] : p00;
+    const uint8_t p01 = (src_row_next && src_x >= src_row_next->min_x &&
+                         src_x <= src_row_next->max_x) ? src_row_next->data[src_x] : p00;
+    const uint8_t p11 = (src_row_next && src_x1 >= src_row_next->min_x &&
+                         src_x1 <= src_row_next->max_x) ? src_row_next->data[src_x1] : p10;
+    dst_line[x] = prv_reference_blend(p00, p10, p01, p11, (src_x_fixed >> 12) & 0xF, fy);
+  }
+}
+
+// Helpers
+///////////////////////////////////////////////////////////
+
+#define MAX_APP_WIDTH (DISP_COLS + 64)
+#define DST_MARGIN 64
+
+static uint8_t s_src_top[MAX_APP_WIDTH];
+static uint8_t s_src_bottom[MAX_APP_WIDTH];
+// Leaves room on both sides to catch writes outside x_begin..x_end
+static uint8_t s_dst_buffer[DST_MARGIN + DISP_COLS + DST_MARGIN];
+static uint8_t s_expected_buffer[DST_MARGIN + DISP_COLS + DST_MARGIN];
+
+static void prv_fill_random(uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    data[i] = rand();
+  }
+}
+
+static uint32_t prv_scale_factor(int16_t app_width, int16_t scaled_width) {
+  return ((uint32_t)app_width << 16) / scaled_width;
+}
+
+static void prv_check_row(int16_t x_begin, int16_t x_end, int16_t coord_origin,
+                          const GBitmapDataRowInfo *src_row,
+                          const GBitmapDataRowInfo *src_row_next, uint8_t fy, bool bilinear,
+                          int16_t app_width, uint32_t scale_x) {
+  prv_fill_random(s_dst_buffer, sizeof(s_dst_buffer));
+  memcpy(s_expected_buffer, s_dst_buffer, sizeof(s_dst_buffer));
+
+  prv_reference_scale_row(&s_expected_buffer[DST_MARGIN], x_begin, x_end, coord_origin, src_row,
+                          src_row_next, fy, bilinear, app_width, scale_x);
+  compositor_scale_row(&s_dst_buffer[DST_MARGIN], x_begin, x_end, coord_origin, src_row,
+                       src_row_next, fy, bilinear, app_width, scale_x);
+  cl_assert_equal_m(s_dst_buffer, s_expected_buffer, sizeof(s_dst_buffer));
+}
+
+//! Checks every fy, with and without a row below, for both filters
+static void prv_check_row_all_modes(int16_t x_begin, int16_t x_end, int16_t coord_origin,
+                                    const GBitmapDataRowInfo *src_row,
+                                    const GBitmapDataRowInfo *src_row_next, int16_t app_width,
+                                    uint32_t scale_x) {
+  prv_check_row(x_begin, x_end, coord_origin, src_row, NULL, 0, false, app_width, scale_x);
+  for (uint8_t fy = 0; fy < 16; fy++) {
+    prv_check_row(x_begin, x_end, coord_origin, src_row, src_row_next, fy, true, app_width,
+                  scale_x);
+    prv_check_row(x_begin, x_end, coord_origin, src_row, NULL, fy, true, app_width, scale_x);
+  }
+}
+
+// Setup
+///////////////////////////////////////////////////////////
+
+void test_compositor_scaling__initialize(void) {
+  srand(42);
+  prv_fill_random(s_src_top, sizeof(s_src_top));
+  prv_fill_random(s_src_bottom, sizeof(s_src_bottom));
+}
+
+// Tests
+///////////////////////////////////////////////////////////
+
+void test_compositor_scaling__blend_matches_per_channel_blend(void) {
+  for (int i = 0; i < 20000; i++) {
+    const uint8_t p00 = rand();
+    const uint8_t p10 = rand();
+    const uint8_t p01 = rand();
+    const uint8_t p11 = rand();
+    for (uint8_t fx = 0; fx < 16; fx++) {
+      for (uint8_t fy = 0; fy < 16; fy++) {
+        cl_assert_equal_i(compositor_scale_blend_bilinear(p00, p10, p01, p11, fx, fy),
+                          prv_reference_blend(p00, p10, p01, p11, fx, fy));
+      }
+    }
+  }
+}
+
+void test_compositor_scaling__blend_extremes(void) {
+  for (uint8_t fx = 0; fx < 16; fx++) {
+    for (uint8_t fy = 0; fy < 16; fy++) {
+      cl_assert_equal_i(compositor_scale_blend_bilinear(0xff, 0xff, 0xff, 0xff, fx, fy), 0xff);
+      cl_assert_equal_i(compositor_scale_blend_bilinear(0x00, 0x00, 0x00, 0x00, fx, fy), 0xc0);
+    }
+  }
+  // No weight on anything but the top left pixel
+  cl_assert_equal_i(compositor_scale_blend_bilinear(0x39, 0x00, 0x00, 0x00, 0, 0), 0xf9);
+}
+
+void test_compositor_scaling__full_rows(void) {
+  const int16_t app_widths[] = { 144, 180, 199, 200, MAX_APP_WIDTH };
+  const int16_t scaled_widths[] = { DISP_COLS, DISP_COLS - 37, 100 };
+  for (unsigned int w = 0; w < ARRAY_LENGTH(app_widths); w++) {
+    const int16_t app_width = app_widths[w];
+    const GBitmapDataRowInfo top = { .data = s_src_top, .min_x = 0, .max_x = app_width - 1 };
+    const GBitmapDataRowInfo bottom = { .data = s_src_bottom, .min_x = 0,
+                                        .max_x = app_width - 1 };
+    for (unsigned int s = 0; s < ARRAY_LENGTH(scaled_widths); s++) {
+      const uint32_t scale_x = prv_scale_factor(app_width, scaled_widths[s]);
+      // The whole display, copied relative to the display origin
+      prv_check_row_all_modes(0, DISP_COLS, 0, &top, &bottom, app_width, scale_x);
+      // Partial update rects, relative to the display origin
+      prv_check_row_all_modes(13, 77, 0, &top, &bottom, app_width, scale_x);
+      prv_check_row_all_modes(DISP_COLS - 1, DISP_COLS, 0, &top, &bottom, app_width, scale_x);
+      // Update rects that map their own origin to app column 0, as the transitions do
+      prv_check_row_all_modes(0, 120, -40, &top, &bottom, app_width, scale_x);
+      prv_check_row_all_modes(30, DISP_COLS, 30, &top, &bottom, app_width, scale_x);
+      // Empty range
+      prv_check_row_all_modes(50, 50, 0, &top, &bottom, app_width, scale_x);
+    }
+  }
+}
+
+void test_compositor_scaling__rows_past_app_width(void) {
+  // Row info may report valid data past the app's width
+  const int16_t app_width = 144;
+  const uint32_t scale_x = prv_scale_factor(app_width, DISP_COLS);
+  const GBitmapDataRowInfo top = { .data = s_src_top, .min_x = 0, .max_x = app_width + 10 };
+  const GBitmapDataRowInfo bottom = { .data = s_src_bottom, .min_x = 0, .max_x = app_width + 3 };
+  prv_check_row_all_modes(0, DISP_COLS, 0, &top, &bottom, app_width, scale_x);
+}
+
+void test_compositor_scaling__partial_rows(void) {
+  // Circular framebuffers only have valid data in the middle of each row
+  const int16_t app_width = 180;
+  const uint32_t scale_x = prv_scale_factor(app_width, DISP_COLS);
+  for (int i = 0; i < 200; i++) {
+    const int16_t top_min_x = rand() % app_width;
+    const int16_t bottom_min_x = rand() % app_width;
+    const GBitmapDataRowInfo top = {
+      .data = s_src_top,
+      .min_x = top_min_x,
+      .max_x = top_min_x + rand() % (app_width - top_min_x),
+    };
+    const GBitmapDataRowInfo bottom = {
+      .data = s_src_bottom,
+      .min_x = bottom_min_x,
+      .max_x = bottom_min_x + rand() % (app_width - bottom_min_x),
+    };
+    const int16_t x_begin = rand() % DISP_COLS;
+    const int16_t x_end = x_begin + rand() % (DISP_COLS - x_begin + 1);
+    prv_check_row_all_modes(x_begin, x_end, 0, &top, &bottom, app_width, scale_x);
+    prv_check_row_all_modes(x_begin, x_end, x_begin, &top, &bottom, app_width, scale_x);
+  }
+}
+
+void test_compositor_scaling__scale_factor_changes(void) {
+  // The column table is cached, so alternating scale factors must not reuse stale entries
+  const GBitmapDataRowInfo top = { .data = s_src_top, .min_x = 0, .max_x = 143 };
+  const GBitmapDataRowInfo bottom = { .data = s_src_bottom, .min_x = 0, .max_x = 143 };
+  const GBitmapDataRowInfo wide_top = { .data = s_src_top, .min_x = 0, .max_x = 179 };
+  for (int i = 0; i < 4; i++) {
+    prv_check_row(0, DISP_COLS, 0, &top, &bottom, 7, true, 144, prv_scale_factor(144, DISP_COLS));
+    prv_check_row(0, DISP_COLS, 0, &wide_top, NULL, 7, true, 180,
+                  prv_scale_factor(180, DISP_COLS));
+    prv_check_row(0, DISP_COLS, 0, &top, &bottom, 7, true, 144, prv_scale_factor(144, 150));
+  }
+}
+
+// Whole frames
+///////////////////////////////////////////////////////////
+
+#define FRAME_APP_WIDTH 144
+#define FRAME_APP_HEIGHT 168
+
+typedef void (*ScaleRowFunc)(uint8_t *dst_line, int16_t x_begin, int16_t x_end,
+                             int16_t coord_origin, const GBitmapDataRowInfo *src_row,
+                             const GBitmapDataRowInfo *src_row_next, uint8_t fy, bool bilinear,
+                             int16_t app_width, uint32_t scale_x);
+
+static uint8_t s_app_frame[FRAME_APP_HEIGHT][FRAME_APP_WIDTH];
+static uint8_t s_display_frame[DISP_ROWS][DISP_COLS];
+
+static void prv_scale_frame(ScaleRowFunc scale_row, bool bilinear) {
+  const uint32_t scale_x = prv_scale_factor(FRAME_APP_WIDTH, DISP_COLS);
+  const uint32_t scale_y = prv_scale_factor(FRAME_APP_HEIGHT, DISP_ROWS);
+  for (int16_t y = 0; y < DISP_ROWS; y++) {
+    const uint32_t src_y_fixed = (uint32_t)y * scale_y;
+    const int16_t src_y = src_y_fixed >> 16;
+    const GBitmapDataRowInfo src_row = {
+      .data = s_app_frame[src_y], .min_x = 0, .max_x = FRAME_APP_WIDTH - 1,
+    };
+    const bool has_next = bilinear && (src_y + 1 < FRAME_APP_HEIGHT);
+    const GBitmapDataRowInfo src_row_next = {
+      .data = has_next ? s_app_frame[src_y + 1] : NULL,
+      .min_x = 0, .max_x = FRAME_APP_WIDTH - 1,
+    };
+    scale_row(s_display_frame[y], 0, DISP_COLS, 0, &src_row, has_next ? &src_row_next : NULL,
+              (src_y_fixed >> 12) & 0xF, bilinear, FRAME_APP_WIDTH, scale_x);
+  }
+}
+
+void test_compositor_scaling__full_frame(void) {
+  static uint8_t s_expected_frame[DISP_ROWS][DISP_COLS];
+  prv_fill_random(&s_app_frame[0][0], sizeof(s_app_frame));
+
+  for (int bilinear = 0; bilinear < 2; bilinear++) {
+    prv_scale_frame(prv_reference_scale_row, bilinear);
+    memcpy(s_expected_frame, s_display_frame, sizeof(s_display_frame));
+    memset(s_display_frame, 0, sizeof(s_display_frame));
+    prv_scale_frame(compositor_scale_row, bilinear);
+    cl_assert_equal_m(s_display_frame, s_expected_frame, sizeof(s_display_frame));
+  }
+}
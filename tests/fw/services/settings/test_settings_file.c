@@ -9,6 +9,7 @@
 
 #include "pbl/services/filesystem/pfs.h"
 #include "flash_region/flash_region.h"
+#include "pbl/util/size.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -434,6 +435,103 @@ void test_settings_file__atomic(void) {
   cl_assert(have_hit_end);
 }
 
+static const SettingsFileBatchWrite s_batch[] = {
+  { .key = "a", .key_len = 1, .val = "new_a", .val_len = 5 },
+  { .key = "b", .key_len = 1 },
+  { .key = "c", .key_len = 1, .val = "new_c_value", .val_len = 11 },
+};
+
+// Checks that the file holds either none or all of s_batch
+static RecordResult prv_verify_batch(SettingsFile *file) {
+  const bool old = (settings_file_get_len(file, "c", 1) == 0);
+  if (old) {
+    verify(file, (uint8_t *)"a", 1, (uint8_t *)"old_a_value", 11);
+    verify(file, (uint8_t *)"b", 1, (uint8_t *)"old_b", 5);
+    return RecordResultOld;
+  }
+  for (size_t i = 0; i < ARRAY_LENGTH(s_batch); i++) {
+    verify(file, (uint8_t *)s_batch[i].key, s_batch[i].key_len,
+           (uint8_t *)s_batch[i].val, s_batch[i].val_len);
+  }
+  return RecordResultNew;
+}
+
+static RecordResult prv_set_batch_aborting_after_bytes(int after_n_bytes) {
+  fake_spi_flash_init(0, 0x1000000);
+  fake_rtc_init(0, 1388563200);
+  pfs_init(false);
+
+  SettingsFile file;
+  cl_must_pass(settings_file_open(&file, "test_file_batch", 4096));
+  set_and_verify(&file, (uint8_t *)"a", 1, (uint8_t *)"old_a_value", 11);
+  set_and_verify(&file, (uint8_t *)"b", 1, (uint8_t *)"old_b", 5);
+
+  jmp_buf jmp;
+  if (setjmp(jmp)) {
+    // Reboot and check that the file is in one state or the other
+    fake_spi_flash_force_future_failure(0, NULL);
+    extern void pfs_reset_all_state(void);
+    pfs_reset_all_state();
+    pfs_init(false);
+
+    SettingsFile file_new;
+    cl_must_pass(settings_file_open(&file_new, "test_file_batch", 4096));
+    RecordResult result = prv_verify_batch(&file_new);
+    settings_file_close(&file_new);
+    return result;
+  }
+  fake_spi_flash_force_future_failure(after_n_bytes, &jmp);
+
+  cl_must_pass(settings_file_set_batch(&file, s_batch, ARRAY_LENGTH(s_batch)));
+  fake_spi_flash_force_future_failure(0, NULL);
+  cl_assert_equal_i(prv_verify_batch(&file), RecordResultNew);
+  settings_file_close(&file);
+  return RecordResultEnd;
+}
+
+void test_settings_file__set_batch_atomic(void) {
+  bool have_hit_old_value = false;
+  bool have_hit_new_value = false;
+  RecordResult result;
+  for (int i = 1; (result = prv_set_batch_aborting_after_bytes(i)) != RecordResultEnd; i += 3) {
+    have_hit_old_value |= (result == RecordResultOld);
+    have_hit_new_value |= (result == RecordResultNew);
+  }
+  cl_assert(have_hit_old_value);
+  cl_assert(have_hit_new_value);
+}
+
+void test_settings_file__set_batch_out_of_storage(void) {
+  SettingsFile file;
+  cl_must_pass(settings_file_open(&file, "test_file_batch", 1024));
+  uint8_t val[400];
+  memset(val, 'x', sizeof(val));
+  set_and_verify(&file, (uint8_t *)"a", 1, val, sizeof(val));
+  const int used_space = file.used_space;
+
+  // Two more records that size don't fit alongside "a"
+  const SettingsFileBatchWrite too_big[] = {
+    { .key = "b", .key_len = 1, .val = val, .val_len = sizeof(val) },
+    { .key = "c", .key_len = 1, .val = val, .val_len = sizeof(val) },
+  };
+  cl_assert_equal_i(settings_file_set_batch(&file, too_big, ARRAY_LENGTH(too_big)),
+                    E_OUT_OF_STORAGE);
+  cl_assert_equal_i(file.used_space, used_space);
+  cl_assert_equal_i(settings_file_get_len(&file, "b", 1), 0);
+
+  // Deleting "a" in the same batch makes room for them
+  const SettingsFileBatchWrite fits[] = {
+    too_big[0],
+    too_big[1],
+    { .key = "a", .key_len = 1 },
+  };
+  cl_must_pass(settings_file_set_batch(&file, fits, ARRAY_LENGTH(fits)));
+  verify(&file, (uint8_t *)"b", 1, val, sizeof(val));
+  verify(&file, (uint8_t *)"c", 1, val, sizeof(val));
+  cl_assert_equal_i(settings_file_get_len(&file, "a", 1), 0);
+  settings_file_close(&file);
+}
+
 void test_settings_file__zero_length(void) {
   printf("\nTesting if we can set keys & values of zero length...\n");
 
@@ -29,6 +29,7 @@
 #include "pbl/util/size.h"
 
 #include <stdio.h>
+#include <string.h>
 
 // helpers from accel manager
 extern void test_accel_manager_get_subsample_info(
@@ -268,3 +269,164 @@ void test_accel_manager__batched_samples(void) {
   sys_accel_manager_set_sample_buffer(main_session, fake_buf, 3);
   cl_assert_equal_i(s_num_samples, 7); /* 300ms / (1000ms / 25 samps) */
 }
+
+// A subscriber fed by prv_feed_samples(), along with the stream it is expected to see
+typedef struct {
+  PebbleTask task;
+  AccelManagerState *session;
+  AccelRawData buffer[32];
+  uint32_t samples_per_update;
+  //! Subsampling state of the reference model, advanced once per driver sample
+  uint32_t model_state;
+  uint16_t num;
+  uint16_t den;
+  //! Samples (and batch timestamps) the subscriber received and the model expects
+  AccelRawData received[400];
+  uint64_t received_timestamps[400];
+  int num_received;
+  int num_received_batches;
+  AccelRawData expected[400];
+  uint64_t expected_timestamps[400];
+  int num_expected;
+  int num_expected_batches;
+} StreamSubscriber;
+
+static AccelDriverSample prv_driver_sample(int i) {
+  return (AccelDriverSample) {
+    .timestamp_us = 1000000000ULL + (uint64_t)i * s_sampling_interval_us,
+    .x = i,
+    .y = -i,
+    .z = 3 * i,
+  };
+}
+
+static void prv_drain_full_buffer(StreamSubscriber *sub) {
+  uint64_t timestamp_ms;
+  const uint32_t num_samples = sys_accel_manager_get_num_samples(sub->session, &timestamp_ms);
+  if (num_samples < sub->samples_per_update) {
+    return;
+  }
+  cl_assert_equal_i(num_samples, sub->samples_per_update);
+  memcpy(&sub->received[sub->num_received], sub->buffer, num_samples * sizeof(AccelRawData));
+  sub->received_timestamps[sub->num_received_batches++] = timestamp_ms;
+  sub->num_received += num_samples;
+  stub_pebble_tasks_set_current(sub->task);
+  cl_assert(sys_accel_manager_consume_samples(sub->session, num_samples));
+}
+
+// Pushes num_samples samples through the driver callback, draining each subscriber as soon as
+// its buffer fills, and models what each of them should have received
+static void prv_feed_samples(StreamSubscriber *subs, int num_subs, int num_samples) {
+  for (int s = 0; s < num_subs; s++) {
+    test_accel_manager_get_subsample_info(subs[s].session, &subs[s].num, &subs[s].den,
+                                          &(uint16_t){0});
+    subs[s].model_state = subs[s].den - subs[s].num;
+  }
+
+  for (int i = 0; i < num_samples; i++) {
+    const AccelDriverSample sample = prv_driver_sample(i);
+    accel_cb_new_sample(&sample);
+
+    for (int s = 0; s < num_subs; s++) {
+      StreamSubscriber *sub = &subs[s];
+      sub->model_state += sub->num;
+      if (sub->model_state >= sub->den) {
+        sub->model_state %= sub->den;
+        if ((sub->num_expected % sub->samples_per_update) == 0) {
+          sub->expected_timestamps[sub->num_expected_batches++] = sample.timestamp_us / 1000;
+        }
+        sub->expected[sub->num_expected++] = (AccelRawData) {
+          .x = sample.x, .y = sample.y, .z = sample.z,
+        };
+      }
+      prv_drain_full_buffer(sub);
+    }
+  }
+}
+
+static void prv_assert_streams_match(StreamSubscriber *subs, int num_subs) {
+  for (int s = 0; s < num_subs; s++) {
+    StreamSubscriber *sub = &subs[s];
+    // only whole batches are handed over
+    const int num_full = sub->num_expected - (sub->num_expected % sub->samples_per_update);
+    cl_assert(num_full > 0);
+    cl_assert_equal_i(sub->num_received, num_full);
+    cl_assert_equal_m(sub->received, sub->expected, num_full * sizeof(AccelRawData));
+    cl_assert_equal_i(sub->num_received_batches, num_full / sub->samples_per_update);
+    for (int b = 0; b < sub->num_received_batches; b++) {
+      cl_assert_equal_i(sub->received_timestamps[b], sub->expected_timestamps[b]);
+    }
+  }
+}
+
+void test_accel_manager__sample_streams(void) {
+  const int rates[] = { ACCEL_SAMPLING_10HZ, ACCEL_SAMPLING_25HZ,
+                        ACCEL_SAMPLING_50HZ, ACCEL_SAMPLING_100HZ };
+  const uint32_t samples_per_update[] = { 1, 7, 25 };
+  const PebbleTask tasks[] = { PebbleTask_KernelMain, PebbleTask_Worker, PebbleTask_App };
+  static StreamSubscriber s_subs[3];
+
+  // every pair and triple of rates, so each subscriber sees several subsampling ratios
+  for (int mask = 0; mask < (1 << ARRAY_LENGTH(rates)); mask++) {
+    const int count = __builtin_popcount(mask);
+    if (count < 2 || count > 3) {
+      continue;
+    }
+    for (size_t spu = 0; spu < ARRAY_LENGTH(samples_per_update); spu++) {
+      memset(s_subs, 0, sizeof(s_subs));
+      int num_subs = 0;
+      for (size_t r = 0; r < ARRAY_LENGTH(rates); r++) {
+        if (!(mask & (1 << r))) {
+          continue;
+        }
+        StreamSubscriber *sub = &s_subs[num_subs];
+        sub->task = tasks[num_subs];
+        // give the subscribers different batch sizes too
+        sub->samples_per_update =
+            samples_per_update[(spu + num_subs) % ARRAY_LENGTH(samples_per_update)];
+        stub_pebble_tasks_set_current(sub->task);
+        sub->session = sys_accel_manager_data_subscribe(rates[r], prv_noop_sample_handler, NULL,
+                                                        sub->task);
+        sys_accel_manager_set_sample_buffer(sub->session, sub->buffer, sub->samples_per_update);
+        num_subs++;
+      }
+
+      prv_feed_samples(s_subs, num_subs, 300);
+      prv_assert_streams_match(s_subs, num_subs);
+
+      for (int s = 0; s < num_subs; s++) {
+        stub_pebble_tasks_set_current(s_subs[s].task);
+        sys_accel_manager_data_unsubscribe(s_subs[s].session);
+      }
+    }
+  }
+}
+
+void test_accel_manager__sample_streams_jitterfree(void) {
+  // 12.5Hz out of 125Hz, next to a 50Hz subscriber that keeps 2 of every 5 samples
+  s_force_sampling_interval = true;
+  s_sampling_interval_us = (1000000000 / 125000);
+  static StreamSubscriber s_subs[2];
+  memset(s_subs, 0, sizeof(s_subs));
+
+  s_subs[0].task = PebbleTask_KernelMain;
+  s_subs[0].samples_per_update = 5;
+  s_subs[0].session = sys_accel_manager_data_subscribe(
+      ACCEL_SAMPLING_25HZ, prv_noop_sample_handler, NULL, s_subs[0].task);
+  accel_manager_set_jitterfree_sampling_rate(s_subs[0].session, 12500);
+  sys_accel_manager_set_sample_buffer(s_subs[0].session, s_subs[0].buffer, 5);
+
+  stub_pebble_tasks_set_current(PebbleTask_Worker);
+  s_subs[1].task = PebbleTask_Worker;
+  s_subs[1].samples_per_update = 16;
+  s_subs[1].session = sys_accel_manager_data_subscribe(
+      ACCEL_SAMPLING_50HZ, prv_noop_sample_handler, NULL, s_subs[1].task);
+  sys_accel_manager_set_sample_buffer(s_subs[1].session, s_subs[1].buffer, 16);
+
+  prv_feed_samples(s_subs, ARRAY_LENGTH(s_subs), 500);
+  prv_assert_streams_match(s_subs, ARRAY_LENGTH(s_subs));
+  cl_assert_equal_i(s_subs[0].num, 1);
+  cl_assert_equal_i(s_subs[0].den, 10);
+  cl_assert_equal_i(s_subs[1].num, 2);
+  cl_assert_equal_i(s_subs[1].den, 5);
+}
@@ -17,6 +17,7 @@
 #include <pbl/logging/logging.h>
 #include "pbl/util/attributes.h"
 #include <stdio.h>
+#include <stdlib.h>
 
 // Fakes
 ////////////////////////////////////
@@ -292,8 +293,9 @@ void test_app_cache__corrupt_key(void) {
   settings_file_close(&file);
   // End Raw SettingsFile calls
 
-  // force iteration on the app_cache. This will find the corrupted entry, and delete the app cache
-  app_cache_free_up_space(1);
+  // the in-RAM index is rebuilt from flash on init. This will find the corrupted entry, and
+  // delete the app cache
+  app_cache_init();
 
   fake_system_task_callbacks_invoke_pending();
   cl_assert_equal_b(false, app_cache_entry_exists(app1.id));
@@ -633,3 +635,170 @@ void test_app_cache__purge_orphaned_files_no_apps(void) {
     prv_check_file_exists(descriptions[i].name);
   }
 }
+
+/*************************************
+ * Fuzz against a flash-scanning reference *
+ *************************************/
+
+#define FUZZ_NUM_IDS 40
+#define FUZZ_NUM_OPS 2000
+
+typedef struct {
+  ListNode node;
+  AppInstallId id;
+  uint32_t size;
+  uint32_t priority;
+} RefEvictNode;
+
+typedef struct {
+  RefEvictNode *list;
+  uint32_t bytes_needed;
+  uint32_t bytes_in_list;
+  AppInstallId do_not_evict[4];
+  AppInstallId min_id;
+  uint32_t min_priority;
+  uint32_t total_size;
+} RefScanData;
+
+static int prv_ref_comparator(void *a, void *b) {
+  RefEvictNode *a_node = a;
+  RefEvictNode *b_node = b;
+  if (b_node->priority != a_node->priority) {
+    return (b_node->priority > a_node->priority) ? 1 : -1;
+  }
+  if (b_node->size != a_node->size) {
+    return (b_node->size < a_node->size) ? 1 : -1;
+  }
+  return 0;
+}
+
+// Mirrors the flash scans the app cache used to do before it kept an in-RAM index
+static bool prv_ref_each(SettingsFile *file, SettingsRecordInfo *info, void *context) {
+  if (info->val_len == 0) {
+    return true; // deleted record
+  }
+  RefScanData *data = context;
+  AppInstallId id;
+  AppCacheEntry entry;
+  info->get_key(file, (uint8_t *)&id, info->key_len);
+  info->get_val(file, (uint8_t *)&entry, info->val_len);
+
+  const uint32_t priority = MAX(entry.last_launch, entry.install_date);
+  data->total_size += entry.total_size;
+  if (priority < data->min_priority) {
+    data->min_id = id;
+    data->min_priority = priority;
+  }
+
+  if (data->bytes_needed == 0) {
+    return true;
+  }
+  RefEvictNode *node = malloc(sizeof(RefEvictNode));
+  *node = (RefEvictNode) {
+    .id = id,
+    .size = entry.total_size,
+    .priority = priority,
+  };
+  for (unsigned int i = 0; i < ARRAY_LENGTH(data->do_not_evict); i++) {
+    if (data->do_not_evict[i] == id) {
+      node->priority = UINT32_MAX;
+    }
+  }
+  data->list = (RefEvictNode *)list_sorted_add((ListNode *)data->list, (ListNode *)node,
+                                               prv_ref_comparator, false);
+  data->bytes_in_list += node->size;
+  while (data->list && (data->bytes_in_list > data->bytes_needed) &&
+         (data->list->size <= (data->bytes_in_list - data->bytes_needed))) {
+    RefEvictNode *head = data->list;
+    data->bytes_in_list -= head->size;
+    data->list = (RefEvictNode *)list_pop_head((ListNode *)head);
+    free(head);
+  }
+  return true;
+}
+
+static void prv_ref_scan(RefScanData *data) {
+  data->min_id = INSTALL_ID_INVALID;
+  data->min_priority = UINT32_MAX;
+  SettingsFile file;
+  if (settings_file_open(&file, APP_CACHE_FILE_NAME, APP_CACHE_MAX_SIZE) != S_SUCCESS) {
+    return;
+  }
+  settings_file_each(&file, prv_ref_each, data);
+  settings_file_close(&file);
+}
+
+static bool prv_ref_exists(AppInstallId id) {
+  SettingsFile file;
+  cl_assert_equal_i(S_SUCCESS, settings_file_open(&file, APP_CACHE_FILE_NAME,
+                                                  APP_CACHE_MAX_SIZE));
+  const bool exists = settings_file_exists(&file, (uint8_t *)&id, sizeof(id));
+  settings_file_close(&file);
+  return exists;
+}
+
+static AppInstallId prv_random_do_not_evict(void) {
+  return (rand() % 3) ? 0 : (1 + rand() % FUZZ_NUM_IDS);
+}
+
+void test_app_cache__fuzz_matches_flash_scan(void) {
+  srand(29);
+  time_t now = rtc_get_time();
+
+  for (int op = 0; op < FUZZ_NUM_OPS; op++) {
+    const AppInstallId id = 1 + rand() % FUZZ_NUM_IDS;
+    const int action = rand() % 10;
+
+    if (action < 4) {
+      app_cache_add_entry(id, 1 + rand() % 300000);
+    } else if (action < 7) {
+      if (prv_ref_exists(id)) {
+        cl_assert_equal_i(S_SUCCESS, app_cache_app_launched(id));
+      }
+    } else if (action < 8) {
+      app_cache_remove_entry(id);
+    } else if (action < 9) {
+      s_test_id_ql_up = prv_random_do_not_evict();
+      s_test_id_ql_down = prv_random_do_not_evict();
+      s_test_id_watchface = prv_random_do_not_evict();
+      s_test_id_worker = prv_random_do_not_evict();
+
+      RefScanData expected = {
+        .bytes_needed = 1 + rand() % 600000,
+        .do_not_evict = { s_test_id_ql_up, s_test_id_ql_down, s_test_id_watchface,
+                          s_test_id_worker },
+      };
+      prv_ref_scan(&expected);
+      bool evicted[FUZZ_NUM_IDS + 1] = { 0 };
+      while (expected.list) {
+        RefEvictNode *head = expected.list;
+        evicted[head->id] = true;
+        expected.list = (RefEvictNode *)list_pop_head((ListNode *)head);
+        free(head);
+      }
+      bool existed[FUZZ_NUM_IDS + 1];
+      for (AppInstallId i = 1; i <= FUZZ_NUM_IDS; i++) {
+        existed[i] = prv_ref_exists(i);
+      }
+
+      cl_assert_equal_i(S_SUCCESS, app_cache_free_up_space(expected.bytes_needed));
+
+      for (AppInstallId i = 1; i <= FUZZ_NUM_IDS; i++) {
+        cl_assert_equal_b(existed[i] && !evicted[i], prv_ref_exists(i));
+      }
+    } else {
+      // simulate a reboot, which rebuilds the index from flash
+      app_cache_init();
+    }
+
+    // step the clock, sometimes not at all (to exercise ties) and sometimes backwards
+    const int step = rand() % 8;
+    now += (step == 0) ? -5 : (step - 1) / 2;
+    rtc_set_time(now);
+
+    RefScanData expected = { 0 };
+    prv_ref_scan(&expected);
+    cl_assert_equal_i(expected.total_size, app_cache_get_size());
+    cl_assert_equal_i(expected.min_id, app_cache_get_next_eviction());
+  }
+}
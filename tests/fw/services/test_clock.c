@@ -551,6 +551,96 @@ void test_clock__dstzone_rule_check(void) {
   }
 }
 
+void prv_dst_transitions_invalidate(void);
+
+//! Looking up DST periods through the transition cache gives the same answer as evaluating the
+//! DST rules from scratch, for every region over many years
+void test_clock__dst_transitions_cache_sweep(void) {
+  fake_rtc_init(0, 0);
+  rtc_timezone_clear();
+  clock_init();
+
+  static const time_t jan1st_2015 = 1420070400;
+  const int region_count = timezone_database_get_region_count();
+  cl_assert(region_count > 0);
+
+  int num_dst_regions = 0;
+  for (int region_id = 0; region_id < region_count; region_id++) {
+    TimezoneInfo region_info;
+    cl_assert(timezone_database_load_region_info(region_id, &region_info));
+    if (region_info.dst_id == 0) {
+      continue;
+    }
+    num_dst_regions++;
+
+    // About every 11 days, at a different time of day each time, through 2030
+    for (time_t t = jan1st_2015; t < jan1st_2015 + 16 * 365 * SECONDS_PER_DAY;
+         t += 11 * SECONDS_PER_DAY + 5 * SECONDS_PER_HOUR) {
+      TimezoneInfo cached = region_info;
+      prv_update_dstrule_timestamps_by_dstzone_id(&cached, t);
+
+      TimezoneInfo evaluated = region_info;
+      prv_dst_transitions_invalidate();
+      prv_update_dstrule_timestamps_by_dstzone_id(&evaluated, t);
+
+      cl_assert_equal_i(cached.dst_start, evaluated.dst_start);
+      cl_assert_equal_i(cached.dst_end, evaluated.dst_end);
+    }
+  }
+  cl_assert(num_dst_regions > 0);
+}
+
+//! Once a DST period is over the clock moves on to the next one by itself
+void test_clock__dst_rolls_over_to_next_period(void) {
+  static const time_t jul1st_noon_2015 = 1435752000;
+  // US DST: Mar 8th 2015 07:00 UTC ~ Nov 1st 2015 06:00 UTC and
+  // Mar 13th 2016 07:00 UTC ~ Nov 6th 2016 06:00 UTC
+  static const time_t dst_end_2015 = 1446357600;
+  static const time_t dst_start_2016 = 1457852400;
+  static const time_t dst_end_2016 = 1478412000;
+
+  fake_rtc_init(0, jul1st_noon_2015);
+  const char *region_name = "America/New_York";
+  const int region_id = timezone_database_find_region_by_name(region_name, strlen(region_name));
+  cl_assert(region_id != -1);
+  TimezoneInfo tz_info;
+  cl_assert(timezone_database_load_region_info(region_id, &tz_info));
+  prv_update_dstrule_timestamps_by_dstzone_id(&tz_info, jul1st_noon_2015);
+  rtc_set_timezone(&tz_info);
+  clock_init();
+  cl_assert_equal_i(time_get_dst_end(), dst_end_2015);
+  cl_assert(time_get_isdst(rtc_get_time()));
+
+  // Nothing changes before the period is over
+  rtc_set_time(dst_end_2015 - SECONDS_PER_MINUTE);
+  prv_watch_dst((void *)true);
+  cl_assert_equal_i(time_get_dst_end(), dst_end_2015);
+
+  fake_event_reset_count();
+  rtc_set_time(dst_end_2015 + SECONDS_PER_MINUTE);
+  prv_watch_dst((void *)true);
+  cl_assert_equal_i(time_get_dst_start(), dst_start_2016);
+  cl_assert_equal_i(time_get_dst_end(), dst_end_2016);
+  cl_assert(!time_get_isdst(rtc_get_time()));
+  cl_assert_equal_i(fake_event_get_count(), 1);
+  cl_assert(fake_event_get_last().set_time_info.dst_changed);
+
+  // The RTC keeps the new period across reboots
+  TimezoneInfo rtc_tz_info;
+  rtc_get_timezone(&rtc_tz_info);
+  cl_assert_equal_i(rtc_tz_info.dst_start, dst_start_2016);
+  cl_assert_equal_i(rtc_tz_info.dst_end, dst_end_2016);
+
+  // And DST starts again the next year
+  fake_event_reset_count();
+  rtc_set_time(dst_start_2016 + SECONDS_PER_MINUTE);
+  prv_watch_dst((void *)false);
+  cl_assert(time_get_isdst(rtc_get_time()));
+  cl_assert_equal_i(fake_event_get_count(), 1);
+  cl_assert(fake_event_get_last().set_time_info.dst_changed);
+  cl_assert_equal_i(time_get_dst_end(), dst_end_2016);
+}
+
 void test_clock__next_monday(void) {
   struct tm jan_1 = {
     .tm_sec = 0, // 0 seconds after the minute
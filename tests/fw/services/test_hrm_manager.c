@@ -26,10 +26,7 @@
 #include "stubs_prompt.h"
 #include "stubs_worker_manager.h"
 
-
-
 #include <stdio.h>
-#include <services/hrm/hrm_manager.h>
 
 
 // -----------------------------------------------------------------------------
@@ -848,3 +845,136 @@ void test_hrm_manager__immediate_off_wrist(void) {
 
   sys_hrm_manager_unsubscribe(session_ref);
 }
+
+static const HRMData s_hrm_all_features_data = {
+  .features = HRMFeature_BPM | HRMFeature_HRV | HRMFeature_SpO2,
+  .hrm_bpm = 91,
+  .hrm_quality = HRMQuality_Good,
+  .hrv_ppi_ms = 655,
+  .hrv_quality = HRMQuality_Acceptable,
+  .spo2_percent = 97,
+  .spo2_quality = HRMQuality_Excellent,
+};
+
+// Events must be fanned out to each subscriber for exactly the features it asked for, in feature
+// order, with KernelBG subscribers sharing one queued event per feature
+void test_hrm_manager__mixed_subscribers_event_stream(void) {
+  const uint16_t expire_s = SECONDS_PER_MINUTE;
+
+  stub_pebble_tasks_set_current(PebbleTask_App);
+  HRMSessionRef app_session = sys_hrm_manager_app_subscribe(1, 1, expire_s,
+                                                            HRMFeature_BPM | HRMFeature_SpO2);
+  stub_pebble_tasks_set_current(PebbleTask_KernelBackground);
+  HRMSessionRef bg_session_1 = hrm_manager_subscribe_with_callback(
+      INSTALL_ID_INVALID, 1, expire_s, HRMFeature_BPM | HRMFeature_HRV, prv_fake_hrm_1_cb, NULL);
+  HRMSessionRef bg_session_2 = hrm_manager_subscribe_with_callback(
+      INSTALL_ID_INVALID, 1, 0 /*expire_s*/, HRMFeature_HRV, prv_fake_hrm_2_cb, NULL);
+  fake_system_task_callbacks_invoke_pending();
+
+  hrm_manager_new_data_cb(&s_hrm_all_features_data);
+
+  // The app gets its features in feature order
+  cl_assert_equal_i(s_event_count, 2);
+  cl_assert_equal_i(s_events_received[0].hrm.event_type, HRMEvent_BPM);
+  cl_assert_equal_i(s_events_received[0].hrm.bpm.bpm, 91);
+  cl_assert_equal_i(s_events_received[0].hrm.bpm.quality, HRMQuality_Good);
+  cl_assert_equal_i(s_events_received[1].hrm.event_type, HRMEvent_SpO2);
+  cl_assert_equal_i(s_events_received[1].hrm.spo2.percent, 97);
+  cl_assert_equal_i(s_events_received[1].hrm.spo2.quality, HRMQuality_Excellent);
+
+  // The newest KernelBG subscriber is visited first, so HRV is queued before BPM
+  cl_assert_equal_i(prv_num_system_task_events_queued(), 2);
+  fake_system_task_callbacks_invoke_pending();
+  cl_assert_equal_i(s_num_cb_events_1, 2);
+  cl_assert_equal_i(s_cb_events_1[0].event_type, HRMEvent_HRV);
+  cl_assert_equal_i(s_cb_events_1[0].hrv.ppi_ms, 655);
+  cl_assert_equal_i(s_cb_events_1[0].hrv.quality, HRMQuality_Acceptable);
+  cl_assert_equal_i(s_cb_events_1[1].event_type, HRMEvent_BPM);
+  cl_assert_equal_i(s_num_cb_events_2, 1);
+  cl_assert_equal_i(s_cb_events_2[0].event_type, HRMEvent_HRV);
+
+  // Data nobody asked for produces no events at all
+  const HRMData spo2_only_data = {
+    .features = HRMFeature_SpO2,
+    .spo2_percent = 95,
+    .spo2_quality = HRMQuality_Good,
+  };
+  stub_pebble_tasks_set_current(PebbleTask_App);
+  sys_hrm_manager_set_features(app_session, HRMFeature_BPM);
+  hrm_manager_new_data_cb(&spo2_only_data);
+  cl_assert_equal_i(s_event_count, 2);
+  cl_assert_equal_i(prv_num_system_task_events_queued(), 0);
+
+  // Inside the warning window, the app gets its expiring event after the data and the KernelBG
+  // subscriber gets it before the data
+  rtc_set_time(rtc_get_time() + expire_s - HRM_SUBSCRIPTION_EXPIRING_WARNING_SEC);
+  hrm_manager_new_data_cb(&s_hrm_all_features_data);
+  cl_assert_equal_i(s_event_count, 4);
+  cl_assert_equal_i(s_events_received[2].hrm.event_type, HRMEvent_BPM);
+  cl_assert_equal_i(s_events_received[3].hrm.event_type, HRMEvent_SubscriptionExpiring);
+  cl_assert(s_events_received[3].hrm.expiring.session_ref == app_session);
+  fake_system_task_callbacks_invoke_pending();
+  cl_assert_equal_i(s_num_cb_events_1, 5);
+  cl_assert_equal_i(s_cb_events_1[2].event_type, HRMEvent_SubscriptionExpiring);
+  cl_assert(s_cb_events_1[2].expiring.session_ref == bg_session_1);
+  cl_assert_equal_i(s_cb_events_1[3].event_type, HRMEvent_HRV);
+  cl_assert_equal_i(s_cb_events_1[4].event_type, HRMEvent_BPM);
+  cl_assert_equal_i(s_num_cb_events_2, 2);
+  cl_assert_equal_i(s_cb_events_2[1].event_type, HRMEvent_HRV);
+
+  // The expiring event is only sent once
+  hrm_manager_new_data_cb(&s_hrm_all_features_data);
+  cl_assert_equal_i(s_event_count, 5);
+  cl_assert_equal_i(s_events_received[4].hrm.event_type, HRMEvent_BPM);
+  fake_system_task_callbacks_invoke_pending();
+  cl_assert_equal_i(s_num_cb_events_1, 7);
+  cl_assert_equal_i(s_num_cb_events_2, 3);
+
+  // Past the expiration, only the subscription without one survives
+  rtc_set_time(rtc_get_time() + HRM_SUBSCRIPTION_EXPIRING_WARNING_SEC);
+  hrm_manager_new_data_cb(&s_hrm_all_features_data);
+  fake_system_task_callbacks_invoke_pending();
+  cl_assert(prv_get_subscriber_state_from_ref(app_session) == NULL);
+  cl_assert(prv_get_subscriber_state_from_ref(bg_session_1) == NULL);
+  cl_assert(prv_get_subscriber_state_from_ref(bg_session_2) != NULL);
+  cl_assert_equal_b(hrm_is_enabled(HRM), true);
+  cl_assert_equal_i(s_hrm_state.features, HRMFeature_HRV);
+
+  hrm_manager_new_data_cb(&s_hrm_all_features_data);
+  fake_system_task_callbacks_invoke_pending();
+  cl_assert_equal_i(s_event_count, 6);
+  cl_assert_equal_i(s_num_cb_events_1, 7);
+  cl_assert_equal_i(s_num_cb_events_2, 5);
+
+  sys_hrm_manager_unsubscribe(bg_session_2);
+}
+
+// When the last subscription expires, the sensor must be turned off right away rather than waiting
+// for data that no subscriber wants anymore
+void test_hrm_manager__expiration_turns_sensor_off(void) {
+  const uint16_t expire_s = SECONDS_PER_MINUTE;
+  HRMSessionRef session_ref = sys_hrm_manager_app_subscribe(1, 1, expire_s, HRMFeature_BPM);
+  fake_system_task_callbacks_invoke_pending();
+  cl_assert_equal_b(hrm_is_enabled(HRM), true);
+
+  rtc_set_time(rtc_get_time() + expire_s);
+  prv_fake_send_new_data();
+  fake_system_task_callbacks_invoke_pending();
+  cl_assert(prv_get_subscriber_state_from_ref(session_ref) == NULL);
+  cl_assert_equal_b(hrm_is_enabled(HRM), false);
+}
+
+// Changing the features of a subscription restarts the sensor with the new feature union
+void test_hrm_manager__set_features_restarts_sensor(void) {
+  HRMSessionRef session_ref = sys_hrm_manager_app_subscribe(1, 1, 0 /*expire_s*/,
+                                                            HRMFeature_BPM);
+  fake_system_task_callbacks_invoke_pending();
+  cl_assert_equal_i(s_hrm_state.features, HRMFeature_BPM);
+
+  cl_assert(sys_hrm_manager_set_features(session_ref, HRMFeature_BPM | HRMFeature_SpO2));
+  fake_system_task_callbacks_invoke_pending();
+  cl_assert_equal_b(hrm_is_enabled(HRM), true);
+  cl_assert_equal_i(s_hrm_state.features, HRMFeature_BPM | HRMFeature_SpO2);
+
+  sys_hrm_manager_unsubscribe(session_ref);
+}
@@ -11,20 +11,33 @@
 #include "stubs_logging.h"
 #include "stubs_passert.h"
 
+#include <pbl/util/math.h>
+
 #include <string.h>
 
 //! Find a region ID for the given region name.
 //! @return a valid, matching region ID, or -1 if no region was found
 int timezone_database_find_region_by_name(const char *region_name, int region_name_length);
 
+//! Size of the fake resource, shrink it to simulate a database without a name index
+static size_t s_database_size;
+
 #include "resource/resource.h"
 size_t resource_load_byte_range_system(ResAppNum app_num, uint32_t resource_id,
                                        uint32_t start_offset, uint8_t *data, size_t num_bytes) {
+  if (start_offset >= s_database_size) {
+    return 0;
+  }
+  num_bytes = MIN(num_bytes, s_database_size - start_offset);
   memcpy(data, ((uint8_t*) s_timezone_database) + start_offset, num_bytes);
   return num_bytes;
 }
 
-#define FIND_REGION(name) timezone_database_find_region_by_name(name, strlen(name));
+#define FIND_REGION(name) timezone_database_find_region_by_name(name, strlen(name))
+
+void test_timezone_database__initialize(void) {
+  s_database_size = sizeof(s_timezone_database);
+}
 
 void test_timezone_database__get_region_count(void) {
   // Note this test will break every time we update the timezone database and that's ok. Just
@@ -120,3 +133,101 @@ void test_timezone_database__kazakhstan(void) {
     cl_assert_equal_i(tz_info.tm_gmtoff, 5 * 60 * 60); // +5 hours
   }
 }
+
+// Walk the link section of the fixture directly, see the format in service.c
+#define LINK_NAME_LENGTH 33
+#define LINK_BYTES (2 + LINK_NAME_LENGTH)
+
+typedef struct {
+  uint16_t region_count;
+  uint16_t dst_rule_count;
+  uint16_t link_count;
+} FixtureHeader;
+
+static const uint8_t *prv_get_link(int link_index, uint16_t *region_id) {
+  FixtureHeader header;
+  memcpy(&header, s_timezone_database, sizeof(header));
+  const uint8_t *link = s_timezone_database + sizeof(header) + (header.region_count * 24) +
+                        ((header.dst_rule_count - 1) * 16) + (link_index * LINK_BYTES);
+  memcpy(region_id, link, sizeof(*region_id));
+  return link + sizeof(*region_id);
+}
+
+static int prv_get_link_count(void) {
+  FixtureHeader header;
+  memcpy(&header, s_timezone_database, sizeof(header));
+  return header.link_count;
+}
+
+static size_t prv_get_name_index_offset(void) {
+  uint16_t region_id;
+  return prv_get_link(prv_get_link_count(), &region_id) - sizeof(region_id) -
+         s_timezone_database;
+}
+
+static void prv_check_every_name(void) {
+  const int region_count = timezone_database_get_region_count();
+  for (int region_id = 0; region_id < region_count; region_id++) {
+    char region_name[TIMEZONE_NAME_LENGTH];
+    cl_assert(timezone_database_load_region_name(region_id, region_name));
+    cl_assert_equal_i(FIND_REGION(region_name), region_id);
+  }
+
+  const int link_count = prv_get_link_count();
+  cl_assert(link_count > 0);
+  for (int i = 0; i < link_count; i++) {
+    uint16_t region_id;
+    char link_name[LINK_NAME_LENGTH + 1] = {0};
+    memcpy(link_name, prv_get_link(i, &region_id), LINK_NAME_LENGTH);
+    cl_assert(region_id < region_count);
+
+    // A link named after a region resolves to the region, and a name listed by several links
+    // resolves through the first one, just like the linear search
+    int expected_region_id = -1;
+    for (int j = 0; j < region_count && expected_region_id == -1; j++) {
+      char region_name[TIMEZONE_NAME_LENGTH];
+      timezone_database_load_region_name(j, region_name);
+      if (strcmp(region_name, link_name) == 0) {
+        expected_region_id = j;
+      }
+    }
+    for (int j = 0; j < i && expected_region_id == -1; j++) {
+      uint16_t earlier_region_id;
+      if (strncmp((const char *)prv_get_link(j, &earlier_region_id), link_name,
+                  LINK_NAME_LENGTH) == 0) {
+        expected_region_id = earlier_region_id;
+      }
+    }
+    if (expected_region_id == -1) {
+      expected_region_id = region_id;
+    }
+    cl_assert_equal_i(FIND_REGION(link_name), expected_region_id);
+  }
+}
+
+void test_timezone_database__find_every_region_and_link(void) {
+  prv_check_every_name();
+}
+
+void test_timezone_database__find_every_region_and_link_without_index(void) {
+  // Older resource packs end right after the links
+  s_database_size = prv_get_name_index_offset();
+  prv_check_every_name();
+
+  cl_assert_equal_i(FIND_REGION("America/Waterloo"), -1);
+}
+
+void test_timezone_database__name_index_exact_match(void) {
+  cl_assert(FIND_REGION("America/New_York") != -1);
+
+  // Truncated, padded or extended names don't match
+  cl_assert_equal_i(FIND_REGION("America/New_Yor"), -1);
+  cl_assert_equal_i(FIND_REGION("America/New_Yorkk"), -1);
+  cl_assert_equal_i(FIND_REGION("US/Pacifi"), -1);
+  cl_assert_equal_i(FIND_REGION(""), -1);
+
+  // A trailing null counted in the length is ignored
+  const char name[] = "Europe/Minsk";
+  cl_assert_equal_i(timezone_database_find_region_by_name(name, sizeof(name)),
+                    FIND_REGION("Europe/Minsk"));
+}
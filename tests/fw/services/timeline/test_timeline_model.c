@@ -18,7 +18,25 @@
 ////////////////////////////////////////////////////////////////
 #include "fake_spi_flash.h"
 #include "fake_pbl_malloc.h"
+#include "fake_pebble_tasks.h"
 #include "fake_rtc.h"
+#include "fake_system_task.h"
+
+// Route timeline_remove through to the pin db like the real BlobDB does
+status_t blob_db_delete(BlobDBId db_id, const uint8_t *key, int key_len) {
+  cl_assert_equal_i(db_id, BlobDBIdPins);
+  const status_t rv = pin_db_delete(key, key_len);
+  if (rv == S_SUCCESS) {
+    blob_db_event_put(BlobDBEventTypeDelete, db_id, key, key_len);
+  }
+  return rv;
+}
+
+// Handle pin db events the way the shell does before they reach the timeline app
+void blob_db_event_put(BlobDBEventType type, BlobDBId db_id, const uint8_t *key, int key_len) {
+  cl_assert_equal_i(db_id, BlobDBIdPins);
+  timeline_pin_cache_invalidate((const Uuid *)key);
+}
 
 static TimezoneInfo tz = {
   .tm_gmtoff = -8 * 60 * 60, // PST
@@ -30,7 +48,6 @@ static TimezoneInfo tz = {
 #include "stubs_app_cache.h"
 #include "stubs_app_install_manager.h"
 #include "stubs_app_manager.h"
-#include "stubs_blob_db.h"
 #include "stubs_blob_db_sync.h"
 #include "stubs_blob_db_sync_util.h"
 #include "stubs_calendar.h"
@@ -44,7 +61,6 @@ static TimezoneInfo tz = {
 #include "stubs_modal_manager.h"
 #include "stubs_mutex.h"
 #include "stubs_passert.h"
-#include "stubs_pebble_tasks.h"
 #include "stubs_prompt.h"
 #include "stubs_rand_ptr.h"
 #include "stubs_regular_timer.h"
@@ -247,6 +263,9 @@ void test_timeline_model__initialize(void) {
 }
 
 void test_timeline_model__cleanup(void) {
+  // let prefetches queued by tests that never scroll finish, then start the next test cold
+  fake_system_task_callbacks_invoke_pending();
+  timeline_pin_cache_invalidate(NULL);
 }
 
 // Tests
@@ -332,6 +351,8 @@ void test_timeline_model__future(void) {
       &timeline_model_get_iter_state(0)->pin.header.id));
 
   cl_assert(!timeline_model_iter_next(&new_idx, &has_next));
+
+  timeline_model_deinit();
 }
 
 void test_timeline_model__and_back(void) {
@@ -411,6 +432,8 @@ void test_timeline_model__and_back(void) {
   cl_assert(timeline_model_get_iter_state(2) == timeline_model_get_iter_state_with_timeline_idx(2));
 
   cl_assert(!timeline_model_iter_prev(&new_idx, NULL));
+
+  timeline_model_deinit();
 }
 
 void test_timeline_model__graceful_delete_middle(void) {
@@ -428,6 +451,8 @@ void test_timeline_model__graceful_delete_middle(void) {
       &timeline_model_get_iter_state(1)->pin.header.id));
   cl_assert(timeline_model_get_iter_state(0) == timeline_model_get_iter_state_with_timeline_idx(0));
   cl_assert(timeline_model_get_iter_state(1) == timeline_model_get_iter_state_with_timeline_idx(2));
+
+  timeline_model_deinit();
 }
 
 void test_timeline_model__graceful_delete_first(void) {
@@ -445,6 +470,8 @@ void test_timeline_model__graceful_delete_first(void) {
       &timeline_model_get_iter_state(1)->pin.header.id));
   cl_assert(timeline_model_get_iter_state(0) == timeline_model_get_iter_state_with_timeline_idx(1));
   cl_assert(timeline_model_get_iter_state(1) == timeline_model_get_iter_state_with_timeline_idx(2));
+
+  timeline_model_deinit();
 }
 
 void test_timeline_model__graceful_delete_all(void) {
@@ -460,6 +487,8 @@ void test_timeline_model__graceful_delete_all(void) {
   cl_assert_equal_i(timeline_model_get_num_items(), 0);
   cl_assert(!timeline_model_iter_next(NULL, NULL));
   cl_assert(!timeline_model_iter_prev(NULL, NULL));
+
+  timeline_model_deinit();
 }
 
 void test_timeline_model__is_empty(void) {
@@ -476,6 +505,8 @@ void test_timeline_model__is_empty(void) {
   }
 
   cl_assert(timeline_model_is_empty());
+
+  timeline_model_deinit();
 }
 
 void test_timeline_model__is_empty_immediate(void) {
@@ -490,4 +521,170 @@ void test_timeline_model__is_empty_immediate(void) {
   timeline_model_init(first_time, &model);
 
   cl_assert(timeline_model_is_empty());
+
+  timeline_model_deinit();
+}
+
+// The pin right after the two visible ones when scrolling into the future, see s_correct_order
+#define NEXT_PIN_IDX (5)
+
+static TimelineItem prv_changed_next_pin(void) {
+  TimelineItem item = s_items[NEXT_PIN_IDX];
+  item.header.duration = 44;
+  return item;
+}
+
+void test_timeline_model__scrolling_uses_prefetched_pins(void) {
+  TimelineModel model = {0};
+  model.direction = TimelineIterDirectionFuture;
+  timeline_model_init(1421178000, &model);
+  cl_assert(fake_system_task_count_callbacks() > 0);
+  fake_system_task_callbacks_invoke_pending();
+
+  // Change the pin behind the cache's back, scrolling onto it must not go to flash
+  TimelineItem changed = prv_changed_next_pin();
+  cl_assert_equal_i(pin_db_insert_item_without_event(&changed), S_SUCCESS);
+
+  cl_assert(timeline_model_iter_next(NULL, NULL));
+  TimelineItem *pin = &timeline_model_get_iter_state(1)->pin;
+  cl_assert(uuid_equal(&s_items[NEXT_PIN_IDX].header.id, &pin->header.id));
+  cl_assert_equal_i(pin->header.duration, s_items[NEXT_PIN_IDX].header.duration);
+
+  timeline_model_deinit();
+}
+
+void test_timeline_model__add_during_iteration(void) {
+  TimelineModel model = {0};
+  model.direction = TimelineIterDirectionFuture;
+  timeline_model_init(1421178000, &model);
+  fake_system_task_callbacks_invoke_pending();
+
+  TimelineItem changed = prv_changed_next_pin();
+  cl_assert(timeline_add(&changed));
+
+  cl_assert(timeline_model_iter_next(NULL, NULL));
+  TimelineItem *pin = &timeline_model_get_iter_state(1)->pin;
+  cl_assert(uuid_equal(&changed.header.id, &pin->header.id));
+  cl_assert_equal_i(pin->header.duration, changed.header.duration);
+
+  timeline_model_deinit();
+}
+
+void test_timeline_model__remove_during_iteration(void) {
+  TimelineModel model = {0};
+  model.direction = TimelineIterDirectionFuture;
+  timeline_model_init(1421178000, &model);
+  fake_system_task_callbacks_invoke_pending();
+
+  Uuid *removed_id = &s_items[NEXT_PIN_IDX].header.id;
+  cl_assert(timeline_remove(removed_id));
+  cl_assert(timeline_model_iter_next(NULL, NULL));
+  cl_assert(uuid_equal(&s_items[s_correct_order[3]].header.id,
+      &timeline_model_get_iter_state(1)->pin.header.id));
+
+  // Bring it back without an event, the removal must have dropped the cached copy
+  cl_assert(timeline_model_iter_prev(NULL, NULL));
+  fake_system_task_callbacks_invoke_pending();
+  TimelineItem changed = prv_changed_next_pin();
+  cl_assert_equal_i(pin_db_insert_item_without_event(&changed), S_SUCCESS);
+  cl_assert(timeline_model_iter_next(NULL, NULL));
+  TimelineItem *pin = &timeline_model_get_iter_state(1)->pin;
+  cl_assert(uuid_equal(removed_id, &pin->header.id));
+  cl_assert_equal_i(pin->header.duration, changed.header.duration);
+
+  timeline_model_deinit();
+}
+
+void test_timeline_model__prefetch_racing_remove(void) {
+  TimelineModel model = {0};
+  model.direction = TimelineIterDirectionFuture;
+  timeline_model_init(1421178000, &model);
+
+  // The queued prefetch runs only after the pin is gone
+  cl_assert(timeline_remove(&s_items[NEXT_PIN_IDX].header.id));
+  fake_system_task_callbacks_invoke_pending();
+
+  TimelineItem changed = prv_changed_next_pin();
+  cl_assert_equal_i(pin_db_insert_item_without_event(&changed), S_SUCCESS);
+  cl_assert(timeline_model_iter_next(NULL, NULL));
+  cl_assert_equal_i(timeline_model_get_iter_state(1)->pin.header.duration,
+                    changed.header.duration);
+
+  timeline_model_deinit();
+}
+
+void test_timeline_model__blobdb_event_invalidates(void) {
+  TimelineModel model = {0};
+  model.direction = TimelineIterDirectionFuture;
+  timeline_model_init(1421178000, &model);
+  fake_system_task_callbacks_invoke_pending();
+
+  // The pin db emits an event for the write, which the shell handles before the timeline app
+  TimelineItem changed = prv_changed_next_pin();
+  cl_assert_equal_i(pin_db_insert_item(&changed), S_SUCCESS);
+
+  cl_assert(timeline_model_iter_next(NULL, NULL));
+  cl_assert_equal_i(timeline_model_get_iter_state(1)->pin.header.duration,
+                    changed.header.duration);
+
+  timeline_model_deinit();
+}
+
+void test_timeline_model__status_change_invalidates(void) {
+  TimelineModel model = {0};
+  model.direction = TimelineIterDirectionFuture;
+  timeline_model_init(1421178000, &model);
+  fake_system_task_callbacks_invoke_pending();
+
+  // What a peek does once the pin has been shown
+  cl_assert_equal_i(pin_db_set_status_bits(&s_items[NEXT_PIN_IDX].header.id,
+                                           TimelineItemStatusRead), S_SUCCESS);
+
+  cl_assert(timeline_model_iter_next(NULL, NULL));
+  cl_assert(timeline_model_get_iter_state(1)->pin.header.status & TimelineItemStatusRead);
+
+  timeline_model_deinit();
+}
+
+void test_timeline_model__deinit_releases_cache(void) {
+  TimelineModel model = {0};
+  model.direction = TimelineIterDirectionFuture;
+  timeline_model_init(1421178000, &model);
+  fake_system_task_callbacks_invoke_pending();
+  timeline_model_deinit();
+  fake_system_task_callbacks_invoke_pending();
+
+  // Nothing prefetched for the old model may leak into the next one
+  TimelineItem changed = prv_changed_next_pin();
+  cl_assert_equal_i(pin_db_insert_item_without_event(&changed), S_SUCCESS);
+  timeline_model_init(1421178000, &model);
+  cl_assert(timeline_model_iter_next(NULL, NULL));
+  cl_assert_equal_i(timeline_model_get_iter_state(1)->pin.header.duration,
+                    changed.header.duration);
+
+  timeline_model_deinit();
+}
+
+void test_timeline_model__cache_outlives_other_iterators(void) {
+  TimelineModel model = {0};
+  model.direction = TimelineIterDirectionFuture;
+  timeline_model_init(1421178000, &model);
+  fake_system_task_callbacks_invoke_pending();
+  const int cached_allocs = fake_pbl_malloc_num_net_allocs();
+
+  // Another iterator over its own timeline comes and goes
+  TimelineNode *timeline = NULL;
+  cl_assert_equal_i(timeline_init(&timeline), S_SUCCESS);
+  Iterator iter;
+  TimelineIterState state = {0};
+  cl_assert_equal_i(timeline_iter_init(&iter, &state, &timeline, TimelineIterDirectionFuture,
+                                       1421178000), S_SUCCESS);
+  timeline_iter_deinit(&iter, &state, &timeline);
+  fake_system_task_callbacks_invoke_pending();
+  // Its prefetch may have cached a few more pins, but none of the model's were dropped
+  cl_assert(fake_pbl_malloc_num_net_allocs() >= cached_allocs);
+
+  // Dropping the last iterator releases the cache
+  timeline_model_deinit();
+  cl_assert_equal_i(fake_pbl_malloc_num_net_allocs(), 0);
 }
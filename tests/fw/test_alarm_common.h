@@ -148,7 +148,7 @@ const char *timeline_get_private_data_source(Uuid *parent_id) {
   return NULL;
 }
 
-status_t pin_db_insert_item_without_event(TimelineItem *item) {
+status_t pin_db_insert_item(TimelineItem *item) {
   s_num_timeline_adds++;
   timeline_item_destroy(s_last_timeline_item_added);
   s_last_timeline_item_added = timeline_item_copy(item);
@@ -54,6 +54,7 @@
 #include "stubs_task_watchdog.h"
 #include "stubs_reboot_reason.h"
 
+#include <setjmp.h>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -459,6 +460,82 @@ void test_data_logging__recover_five(void) {
   prv_do_recovery_test(5);
 }
 
+// ----------------------------------------------------------------------------------------
+//! Log a write that spans several chunks to an unbuffered session and simulate a reset after
+//! after_n_bytes have been written to flash. Returns false if the write completed before that.
+static bool prv_log_with_reset_after_bytes(int after_n_bytes) {
+  const int old_bytes = 150;
+  const int new_bytes = 350;
+  uint8_t data[old_bytes + new_bytes];
+  for (unsigned int i = 0; i < sizeof(data); i++) {
+    data[i] = (uint8_t)(i * 7 + 1);
+  }
+
+  Uuid system_uuid = UUID_SYSTEM;
+  DataLoggingSession *session = dls_create(0, DATA_LOGGING_BYTE_ARRAY, 1, false /*buffered*/,
+                                           false /*resume*/, &system_uuid);
+  cl_assert(session);
+  cl_assert_equal_i(DATA_LOGGING_SUCCESS, dls_log(session, data, old_bytes));
+
+  jmp_buf jmp;
+  if (setjmp(jmp)) {
+    // Simulate a reboot by clearing out PFS's and data logging's RAM state and rebuilding the
+    // sessions from flash
+    fake_spi_flash_force_future_failure(0, NULL);
+    extern void pfs_reset_all_state(void);
+    pfs_reset_all_state();
+    pfs_init(false);
+    dls_list_remove_all();
+    regular_timer_deinit();
+    regular_timer_init();
+    dls_init();
+    fake_system_task_callbacks_invoke_pending();
+
+    // The header of the batch's first chunk is the last thing written, so none of the
+    // interrupted write may be recovered, not even the chunks that made it out whole
+    session = dls_list_get_next(NULL);
+    cl_assert(session);
+    uint8_t buffer[sizeof(data)];
+    cl_assert_equal_i(old_bytes, dls_test_get_num_bytes(session));
+    cl_assert_equal_i(old_bytes, dls_test_read(session, buffer, sizeof(buffer)));
+    cl_assert_equal_m(buffer, data, old_bytes);
+
+    // Writing to the storage again must not land on the flash the interrupted write left
+    // programmed. Write something else than what was interrupted so that it would show.
+    for (unsigned int i = old_bytes; i < sizeof(data); i++) {
+      data[i] = ~data[i];
+    }
+    cl_assert(dls_storage_write_data(session, &data[old_bytes], new_bytes));
+    cl_assert_equal_i(sizeof(data), dls_test_get_num_bytes(session));
+    cl_assert_equal_i(sizeof(data), dls_test_read(session, buffer, sizeof(buffer)));
+    cl_assert_equal_m(buffer, data, sizeof(data));
+    return true;
+  }
+  fake_spi_flash_force_future_failure(after_n_bytes, &jmp);
+
+  cl_assert_equal_i(DATA_LOGGING_SUCCESS, dls_log(session, &data[old_bytes], new_bytes));
+  fake_spi_flash_force_future_failure(0, NULL);
+  return false;
+}
+
+void test_data_logging__reset_during_write(void) {
+  int num_resets = 0;
+  while (true) {
+    dls_list_remove_all();
+    extern void pfs_reset_all_state(void);
+    pfs_reset_all_state();
+    prv_init_fake_flash();
+
+    if (!prv_log_with_reset_after_bytes(num_resets)) {
+      break;
+    }
+    num_resets++;
+  }
+  // Make sure we actually interrupted the data write and not just the header write
+  cl_assert(num_resets > 350);
+}
+
+
 // ----------------------------------------------------------------------------------------
 //! Try passing garbage pointers to sessions to data logging functions.
 void test_data_logging__invalid_session_garbage(void) {
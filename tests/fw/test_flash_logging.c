@@ -9,6 +9,7 @@
 #include "pbl/util/size.h"
 #include "pbl/util/string.h"
 
+#include "fake_rtc.h"
 #include "fake_spi_flash.h"
 #include "fake_system_task.h"
 
@@ -29,6 +30,8 @@
 
 void test_flash_logging__initialize(void) {
   fake_spi_flash_init(0, BOARD_NOR_FLASH_SIZE);
+  fake_rtc_init(0, 0);
+  fake_rtc_auto_increment_ticks(0);
 }
 
 void test_flash_logging__cleanup(void) {
@@ -50,7 +53,7 @@ typedef struct {
 static ExpectedMessage s_msg;
 
 void test_flash_logging_get_info(uint32_t *tot_size, uint32_t *erase_unit_size,
-    uint32_t *chunk_size, uint32_t *page_hdr_size);
+    uint32_t *chunk_size, uint32_t *page_overhead);
 
 const uint8_t *version_get_build_id(size_t *out_len) {
   static uint8_t build_id[20] = {
@@ -125,18 +128,10 @@ static void prv_flash_log_dump_completed_cb(bool success) {
   s_completed_success = success;
 }
 
-static void setup_and_test_expected_msg(char **msg_arr, int log_gen,
-    int start_idx, int num_items) {
-
-  for (int i = start_idx; i < num_items; i++) {
-    char *msg = msg_arr[i];
-    uint32_t addr = flash_logging_log_start(strlen(msg));
-    cl_assert(addr != FLASH_LOG_INVALID_ADDR);
-
-    bool rv = flash_logging_write((uint8_t *)msg, addr, strlen(msg));
-    cl_assert(rv);
-  }
-
+//! Dumps the given generation and checks it holds exactly the messages in msg_arr
+//! @return the number of system task callbacks the dump took
+static int prv_dump_and_test_expected_msg(char **msg_arr, int log_gen, time_t since_utc,
+                                          int num_items) {
   ExpectedMessage newmsg = {
     .msg_arr = msg_arr,
     .curr_msg_idx = 0,
@@ -147,15 +142,33 @@ static void setup_and_test_expected_msg(char **msg_arr, int log_gen,
   s_msg = newmsg;
 
   s_completed = false;
-  bool success = flash_dump_log_file(log_gen, prv_flash_log_line_dump,
-                                     prv_flash_log_dump_completed_cb);
+  bool success = flash_dump_log_file_since(log_gen, since_utc, prv_flash_log_line_dump,
+                                           prv_flash_log_dump_completed_cb);
   cl_assert(success);
+  int num_callbacks = 0;
   while (!s_completed) {
-    fake_system_task_callbacks_invoke_pending();
+    fake_system_task_callbacks_invoke(1);
+    num_callbacks++;
   }
   cl_assert(s_completed_success);
 
   cl_assert_equal_i(s_msg.num_processed, s_msg.num_items);
+  return num_callbacks;
+}
+
+static void setup_and_test_expected_msg(char **msg_arr, int log_gen,
+    int start_idx, int num_items) {
+
+  for (int i = start_idx; i < num_items; i++) {
+    char *msg = msg_arr[i];
+    uint32_t addr = flash_logging_log_start(strlen(msg));
+    cl_assert(addr != FLASH_LOG_INVALID_ADDR);
+
+    bool rv = flash_logging_write((uint8_t *)msg, addr, strlen(msg));
+    cl_assert(rv);
+  }
+
+  prv_dump_and_test_expected_msg(msg_arr, log_gen, 0, num_items);
 }
 
 static char **generate_unique_logs(size_t space_avail, size_t log_len,
@@ -215,8 +228,9 @@ void test_flash_logging__basic(void) {
 //! Auto generate unique log messages of uniform length which span multiple log
 //! chunks. Try several log message lengths
 void test_flash_logging__multi_region(void) {
-  const uint32_t header_overhead = 8 * 28;
-  const uint32_t space_avail = 64 * 1024 - header_overhead;
+  uint32_t tot_size, erase_size, page_size, page_overhead;
+  test_flash_logging_get_info(&tot_size, &erase_size, &page_size, &page_overhead);
+  const uint32_t space_avail = 64 * 1024 - 8 * page_overhead;
 
   for (int log_len = 2; log_len < 128; log_len += 3) {
     test_flash_logging__cleanup();
@@ -233,27 +247,70 @@ void test_flash_logging__multi_region(void) {
 void test_flash_logging__wrap(void) {
   flash_logging_init();
 
-  uint32_t tot_size, erase_size, page_size, page_hdr_size;
+  uint32_t tot_size, erase_size, page_size, page_overhead;
 
   test_flash_logging_get_info(&tot_size, &erase_size, &page_size,
-      &page_hdr_size);
+      &page_overhead);
 
   int num_pages = tot_size / page_size;
 
-  uint32_t space_avail = tot_size - num_pages * page_hdr_size;
+  uint32_t space_avail = tot_size - num_pages * page_overhead;
 
   // make sure the logs are of an appropriate size such that each page will
   // be entirely filled
   int log_len = 2;
-  cl_assert((page_size - page_hdr_size) % (2 + log_len) == 0);
+  cl_assert((page_size - page_overhead) % (2 + log_len) == 0);
 
   // fill up all of our log record space
   int num_logs;
   char **logs = generate_unique_logs(space_avail, log_len, &num_logs);
-  setup_and_test_expected_msg(logs, 0, 0, num_logs);
+  for (int i = 0; i < num_logs; i++) {
+    uint32_t addr = flash_logging_log_start(log_len);
+    cl_assert(addr != FLASH_LOG_INVALID_ADDR);
+    cl_assert(flash_logging_write((uint8_t *)logs[i], addr, log_len));
+  }
 
-  // write two more additional logs which should cause the first erase
-  // region to get erased
+  // the first erase region gets erased ahead of time while the last page fills
+  // up, so only the logs after it remain
+  int start_log = num_logs / (tot_size / erase_size);
+  int num_wrapped = num_logs - start_log;
+  setup_and_test_expected_msg(&logs[start_log], 0, num_wrapped, num_wrapped);
+
+  // write two more additional logs which should land in the first erase region
+  logs = realloc(logs, sizeof(char *) * (num_logs + 2));
+  logs[num_logs] = task_strdup("Let's test if wrap around is working!");
+  logs[num_logs + 1] = task_strdup("This should be on an early page");
+
+  setup_and_test_expected_msg(&logs[start_log], 0, num_wrapped, num_wrapped + 2);
+
+  free_logs(logs, num_logs + 2);
+}
+
+//! Same as wrap, but the erase started ahead of time only completes once the log
+//! crosses into its unit, as when the timer task which polls it is the one logging
+void test_flash_logging__wrap_pre_erase_completes_late(void) {
+  fake_spi_flash_defer_erase_completion(true);
+  flash_logging_init();
+
+  uint32_t tot_size, erase_size, page_size, page_overhead;
+  test_flash_logging_get_info(&tot_size, &erase_size, &page_size, &page_overhead);
+  const int num_pages = tot_size / page_size;
+  const uint32_t space_avail = tot_size - num_pages * page_overhead;
+  const int log_len = 2;
+
+  int num_logs;
+  char **logs = generate_unique_logs(space_avail, log_len, &num_logs);
+  for (int i = 0; i < num_logs; i++) {
+    uint32_t addr = flash_logging_log_start(log_len);
+    cl_assert(addr != FLASH_LOG_INVALID_ADDR);
+    cl_assert(flash_logging_write((uint8_t *)logs[i], addr, log_len));
+  }
+
+  // Nothing has been erased yet
+  setup_and_test_expected_msg(logs, 0, num_logs, num_logs);
+
+  // Crossing into the first erase region completes its erase before the logs land in it
+  const uint32_t erases_before = fake_flash_erase_count();
   logs = realloc(logs, sizeof(char *) * (num_logs + 2));
   logs[num_logs] = task_strdup("Let's test if wrap around is working!");
   logs[num_logs + 1] = task_strdup("This should be on an early page");
@@ -261,6 +318,7 @@ void test_flash_logging__wrap(void) {
   int start_log = num_logs / (tot_size / erase_size);
   int num_wrapped = num_logs - start_log;
   setup_and_test_expected_msg(&logs[start_log], 0, num_wrapped, num_wrapped + 2);
+  cl_assert_equal_i(fake_flash_erase_count() - erases_before, 1);
 
   free_logs(logs, num_logs + 2);
 }
@@ -269,9 +327,9 @@ void test_flash_logging__wrap(void) {
 //! the most recent generations are not removed during reboots.
 void test_flash_logging__generations(void) {
 
-  uint32_t tot_size, erase_size, page_size, page_hdr_size;
+  uint32_t tot_size, erase_size, page_size, page_overhead;
   test_flash_logging_get_info(&tot_size, &erase_size, &page_size,
-      &page_hdr_size);
+      &page_overhead);
 
   int gens_avail = (tot_size - erase_size) / page_size;
 
@@ -333,9 +391,9 @@ void test_flash_logging__long_lived_log(void) {
   bool rv = flash_logging_write((uint8_t *)msg, start_addr, 1);
   cl_assert(rv);
 
-  uint32_t tot_size, erase_size, page_size, page_hdr_size;
+  uint32_t tot_size, erase_size, page_size, page_overhead;
   test_flash_logging_get_info(&tot_size, &erase_size, &page_size,
-      &page_hdr_size);
+      &page_overhead);
 
   uint32_t addr = FLASH_LOG_INVALID_ADDR;
   int loop_count = 0;
@@ -430,3 +488,282 @@ void test_flash_logging__multi_writes_per_log(void) {
 
   setup_and_test_expected_msg(logs, 0, num_logs, num_logs);
 }
+
+//! Messages logged in a batch are only programmed when it is flushed (or the
+//! stage fills up) and come back in the order they were logged
+void test_flash_logging__batch_ordering(void) {
+  flash_logging_init();
+
+  const int log_len = 20;
+  int num_logs = 0;
+  char **logs = generate_unique_logs(3000, log_len, &num_logs);
+
+  flash_logging_begin_batch();
+  const uint32_t writes_before = fake_flash_write_count();
+  uint32_t first_addr = FLASH_LOG_INVALID_ADDR;
+  for (int i = 0; i < num_logs; i++) {
+    uint32_t addr = flash_logging_log_start(log_len);
+    cl_assert(addr != FLASH_LOG_INVALID_ADDR);
+    if (i == 0) {
+      first_addr = addr;
+      // Not programmed yet
+      cl_assert_equal_i(fake_flash_write_count(), writes_before);
+    }
+    cl_assert(flash_logging_write((uint8_t *)logs[i], addr, log_len));
+  }
+  flash_logging_flush();
+
+  // The records were programmed a stage at a time, not one by one
+  const uint32_t writes = fake_flash_write_count() - writes_before;
+  cl_assert(writes < (uint32_t)num_logs / 4);
+
+  uint8_t hdr[2];
+  flash_read_bytes(hdr, first_addr, sizeof(hdr));
+  cl_assert_equal_i(hdr[1], log_len);
+
+  setup_and_test_expected_msg(logs, 0, num_logs, num_logs);
+  free_logs(logs, num_logs);
+}
+
+//! Batched logging that keeps wrapping around the region over several
+//! generations leaves the most recent generations intact
+void test_flash_logging__batch_wrap_generations(void) {
+  uint32_t tot_size, erase_size, page_size, page_overhead;
+  test_flash_logging_get_info(&tot_size, &erase_size, &page_size, &page_overhead);
+
+  const int log_len = 30;
+  const int logs_per_page = (page_size - page_overhead) / (sizeof(uint16_t) + log_len);
+  // Each generation uses a bit over a third of the region, so it wraps every third boot
+  const int logs_per_gen = (tot_size / page_size) * logs_per_page / 3 + 1;
+
+  int num_logs = 0;
+  char **logs = generate_unique_logs(logs_per_gen * (sizeof(uint16_t) + log_len), log_len,
+                                     &num_logs);
+  cl_assert_equal_i(num_logs, logs_per_gen);
+
+  for (int gen = 0; gen < 7; gen++) {
+    flash_logging_init();
+    flash_logging_begin_batch();
+    for (int i = 0; i < num_logs; i++) {
+      // A different message per generation
+      logs[i][0] = 'a' + gen;
+      uint32_t addr = flash_logging_log_start(log_len);
+      cl_assert(addr != FLASH_LOG_INVALID_ADDR);
+      cl_assert(flash_logging_write((uint8_t *)logs[i], addr, log_len));
+    }
+    flash_logging_flush();
+
+    setup_and_test_expected_msg(logs, 0, num_logs, num_logs);
+    if (gen > 0) {
+      // The previous generation survives too
+      for (int i = 0; i < num_logs; i++) {
+        logs[i][0] = 'a' + gen - 1;
+      }
+      setup_and_test_expected_msg(logs, 1, num_logs, num_logs);
+    }
+  }
+
+  free_logs(logs, num_logs);
+}
+
+static char **s_power_loss_logs;
+static int s_power_loss_num_dumped;
+static bool prv_power_loss_line_dump(uint8_t *msg, uint32_t tot_len) {
+  if (s_power_loss_num_dumped++ == 0) {
+    return true; // build id
+  }
+  const char *expected = s_power_loss_logs[s_power_loss_num_dumped - 2];
+  cl_assert_equal_i(tot_len, strlen(expected));
+  cl_assert(memcmp(msg, expected, tot_len) == 0);
+  return true;
+}
+
+//! Cut the power after every byte programmed while flushing a batch that
+//! crosses into a new page and check that after a reboot the previous boot's
+//! log holds exactly the messages that were logged, in order, up to some point
+void test_flash_logging__batch_power_loss(void) {
+  uint32_t tot_size, erase_size, page_size, page_overhead;
+  test_flash_logging_get_info(&tot_size, &erase_size, &page_size, &page_overhead);
+
+  const int log_len = 30;
+  const int rec_size = sizeof(uint16_t) + log_len;
+  // Leave room for a few messages of the batch on the first page
+  const int num_durable = (page_size - page_overhead) / rec_size - 4;
+  const int num_batched = 20;
+  int num_logs = 0;
+  char **logs = generate_unique_logs((num_durable + num_batched) * rec_size, log_len, &num_logs);
+  cl_assert_equal_i(num_logs, num_durable + num_batched);
+  s_power_loss_logs = logs;
+
+  bool completed = false;
+  int max_dumped = 0;
+  for (int fail_after = 0; !completed; fail_after++) {
+    for (uint32_t addr = FLASH_REGION_DEBUG_DB_BEGIN; addr < FLASH_REGION_DEBUG_DB_END;
+         addr += erase_size) {
+      flash_erase_subsector_blocking(addr);
+    }
+    flash_logging_init();
+    for (int i = 0; i < num_durable; i++) {
+      uint32_t addr = flash_logging_log_start(log_len);
+      cl_assert(flash_logging_write((uint8_t *)logs[i], addr, log_len));
+    }
+
+    jmp_buf power_loss;
+    if (setjmp(power_loss) == 0) {
+      flash_logging_begin_batch();
+      fake_spi_flash_force_future_failure(fail_after, &power_loss);
+      for (int i = num_durable; i < num_logs; i++) {
+        uint32_t addr = flash_logging_log_start(log_len);
+        cl_assert(flash_logging_write((uint8_t *)logs[i], addr, log_len));
+      }
+      flash_logging_flush();
+      completed = true;
+    }
+    fake_spi_flash_force_future_failure(0, NULL);
+
+    // Reboot
+    flash_logging_init();
+    s_power_loss_num_dumped = 0;
+    s_completed = false;
+    cl_assert(flash_dump_log_file(1, prv_power_loss_line_dump, prv_flash_log_dump_completed_cb));
+    while (!s_completed) {
+      fake_system_task_callbacks_invoke_pending();
+    }
+    cl_assert(s_completed_success);
+
+    const int num_dumped = s_power_loss_num_dumped - 1;
+    cl_assert(num_dumped >= num_durable);
+    cl_assert(num_dumped >= max_dumped);
+    max_dumped = num_dumped;
+  }
+  cl_assert_equal_i(max_dumped, num_logs);
+
+  free_logs(logs, num_logs);
+}
+
+static void prv_write_logs(char **msg_arr, int num_logs) {
+  for (int i = 0; i < num_logs; i++) {
+    uint32_t addr = flash_logging_log_start(strlen(msg_arr[i]));
+    cl_assert(addr != FLASH_LOG_INVALID_ADDR);
+    cl_assert(flash_logging_write((uint8_t *)msg_arr[i], addr, strlen(msg_arr[i])));
+  }
+}
+
+//! Fills up two pages an hour apart and starts on a third. Returns the logs written and the flash
+//! address of the first page.
+static char **prv_write_timed_pages(int *logs_per_page, int *num_logs, uint32_t *first_page) {
+  uint32_t tot_size, erase_size, page_size, page_overhead;
+  test_flash_logging_get_info(&tot_size, &erase_size, &page_size, &page_overhead);
+
+  // Records of this length fill a page exactly
+  const int log_len = 14;
+  cl_assert((page_size - page_overhead) % (2 + log_len) == 0);
+  *logs_per_page = (page_size - page_overhead) / (2 + log_len);
+  *num_logs = 2 * *logs_per_page + 5;
+  int generated;
+  char **logs = generate_unique_logs(*num_logs * (2 + log_len), log_len, &generated);
+  cl_assert_equal_i(generated, *num_logs);
+
+  fake_rtc_init(0, 1000);
+  flash_logging_init();
+  *first_page = flash_logging_log_start(log_len);
+  cl_assert(flash_logging_write((uint8_t *)logs[0], *first_page, log_len));
+  *first_page -= *first_page % page_size;
+  prv_write_logs(&logs[1], *logs_per_page - 1);
+
+  // The first page fills up at 2000 and the second one at 3000
+  fake_rtc_increment_time(1000);
+  prv_write_logs(&logs[*logs_per_page], *logs_per_page);
+  fake_rtc_increment_time(1000);
+  prv_write_logs(&logs[2 * *logs_per_page], 5);
+  return logs;
+}
+
+//! Dumping from a point in time skips the pages that filled up before it
+void test_flash_logging__dump_since(void) {
+  int logs_per_page, num_logs;
+  uint32_t first_page;
+  char **logs = prv_write_timed_pages(&logs_per_page, &num_logs, &first_page);
+
+  prv_dump_and_test_expected_msg(logs, 0, 0, num_logs);
+  prv_dump_and_test_expected_msg(logs, 0, 2000, num_logs);
+  prv_dump_and_test_expected_msg(&logs[logs_per_page], 0, 2001, num_logs - logs_per_page);
+  prv_dump_and_test_expected_msg(&logs[2 * logs_per_page], 0, 3001, 5);
+  // The page still being written is always dumped
+  prv_dump_and_test_expected_msg(&logs[2 * logs_per_page], 0, 5000, 5);
+
+  free_logs(logs, num_logs);
+}
+
+//! A page whose summary doesn't check out is scanned record by record instead
+void test_flash_logging__dump_corrupt_summary(void) {
+  int logs_per_page, num_logs;
+  uint32_t first_page;
+  char **logs = prv_write_timed_pages(&logs_per_page, &num_logs, &first_page);
+
+  uint32_t tot_size, erase_size, page_size, page_overhead;
+  test_flash_logging_get_info(&tot_size, &erase_size, &page_size, &page_overhead);
+
+  // Clear some bits of the crc, the last field of the summary
+  const uint8_t zero = 0;
+  flash_write_bytes(&zero, first_page + page_size - 1, sizeof(zero));
+
+  // The first page can no longer be skipped, but all its records are still there
+  prv_dump_and_test_expected_msg(logs, 0, 2001, num_logs);
+
+  free_logs(logs, num_logs);
+}
+
+//! Each system task callback sends as many messages as it can within its time budget
+void test_flash_logging__dump_batches(void) {
+  flash_logging_init();
+
+  int num_logs;
+  char **logs = generate_unique_logs(300 * 22, 20, &num_logs);
+  prv_write_logs(logs, num_logs);
+
+  // With the clock standing still, one callback for the build ID and one for the messages
+  cl_assert_equal_i(prv_dump_and_test_expected_msg(logs, 0, 0, num_logs), 2);
+
+  // Each message takes a tick, so the budget runs out every DUMP_LOG_TIME_BUDGET_MS messages
+  fake_rtc_auto_increment_ticks(1);
+  const int num_callbacks = prv_dump_and_test_expected_msg(logs, 0, 0, num_logs);
+  cl_assert(num_callbacks > num_logs / 25);
+  cl_assert(num_callbacks < num_logs / 10);
+
+  free_logs(logs, num_logs);
+}
+
+static int s_refuse_count;
+static bool prv_refusing_line_dump(uint8_t *msg, uint32_t tot_len) {
+  // Refuse every other attempt at a few messages in the middle
+  if (s_msg.num_processed >= 10 && s_msg.num_processed < 13 && (s_refuse_count++ % 2) == 0) {
+    return false;
+  }
+  return prv_flash_log_line_dump(msg, tot_len);
+}
+
+//! A message the receiver can't take right away is sent again rather than dropped
+void test_flash_logging__dump_retries_message(void) {
+  flash_logging_init();
+
+  int num_logs;
+  char **logs = generate_unique_logs(20 * 22, 20, &num_logs);
+  prv_write_logs(logs, num_logs);
+
+  s_msg = (ExpectedMessage) {
+    .msg_arr = logs,
+    .num_items = num_logs + 1,
+  };
+  s_refuse_count = 0;
+  s_completed = false;
+  cl_assert(flash_dump_log_file(0, prv_refusing_line_dump, prv_flash_log_dump_completed_cb));
+  while (!s_completed) {
+    fake_system_task_callbacks_invoke_pending();
+  }
+  cl_assert(s_completed_success);
+  cl_assert_equal_i(s_msg.num_processed, s_msg.num_items);
+  cl_assert_equal_i(s_refuse_count, 6);
+
+  free_logs(logs, num_logs);
+}
@@ -9,6 +9,7 @@
 #include "pbl/services/filesystem/pfs.h"
 #include "resource/resource_ids.auto.h"
 #include "flash_region/flash_region.h"
+#include "pbl/util/size.h"
 
 #define I18N_FIXTURE_PATH "i18n"
 
@@ -60,20 +61,20 @@ void test_i18n__initialize(void) {
 void test_i18n__cleanup(void) {
 }
 
-extern I18nString *prv_list_find_string(const char *string, void * owner);
+extern I18nString *prv_string_cache_find(const char *string, void * owner);
 
 void test_i18n__music(void) {
   const char *first = i18n_get("Music", (void *)0x12345);
   cl_assert(strcmp(first, "Musique") == 0);
-  cl_assert(prv_list_find_string("Music", (void *)0x12345) != NULL);
+  cl_assert(prv_string_cache_find("Music", (void *)0x12345) != NULL);
   const char *second = i18n_get("Music", (void *)0x12345);
   cl_assert(first == second);
   const char *third = i18n_get("Music", (void *)0xdeadbeef);
   cl_assert(first != third);
   i18n_free_all((void *)0x12345);
-  cl_assert(prv_list_find_string("Music", (void *)0xdeadbeef)->translated_string == third);
+  cl_assert(prv_string_cache_find("Music", (void *)0xdeadbeef)->translated_string == third);
   i18n_free_all((void *)0xdeadbeef);
-  cl_assert(prv_list_find_string("Music", __FILE__) == NULL);
+  cl_assert(prv_string_cache_find("Music", __FILE__) == NULL);
   // this should be a no-op
   i18n_free("Music", __FILE__);
 }
@@ -128,9 +129,9 @@ void test_i18n__ctxt_get(void) {
   cl_assert(fourth == second);
 
   i18n_free(ctxt_txt_1, __FILE__);
-  cl_assert(prv_list_find_string(ctxt_txt_1, __FILE__) == NULL);
+  cl_assert(prv_string_cache_find(ctxt_txt_1, __FILE__) == NULL);
   i18n_ctx_free("Quiet Time", "Enabled", __FILE__);
-  cl_assert(prv_list_find_string(ctxt_txt_2, __FILE__) == NULL);
+  cl_assert(prv_string_cache_find(ctxt_txt_2, __FILE__) == NULL);
 }
 
 void test_i18n__ctxt_get_length(void) {
@@ -173,3 +174,110 @@ void test_i18n__reset_language(void) {
   test_i18n__cleanup();
   test_i18n__initialize();
 }
+
+void test_i18n__lookup_flash_reads(void) {
+  uint32_t flash_reads = fake_flash_read_count();
+  const char *first = i18n_get("Music", (void *)0x12345);
+  cl_assert_equal_s(first, "Musique");
+  cl_assert(fake_flash_read_count() > flash_reads);
+
+  // Cached per owner
+  flash_reads = fake_flash_read_count();
+  cl_assert(i18n_get("Music", (void *)0x12345) == first);
+  cl_assert_equal_s(i18n_get("abcd", (void *)0x12345), "abcd");
+  const uint32_t miss_reads = fake_flash_read_count() - flash_reads;
+  flash_reads = fake_flash_read_count();
+  cl_assert_equal_s(i18n_get("abcd", (void *)0x12345), "abcd");
+  cl_assert_equal_i(fake_flash_read_count() - flash_reads, 0);
+
+  // Probing the pack for a string it doesn't have only compares lengths against the lengths of
+  // its original strings, which are kept in RAM
+  cl_assert_equal_i(miss_reads, 0);
+
+  i18n_free_all((void *)0x12345);
+  flash_reads = fake_flash_read_count();
+  cl_assert(i18n_get("Music", (void *)0x12345) != NULL);
+  cl_assert(fake_flash_read_count() > flash_reads);
+  i18n_free_all((void *)0x12345);
+}
+
+//! Enough strings for a few owners to grow the cache, freed one at a time and by owner
+void test_i18n__string_cache_owners(void) {
+  void *owners[] = { (void *)0x1000, (void *)0x2000, (void *)0x3000 };
+  char originals[100][16];
+  const char *translations[ARRAY_LENGTH(owners)][ARRAY_LENGTH(originals)];
+  for (unsigned int i = 0; i < ARRAY_LENGTH(originals); i++) {
+    snprintf(originals[i], sizeof(originals[i]), "string %u", i);
+  }
+  strcpy(originals[0], "Music");
+
+  for (unsigned int i = 0; i < ARRAY_LENGTH(originals); i++) {
+    for (unsigned int o = 0; o < ARRAY_LENGTH(owners); o++) {
+      translations[o][i] = i18n_get(originals[i], owners[o]);
+    }
+  }
+  cl_assert_equal_s(translations[1][0], "Musique");
+  cl_assert(translations[0][0] != translations[1][0]);
+
+  // Free every third string of the first owner and all strings of the second
+  for (unsigned int i = 0; i < ARRAY_LENGTH(originals); i += 3) {
+    i18n_free(originals[i], owners[0]);
+  }
+  i18n_free_all(owners[1]);
+
+  for (unsigned int i = 0; i < ARRAY_LENGTH(originals); i++) {
+    I18nString *first = prv_string_cache_find(originals[i], owners[0]);
+    cl_assert_equal_b(first == NULL, (i % 3) == 0);
+    cl_assert(prv_string_cache_find(originals[i], owners[1]) == NULL);
+    I18nString *third = prv_string_cache_find(originals[i], owners[2]);
+    cl_assert(third);
+    cl_assert_equal_s(third->original_string, originals[i]);
+    if (i > 0) {
+      cl_assert(i18n_get(originals[i], owners[2]) == originals[i]);
+    }
+  }
+  cl_assert(i18n_get(originals[0], owners[2]) == translations[2][0]);
+
+  i18n_free_all(owners[0]);
+  i18n_free_all(owners[2]);
+  for (unsigned int i = 0; i < ARRAY_LENGTH(originals); i++) {
+    for (unsigned int o = 0; o < ARRAY_LENGTH(owners); o++) {
+      cl_assert(prv_string_cache_find(originals[i], owners[o]) == NULL);
+    }
+  }
+}
+
+#define BENCHMARK_LOOKUPS 500
+
+//! A localized menu looks up the title of every visible row on every render
+void test_i18n__lookup_benchmark(void) {
+  static const char *rows[] = {
+    "Music", "Notifications", "Disabled", "10 minutes", "About average", "AM", "1 hour",
+    "5 Seconds", "<Untitled>", "abcd",
+  };
+  void *menu = (void *)0x4000;
+
+  uint32_t flash_reads = fake_flash_read_count();
+  for (unsigned int i = 0; i < BENCHMARK_LOOKUPS; i++) {
+    char buffer[40];
+    i18n_get_with_buffer(rows[i % ARRAY_LENGTH(rows)], buffer, sizeof(buffer));
+  }
+  const uint32_t uncached_reads = fake_flash_read_count() - flash_reads;
+
+  flash_reads = fake_flash_read_count();
+  for (unsigned int i = 0; i < BENCHMARK_LOOKUPS; i++) {
+    i18n_get(rows[i % ARRAY_LENGTH(rows)], menu);
+  }
+  const uint32_t cached_reads = fake_flash_read_count() - flash_reads;
+
+  // Only the first render of the menu reads the pack
+  flash_reads = fake_flash_read_count();
+  for (unsigned int i = 0; i < ARRAY_LENGTH(rows); i++) {
+    i18n_get(rows[i], menu);
+  }
+  cl_assert_equal_i(fake_flash_read_count(), flash_reads);
+  i18n_free_all(menu);
+
+  cl_assert(cached_reads > 0);
+  cl_assert(cached_reads * (BENCHMARK_LOOKUPS / ARRAY_LENGTH(rows)) <= uncached_reads);
+}
@@ -131,6 +131,9 @@ BaseType_t event_queue_cleanup_and_reset(QueueHandle_t queue) {
 void event_service_clear_process_subscriptions(void) {
 }
 
+void timeline_process_cleanup(void) {
+}
+
 bool app_install_entry_is_watchface(const AppInstallEntry *entry) {
   return false;
 }
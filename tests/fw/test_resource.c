@@ -5,14 +5,23 @@
 #include "resource/resource_storage.h"
 #include "resource/resource_storage_impl.h"
 
+#include <pbl/drivers/flash.h>
+#include "flash_region/flash_region.h"
+#include "pbl/services/filesystem/app_file.h"
+#include "pbl/services/filesystem/pfs.h"
+
 #include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
 
 #include "clar.h"
 #include "fixtures/load_test_resources.h"
+#include "pbl/util/size.h"
 
 // Fakes
 #include "fake_app_manager.h"
 #include "fake_bootbits.h"
+#include "fake_spi_flash.h"
 
 // Stubs
 #include "stubs_analytics.h"
@@ -429,3 +438,257 @@ void test_resource__overflow_data_section_length(void) {
   cl_assert_equal_i(prv_get_store_length(&entry, &manifest), 0);
 }
 
+
+extern void resource_cache_get_stats(uint32_t *hits, uint32_t *misses);
+
+static void prv_load_app_bank(void) {
+  char filename[32];
+  resource_storage_get_file_name(filename, sizeof(filename), resource_bank);
+  load_resource_fixture_on_pfs(RESOURCES_FIXTURE_PATH, APP_RESOURCES_FIXTURE_NAME, filename);
+}
+
+static void prv_assert_cache_stats(uint32_t hits, uint32_t misses,
+                                   uint32_t expected_hits, uint32_t expected_misses) {
+  uint32_t now_hits, now_misses;
+  resource_cache_get_stats(&now_hits, &now_misses);
+  cl_assert_equal_i(now_hits - hits, expected_hits);
+  cl_assert_equal_i(now_misses - misses, expected_misses);
+}
+
+//! Resources of both banks are only looked up in storage the first time
+void test_resource__cache_hits_and_misses(void) {
+  resource_init();
+  prv_load_app_bank();
+  load_resource_fixture_on_pfs(RESOURCES_FIXTURE_PATH, PUG_FIXTURE_NAME, "pug");
+
+  uint32_t hits, misses;
+  resource_cache_get_stats(&hits, &misses);
+
+  const size_t system_size = resource_size(SYSTEM_APP, RESOURCE_ID_GOTHIC_18_BOLD);
+  cl_assert(system_size > 0);
+  const size_t app_size = resource_size(resource_bank, no_litter_res_id);
+  cl_assert_equal_i(app_size, sizeof(no_litter));
+  prv_assert_cache_stats(hits, misses, 0, 2);
+
+  for (int i = 0; i < 3; i++) {
+    cl_assert_equal_i(resource_size(SYSTEM_APP, RESOURCE_ID_GOTHIC_18_BOLD), system_size);
+    cl_assert_equal_i(resource_size(resource_bank, no_litter_res_id), app_size);
+  }
+  prv_assert_cache_stats(hits, misses, 6, 2);
+
+  // Resources stored in their own files can change at any time and are never cached
+  cl_assert_equal_i(resource_size(SYSTEM_APP, RESOURCE_ID_PUG), sizeof(pug));
+  cl_assert_equal_i(resource_size(SYSTEM_APP, RESOURCE_ID_PUG), sizeof(pug));
+  prv_assert_cache_stats(hits, misses, 6, 4);
+}
+
+//! Replacing or removing an app bank drops its cached resources
+void test_resource__cache_invalidated_with_bank(void) {
+  resource_init();
+  prv_load_app_bank();
+  cl_assert_equal_i(resource_size(resource_bank, no_litter_res_id), sizeof(no_litter));
+
+  resource_storage_clear(resource_bank);
+  cl_assert_equal_i(resource_size(resource_bank, no_litter_res_id), 0);
+
+  prv_load_app_bank();
+  cl_assert(resource_init_app(resource_bank, NULL));
+  uint32_t hits, misses;
+  resource_cache_get_stats(&hits, &misses);
+  cl_assert_equal_i(resource_size(resource_bank, no_litter_res_id), sizeof(no_litter));
+  prv_assert_cache_stats(hits, misses, 0, 1);
+
+  // Other banks keep theirs
+  resource_size(SYSTEM_APP, RESOURCE_ID_GOTHIC_18_BOLD);
+  resource_cache_invalidate(resource_bank);
+  resource_cache_get_stats(&hits, &misses);
+  resource_size(SYSTEM_APP, RESOURCE_ID_GOTHIC_18_BOLD);
+  resource_size(resource_bank, no_litter_res_id);
+  prv_assert_cache_stats(hits, misses, 1, 1);
+}
+
+#define INTERLEAVED_ROUNDS 2000
+
+//! @return the number of flash reads it took
+static uint32_t prv_interleaved_reads(bool invalidate_each_round) {
+  static const uint32_t system_ids[] = {
+    RESOURCE_ID_GOTHIC_18_BOLD, RESOURCE_ID_BT_PAIR_SUCCESS, RESOURCE_ID_ACTION_BAR_ICON_X,
+  };
+  uint8_t buf[16];
+  const uint32_t flash_reads = fake_flash_read_count();
+  for (int i = 0; i < INTERLEAVED_ROUNDS; i++) {
+    if (invalidate_each_round) {
+      resource_cache_invalidate(SYSTEM_APP);
+      resource_cache_invalidate(resource_bank);
+    }
+    for (unsigned int j = 0; j < ARRAY_LENGTH(system_ids); j++) {
+      cl_assert(resource_load_byte_range_system(SYSTEM_APP, system_ids[j], 0, buf, 1) == 1);
+      cl_assert(resource_load_byte_range_system(resource_bank, no_litter_res_id, 0, buf, 1) == 1);
+    }
+  }
+  return fake_flash_read_count() - flash_reads;
+}
+
+//! Alternating between a few resources of both banks, as a watchface drawing text in several
+//! fonts over a bitmap does, only looks each of them up once
+void test_resource__cache_interleaved_reads(void) {
+  resource_init();
+  prv_load_app_bank();
+
+  uint32_t hits, misses;
+  resource_cache_get_stats(&hits, &misses);
+  const uint32_t cached_reads = prv_interleaved_reads(false);
+  prv_assert_cache_stats(hits, misses, INTERLEAVED_ROUNDS * 6 - 4, 4);
+
+  const uint32_t uncached_reads = prv_interleaved_reads(true);
+  cl_assert(cached_reads * 2 < uncached_reads);
+}
+
+//! @return the number of flash reads it took
+static uint32_t prv_launch_app_bank(const ResourceVersion *expected_version, bool expected_rv) {
+  const uint32_t flash_reads = fake_flash_read_count();
+  cl_assert_equal_b(resource_init_app(resource_bank, expected_version), expected_rv);
+  return fake_flash_read_count() - flash_reads;
+}
+
+//! Whether a launch that took this many flash reads went through a full validation, compared to
+//! one that did. Looking up and writing the marker file takes most of the reads of a full
+//! validation, and a launch that skips the marker lookup takes about half as many.
+static bool prv_was_full_check(uint32_t reads, uint32_t full_check_reads) {
+  if (reads * 4 > full_check_reads) {
+    return true;
+  }
+  cl_assert(reads * 16 < full_check_reads);
+  return false;
+}
+
+//! Finds where the given bytes of the app bank ended up in the filesystem region
+static uint32_t prv_find_in_filesystem(const void *data, size_t length) {
+  uint8_t buf[length];
+  for (uint32_t addr = FLASH_REGION_FILESYSTEM_BEGIN;
+       addr + length <= FLASH_REGION_FILESYSTEM_END; addr++) {
+    flash_read_bytes(buf, addr, length);
+    if (memcmp(buf, data, length) == 0) {
+      return addr;
+    }
+  }
+  cl_fail("bytes not found in the filesystem");
+  return 0;
+}
+
+//! Flips bits of the flash behind the filesystem's back, as bit rot would
+static void prv_clear_flash_byte(uint32_t addr) {
+  const uint8_t zero = 0;
+  flash_write_bytes(&zero, addr, sizeof(zero));
+}
+
+//! A bank is validated in full once, later launches only check the resources they load
+void test_resource__validated_bank_skips_full_check(void) {
+  resource_init();
+  prv_load_app_bank();
+
+  const uint32_t first_launch_reads = prv_launch_app_bank(NULL, true);
+  const uint32_t second_launch_reads = prv_launch_app_bank(NULL, true);
+  cl_assert(second_launch_reads * 4 < first_launch_reads);
+
+  const ResourceVersion version = resource_get_version(resource_bank, 0);
+  prv_launch_app_bank(&version, true);
+  const ResourceVersion other_version = { .crc = ~version.crc };
+  prv_launch_app_bank(&other_version, false);
+
+  cl_assert_equal_i(resource_size(resource_bank, no_litter_res_id), sizeof(no_litter));
+}
+
+//! Corruption after the bank was validated is caught when the resource is loaded
+void test_resource__validated_bank_corrupted_after_validation(void) {
+  resource_init();
+  prv_load_app_bank();
+  prv_launch_app_bank(NULL, true);
+
+  // Find a byte of the resource that clearing actually changes
+  uint32_t addr = prv_find_in_filesystem(no_litter, 8);
+  for (int i = 0; no_litter[i] == 0; i++) {
+    addr++;
+  }
+  prv_clear_flash_byte(addr);
+
+  // The bank still looks like the validated one, but the resource doesn't match its CRC
+  prv_launch_app_bank(NULL, true);
+  cl_assert_equal_i(resource_size(resource_bank, no_litter_res_id), 0);
+
+  // Which sends the next launch through a full validation
+  prv_launch_app_bank(NULL, false);
+}
+
+//! A different version than the validated one is validated in full
+void test_resource__validated_bank_version_bump(void) {
+  resource_init();
+  prv_load_app_bank();
+  const uint32_t full_check_reads = prv_launch_app_bank(NULL, true);
+  const ResourceVersion version = resource_get_version(resource_bank, 0);
+
+  // Change the version in place without PFS noticing
+  ResourceManifest manifest;
+  char filename[32];
+  resource_storage_get_file_name(filename, sizeof(filename), resource_bank);
+  int fd = pfs_open(filename, OP_FLAG_READ, FILE_TYPE_STATIC, 0);
+  cl_assert(fd >= 0);
+  cl_assert_equal_i(pfs_read(fd, &manifest, sizeof(manifest)), sizeof(manifest));
+  pfs_close(fd);
+  cl_assert(manifest.version.timestamp != 0);
+  const uint32_t addr = prv_find_in_filesystem(&manifest, sizeof(manifest));
+  prv_clear_flash_byte(addr + offsetof(ResourceManifest, version.timestamp));
+  prv_clear_flash_byte(addr + offsetof(ResourceManifest, version.timestamp) + 1);
+  prv_clear_flash_byte(addr + offsetof(ResourceManifest, version.timestamp) + 2);
+  prv_clear_flash_byte(addr + offsetof(ResourceManifest, version.timestamp) + 3);
+
+  // The timestamp isn't covered by the CRC, so the bank is still valid once fully checked
+  cl_assert(prv_was_full_check(prv_launch_app_bank(&version, true), full_check_reads));
+  cl_assert(!prv_was_full_check(prv_launch_app_bank(&version, true), full_check_reads));
+
+  // Installing a bank with another version over it
+  cl_assert_equal_i(pfs_remove(filename), S_SUCCESS);
+  load_resource_fixture_on_pfs(RESOURCES_FIXTURE_PATH, PUG_FIXTURE_NAME, filename);
+  prv_launch_app_bank(&version, false);
+  prv_launch_app_bank(NULL, true);
+  const ResourceVersion new_version = resource_get_version(resource_bank, 0);
+  cl_assert(!resource_version_matches(&version, &new_version));
+}
+
+//! Reinstalling the bank, with or without removing it first, validates it in full again
+void test_resource__validated_bank_reinstall(void) {
+  resource_init();
+  prv_load_app_bank();
+  const uint32_t full_check_reads = prv_launch_app_bank(NULL, true);
+
+  resource_storage_clear(resource_bank);
+  cl_assert_equal_i(resource_size(resource_bank, no_litter_res_id), 0);
+  prv_load_app_bank();
+  cl_assert(prv_was_full_check(prv_launch_app_bank(NULL, true), full_check_reads));
+  cl_assert(!prv_was_full_check(prv_launch_app_bank(NULL, true), full_check_reads));
+
+  prv_load_app_bank();
+  cl_assert(prv_was_full_check(prv_launch_app_bank(NULL, true), full_check_reads));
+  cl_assert_equal_i(resource_size(resource_bank, no_litter_res_id), sizeof(no_litter));
+}
+
+//! The marker left by a full validation outlives a reboot, and clearing the bank removes it
+void test_resource__validated_bank_marker_persists(void) {
+  resource_init();
+  prv_load_app_bank();
+  const uint32_t full_check_reads = prv_launch_app_bank(NULL, true);
+
+  // Rebooting only forgets which resources this launch checked
+  resource_init();
+  cl_assert(!prv_was_full_check(prv_launch_app_bank(NULL, true), full_check_reads));
+  cl_assert_equal_i(resource_size(resource_bank, no_litter_res_id), sizeof(no_litter));
+
+  // put_bytes clears the bank before installing it again after a reboot
+  resource_init();
+  resource_storage_clear(resource_bank);
+  char filename[32];
+  app_file_name_make(filename, sizeof(filename), resource_bank, "resv", strlen("resv"));
+  cl_assert_equal_i(pfs_open(filename, OP_FLAG_READ, FILE_TYPE_STATIC, 0), E_DOES_NOT_EXIST);
+  prv_load_app_bank();
+  cl_assert(prv_was_full_check(prv_launch_app_bank(NULL, true), full_check_reads));
+}
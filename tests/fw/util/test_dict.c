@@ -378,3 +378,125 @@ void test_dict__merge(void) {
     cl_assert(has_tuple[DATA_IDX] == true);
   }
 }
+
+// Reference merge, equivalent to the original implementation that used dict_find() for every
+// lookup. dict_merge() must produce byte-identical output and the same callback sequence.
+///////////////////////////////////////////////////////////
+
+#define MAX_RECORDED_UPDATES (96)
+
+typedef struct {
+  uint32_t key;
+  size_t new_offset;
+  uint8_t old_tuple[sizeof(Tuple) + 8];
+} RecordedUpdate;
+
+typedef struct {
+  const uint8_t *dest_buffer;
+  RecordedUpdate updates[MAX_RECORDED_UPDATES];
+  int num_updates;
+} UpdateRecorder;
+
+static void prv_record_update_callback(const uint32_t key, const Tuple *new_tuple,
+                                       const Tuple *old_tuple, void *context) {
+  UpdateRecorder *recorder = context;
+  cl_assert(recorder->num_updates < MAX_RECORDED_UPDATES);
+  RecordedUpdate *update = &recorder->updates[recorder->num_updates++];
+  memset(update, 0, sizeof(*update));
+  update->key = key;
+  update->new_offset = (const uint8_t *)new_tuple - recorder->dest_buffer;
+  memcpy(update->old_tuple, old_tuple, sizeof(Tuple) + MIN(old_tuple->length, 8));
+}
+
+static void prv_reference_merge(uint8_t *dest_buffer, uint32_t *dest_size_in_out,
+                                uint32_t dest_used_size, DictionaryIterator *new_iter,
+                                bool update_existing_keys_only, UpdateRecorder *recorder) {
+  uint8_t orig_buffer[dest_used_size];
+  memcpy(orig_buffer, dest_buffer, dest_used_size);
+  DictionaryIterator orig_iter;
+  dict_read_begin_from_buffer(&orig_iter, orig_buffer, dest_used_size);
+
+  DictionaryIterator dest_iter;
+  dict_write_begin(&dest_iter, dest_buffer, *dest_size_in_out);
+  for (Tuple *new = dict_read_first(new_iter); new; new = dict_read_next(new_iter)) {
+    const Tuple *orig = dict_find(&orig_iter, new->key);
+    if (orig == NULL && update_existing_keys_only) {
+      continue;
+    }
+    Tuple *dest = dest_iter.cursor;
+    cl_assert_equal_i(dict_write_data(&dest_iter, new->key, new->value->data, new->length),
+                      DICT_OK);
+    dest->type = new->type;
+    prv_record_update_callback(new->key, dest, orig ?: NULL_TUPLE, recorder);
+  }
+  for (Tuple *orig = dict_read_first(&orig_iter); orig; orig = dict_read_next(&orig_iter)) {
+    if (dict_find(new_iter, orig->key) != NULL) {
+      continue;
+    }
+    Tuple *dest = dest_iter.cursor;
+    cl_assert_equal_i(dict_write_data(&dest_iter, orig->key, orig->value->data, orig->length),
+                      DICT_OK);
+    dest->type = orig->type;
+    prv_record_update_callback(orig->key, dest, orig, recorder);
+  }
+  *dest_size_in_out = dict_write_end(&dest_iter);
+}
+
+// Writes num_tuples random tuples, drawing keys from a small range so that keys overlap between
+// dictionaries and occasionally repeat within one.
+static uint32_t prv_write_random_dict(uint8_t *buffer, uint32_t size, int num_tuples) {
+  DictionaryIterator iter;
+  dict_write_begin(&iter, buffer, size);
+  for (int i = 0; i < num_tuples; i++) {
+    const uint32_t key = rand() % 48;
+    if (rand() % 2) {
+      cl_assert_equal_i(dict_write_uint32(&iter, key, rand()), DICT_OK);
+    } else {
+      uint8_t data[8];
+      const uint16_t length = rand() % sizeof(data);
+      for (int j = 0; j < length; j++) {
+        data[j] = rand();
+      }
+      cl_assert_equal_i(dict_write_data(&iter, key, data, length), DICT_OK);
+    }
+  }
+  return dict_write_end(&iter);
+}
+
+void test_dict__merge_matches_reference(void) {
+  srand(0);
+  for (int round = 0; round < 500; round++) {
+    const bool update_existing_keys_only = (round % 2);
+    const int num_orig = rand() % 40;
+    const int num_new = rand() % 40;
+    const uint32_t capacity = dict_calc_buffer_size(0) + 2 * 40 * (sizeof(Tuple) + 8);
+
+    uint8_t new_buffer[capacity];
+    const uint32_t new_size = prv_write_random_dict(new_buffer, capacity, num_new);
+    DictionaryIterator new_iter;
+    dict_read_begin_from_buffer(&new_iter, new_buffer, new_size);
+
+    uint8_t expected_buffer[capacity];
+    const uint32_t orig_size = prv_write_random_dict(expected_buffer, capacity, num_orig);
+    uint8_t actual_buffer[capacity];
+    memcpy(actual_buffer, expected_buffer, capacity);
+
+    UpdateRecorder expected = { .dest_buffer = expected_buffer };
+    uint32_t expected_size = capacity;
+    prv_reference_merge(expected_buffer, &expected_size, orig_size, &new_iter,
+                        update_existing_keys_only, &expected);
+
+    UpdateRecorder actual = { .dest_buffer = actual_buffer };
+    uint32_t actual_size = capacity;
+    DictionaryIterator dest_iter;
+    dict_read_begin_from_buffer(&dest_iter, actual_buffer, orig_size);
+    cl_assert_equal_i(dict_merge(&dest_iter, &actual_size, &new_iter, update_existing_keys_only,
+                                 prv_record_update_callback, &actual), DICT_OK);
+
+    cl_assert_equal_i(actual_size, expected_size);
+    cl_assert_equal_m(actual_buffer, expected_buffer, expected_size);
+    cl_assert_equal_i(actual.num_updates, expected.num_updates);
+    cl_assert_equal_m(actual.updates, expected.updates,
+                      expected.num_updates * sizeof(RecordedUpdate));
+  }
+}
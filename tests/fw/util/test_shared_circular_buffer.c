@@ -358,3 +358,127 @@ void test_shared_circular_buffer__subsampling_set_ratio_is_idempotent(void) {
       &buffer, &client, item_size, out_buffer, 1), 1);
   cl_assert_equal_m(out_buffer, "6g", 2);
 }
+
+
+void test_shared_circular_buffer__subsampled_batch_copies_prefix(void) {
+  SharedCircularBuffer buffer;
+  uint16_t item_size = 3;
+  // not a multiple of the item size, so items straddle the end of the storage
+  uint8_t storage[11];
+  uint8_t out_buffer[12];
+  char first[3];
+
+  shared_circular_buffer_init(&buffer, storage, sizeof(storage));
+  SubsampledSharedCircularBufferClient client = {};
+  shared_circular_buffer_add_subsampled_client(&buffer, &client, 1, 2);
+
+  cl_assert(shared_circular_buffer_write(&buffer, (uint8_t*)"0ab1cd2ef", 3*item_size, false));
+  cl_assert_equal_i(shared_circular_buffer_read_subsampled_batch(
+      &buffer, &client, item_size, 2, out_buffer, 100, first), 2);
+  cl_assert_equal_m(out_buffer, "0a2e", 4);
+  cl_assert_equal_m(first, "0ab", 3);
+
+  // "4ij" wraps the end of the storage
+  cl_assert(shared_circular_buffer_write(&buffer, (uint8_t*)"3gh4ij5kl", 3*item_size, false));
+  cl_assert_equal_i(shared_circular_buffer_read_subsampled_batch(
+      &buffer, &client, item_size, 2, out_buffer, 1, first), 1);
+  cl_assert_equal_m(out_buffer, "4i", 2);
+  cl_assert_equal_m(first, "4ij", 3);
+  cl_assert_equal_i(shared_circular_buffer_get_read_space_remaining(
+      &buffer, &client.buffer_client), 1*item_size);
+
+  // Nothing kept, first item untouched
+  memcpy(first, "xyz", 3);
+  cl_assert_equal_i(shared_circular_buffer_read_subsampled_batch(
+      &buffer, &client, item_size, 2, out_buffer, 100, first), 0);
+  cl_assert_equal_m(first, "xyz", 3);
+  cl_assert_equal_i(shared_circular_buffer_get_read_space_remaining(
+      &buffer, &client.buffer_client), 0);
+}
+
+
+typedef struct {
+  int16_t x;
+  int16_t y;
+  int16_t z;
+  uint16_t timestamp;
+} Sample;
+
+#define NUM_STREAM_SAMPLES 5000
+
+// The stream one item at a time, through shared_circular_buffer_read_subsampled()
+static int prv_read_one_at_a_time(SharedCircularBuffer *buffer,
+                                  SubsampledSharedCircularBufferClient *client,
+                                  uint16_t batch, uint8_t *out, Sample *first) {
+  int num_read = 0;
+  Sample sample;
+  while (num_read < batch &&
+         shared_circular_buffer_read_subsampled(buffer, client, sizeof(sample), &sample, 1)) {
+    if (num_read == 0) {
+      *first = sample;
+    }
+    memcpy(out + num_read * 6, &sample, 6);
+    num_read++;
+  }
+  return num_read;
+}
+
+// Writes a stream of samples and drains it in batches of varying size, either one item at a
+// time or with batched reads. Returns the number of samples read.
+static int prv_drain_stream(uint32_t numerator, uint32_t denominator, bool batched,
+                            uint8_t *out, Sample *firsts) {
+  static uint8_t storage[61 * sizeof(Sample)];
+  SharedCircularBuffer buffer;
+  shared_circular_buffer_init(&buffer, storage, sizeof(storage));
+  SubsampledSharedCircularBufferClient client = {};
+  shared_circular_buffer_add_subsampled_client(&buffer, &client, numerator, denominator);
+
+  int num_read = 0;
+  int num_batches = 0;
+  for (int i = 0; i < NUM_STREAM_SAMPLES; i++) {
+    const Sample sample = { .x = i, .y = -i, .z = 7 * i, .timestamp = 10 * i };
+    cl_assert(shared_circular_buffer_write(&buffer, (uint8_t *)&sample, sizeof(sample), false));
+    if ((i % 23) != 22) {
+      continue;
+    }
+
+    const uint16_t batch = 1 + (i % 25);
+    int batch_read;
+    do {
+      Sample *first = &firsts[num_batches++];
+      if (batched) {
+        batch_read = shared_circular_buffer_read_subsampled_batch(
+            &buffer, &client, sizeof(Sample), 6, &out[num_read * 6], batch, first);
+      } else {
+        batch_read = prv_read_one_at_a_time(&buffer, &client, batch, &out[num_read * 6], first);
+      }
+      num_read += batch_read;
+    } while (batch_read == batch);
+  }
+  return num_read;
+}
+
+static void prv_compare_stream(uint32_t numerator, uint32_t denominator) {
+  static uint8_t expected[NUM_STREAM_SAMPLES * 6];
+  static uint8_t actual[NUM_STREAM_SAMPLES * 6];
+  static Sample expected_firsts[NUM_STREAM_SAMPLES];
+  static Sample actual_firsts[NUM_STREAM_SAMPLES];
+  memset(expected_firsts, 0, sizeof(expected_firsts));
+  memset(actual_firsts, 0, sizeof(actual_firsts));
+
+  const int num_expected = prv_drain_stream(numerator, denominator, false /* batched */,
+                                            expected, expected_firsts);
+  const int num_actual = prv_drain_stream(numerator, denominator, true /* batched */,
+                                          actual, actual_firsts);
+
+  cl_assert_equal_i(num_actual, num_expected);
+  cl_assert_equal_m(actual, expected, num_expected * 6);
+  cl_assert_equal_m(actual_firsts, expected_firsts, sizeof(expected_firsts));
+}
+
+void test_shared_circular_buffer__subsampled_batch_matches_single_reads(void) {
+  const uint32_t ratios[][2] = { {1, 1}, {1, 2}, {1, 4}, {1, 10}, {2, 5}, {3, 4}, {4, 8} };
+  for (size_t i = 0; i < sizeof(ratios) / sizeof(ratios[0]); i++) {
+    prv_compare_stream(ratios[i][0], ratios[i][1]);
+  }
+}
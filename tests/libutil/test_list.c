@@ -267,3 +267,61 @@ void test_list__each(void) {
 
   cl_assert_equal_i(num_nodes, 3);
 }
+
+typedef struct {
+  ListNode list_node;
+  int value;
+  int seq;
+} SeqNode;
+
+static int prv_seq_node_comparator(SeqNode *a, SeqNode *b) {
+  return b->value - a->value;
+}
+
+void test_list__sort_matches_sorted_add(void) {
+  enum { NUM_NODES = 100 };
+  srand(0);
+  for (int round = 0; round < 20; ++round) {
+    for (int ascending = 0; ascending < 2; ++ascending) {
+      SeqNode sorted_add_nodes[NUM_NODES];
+      SeqNode sort_nodes[NUM_NODES];
+      const int num_nodes = rand() % NUM_NODES;
+      ListNode *sorted_add_head = NULL;
+      ListNode *sort_tail = NULL;
+      for (int i = 0; i < num_nodes; ++i) {
+        // Lots of duplicate values to check that the sort is stable
+        sorted_add_nodes[i] = (SeqNode) { .value = rand() % 10, .seq = i };
+        sort_nodes[i] = sorted_add_nodes[i];
+        sorted_add_head = list_sorted_add(sorted_add_head, &sorted_add_nodes[i].list_node,
+                                          (Comparator)prv_seq_node_comparator, ascending);
+        sort_tail = list_append(sort_tail, &sort_nodes[i].list_node);
+      }
+      ListNode *sort_head = list_sort(list_get_head(sort_tail),
+                                      (Comparator)prv_seq_node_comparator, ascending);
+      cl_assert_equal_i(list_count(sort_head), num_nodes);
+      cl_assert(list_get_prev(sort_head) == NULL);
+
+      SeqNode *expected = (SeqNode *)sorted_add_head;
+      SeqNode *actual = (SeqNode *)sort_head;
+      while (expected) {
+        cl_assert_equal_i(actual->seq, expected->seq);
+        SeqNode *next = (SeqNode *)list_get_next(&actual->list_node);
+        if (next) {
+          cl_assert(list_get_prev(&next->list_node) == &actual->list_node);
+        }
+        expected = (SeqNode *)list_get_next(&expected->list_node);
+        actual = next;
+      }
+      cl_assert(actual == NULL);
+    }
+  }
+}
+
+void test_list__sort_empty_and_single(void) {
+  cl_assert(list_sort(NULL, (Comparator)prv_seq_node_comparator, true) == NULL);
+  SeqNode node = { .value = 1 };
+  cl_assert(list_sort(&node.list_node, (Comparator)prv_seq_node_comparator, true) ==
+            &node.list_node);
+  cl_assert(list_get_next(&node.list_node) == NULL);
+  cl_assert(list_get_prev(&node.list_node) == NULL);
+}
@@ -39,7 +39,7 @@ static int prv_int32_cmp_desc(const void *a, const void *b) {
 void test_sort__uint8_array(void) {
   uint8_t array[] = {9, 1, 8, 2, 7, 3, 6, 4, 6, 5, 5};
 
-  sort_bubble(array, ARRAY_LENGTH(array), sizeof(uint8_t), prv_uint8_cmp);
+  sort_intro(array, ARRAY_LENGTH(array), sizeof(uint8_t), prv_uint8_cmp);
 
   uint8_t sorted[] = {1, 2, 3, 4, 5, 5, 6, 6, 7, 8, 9};
   cl_assert_equal_m(array, sorted, sizeof(array));
@@ -48,7 +48,7 @@ void test_sort__uint8_array(void) {
 void test_sort__int32_array(void) {
   int32_t array[] = {-9, 1, 8, 2, 7, 3, -6, 4, 6, 5, 5};
 
-  sort_bubble(array, ARRAY_LENGTH(array), sizeof(int32_t), prv_int32_cmp);
+  sort_intro(array, ARRAY_LENGTH(array), sizeof(int32_t), prv_int32_cmp);
 
   int32_t sorted[] = {-9, -6, 1, 2, 3, 4, 5, 5, 6, 7, 8};
   cl_assert_equal_m(array, sorted, sizeof(array));
@@ -57,7 +57,7 @@ void test_sort__int32_array(void) {
 void test_sort__int32_array_desc(void) {
   int32_t array[] = {-9, 1, 8, 2, 7, 3, -6, 4, 6, 5, 5};
 
-  sort_bubble(array, ARRAY_LENGTH(array), sizeof(int32_t), prv_int32_cmp_desc);
+  sort_intro(array, ARRAY_LENGTH(array), sizeof(int32_t), prv_int32_cmp_desc);
 
   int32_t sorted[] = {8, 7, 6, 5, 5, 4, 3, 2, 1, -6, -9};
   cl_assert_equal_m(array, sorted, sizeof(array));
@@ -66,7 +66,7 @@ void test_sort__int32_array_desc(void) {
 void test_sort__single_element_array(void) {
   int32_t array[] = {1};
 
-  sort_bubble(array, ARRAY_LENGTH(array), sizeof(int32_t), prv_int32_cmp);
+  sort_intro(array, ARRAY_LENGTH(array), sizeof(int32_t), prv_int32_cmp);
 
   int32_t sorted[] = {1};
   cl_assert_equal_m(array, sorted, sizeof(array));
@@ -92,7 +92,7 @@ void test_sort__sort_structs(void) {
     {.number = -123 },
   };
 
-  sort_bubble(array, ARRAY_LENGTH(array), sizeof(MyStruct), prv_MyStruct_cmp);
+  sort_intro(array, ARRAY_LENGTH(array), sizeof(MyStruct), prv_MyStruct_cmp);
 
   MyStruct sorted[] = {
     {.number = -123 },
@@ -102,3 +102,168 @@ void test_sort__sort_structs(void) {
   };
   cl_assert_equal_m(array, sorted, sizeof(array));
 }
+
+typedef struct Record {
+  int16_t key;
+  uint16_t seq;
+} Record;
+
+static int prv_Record_cmp(const void *a, const void *b) {
+  return prv_cmp(((const Record *)a)->key, ((const Record *)b)->key);
+}
+
+#define LARGE_NUM (1000)
+
+static uint32_t s_seed;
+
+static int16_t prv_rand16(void) {
+  s_seed = s_seed * 1103515245 + 12345;
+  return (int16_t)(s_seed >> 16);
+}
+
+typedef enum {
+  PatternRandom,
+  PatternSorted,
+  PatternReversed,
+  PatternAllEqual,
+  PatternFewDistinct,
+  PatternOrganPipe,
+  PatternSawtooth,
+  PatternMedianOfThreeKiller,
+  PatternCount,
+} Pattern;
+
+static void prv_fill(int16_t *array, size_t num, Pattern pattern) {
+  for (size_t i = 0; i < num; i++) {
+    switch (pattern) {
+      case PatternRandom:
+        array[i] = prv_rand16();
+        break;
+      case PatternSorted:
+        array[i] = (int16_t)(i - num / 2);
+        break;
+      case PatternReversed:
+        array[i] = (int16_t)(num / 2 - i);
+        break;
+      case PatternAllEqual:
+        array[i] = 7;
+        break;
+      case PatternFewDistinct:
+        array[i] = prv_rand16() % 4;
+        break;
+      case PatternOrganPipe:
+        array[i] = (int16_t)((i < num / 2) ? i : num - i);
+        break;
+      case PatternSawtooth:
+        array[i] = (int16_t)(i % 17);
+        break;
+      case PatternMedianOfThreeKiller:
+        // Classic input that drives naive median-of-three quicksort quadratic
+        array[i] = (int16_t)((i % 2) ? (num / 2 + i / 2) : (i / 2 + 1));
+        break;
+      case PatternCount:
+        break;
+    }
+  }
+}
+
+static void prv_assert_sorted(const int16_t *array, size_t num) {
+  for (size_t i = 1; i < num; i++) {
+    cl_assert(array[i - 1] <= array[i]);
+  }
+}
+
+// Element-wise check that sorted is a permutation of the input, via a histogram of the keys
+static void prv_assert_permutation(const int16_t *input, const int16_t *sorted, size_t num) {
+  static int32_t s_histogram[UINT16_MAX + 1];
+  memset(s_histogram, 0, sizeof(s_histogram));
+  for (size_t i = 0; i < num; i++) {
+    s_histogram[(uint16_t)input[i]]++;
+    s_histogram[(uint16_t)sorted[i]]--;
+  }
+  for (size_t i = 0; i < ARRAY_LENGTH(s_histogram); i++) {
+    cl_assert_equal_i(s_histogram[i], 0);
+  }
+}
+
+static int s_num_compares;
+
+static int prv_int16_cmp_counting(const void *a, const void *b) {
+  s_num_compares++;
+  return prv_cmp(*(const int16_t *)a, *(const int16_t *)b);
+}
+
+void test_sort__initialize(void) {
+  s_seed = 1;
+  s_num_compares = 0;
+}
+
+void test_sort__adversarial_inputs(void) {
+  static int16_t s_input[LARGE_NUM];
+  static int16_t s_array[LARGE_NUM];
+  const size_t sizes[] = { 0, 1, 2, 3, 12, 13, 100, LARGE_NUM };
+  for (Pattern pattern = 0; pattern < PatternCount; pattern++) {
+    for (size_t s = 0; s < ARRAY_LENGTH(sizes); s++) {
+      const size_t num = sizes[s];
+      prv_fill(s_input, num, pattern);
+
+      memcpy(s_array, s_input, num * sizeof(int16_t));
+      s_num_compares = 0;
+      sort_intro(s_array, num, sizeof(int16_t), prv_int16_cmp_counting);
+      prv_assert_sorted(s_array, num);
+      prv_assert_permutation(s_input, s_array, num);
+      // Introsort bounds the work at O(n log n) whatever the input: 1000 * log2(1000) * 4
+      cl_assert(s_num_compares <= 40000);
+
+      memcpy(s_array, s_input, num * sizeof(int16_t));
+      s_num_compares = 0;
+      sort_stable(s_array, num, sizeof(int16_t), prv_int16_cmp_counting);
+      prv_assert_sorted(s_array, num);
+      prv_assert_permutation(s_input, s_array, num);
+      cl_assert(s_num_compares <= 40000);
+    }
+  }
+}
+
+static void prv_assert_stable(const Record *records, size_t num) {
+  for (size_t i = 1; i < num; i++) {
+    cl_assert(records[i - 1].key <= records[i].key);
+    if (records[i - 1].key == records[i].key) {
+      cl_assert(records[i - 1].seq < records[i].seq);
+    }
+  }
+}
+
+void test_sort__stable(void) {
+  static Record s_records[LARGE_NUM];
+  const size_t sizes[] = { 2, 5, 12, 13, 25, 100, LARGE_NUM };
+  for (size_t s = 0; s < ARRAY_LENGTH(sizes); s++) {
+    const size_t num = sizes[s];
+    for (size_t i = 0; i < num; i++) {
+      s_records[i] = (Record) { .key = prv_rand16() % 8, .seq = i };
+    }
+    sort_stable(s_records, num, sizeof(Record), prv_Record_cmp);
+    prv_assert_stable(s_records, num);
+
+    for (size_t i = 0; i < num; i++) {
+      s_records[i] = (Record) { .key = (num - i) / 3, .seq = i };
+    }
+    sort_stable_by_int16_key(s_records, num, sizeof(Record), offsetof(Record, key));
+    prv_assert_stable(s_records, num);
+  }
+}
+
+void test_sort__int16_key_is_signed(void) {
+  Record records[] = {
+    { .key = 3, .seq = 0 },
+    { .key = INT16_MIN, .seq = 1 },
+    { .key = -1, .seq = 2 },
+    { .key = INT16_MAX, .seq = 3 },
+    { .key = 0, .seq = 4 },
+  };
+  sort_stable_by_int16_key(records, ARRAY_LENGTH(records), sizeof(Record), offsetof(Record, key));
+  const uint16_t expected_seq[] = { 1, 2, 4, 0, 3 };
+  for (size_t i = 0; i < ARRAY_LENGTH(records); i++) {
+    cl_assert_equal_i(records[i].seq, expected_seq[i]);
+  }
+}
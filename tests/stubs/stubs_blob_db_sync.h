@@ -19,7 +19,11 @@ BlobDBSyncSession *blob_db_sync_get_session_for_token(BlobDBToken token) {
   return NULL;
 }
 
-void blob_db_sync_next(BlobDBSyncSession *session) {
+BlobDBDirtyItem *blob_db_sync_get_item_for_token(BlobDBSyncSession *session, BlobDBToken token) {
+  return NULL;
+}
+
+void blob_db_sync_next(BlobDBSyncSession *session, BlobDBToken token) {
   return;
 }
 
@@ -30,6 +30,7 @@
 #include "kernel/coredump_extra_regions.h"
 #include "kernel/core_dump.h"
 #include "kernel/core_dump_private.h"
+#include "kernel/core_dump_reader.h"
 #include "kernel/pbl_malloc.h"
 #include "system/reboot_reason.h"
 
@@ -113,32 +114,6 @@ typedef struct {
   uint32_t registers[17];  // r0-r12, sp, lr, pc, xpsr
 } ThreadInfo;
 
-// -----------------------------------------------------------------------
-// State for the RAM dump region in flash - used to read per-thread stack data
-
-typedef struct {
-  uint32_t flash_offset;  // Offset within the coredump image in flash
-  uint32_t ram_start;     // Start address of the RAM region (0x20000000)
-  uint32_t ram_size;      // Size of the RAM dump (256KB)
-} RamDumpInfo;
-
-// Read a chunk of the RAM dump from flash, translating a RAM address to a flash
-// offset within the coredump's memory chunk.
-static bool prv_read_ram_from_coredump(const RamDumpInfo *ram_dump,
-                                       uint32_t image_base,
-                                       uint32_t ram_addr, void *buf,
-                                       size_t len) {
-  if (ram_addr < ram_dump->ram_start ||
-      (ram_addr + len) > (ram_dump->ram_start + ram_dump->ram_size)) {
-    return false;
-  }
-
-  uint32_t offset_in_ram = ram_addr - ram_dump->ram_start;
-  uint32_t flash_addr = image_base + ram_dump->flash_offset + offset_in_ram;
-  flash_read_bytes((uint8_t *)buf, flash_addr, len);
-  return true;
-}
-
 // -----------------------------------------------------------------------
 // Map PebbleOS RebootReasonCode to Memfault reboot reason
 
@@ -205,7 +180,9 @@ void memfault_pebble_coredump_reconstruct(void) {
   static CoreDumpExtraRegInfo extra_regs;
   memset(&extra_regs, 0, sizeof(extra_regs));
   bool have_extra_regs = false;
-  static RamDumpInfo ram_dump;
+  // Reads per-thread stack data out of the RAM dump region in flash, whether
+  // it was stored as is or run-length encoded
+  static CoreDumpMemoryReader ram_dump;
   memset(&ram_dump, 0, sizeof(ram_dump));
   bool have_ram_dump = false;
 
@@ -245,20 +222,21 @@ void memfault_pebble_coredump_reconstruct(void) {
         break;
       }
 
-      case CORE_DUMP_CHUNK_KEY_MEMORY: {
+      case CORE_DUMP_CHUNK_KEY_MEMORY:
+      case CORE_DUMP_CHUNK_KEY_MEMORY_RLE: {
         // Read the memory header to find the RAM dump region
         CoreDumpMemoryHeader mem_hdr;
         flash_read_bytes((uint8_t *)&mem_hdr, image_base + data_offset,
                          sizeof(mem_hdr));
 
-        uint32_t mem_size = chunk_hdr.size - sizeof(CoreDumpMemoryHeader);
-
-        // Check if this is the main SRAM region
-        if (mem_hdr.start == SRAM_BASE_ADDR && mem_size >= (256 * 1024)) {
-          ram_dump.flash_offset = data_offset + sizeof(CoreDumpMemoryHeader);
-          ram_dump.ram_start = mem_hdr.start;
-          ram_dump.ram_size = mem_size;
-          have_ram_dump = true;
+        // Check if this is the main SRAM region. The main SRAM region is mostly
+        // zeroes and painted stacks, so it is usually run-length encoded.
+        if (!have_ram_dump && mem_hdr.start == SRAM_BASE_ADDR) {
+          have_ram_dump = core_dump_reader_init(&ram_dump, image_base + chunk_offset) &&
+                          ram_dump.length >= (256 * 1024);
+          if (!have_ram_dump) {
+            memset(&ram_dump, 0, sizeof(ram_dump));
+          }
         }
         break;
       }
@@ -381,7 +359,7 @@ void memfault_pebble_coredump_reconstruct(void) {
   // Derive valid address range from the RAM dump we found in the coredump.
   // This adapts to different platforms (SF32LB52 vs nRF52840) automatically.
   const uint32_t ram_end = have_ram_dump
-      ? (ram_dump.ram_start + ram_dump.ram_size)
+      ? (ram_dump.start + ram_dump.length)
       : (SRAM_BASE_ADDR + 256 * 1024);
 
   // Helper: add a CachedMemory region from the RAM dump
@@ -396,8 +374,7 @@ void memfault_pebble_coredump_reconstruct(void) {
         _cached->valid_cache = 1; \
         _cached->cached_address = _addr; \
         _cached->blk_size = _size; \
-        if (prv_read_ram_from_coredump(&ram_dump, image_base, _addr, \
-                                       (uint8_t *)_cached->blk, _size)) { \
+        if (core_dump_reader_read(&ram_dump, _addr, (uint8_t *)_cached->blk, _size)) { \
           regions[num_regions++] = (sMfltCoredumpRegion){ \
             .type = kMfltCoredumpRegionType_CachedMemory, \
             .region_start = _cached, \
@@ -475,8 +452,8 @@ void memfault_pebble_coredump_reconstruct(void) {
 
       // Read pxTopOfStack from the TCB (first field, offset 0)
       uint32_t top_of_stack = 0;
-      if (!prv_read_ram_from_coredump(&ram_dump, image_base, tcb_addr,
-                                       &top_of_stack, sizeof(top_of_stack))) {
+      if (!core_dump_reader_read(&ram_dump, tcb_addr, &top_of_stack,
+                                 sizeof(top_of_stack))) {
         continue;
       }
 
@@ -500,7 +477,7 @@ void memfault_pebble_coredump_reconstruct(void) {
   // coredump. The log buffer and logger state are static variables at fixed
   // linker-determined addresses. Even though current RAM is re-initialized
   // after reboot, ADD_CACHED_REGION reads the crash-time contents from the
-  // SPI flash RAM dump (via prv_read_ram_from_coredump), not from current RAM.
+  // SPI flash RAM dump (via core_dump_reader_read), not from current RAM.
   sMemfaultLogRegions log_regions = { 0 };
   if (memfault_log_get_regions(&log_regions)) {
     for (size_t i = 0; i < MEMFAULT_LOG_NUM_RAM_REGIONS; i++) {
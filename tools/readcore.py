@@ -15,6 +15,7 @@ __author__ = "Joshua Wise <joshua@accelerated.tech>"
 
 import binascii
 import json
+import struct
 from enum import Enum
 
 # We use a truly ancient `construct` because it's what libpebble etc need.
@@ -32,9 +33,34 @@ class _CoreDumpChunkKey(Enum):
     THREAD = 2
     EXTRA_REG = 3
     MEMORY = 4
+    MEMORY_RLE = 5
     TERMINATOR = 0xFFFFFFFF
 
 
+# CORE_DUMP_VERSION in core_dump_private.h. Version 2 added MEMORY_RLE chunks.
+_CORE_DUMP_VERSION = 2
+
+# Records of a MEMORY_RLE chunk, see CORE_DUMP_CHUNK_KEY_MEMORY_RLE in core_dump_private.h
+_RLE_RUN = 0x80000000
+_RLE_COUNT_MASK = 0x7FFFFFFF
+
+
+def _expand_rle(data):
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        (record_hdr,) = struct.unpack_from("<I", data, pos)
+        pos += 4
+        count = record_hdr & _RLE_COUNT_MASK
+        if record_hdr & _RLE_RUN:
+            out += data[pos : pos + 4] * count
+            pos += 4
+        else:
+            out += data[pos : pos + 4 * count]
+            pos += 4 * count
+    return bytes(out)
+
+
 _CoreDumpImageHeader = cs.Struct(
     "CoreDumpImageHeader",
     cs.Const(cs.Bytes("signature", 4), b"\xfe\xca\x0d\xf0"),  # 0xF00DCAFE in LE
@@ -100,6 +126,10 @@ _CoreDumpChunk = cs.Struct(
                 lambda ctx: ctx.key == _CoreDumpChunkKey.MEMORY.value,
                 cs.Rename("memory", _CoreDumpMemoryChunk),
             ),
+            cs.If(
+                lambda ctx: ctx.key == _CoreDumpChunkKey.MEMORY_RLE.value,
+                cs.Rename("memory_rle", _CoreDumpMemoryChunk),
+            ),
         )
     ),
 )
@@ -199,10 +229,25 @@ class Coredump:
 
         self.raw = _CoreDump.parse_stream(file)
 
+        self.version = self.raw.header.version >> 8
+        if self.version > _CORE_DUMP_VERSION:
+            raise ValueError(
+                f"core dump version {self.version} is newer than this tool "
+                f"(up to version {_CORE_DUMP_VERSION})"
+            )
         self.timestamp = self.raw.header.timestamp
         self.serial_number = self.raw.header.serial_number
         self.build_id = self.raw.header.build_id
-        self.memory = [x.memory for x in self.raw.chunks if x.memory]
+        self.memory = []
+        for x in self.raw.chunks:
+            if x.memory:
+                self.memory.append(x.memory)
+            elif x.memory_rle:
+                self.memory.append(
+                    cs.Container(
+                        start=x.memory_rle.start, data=_expand_rle(x.memory_rle.data)
+                    )
+                )
         self.threads = [x.thread for x in self.raw.chunks if x.thread]
 
     def __str__(self):
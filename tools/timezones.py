@@ -393,6 +393,16 @@ def zonelink_parse(tzfile):
     return zonelink_list
 
 
+def name_hash(name):
+    """
+    DJB2 hash of a region or link name, must match hash() in lib/util/hash.c
+    """
+    value = 5381
+    for c in name.encode("utf8"):
+        value = (value * 33 + c) & 0xFFFFFFFF
+    return value
+
+
 def zoneinfo_to_bin(zoneinfo_list, dstrule_list, zonelink_list, output_bin):
     # Corresponds to TIMEZONE_LINK_NAME_LENGTH in clock.c
     # only reason we need 33 characters is for that
@@ -403,14 +413,27 @@ def zoneinfo_to_bin(zoneinfo_list, dstrule_list, zonelink_list, output_bin):
     # 1 byte + 15 bytes + 2 bytes + 5 bytes + 1 byte = 24 bytes
     # Continent_index City gmt_offset_minutes tz_abbr dst_id
 
+    region_id_list = [
+        "/".join(line.split(" ")[:2]) for line in zoneinfo_list
+    ]
+
+    # Drop links to regions we don't ship before writing the header, the reader finds the
+    # name index by skipping link_count links
+    link_list = []
+    for line in zonelink_list:
+        target, linkname = line.split(" ")
+        try:
+            link_list.append((region_id_list.index(target), linkname))
+        except ValueError as e:
+            print("Couldn't find region, skipping:", e)
+
     # Unsigned short - count of entries
     output_bin.write(struct.pack("<H", len(zoneinfo_list)))
     # Unsigned short - count of DST rules
     output_bin.write(struct.pack("<H", len(dstzone_dict.values())))
     # Unsigned short - count of links
-    output_bin.write(struct.pack("<H", len(zonelink_list)))
+    output_bin.write(struct.pack("<H", len(link_list)))
 
-    region_id_list = []
     # write all the timezones to file
     for line in zoneinfo_list:
         continent, region, gmt_offset_minutes, tz_abbr, dst_zone = line.split(" ")
@@ -418,7 +441,6 @@ def zoneinfo_to_bin(zoneinfo_list, dstrule_list, zonelink_list, output_bin):
         # output the timezone continent index
         continent_index = tz_continent_dict[continent]
         output_bin.write(struct.pack("B", continent_index))
-        region_id_list.append(continent + "/" + region)
 
         # fixup and output the timezone region name
         output_bin.write(
@@ -492,16 +514,20 @@ def zoneinfo_to_bin(zoneinfo_list, dstrule_list, zonelink_list, output_bin):
         output_bin.write(bytearray(DST_RULE_PAIR_BYTES - bytes_written))
 
     # write all the timezone links to file
-    for line in zonelink_list:
-        target, linkname = line.split(" ")
-        try:
-            region_id = region_id_list.index(target)
-        except ValueError as e:
-            print("Couldn't find region, skipping:", e)
-            continue
+    for region_id, linkname in link_list:
         output_bin.write(struct.pack("<H", region_id))
         output_bin.write(linkname.ljust(TIMEZONE_LINK_NAME_LENGTH, "\0").encode("utf8"))
 
+    # Name index, lets the firmware binary search a name instead of reading every region and
+    # link. Name ids below the region count are regions, the rest are links in link order.
+    # Sorting by (hash, name id) keeps regions ahead of links that share a hash.
+    names = region_id_list + [linkname for _, linkname in link_list]
+    name_index = sorted((name_hash(name), name_id) for name_id, name in enumerate(names))
+    # Unsigned short - count of index entries
+    output_bin.write(struct.pack("<H", len(name_index)))
+    for hash_value, name_id in name_index:
+        output_bin.write(struct.pack("<IH", hash_value, name_id))
+
 
 def build_and_create_tzdata(olson_database, output_text, output_bin):
     zoneinfo_list = build_zoneinfo_list(olson_database)